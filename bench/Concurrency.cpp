@@ -0,0 +1,386 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+// dbpp_bench_concurrency: throughput and latency of mixed readers and writers, running
+// in several threads against a WAL database on disk.
+//
+// Each thread picks reads (a point query) and writes (a single row update, in its own
+// transaction) at random, in the proportion given by the mix. The threads connect to
+// the database in one of these modes:
+//
+//   separate   Every thread has its own connection, opened with the default flags
+//   shared     All threads share one connection, opened with OpenFlag::FullMutex
+//   nomutex    Every thread has its own connection, opened with OpenFlag::NoMutex
+//
+// Automatic checkpoints are turned off. Instead the writers run a passive checkpoint
+// every --checkpoint-every writes, so the time they stall for it can be reported.
+// Operations and checkpoints that fail with SQLITE_BUSY or SQLITE_LOCKED, once the busy
+// timeout has run out, are counted in the busy rate.
+//
+// --memstatus, --lookaside and --pagecache apply a Sqlite3::GlobalConfig before the
+// database is opened, to compare the memory subsystem settings under concurrency.
+
+#include "Harness.h"
+
+#include <dbpp/dbpp.h>
+#include <dbpp/sqlite3/Sqlite3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int RowCount = 10000;
+
+enum class Mode { Separate, Shared, NoMutex };
+
+const char* modeName(Mode mode) {
+    switch (mode) {
+        case Mode::Separate: return "separate";
+        case Mode::Shared: return "shared";
+        case Mode::NoMutex: return "nomutex";
+        default: return "unknown";
+    }
+}
+
+struct Options {
+    std::filesystem::path file = std::filesystem::temp_directory_path() / "dbpp_bench_concurrency.db";
+    unsigned int maxThreads = std::max(std::min(std::thread::hardware_concurrency(), 8U), 1U);
+    std::vector<int> readPercentages{100, 90, 50};
+    std::vector<Mode> modes{Mode::Separate, Mode::Shared, Mode::NoMutex};
+    std::chrono::milliseconds duration{1000};
+    std::chrono::milliseconds busyTimeout{100};
+    int checkpointEvery = 1000;
+    bool csv = false;
+    Dbpp::Sqlite3::GlobalConfig config;
+};
+
+struct Result {
+    Mode mode = Mode::Separate;
+    unsigned int threads = 0;
+    int readPercentage = 0;
+    double opsPerSecond = 0.0;
+    double p50Us = 0.0;
+    double p99Us = 0.0;
+    double busyPercentage = 0.0;
+    long long checkpoints = 0;
+    double checkpointMaxMs = 0.0;
+    double checkpointTotalMs = 0.0;
+};
+
+// What a thread measured
+struct ThreadStats {
+    std::vector<double> latenciesNs;
+    long long ops = 0;
+    long long busy = 0;
+    long long checkpoints = 0;
+    double checkpointMaxNs = 0.0;
+    double checkpointTotalNs = 0.0;
+};
+
+Dbpp::Connection connect(const Options& options, Dbpp::Sqlite3::OpenFlag flags) {
+    auto db = Dbpp::Sqlite3::open(options.file, Dbpp::Sqlite3::OpenMode::ReadWrite, flags);
+    Dbpp::Sqlite3::setBusyTimeout(db, options.busyTimeout);
+    db.exec("PRAGMA wal_autocheckpoint = 0");
+    return db;
+}
+
+void createDatabase(const Options& options) {
+    for (const auto* suffix : {"", "-wal", "-shm"})
+        std::filesystem::remove(options.file.string() + suffix);
+
+    auto db = Dbpp::Sqlite3::open(options.file);
+    db.exec("PRAGMA journal_mode = WAL");
+    db.exec("CREATE TABLE kv (id INTEGER PRIMARY KEY, value INTEGER NOT NULL)");
+    Dbpp::Transaction tx(db);
+    auto insert = db.preparedStatement("INSERT INTO kv (id, value) VALUES (?, ?)");
+    for (int i = 0; i < RowCount; ++i) {
+        insert.rebind(i, i);
+        (void) insert.step();
+    }
+    tx.commit();
+}
+
+bool isBusy(const Dbpp::ErrorWithCode& e) {
+    const auto primary = e.code & 0xff;
+    return primary == SQLITE_BUSY || primary == SQLITE_LOCKED;
+}
+
+void runThread(Dbpp::Connection& db, const Options& options, int readPercentage, unsigned int seed,
+               Clock::time_point deadline, ThreadStats& stats) {
+    const char* const readSql = "SELECT value FROM kv WHERE id = ?";
+    const char* const writeSql = "UPDATE kv SET value = value + 1 WHERE id = ?";
+    auto read = db.preparedStatement(readSql);
+    auto write = db.preparedStatement(writeSql);
+
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> ids(0, RowCount - 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+    long long writes = 0;
+
+    while (Clock::now() < deadline) {
+        const bool isRead = percent(rng) < readPercentage;
+        const int id = ids(rng);
+        const auto start = Clock::now();
+        try {
+            if (isRead) {
+                read.rebind(id);
+                Bench::doNotOptimize(read.step().get<long long>(0));
+                read.reset(); // Don't keep the read transaction open while waiting for the next operation
+            } else {
+                write.rebind(id);
+                (void) write.step();
+                write.reset();
+                ++writes;
+            }
+        } catch (const Dbpp::ErrorWithCode& e) {
+            if (!isBusy(e))
+                throw;
+            ++stats.busy;
+            // A statement that failed reports the error again when reset, so start over with a new one
+            if (isRead)
+                read = db.preparedStatement(readSql);
+            else
+                write = db.preparedStatement(writeSql);
+        }
+        const auto end = Clock::now();
+        stats.latenciesNs.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        ++stats.ops;
+
+        if (!isRead && options.checkpointEvery > 0 && writes > 0 && writes % options.checkpointEvery == 0) {
+            const auto checkpointStart = Clock::now();
+            try {
+                (void) db.exec("PRAGMA wal_checkpoint(PASSIVE)");
+            } catch (const Dbpp::ErrorWithCode& e) {
+                // On a shared connection, a checkpoint fails while another thread is in a statement
+                if (!isBusy(e))
+                    throw;
+                ++stats.busy;
+            }
+            const double ns = std::chrono::duration<double, std::nano>(Clock::now() - checkpointStart).count();
+            ++stats.checkpoints;
+            stats.checkpointTotalNs += ns;
+            stats.checkpointMaxNs = std::max(stats.checkpointMaxNs, ns);
+        }
+    }
+}
+
+Result runConfiguration(const Options& options, Mode mode, unsigned int threads, int readPercentage) {
+    const auto flags = mode == Mode::NoMutex ? Dbpp::Sqlite3::OpenFlag::NoMutex
+                     : mode == Mode::Shared ? Dbpp::Sqlite3::OpenFlag::FullMutex
+                                            : Dbpp::Sqlite3::OpenFlag::None;
+    std::vector<Dbpp::Connection> connections;
+    for (unsigned int i = 0; i < (mode == Mode::Shared ? 1 : threads); ++i)
+        connections.push_back(connect(options, flags));
+
+    std::vector<ThreadStats> stats(threads);
+    std::vector<std::thread> workers;
+    std::exception_ptr failure;
+    std::atomic<bool> failed{false};
+    const auto start = Clock::now();
+    const auto deadline = start + options.duration;
+    for (unsigned int i = 0; i < threads; ++i) {
+        auto& db = connections[mode == Mode::Shared ? 0 : i];
+        workers.emplace_back([&, i, readPercentage]() {
+            try {
+                runThread(db, options, readPercentage, 1234 + i, deadline, stats[i]);
+            } catch (...) {
+                if (!failed.exchange(true))
+                    failure = std::current_exception();
+            }
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    if (failure)
+        std::rethrow_exception(failure);
+
+    ThreadStats total;
+    for (auto& s : stats) {
+        total.latenciesNs.insert(total.latenciesNs.end(), s.latenciesNs.begin(), s.latenciesNs.end());
+        total.ops += s.ops;
+        total.busy += s.busy;
+        total.checkpoints += s.checkpoints;
+        total.checkpointTotalNs += s.checkpointTotalNs;
+        total.checkpointMaxNs = std::max(total.checkpointMaxNs, s.checkpointMaxNs);
+    }
+
+    Result result;
+    result.mode = mode;
+    result.threads = threads;
+    result.readPercentage = readPercentage;
+    result.opsPerSecond = static_cast<double>(total.ops) / elapsed;
+    if (!total.latenciesNs.empty()) {
+        auto percentile = [&total](double p) {
+            auto idx = static_cast<std::size_t>(p * static_cast<double>(total.latenciesNs.size() - 1));
+            std::nth_element(total.latenciesNs.begin(), total.latenciesNs.begin() + static_cast<std::ptrdiff_t>(idx), total.latenciesNs.end());
+            return total.latenciesNs[idx] / 1000.0;
+        };
+        result.p50Us = percentile(0.50);
+        result.p99Us = percentile(0.99);
+        result.busyPercentage = 100.0 * static_cast<double>(total.busy) / static_cast<double>(total.ops);
+    }
+    result.checkpoints = total.checkpoints;
+    result.checkpointMaxMs = total.checkpointMaxNs / 1e6;
+    result.checkpointTotalMs = total.checkpointTotalNs / 1e6;
+    return result;
+}
+
+void report(const Result& r, const Options& options) {
+    if (options.csv) {
+        std::cout << modeName(r.mode) << ',' << r.threads << ',' << r.readPercentage << ',' << std::fixed
+                  << std::setprecision(1) << r.opsPerSecond << ',' << r.p50Us << ',' << r.p99Us << ','
+                  << std::setprecision(3) << r.busyPercentage << ',' << r.checkpoints << ','
+                  << r.checkpointMaxMs << ',' << r.checkpointTotalMs << '\n';
+        return;
+    }
+    std::cout << std::left << std::setw(10) << modeName(r.mode) << std::right << std::setw(8) << r.threads
+              << std::setw(7) << r.readPercentage << '%' << std::fixed << std::setprecision(0)
+              << std::setw(12) << r.opsPerSecond << std::setprecision(1) << std::setw(10) << r.p50Us
+              << std::setw(10) << r.p99Us << std::setprecision(2) << std::setw(8) << r.busyPercentage << '%'
+              << std::setw(8) << r.checkpoints << std::setprecision(2) << std::setw(12) << r.checkpointMaxMs
+              << std::setw(12) << r.checkpointTotalMs << '\n';
+}
+
+void printHeader(const Options& options) {
+    if (options.csv) {
+        std::cout << "mode,threads,read_pct,ops_per_s,p50_us,p99_us,busy_pct,checkpoints,checkpoint_max_ms,checkpoint_total_ms\n";
+        return;
+    }
+    std::cout << std::left << std::setw(10) << "mode" << std::right << std::setw(8) << "threads"
+              << std::setw(8) << "reads" << std::setw(12) << "ops/s" << std::setw(10) << "p50 us"
+              << std::setw(10) << "p99 us" << std::setw(9) << "busy" << std::setw(8) << "ckpts"
+              << std::setw(12) << "ckpt max ms" << std::setw(12) << "ckpt tot ms" << '\n';
+}
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::size_t pos = 0;
+    while (pos <= list.size()) {
+        auto comma = list.find(',', pos);
+        if (comma == std::string::npos)
+            comma = list.size();
+        items.push_back(list.substr(pos, comma - pos));
+        pos = comma + 1;
+    }
+    return items;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    const std::vector<std::string> args(argv + 1, argv + argc); // NOLINT
+    try {
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            const auto& arg = args[i];
+            const bool hasValue = i + 1 < args.size();
+            if (arg == "--file" && hasValue) {
+                options.file = args[++i];
+            } else if (arg == "--threads" && hasValue) {
+                options.maxThreads = static_cast<unsigned int>(std::max(std::stoi(args[++i]), 1));
+            } else if (arg == "--mix" && hasValue) {
+                options.readPercentages.clear();
+                for (const auto& item : split(args[++i]))
+                    options.readPercentages.push_back(std::clamp(std::stoi(item), 0, 100));
+            } else if (arg == "--modes" && hasValue) {
+                options.modes.clear();
+                for (const auto& item : split(args[++i])) {
+                    if (item == "separate")
+                        options.modes.push_back(Mode::Separate);
+                    else if (item == "shared")
+                        options.modes.push_back(Mode::Shared);
+                    else if (item == "nomutex")
+                        options.modes.push_back(Mode::NoMutex);
+                    else
+                        return false;
+                }
+            } else if (arg == "--duration" && hasValue) {
+                options.duration = std::chrono::milliseconds(std::max(std::stoi(args[++i]), 1));
+            } else if (arg == "--busy-timeout" && hasValue) {
+                options.busyTimeout = std::chrono::milliseconds(std::max(std::stoi(args[++i]), 0));
+            } else if (arg == "--checkpoint-every" && hasValue) {
+                options.checkpointEvery = std::max(std::stoi(args[++i]), 0);
+            } else if (arg == "--memstatus" && hasValue) {
+                const auto& value = args[++i];
+                if (value != "on" && value != "off")
+                    return false;
+                options.config.memoryStatus = value == "on";
+            } else if (arg == "--lookaside" && hasValue) {
+                const auto items = split(args[++i]);
+                if (items.size() != 2)
+                    return false;
+                options.config.lookaside = Dbpp::Sqlite3::LookasideConfig{std::stoi(items[0]), std::stoi(items[1])};
+            } else if (arg == "--pagecache" && hasValue) {
+                options.config.pageCache = Dbpp::Sqlite3::PageCacheConfig{4096, std::max(std::stoi(args[++i]), 0)};
+            } else if (arg == "--csv") {
+                options.csv = true;
+            } else {
+                return false;
+            }
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] // NOLINT
+                  << " [--file PATH] [--threads N] [--mix READ%,...] [--modes separate,shared,nomutex]"
+                     " [--duration MS] [--busy-timeout MS] [--checkpoint-every WRITES]"
+                     " [--memstatus on|off] [--lookaside SLOT_SIZE,SLOTS] [--pagecache PAGES] [--csv]\n";
+        return 2;
+    }
+
+    try {
+        // 1, 2, 4, ... threads, always finishing with the maximum
+        std::vector<unsigned int> threadCounts;
+        for (unsigned int threads = 1; threads < options.maxThreads; threads *= 2)
+            threadCounts.push_back(threads);
+        threadCounts.push_back(options.maxThreads);
+
+        Dbpp::Sqlite3::applyGlobalConfig(options.config);
+        createDatabase(options);
+        printHeader(options);
+        for (auto mode : options.modes) {
+            for (auto readPercentage : options.readPercentages) {
+                for (auto threads : threadCounts)
+                    report(runConfiguration(options, mode, threads, readPercentage), options);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << '\n';
+        return 1;
+    }
+    for (const auto* suffix : {"", "-wal", "-shm"})
+        std::filesystem::remove(options.file.string() + suffix);
+    return 0;
+}
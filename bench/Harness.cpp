@@ -0,0 +1,167 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Harness.h"
+
+#include <algorithm>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+
+namespace Bench {
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    double timeRun(const Body& body, std::size_t iterations) {
+        const auto start = Clock::now();
+        body(iterations);
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    double measure(const Body& body, const Options& options) {
+        const double minTime = std::chrono::duration<double, std::nano>(options.minTime).count();
+
+        // Find an iteration count that makes a run last at least minTime
+        std::size_t iterations = 1;
+        double elapsed = timeRun(body, iterations);
+        while (elapsed < minTime) {
+            const double perOp = std::max(elapsed / static_cast<double>(iterations), 1.0);
+            const auto wanted = static_cast<std::size_t>(minTime * 1.2 / perOp);
+            iterations = std::max(iterations * 2, std::min(wanted, iterations * 100));
+            elapsed = timeRun(body, iterations);
+        }
+
+        std::vector<double> perOp;
+        for (int i = 0; i < options.repeats; ++i)
+            perOp.push_back(timeRun(body, iterations) / static_cast<double>(iterations));
+        std::sort(perOp.begin(), perOp.end());
+        return perOp[perOp.size() / 2];
+    }
+
+    void usage(const char* program, std::ostream& err) {
+        err << "Usage: " << program << " [--filter TEXT] [--repeats N] [--min-time MS] [--csv] [--list]\n";
+    }
+
+} // namespace
+
+void Suite::add(std::string group, std::string variant, Body body) {
+    benchmarks_.push_back({std::move(group), std::move(variant), false, std::move(body)});
+}
+
+void Suite::addBaseline(std::string group, Body body) {
+    benchmarks_.push_back({std::move(group), BaselineName, true, std::move(body)});
+}
+
+std::vector<Measurement> Suite::run(const Options& options, std::ostream& out) const {
+    // Run the groups in the order they were added, with the baseline first
+    std::vector<std::string> groups;
+    for (const auto& benchmark : benchmarks_) {
+        if (std::find(groups.begin(), groups.end(), benchmark.group) == groups.end())
+            groups.push_back(benchmark.group);
+    }
+
+    if (options.csv)
+        out << "group,variant,ns_per_op,ratio\n";
+
+    std::vector<Measurement> results;
+    for (const auto& group : groups) {
+        std::vector<const Benchmark*> selected;
+        for (const auto& benchmark : benchmarks_) {
+            if (benchmark.group == group && (group + "/" + benchmark.variant).find(options.filter) != std::string::npos)
+                selected.push_back(&benchmark);
+        }
+        std::stable_partition(selected.begin(), selected.end(), [](const Benchmark* b) { return b->baseline; });
+        if (selected.empty())
+            continue;
+
+        if (!options.csv && !options.list)
+            out << '\n' << group << '\n';
+
+        double baseline = 0.0;
+        for (const auto* benchmark : selected) {
+            if (options.list) {
+                out << group << '/' << benchmark->variant << '\n';
+                continue;
+            }
+
+            Measurement m{group, benchmark->variant, measure(benchmark->body, options), 0.0};
+            if (benchmark->baseline)
+                baseline = m.nsPerOp;
+            if (baseline > 0.0)
+                m.ratio = m.nsPerOp / baseline;
+
+            if (options.csv) {
+                out << '"' << m.group << "\",\"" << m.variant << "\"," << std::fixed << std::setprecision(1)
+                    << m.nsPerOp << ',' << std::setprecision(3) << m.ratio << '\n';
+            } else {
+                out << "  " << std::left << std::setw(40) << m.variant << std::right << std::fixed
+                    << std::setprecision(1) << std::setw(14) << m.nsPerOp << " ns/op";
+                if (m.ratio > 0.0)
+                    out << std::setprecision(2) << std::setw(9) << m.ratio << "x";
+                out << '\n';
+            }
+            out.flush();
+            results.push_back(std::move(m));
+        }
+    }
+    return results;
+}
+
+bool parseOptions(int argc, char** argv, Options& options, std::ostream& err) {
+    const std::vector<std::string> args(argv + 1, argv + argc); // NOLINT
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        const auto& arg = args[i];
+        const bool hasValue = i + 1 < args.size();
+        try {
+            if (arg == "--filter" && hasValue) {
+                options.filter = args[++i];
+            } else if (arg == "--repeats" && hasValue) {
+                options.repeats = std::max(std::stoi(args[++i]), 1);
+            } else if (arg == "--min-time" && hasValue) {
+                options.minTime = std::chrono::milliseconds(std::max(std::stoi(args[++i]), 1));
+            } else if (arg == "--csv") {
+                options.csv = true;
+            } else if (arg == "--list") {
+                options.list = true;
+            } else {
+                usage(argv[0], err); // NOLINT
+                return false;
+            }
+        } catch (const std::exception&) {
+            usage(argv[0], err); // NOLINT
+            return false;
+        }
+    }
+    return true;
+}
+
+int runMain(int argc, char** argv, const Suite& suite) {
+    Options options;
+    if (!parseOptions(argc, argv, options, std::cerr))
+        return 2;
+    try {
+        suite.run(options, std::cout);
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace Bench
@@ -0,0 +1,93 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+// A minimal benchmark harness, shared by the benchmark executables.
+//
+// Benchmarks are grouped. Each group may have a baseline, normally written directly
+// against the sqlite3 C API, and the other variants in the group are reported as a
+// ratio of its time.
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Bench {
+
+// Keeps the compiler from optimizing away a value that is computed but not used
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    __asm__ __volatile__("" : : "r"(&value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+}
+
+// Runs an operation the given number of times
+using Body = std::function<void(std::size_t iterations)>;
+
+struct Options {
+    std::string filter; // Only run the benchmarks whose "group/variant" name contains this
+    int repeats = 5; // Number of timed runs. The median is reported
+    std::chrono::milliseconds minTime{200}; // Minimum duration of each timed run
+    bool csv = false; // Report as CSV instead of a table
+    bool list = false; // Only list the benchmarks
+};
+
+struct Measurement {
+    std::string group;
+    std::string variant;
+    double nsPerOp = 0.0;
+    double ratio = 0.0; // nsPerOp divided by the baseline's, or 0 if the group has no baseline
+};
+
+class Suite {
+    struct Benchmark {
+        std::string group;
+        std::string variant;
+        bool baseline;
+        Body body;
+    };
+
+    std::vector<Benchmark> benchmarks_;
+
+public:
+    static constexpr const char* BaselineName = "sqlite3 C API";
+
+    // Adds a benchmark to a group
+    void add(std::string group, std::string variant, Body body);
+
+    // Adds the baseline of a group
+    void addBaseline(std::string group, Body body);
+
+    // Runs the benchmarks selected by the options, reporting each result as it's done
+    std::vector<Measurement> run(const Options& options, std::ostream& out) const;
+};
+
+// Parses the command line. Returns false, after printing the usage, if it's invalid or help was asked for
+bool parseOptions(int argc, char** argv, Options& options, std::ostream& err);
+
+// Runs a suite as the main function of a benchmark executable
+int runMain(int argc, char** argv, const Suite& suite);
+
+} // namespace Bench
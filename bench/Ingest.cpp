@@ -0,0 +1,385 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+// dbpp_bench_ingest: loads synthetic persons (see test/Persons.h) into the person table,
+// using each of the ways dbpp supports inserting rows, and reports rows per second and
+// the memory allocated per row.
+//
+// The same rows are also loaded through the sqlite3 C API, right before each run of a
+// style, and the throughput of every style is reported relative to it as well. That ratio
+// depends far less on the machine than the rows per second do.
+//
+// With --baseline, the relative throughput of every style is compared to a checked-in
+// baseline, and the program fails if any of them is more than --tolerance percent slower.
+// This is what the ctest tests labelled "perf" run.
+
+#include "AllocationCounter.h"
+#include "Persons.h"
+
+#include <dbpp/sqlite3/Stats.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char* const InsertSql = "INSERT INTO person (name, age) VALUES (?, ?)";
+
+// The rows per transaction of the sqlite3 C API reference
+constexpr std::int64_t ReferenceBatchSize = 1000;
+
+struct Options {
+    std::int64_t rows = 1000000;
+    std::filesystem::path file; // In memory if empty
+    std::string filter;
+    int repeats = 1; // The fastest of the repeats is a run's result
+    int runs = 1; // The median of the runs is reported
+    bool csv = false;
+    std::filesystem::path baseline;
+    double tolerance = 25.0;
+    std::filesystem::path writeBaseline;
+};
+
+struct Measurement {
+    std::string style;
+    double rowsPerSecond = 0.0;
+    double relative = 0.0; // rowsPerSecond divided by that of the sqlite3 C API reference
+    double bytesPerRow = 0.0;
+    double allocationsPerRow = 0.0;
+    double sqlitePeakKiB = 0.0;
+};
+
+// Loads the rows [0, count) into the person table
+using Loader = std::function<void(Dbpp::Connection& db, std::int64_t count)>;
+
+struct Style {
+    std::string name;
+    Loader load;
+};
+
+void insertOneByOne(Dbpp::PreparedStatement& insert, std::int64_t first, std::int64_t last) {
+    for (auto i = first; i < last; ++i) {
+        const auto p = Persons::generate(i);
+        insert.rebind(p.name, p.age);
+        (void) insert.step();
+    }
+}
+
+void insertValues(Dbpp::Connection& db, std::int64_t first, std::int64_t last) {
+    Dbpp::StatementBuilder builder("INSERT INTO person (name, age) VALUES ");
+    for (auto i = first; i < last; ++i) {
+        const auto p = Persons::generate(i);
+        builder.append(i == first ? "(?, ?)" : ", (?, ?)", p.name, p.age);
+    }
+    (void) db.statement(builder).step();
+}
+
+std::vector<Style> styles() {
+    std::vector<Style> result;
+
+    result.push_back({"Connection::exec()", [](Dbpp::Connection& db, std::int64_t count) {
+        for (std::int64_t i = 0; i < count; ++i) {
+            const auto p = Persons::generate(i);
+            (void) db.exec(InsertSql, p.name, p.age);
+        }
+    }});
+
+    result.push_back({"PreparedStatement::rebind()", [](Dbpp::Connection& db, std::int64_t count) {
+        auto insert = db.preparedStatement(InsertSql);
+        insertOneByOne(insert, 0, count);
+    }});
+
+    for (std::int64_t batchSize : {10, 100, 1000, 10000}) {
+        result.push_back({"rebind(), " + std::to_string(batchSize) + " rows per transaction",
+            [batchSize](Dbpp::Connection& db, std::int64_t count) {
+                auto insert = db.preparedStatement(InsertSql);
+                for (std::int64_t first = 0; first < count; first += batchSize) {
+                    Dbpp::Transaction tx(db);
+                    insertOneByOne(insert, first, std::min(first + batchSize, count));
+                    tx.commit();
+                }
+            }});
+    }
+
+    for (std::int64_t rowsPerStatement : {10, 100, 1000}) {
+        result.push_back({"multi-row VALUES, " + std::to_string(rowsPerStatement) + " rows per statement",
+            [rowsPerStatement](Dbpp::Connection& db, std::int64_t count) {
+                for (std::int64_t first = 0; first < count; first += rowsPerStatement)
+                    insertValues(db, first, std::min(first + rowsPerStatement, count));
+            }});
+    }
+    return result;
+}
+
+Dbpp::Connection openDatabase(const Options& options) {
+    if (options.file.empty())
+        return Dbpp::Sqlite3::open(":memory:");
+
+    for (const auto* suffix : {"", "-wal", "-shm", "-journal"})
+        std::filesystem::remove(options.file.string() + suffix);
+    auto db = Dbpp::Sqlite3::open(options.file);
+    db.exec("PRAGMA journal_mode = WAL");
+    db.exec("PRAGMA synchronous = NORMAL");
+    return db;
+}
+
+void check(int res, sqlite3* db) {
+    if (res != SQLITE_OK && res != SQLITE_ROW && res != SQLITE_DONE)
+        throw std::runtime_error(std::string("sqlite3 error: ") + sqlite3_errmsg(db));
+}
+
+// Loads the rows with the sqlite3 C API, into the same kind of database as the styles, in
+// transactions of ReferenceBatchSize rows. Returns the rows per second
+double runReference(const Options& options) {
+    if (!options.file.empty()) {
+        for (const auto* suffix : {"", "-wal", "-shm", "-journal"})
+            std::filesystem::remove(options.file.string() + suffix);
+    }
+    sqlite3* db = nullptr;
+    const auto name = options.file.empty() ? std::string(":memory:") : options.file.string();
+    std::unique_ptr<sqlite3, int (*)(sqlite3*)> closer(nullptr, sqlite3_close_v2);
+    const int opened = sqlite3_open(name.c_str(), &db);
+    closer.reset(db);
+    check(opened, db);
+    if (!options.file.empty()) {
+        check(sqlite3_exec(db, "PRAGMA journal_mode = WAL", nullptr, nullptr, nullptr), db);
+        check(sqlite3_exec(db, "PRAGMA synchronous = NORMAL", nullptr, nullptr, nullptr), db);
+    }
+    // The same table as Persons::createTable()
+    check(sqlite3_exec(db,
+                       "CREATE TABLE person ("
+                       " id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                       " name TEXT NOT NULL,"
+                       " age INTEGER NOT NULL,"
+                       " spouse_id INTEGER REFERENCES person(id)"
+                       ")",
+                       nullptr, nullptr, nullptr),
+          db);
+
+    sqlite3_stmt* insert = nullptr;
+    check(sqlite3_prepare_v2(db, InsertSql, -1, &insert, nullptr), db);
+    std::unique_ptr<sqlite3_stmt, int (*)(sqlite3_stmt*)> finalizer(insert, sqlite3_finalize);
+
+    const auto start = Clock::now();
+    for (std::int64_t first = 0; first < options.rows; first += ReferenceBatchSize) {
+        check(sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr), db);
+        const auto last = std::min(first + ReferenceBatchSize, options.rows);
+        for (auto i = first; i < last; ++i) {
+            const auto p = Persons::generate(i);
+            sqlite3_bind_text(insert, 1, p.name.data(), static_cast<int>(p.name.size()), SQLITE_STATIC); // NOLINT
+            sqlite3_bind_int(insert, 2, p.age);
+            check(sqlite3_step(insert), db);
+            sqlite3_reset(insert);
+        }
+        check(sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr), db);
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return static_cast<double>(options.rows) / seconds;
+}
+
+Measurement run(const Style& style, const Options& options) {
+    Persons persons(openDatabase(options));
+    persons.createTable();
+    (void) Dbpp::Sqlite3::memoryStats(true);
+
+    // Only counts the memory allocated through operator new, i.e. by dbpp and the benchmark
+    // itself. SQLite's own allocations are reported separately, from its memory statistics
+    const AllocationCounter allocations;
+    const auto start = Clock::now();
+    style.load(persons.db, options.rows);
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const auto bytes = allocations.bytes();
+    const auto count = allocations.count();
+
+    const auto inserted = persons.db.get<std::int64_t>("SELECT COUNT(*) FROM person");
+    if (inserted != options.rows)
+        throw std::runtime_error(style.name + " inserted " + std::to_string(inserted) + " rows");
+
+    const auto rows = static_cast<double>(options.rows);
+    return {style.name, rows / seconds, 0.0, static_cast<double>(bytes) / rows, static_cast<double>(count) / rows,
+            static_cast<double>(Dbpp::Sqlite3::memoryStats().memoryUsedHighwater) / 1024.0};
+}
+
+void report(const Measurement& m, const Options& options) {
+    if (options.csv) {
+        std::cout << '"' << m.style << "\"," << std::fixed << std::setprecision(0) << m.rowsPerSecond << ','
+                  << std::setprecision(3) << m.relative << ',' << std::setprecision(1) << m.bytesPerRow << ',' << std::setprecision(2) << m.allocationsPerRow
+                  << ',' << std::setprecision(0) << m.sqlitePeakKiB << '\n';
+    } else {
+        std::cout << std::left << std::setw(46) << m.style << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << m.rowsPerSecond << std::setprecision(2) << std::setw(12) << m.relative
+                  << std::setprecision(1) << std::setw(12) << m.bytesPerRow
+                  << std::setprecision(2) << std::setw(12) << m.allocationsPerRow << std::setprecision(0)
+                  << std::setw(14) << m.sqlitePeakKiB << '\n';
+    }
+    std::cout.flush();
+}
+
+// The baseline is a CSV file of style names and throughput relative to the sqlite3 C API
+std::map<std::string, double> readBaseline(const std::filesystem::path& file) {
+    std::ifstream in(file);
+    if (!in)
+        throw std::runtime_error("Failed to read the baseline " + file.string());
+    std::map<std::string, double> baseline;
+    std::string line;
+    while (std::getline(in, line)) {
+        const auto comma = line.rfind(',');
+        if (line.empty() || line[0] == '#' || comma == std::string::npos || line.compare(0, comma, "style") == 0)
+            continue;
+        auto style = line.substr(0, comma);
+        if (style.size() >= 2 && style.front() == '"' && style.back() == '"')
+            style = style.substr(1, style.size() - 2);
+        baseline[style] = std::stod(line.substr(comma + 1));
+    }
+    return baseline;
+}
+
+void writeBaseline(const std::filesystem::path& file, const std::vector<Measurement>& results, const Options& options) {
+    std::ofstream out(file);
+    if (!out)
+        throw std::runtime_error("Failed to write the baseline " + file.string());
+    out << "# Rows per second relative to the sqlite3 C API with " << ReferenceBatchSize
+        << " rows per transaction, of dbpp_bench_ingest --rows " << options.rows << " --repeats " << options.repeats
+        << " --runs " << options.runs << ", the median of the runs, from a release build\n";
+    out << "style,relative_to_c_api\n";
+    for (const auto& m : results)
+        out << '"' << m.style << "\"," << std::fixed << std::setprecision(3) << m.relative << '\n';
+}
+
+// Returns false if any style is slower than the baseline allows
+bool checkBaseline(const std::vector<Measurement>& results, const Options& options) {
+    const auto baseline = readBaseline(options.baseline);
+    bool ok = true;
+    for (const auto& m : results) {
+        auto it = baseline.find(m.style);
+        if (it == baseline.end()) {
+            std::cerr << "No baseline for \"" << m.style << "\"\n";
+            continue;
+        }
+        const double limit = it->second * (1.0 - options.tolerance / 100.0);
+        if (m.relative < limit) {
+            std::cerr << "Regression: \"" << m.style << "\" loads " << std::fixed << std::setprecision(3)
+                      << m.relative << " times as fast as the sqlite3 C API, the baseline is " << it->second
+                      << " (limit " << limit << ")\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    const std::vector<std::string> args(argv + 1, argv + argc); // NOLINT
+    try {
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            const auto& arg = args[i];
+            const bool hasValue = i + 1 < args.size();
+            if (arg == "--rows" && hasValue) {
+                options.rows = std::max(std::stoll(args[++i]), 1LL);
+            } else if (arg == "--file" && hasValue) {
+                options.file = args[++i];
+            } else if (arg == "--filter" && hasValue) {
+                options.filter = args[++i];
+            } else if (arg == "--repeats" && hasValue) {
+                options.repeats = std::max(std::stoi(args[++i]), 1);
+            } else if (arg == "--runs" && hasValue) {
+                options.runs = std::max(std::stoi(args[++i]), 1);
+            } else if (arg == "--csv") {
+                options.csv = true;
+            } else if (arg == "--baseline" && hasValue) {
+                options.baseline = args[++i];
+            } else if (arg == "--tolerance" && hasValue) {
+                options.tolerance = std::stod(args[++i]);
+            } else if (arg == "--write-baseline" && hasValue) {
+                options.writeBaseline = args[++i];
+            } else {
+                return false;
+            }
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] // NOLINT
+                  <<  " [--rows N] [--file PATH] [--filter TEXT] [--repeats N] [--runs N] [--csv]"
+                     " [--baseline FILE [--tolerance PERCENT]] [--write-baseline FILE]\n";
+        return 2;
+    }
+
+    std::vector<Measurement> results;
+    try {
+        if (options.csv) {
+            std::cout << "style,rows_per_s,relative_to_c_api,bytes_per_row,allocations_per_row,sqlite_peak_kib\n";
+        } else {
+            std::cout << "Loading " << options.rows << " rows into " << (options.file.empty() ? ":memory:" : options.file.string())
+                      << "\n\n" << std::left << std::setw(46) << "style" << std::right << std::setw(12) << "rows/s"
+                      << std::setw(12) << "vs C API" << std::setw(12) << "bytes/row" << std::setw(12) << "allocs/row" << std::setw(14)
+                      << "sqlite KiB" << '\n';
+        }
+        for (const auto& style : styles()) {
+            if (style.name.find(options.filter) == std::string::npos)
+                continue;
+            // Each repeat is paired with a reference run right before it, so that changes in the
+            // speed of the machine during the benchmark affect both. A run is the best of its
+            // repeats, and the median of the runs is reported, so one lucky run doesn't count
+            std::vector<Measurement> runs;
+            for (int r = 0; r < options.runs; ++r) {
+                Measurement best;
+                for (int i = 0; i < options.repeats; ++i) {
+                    const double reference = runReference(options);
+                    auto m = run(style, options);
+                    m.relative = m.rowsPerSecond / reference;
+                    if (i == 0 || m.relative > best.relative)
+                        best = std::move(m);
+                }
+                runs.push_back(std::move(best));
+            }
+            std::sort(runs.begin(), runs.end(), [](const auto& a, const auto& b) { return a.relative < b.relative; });
+            results.push_back(std::move(runs[runs.size() / 2]));
+            report(results.back(), options);
+        }
+        if (!options.file.empty()) {
+            for (const auto* suffix : {"", "-wal", "-shm", "-journal"})
+                std::filesystem::remove(options.file.string() + suffix);
+        }
+        if (!options.writeBaseline.empty())
+            writeBaseline(options.writeBaseline, results, options);
+        if (!options.baseline.empty() && !checkBaseline(results, options))
+            return 3;
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
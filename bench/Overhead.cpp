@@ -0,0 +1,331 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+// dbpp_bench: the overhead of the dbpp API compared to using the sqlite3 C API directly.
+//
+// Every group has a baseline written against the C API, doing the same work as the
+// dbpp variants, so the reported ratios are the abstraction overhead of dbpp.
+
+#include "Harness.h"
+
+#include <dbpp/dbpp.h>
+#include <dbpp/sqlite3/Sqlite3.h>
+
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int RowCount = 1000;
+const std::vector<std::size_t> BlobSizes{16, 1024, 64 * 1024};
+
+void check(int res, sqlite3* db) {
+    if (res != SQLITE_OK && res != SQLITE_ROW && res != SQLITE_DONE)
+        throw std::runtime_error(std::string("sqlite3 error: ") + sqlite3_errmsg(db));
+}
+
+struct StmtDeleter {
+    void operator()(sqlite3_stmt* stmt) { sqlite3_finalize(stmt); }
+};
+using StmtPtr = std::unique_ptr<sqlite3_stmt, StmtDeleter>;
+
+StmtPtr prepare(sqlite3* db, const char* sql) {
+    sqlite3_stmt* stmt = nullptr;
+    check(sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr), db);
+    return StmtPtr(stmt);
+}
+
+const std::vector<const char*> Schema{
+    "CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT NOT NULL, value REAL NOT NULL)",
+    "CREATE TABLE blob (size INTEGER PRIMARY KEY, data BLOB NOT NULL)",
+    "CREATE TABLE counter (id INTEGER PRIMARY KEY, n INTEGER NOT NULL)",
+    "INSERT INTO counter VALUES (1, 0)",
+};
+
+std::vector<std::byte> makeBlob(std::size_t size) {
+    std::vector<std::byte> blob(size);
+    for (std::size_t i = 0; i < size; ++i)
+        blob[i] = static_cast<std::byte>(i * 31 + 7);
+    return blob;
+}
+
+// The same data is loaded into two in-memory databases, one used through dbpp
+// and the other through the C API
+struct Fixture {
+    Dbpp::Connection db = Dbpp::Sqlite3::open(":memory:");
+    sqlite3* raw = nullptr;
+
+    Fixture() {
+        check(sqlite3_open(":memory:", &raw), raw);
+        for (const auto* sql : Schema) {
+            check(sqlite3_exec(raw, sql, nullptr, nullptr, nullptr), raw);
+            db.exec(sql);
+        }
+
+        Dbpp::Transaction tx(db);
+        check(sqlite3_exec(raw, "BEGIN", nullptr, nullptr, nullptr), raw);
+        auto insert = db.preparedStatement("INSERT INTO item (id, name, value) VALUES (?, ?, ?)");
+        auto rawInsert = prepare(raw, "INSERT INTO item (id, name, value) VALUES (?, ?, ?)");
+        for (int i = 0; i < RowCount; ++i) {
+            const std::string name = "item-" + std::to_string(i);
+            const double value = i * 0.5;
+            insert.rebind(i, name, value);
+            (void) insert.step();
+            sqlite3_bind_int(rawInsert.get(), 1, i);
+            sqlite3_bind_text(rawInsert.get(), 2, name.c_str(), static_cast<int>(name.size()), SQLITE_TRANSIENT); // NOLINT
+            sqlite3_bind_double(rawInsert.get(), 3, value);
+            check(sqlite3_step(rawInsert.get()), raw);
+            sqlite3_reset(rawInsert.get());
+        }
+        for (auto size : BlobSizes) {
+            const auto blob = makeBlob(size);
+            db.exec("INSERT INTO blob (size, data) VALUES (?, ?)", static_cast<long long>(size), blob);
+            auto stmt = prepare(raw, "INSERT INTO blob (size, data) VALUES (?, ?)");
+            sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(size));
+            sqlite3_bind_blob(stmt.get(), 2, blob.data(), static_cast<int>(blob.size()), SQLITE_TRANSIENT); // NOLINT
+            check(sqlite3_step(stmt.get()), raw);
+        }
+        check(sqlite3_exec(raw, "COMMIT", nullptr, nullptr, nullptr), raw);
+        tx.commit();
+    }
+
+    ~Fixture() {
+        sqlite3_close(raw);
+    }
+
+    Fixture(const Fixture&) = delete;
+    Fixture& operator=(const Fixture&) = delete;
+    Fixture(Fixture&&) = delete;
+    Fixture& operator=(Fixture&&) = delete;
+};
+
+const char* const PointQuery = "SELECT name, value FROM item WHERE id = ?";
+const char* const ScanQuery = "SELECT id, name, value FROM item";
+
+void addPointQueries(Bench::Suite& suite, const std::shared_ptr<Fixture>& f) {
+    const std::string oneShot = "point query, new statement each time";
+    suite.addBaseline(oneShot, [f](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            auto stmt = prepare(f->raw, PointQuery);
+            sqlite3_bind_int(stmt.get(), 1, static_cast<int>(i % RowCount));
+            check(sqlite3_step(stmt.get()), f->raw);
+            std::string name(reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 0))); // NOLINT
+            double value = sqlite3_column_double(stmt.get(), 1);
+            Bench::doNotOptimize(name);
+            Bench::doNotOptimize(value);
+        }
+    });
+    suite.add(oneShot, "Connection::exec()", [f](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            auto res = f->db.exec(PointQuery, static_cast<int>(i % RowCount));
+            auto name = res.get<std::string>(0);
+            auto value = res.get<double>(1);
+            Bench::doNotOptimize(name);
+            Bench::doNotOptimize(value);
+        }
+    });
+    suite.add(oneShot, "Connection::get<std::string, double>()", [f](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            auto row = f->db.get<std::string, double>(PointQuery, static_cast<int>(i % RowCount));
+            Bench::doNotOptimize(row);
+        }
+    });
+    suite.add(oneShot, "StatementBuilder", [f](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            Dbpp::StatementBuilder builder("SELECT name, value FROM item WHERE id = ?", static_cast<int>(i % RowCount));
+            auto res = f->db.statement(builder).step();
+            auto name = res.get<std::string>(0);
+            auto value = res.get<double>(1);
+            Bench::doNotOptimize(name);
+            Bench::doNotOptimize(value);
+        }
+    });
+
+    const std::string reused = "point query, reused statement";
+    suite.addBaseline(reused, [f](std::size_t n) {
+        auto stmt = prepare(f->raw, PointQuery);
+        for (std::size_t i = 0; i < n; ++i) {
+            sqlite3_reset(stmt.get());
+            sqlite3_bind_int(stmt.get(), 1, static_cast<int>(i % RowCount));
+            check(sqlite3_step(stmt.get()), f->raw);
+            std::string name(reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 0))); // NOLINT
+            double value = sqlite3_column_double(stmt.get(), 1);
+            Bench::doNotOptimize(name);
+            Bench::doNotOptimize(value);
+        }
+    });
+    suite.add(reused, "PreparedStatement::rebind()", [f](std::size_t n) {
+        auto stmt = f->db.preparedStatement(PointQuery);
+        for (std::size_t i = 0; i < n; ++i) {
+            stmt.rebind(static_cast<int>(i % RowCount));
+            auto res = stmt.step();
+            auto name = res.get<std::string>(0);
+            auto value = res.get<double>(1);
+            Bench::doNotOptimize(name);
+            Bench::doNotOptimize(value);
+        }
+    });
+}
+
+void addIteration(Bench::Suite& suite, const std::shared_ptr<Fixture>& f) {
+    const std::string group = "iterate " + std::to_string(RowCount) + " rows";
+    suite.addBaseline(group, [f](std::size_t n) {
+        auto stmt = prepare(f->raw, ScanQuery);
+        for (std::size_t i = 0; i < n; ++i) {
+            sqlite3_reset(stmt.get());
+            while (sqlite3_step(stmt.get()) == SQLITE_ROW) {
+                int id = sqlite3_column_int(stmt.get(), 0);
+                std::string name(reinterpret_cast<const char*>(sqlite3_column_text(stmt.get(), 1))); // NOLINT
+                double value = sqlite3_column_double(stmt.get(), 2);
+                Bench::doNotOptimize(id);
+                Bench::doNotOptimize(name);
+                Bench::doNotOptimize(value);
+            }
+        }
+    });
+    suite.add(group, "StatementIterator, get<T>(index)", [f](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            for (auto&& row : f->db.statement(ScanQuery)) {
+                auto id = row.get<int>(0);
+                auto name = row.get<std::string>(1);
+                auto value = row.get<double>(2);
+                Bench::doNotOptimize(id);
+                Bench::doNotOptimize(name);
+                Bench::doNotOptimize(value);
+            }
+        }
+    });
+    suite.add(group, "StatementIterator, get<T>(name)", [f](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            for (auto&& row : f->db.statement(ScanQuery)) {
+                auto id = row.get<int>("id");
+                auto name = row.get<std::string>("name");
+                auto value = row.get<double>("value");
+                Bench::doNotOptimize(id);
+                Bench::doNotOptimize(name);
+                Bench::doNotOptimize(value);
+            }
+        }
+    });
+    suite.add(group, "as<int, std::string, double>()", [f](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            for (auto&& [id, name, value] : f->db.statement(ScanQuery).as<int, std::string, double>()) {
+                Bench::doNotOptimize(id);
+                Bench::doNotOptimize(name);
+                Bench::doNotOptimize(value);
+            }
+        }
+    });
+}
+
+void addTransactions(Bench::Suite& suite, const std::shared_ptr<Fixture>& f) {
+    const std::string group = "transaction with one update";
+    suite.addBaseline(group, [f](std::size_t n) {
+        auto begin = prepare(f->raw, "BEGIN");
+        auto update = prepare(f->raw, "UPDATE counter SET n = n + 1 WHERE id = 1");
+        auto commit = prepare(f->raw, "COMMIT");
+        for (std::size_t i = 0; i < n; ++i) {
+            for (auto* stmt : {begin.get(), update.get(), commit.get()}) {
+                check(sqlite3_step(stmt), f->raw);
+                sqlite3_reset(stmt);
+            }
+        }
+    });
+    suite.add(group, "Transaction, Connection::exec()", [f](std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            Dbpp::Transaction tx(f->db);
+            f->db.exec("UPDATE counter SET n = n + 1 WHERE id = 1");
+            tx.commit();
+        }
+    });
+    suite.add(group, "Transaction, PreparedStatement", [f](std::size_t n) {
+        auto update = f->db.preparedStatement("UPDATE counter SET n = n + 1 WHERE id = 1");
+        for (std::size_t i = 0; i < n; ++i) {
+            Dbpp::Transaction tx(f->db);
+            update.reset();
+            (void) update.step();
+            tx.commit();
+        }
+    });
+}
+
+void addBlobs(Bench::Suite& suite, const std::shared_ptr<Fixture>& f) {
+    for (auto size : BlobSizes) {
+        const auto blob = std::make_shared<std::vector<std::byte>>(makeBlob(size));
+        const std::string suffix = std::to_string(size) + " bytes";
+
+        const std::string bind = "bind blob, " + suffix;
+        suite.addBaseline(bind, [f, blob](std::size_t n) {
+            auto stmt = prepare(f->raw, "SELECT length(?)");
+            for (std::size_t i = 0; i < n; ++i) {
+                sqlite3_reset(stmt.get());
+                sqlite3_bind_blob(stmt.get(), 1, blob->data(), static_cast<int>(blob->size()), SQLITE_TRANSIENT); // NOLINT
+                check(sqlite3_step(stmt.get()), f->raw);
+                Bench::doNotOptimize(sqlite3_column_int(stmt.get(), 0));
+            }
+        });
+        suite.add(bind, "PreparedStatement::rebind()", [f, blob](std::size_t n) {
+            auto stmt = f->db.preparedStatement("SELECT length(?)");
+            for (std::size_t i = 0; i < n; ++i) {
+                stmt.rebind(*blob);
+                Bench::doNotOptimize(stmt.step().get<int>(0));
+            }
+        });
+
+        const std::string get = "get blob, " + suffix;
+        suite.addBaseline(get, [f, size](std::size_t n) {
+            auto stmt = prepare(f->raw, "SELECT data FROM blob WHERE size = ?");
+            sqlite3_bind_int64(stmt.get(), 1, static_cast<sqlite3_int64>(size));
+            for (std::size_t i = 0; i < n; ++i) {
+                sqlite3_reset(stmt.get());
+                check(sqlite3_step(stmt.get()), f->raw);
+                const auto* data = static_cast<const std::byte*>(sqlite3_column_blob(stmt.get(), 0));
+                std::vector<std::byte> out(data, data + sqlite3_column_bytes(stmt.get(), 0)); // NOLINT
+                Bench::doNotOptimize(out);
+            }
+        });
+        suite.add(get, "Result::get<std::vector<std::byte>>()", [f, size](std::size_t n) {
+            auto stmt = f->db.preparedStatement("SELECT data FROM blob WHERE size = ?");
+            stmt.rebind(static_cast<long long>(size));
+            for (std::size_t i = 0; i < n; ++i) {
+                stmt.reset();
+                auto out = stmt.step().get<std::vector<std::byte>>(0);
+                Bench::doNotOptimize(out);
+            }
+        });
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Bench::Suite suite;
+    try {
+        auto fixture = std::make_shared<Fixture>();
+        addPointQueries(suite, fixture);
+        addIteration(suite, fixture);
+        addTransactions(suite, fixture);
+        addBlobs(suite, fixture);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to set up the benchmarks: " << e.what() << '\n';
+        return 1;
+    }
+    return Bench::runMain(argc, argv, suite);
+}
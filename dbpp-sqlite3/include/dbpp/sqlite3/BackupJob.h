@@ -0,0 +1,176 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/util.h>
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief The state of a BackupJob
+///
+/// \since v1.0.0
+enum class BackupStatus {
+    Running,
+    Paused,
+    Completed, ///< The destination is a complete copy of the source
+    Cancelled, ///< The job was cancelled, and the destination was left as it was
+    Failed, ///< The job failed. wait() throws the error
+};
+
+/// \brief Progress of a BackupJob
+///
+/// \since v1.0.0
+struct BackupProgress {
+    int remainingPages = 0; ///< Pages left to copy
+    int totalPages = 0; ///< Pages in the source database
+    int pagesPerStep = 0; ///< Number of pages copied by the latest step
+    int restarts = 0; ///< Number of times the backup has restarted because the source was written by another connection
+};
+
+/// \brief Settings of a BackupJob
+///
+/// \since v1.0.0
+struct BackupOptions {
+    /// \brief Target duration of a step
+    ///
+    /// The source database is locked while a step runs, so this is the longest a writer
+    /// should have to wait for the backup. The number of pages per step is adjusted after
+    /// each step to meet it.
+    std::chrono::microseconds maxStepTime{std::chrono::milliseconds(5)};
+
+    /// \brief Time between the steps, during which writers can proceed
+    std::chrono::milliseconds interval{std::chrono::milliseconds(5)};
+
+    int minPagesPerStep = 1; ///< Lower bound of the number of pages per step
+    int maxPagesPerStep = 4096; ///< Upper bound of the number of pages per step
+
+    /// \brief Number of restarts after which the backup is completed with VACUUM INTO instead
+    ///
+    /// An online backup restarts from the beginning whenever another connection writes to
+    /// the source, so it may never complete when the source is written often. VACUUM INTO
+    /// copies the database in a single read transaction, which blocks checkpoints but not
+    /// writers in WAL mode. It runs on a separate read only connection to the source file,
+    /// so the application's connection stays usable, and its query limits and hooks don't
+    /// apply. The copy is written to the destination path with "-vacuum" appended, and
+    /// renamed to the destination when it's complete. Negative values disable the fallback.
+    int vacuumIntoAfterRestarts = 8;
+
+    /// \brief Called from the backup thread after each step
+    std::function<void(const BackupProgress&)> progressCallback;
+};
+
+/// \brief Copies an SQLite3 database to a file, on a background thread
+///
+/// The job runs sqlite3_backup_step() on the connection's database handle, in steps sized
+/// to keep writers from stalling for longer than BackupOptions::maxStepTime. It can be
+/// paused, resumed and cancelled at any time.
+///
+/// The connection must not have been opened with OpenFlag::NoMutex, since it's used from
+/// the backup thread as well. The job keeps the connection's database handle open until
+/// it has finished.
+///
+/// The destructor cancels the job if it's still running, and waits for it to stop.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT BackupJob {
+    DBPP_NO_COPY_SEMANTICS(BackupJob);
+    DBPP_NO_MOVE_SEMANTICS(BackupJob);
+
+public:
+    class Impl;
+
+private:
+    std::shared_ptr<Impl> impl_;
+    std::thread thread_;
+
+public:
+    /// \brief Starts backing up the main database of a connection
+    ///
+    /// \param db An sqlite3 connection
+    /// \param destination The file to write the backup to. An existing database file is overwritten
+    /// \param options Settings of the job
+    ///
+    /// \since v1.0.0
+    BackupJob(Dbpp::Connection& db, std::filesystem::path destination, BackupOptions options = {});
+
+    /// \brief Destructor. Cancels the job and waits for it to stop
+    ///
+    /// \since v1.0.0
+    ~BackupJob();
+
+    /// \brief Stops copying pages until resume() is called
+    ///
+    /// \since v1.0.0
+    void pause();
+
+    /// \brief Continues a paused job
+    ///
+    /// \since v1.0.0
+    void resume();
+
+    /// \brief Stops the job, without waiting for it
+    ///
+    /// A VACUUM INTO that has already started runs to completion.
+    ///
+    /// \since v1.0.0
+    void cancel();
+
+    /// \brief Returns the current state of the job
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    BackupStatus status() const;
+
+    /// \brief Returns the progress of the job, as of its latest step
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    BackupProgress progress() const;
+
+    /// \brief Returns true if the job was completed with VACUUM INTO
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    bool usedVacuumInto() const;
+
+    /// \brief Waits until the job has completed, been cancelled or failed
+    ///
+    /// \return BackupStatus::Completed or BackupStatus::Cancelled
+    /// \throws The error that made the job fail
+    ///
+    /// \since v1.0.0
+    BackupStatus wait();
+
+    /// \brief Waits until the job has completed, been cancelled or failed, or the timeout expires
+    ///
+    /// \param timeout The longest time to wait
+    /// \return True if the job has stopped
+    ///
+    /// \since v1.0.0
+    bool waitFor(std::chrono::milliseconds timeout);
+};
+
+} // namespace Dbpp::Sqlite3
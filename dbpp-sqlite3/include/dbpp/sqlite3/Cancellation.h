@@ -0,0 +1,180 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/Exception.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/util.h>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief The point in time at which a query should be abandoned
+///
+/// \since v1.0.0
+using Deadline = std::chrono::steady_clock::time_point;
+
+/// \brief Thrown by a statement that was stopped by a CancellationToken
+///
+/// The code is the SQLite error code that ended the statement, which is SQLITE_INTERRUPT,
+/// or SQLITE_BUSY if it was waiting for a lock. Catching this also catches DeadlineExceeded.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT QueryCancelled : public Dbpp::ErrorWithCode {
+    using ErrorWithCode::ErrorWithCode;
+};
+
+/// \brief Thrown by a statement that was stopped because its deadline had passed
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT DeadlineExceeded : public QueryCancelled {
+    using QueryCancelled::QueryCancelled;
+};
+
+class QueryLimitScope;
+struct QueryLimits;
+
+/// \brief Cancels the queries running under QueryLimits that refer to it
+///
+/// Copies of a token share their state, so a copy can be kept by another thread and
+/// cancelled from there.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT CancellationToken {
+public:
+    class Impl;
+
+private:
+    std::shared_ptr<Impl> impl_;
+
+    friend QueryLimitScope limitQueries(Dbpp::Connection& db, QueryLimits limits);
+
+public:
+    /// \brief Constructs a token that is not cancelled
+    ///
+    /// \since v1.0.0
+    CancellationToken();
+
+    /// \brief Cancels the token
+    ///
+    /// Running statements that use the token are interrupted with sqlite3_interrupt(), and
+    /// statements started later fail before running. A token can't be reset. May be called
+    /// from any thread.
+    ///
+    /// \since v1.0.0
+    void cancel();
+
+    /// \brief Checks if cancel() has been called
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    bool isCancelled() const;
+};
+
+/// \brief Limits on how long the statements of a connection may run
+///
+/// \since v1.0.0
+struct QueryLimits {
+    std::optional<Deadline> deadline; ///< Statements still running at this time are stopped with DeadlineExceeded
+    std::optional<CancellationToken> token; ///< Statements running when the token is cancelled are stopped with QueryCancelled
+    int checkInterval = 1000; ///< The number of virtual machine instructions between the checks of the limits
+};
+
+/// \brief Applies QueryLimits to a connection while it exists
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT QueryLimitScope {
+    DBPP_NO_COPY_SEMANTICS(QueryLimitScope);
+
+public:
+    class Impl;
+
+private:
+    std::unique_ptr<Impl> impl_;
+
+    explicit QueryLimitScope(std::unique_ptr<Impl> impl);
+
+    friend QueryLimitScope limitQueries(Dbpp::Connection& db, QueryLimits limits);
+
+public:
+    /// \brief Constructs a scope that doesn't limit anything
+    ///
+    /// \since v1.0.0
+    QueryLimitScope();
+
+    QueryLimitScope(QueryLimitScope&&) noexcept;
+    QueryLimitScope& operator=(QueryLimitScope&&) noexcept;
+
+    /// \brief Destructor. Removes the limits
+    ///
+    /// \since v1.0.0
+    ~QueryLimitScope();
+
+    /// \brief Removes the limits
+    ///
+    /// \since v1.0.0
+    void release();
+};
+
+/// \brief Limits how long the statements of a connection may run
+///
+/// Applies to every statement stepped on the connection until the returned scope is
+/// destroyed, including the ones run by Connection::exec() and by iterating over results.
+/// This makes it possible to bound the time a connection borrowed from a pool is held
+/// by ad-hoc queries.
+///
+/// The limits are checked before a statement starts, by a progress handler every
+/// checkInterval virtual machine instructions, and while waiting for a database lock. Lock
+/// waits are only checked when the busy timeout is set with setBusyTimeout(), not with
+/// "PRAGMA busy_timeout". A cancelled token interrupts the running statement at once. A stopped statement throws DeadlineExceeded or
+/// QueryCancelled, and is reset so that it can be executed again. As with any interrupted
+/// statement, if it was writing within an explicit transaction, SQLite rolls back the
+/// transaction, and a later Connection::rollback(), such as that of a Transaction, does
+/// nothing. Rolling back with Connection::rollback() or a Transaction is never stopped.
+///
+/// Scopes may be nested, and then all their limits apply.
+///
+/// \param db An sqlite3 connection
+/// \param limits The limits. At least one of the deadline and token must be set
+/// \return The scope in which the limits apply
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT QueryLimitScope limitQueries(Dbpp::Connection& db, QueryLimits limits);
+
+/// \brief Stops the statements of a connection that are still running at a deadline
+///
+/// \see limitQueries(Dbpp::Connection&, QueryLimits)
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT QueryLimitScope limitQueries(Dbpp::Connection& db, Deadline deadline);
+
+/// \brief Stops the statements of a connection that are running when a token is cancelled
+///
+/// \see limitQueries(Dbpp::Connection&, QueryLimits)
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT QueryLimitScope limitQueries(Dbpp::Connection& db, CancellationToken token);
+
+} // namespace Dbpp::Sqlite3
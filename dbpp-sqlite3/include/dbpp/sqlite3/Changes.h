@@ -0,0 +1,134 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/util.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief The kind of change made to a row
+///
+/// \since v1.0.0
+enum class ChangeOperation {
+    Insert,
+    Update,
+    Delete,
+};
+
+/// \brief A change to a row of a table
+///
+/// A change with an empty table name means that the changes of the transaction couldn't be
+/// recorded, since memory ran out, and that any row of any table may have changed. It is
+/// then the only change in the batch, and it is delivered to all listeners.
+///
+/// \since v1.0.0
+struct RowChange {
+    std::string table; ///< The name of the table, or empty if the changes were lost
+    ChangeOperation operation; ///< The kind of change
+    std::int64_t rowid; ///< The rowid of the changed row
+
+    [[nodiscard]]
+    bool operator==(const RowChange& other) const {
+        return std::tie(rowid, operation, table) == std::tie(other.rowid, other.operation, other.table);
+    }
+
+    [[nodiscard]]
+    bool operator<(const RowChange& other) const {
+        return std::tie(table, rowid, operation) < std::tie(other.table, other.rowid, other.operation);
+    }
+};
+
+/// \brief Receives the rows changed by a committed transaction
+///
+/// The changes are sorted by table and rowid, and each change appears once.
+///
+/// \since v1.0.0
+using ChangeListener = std::function<void(const std::vector<RowChange>& changes)>;
+
+/// \brief A subscription to the changes committed on a connection
+///
+/// The listener is called until the subscription is destroyed, or unsubscribe() is called.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT ChangeSubscription {
+    DBPP_NO_COPY_SEMANTICS(ChangeSubscription);
+
+public:
+    class Impl;
+
+private:
+    std::unique_ptr<Impl> impl_;
+
+    explicit ChangeSubscription(std::unique_ptr<Impl> impl);
+
+    friend ChangeSubscription subscribeToChanges(Dbpp::Connection& db, ChangeListener listener, std::vector<std::string> tables);
+
+public:
+    /// \brief Constructs a subscription that isn't subscribed to anything
+    ///
+    /// \since v1.0.0
+    ChangeSubscription();
+
+    ChangeSubscription(ChangeSubscription&&) noexcept;
+    ChangeSubscription& operator=(ChangeSubscription&&) noexcept;
+
+    /// \brief Destructor. Stops the notifications
+    ///
+    /// \since v1.0.0
+    ~ChangeSubscription();
+
+    /// \brief Stops the notifications
+    ///
+    /// \since v1.0.0
+    void unsubscribe();
+};
+
+/// \brief Subscribes to the rows changed by the transactions committed on a connection
+///
+/// The changes are collected with sqlite3_update_hook(), and delivered in one batch when
+/// the statement that commits the transaction returns, on the thread that executed it. The
+/// changes of transactions that are rolled back are discarded. Changes undone by rolling
+/// back to a savepoint, or by a failed statement within a transaction, are still delivered,
+/// which errs on the side of caution when invalidating caches.
+///
+/// Changes to WITHOUT ROWID tables, and rows deleted by an ON CONFLICT REPLACE clause, are
+/// not reported by SQLite, and neither are changes made by other connections.
+///
+/// The listener may use the connection. Exceptions thrown by it are ignored, since the
+/// transaction has already been committed when it's called, so a listener that must not miss
+/// changes has to handle its own errors.
+///
+/// \param db An sqlite3 connection
+/// \param listener Receives the changes
+/// \param tables The tables to report changes to. All tables if empty
+/// \return The subscription
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT ChangeSubscription subscribeToChanges(Dbpp::Connection& db, ChangeListener listener, std::vector<std::string> tables = {});
+
+} // namespace Dbpp::Sqlite3
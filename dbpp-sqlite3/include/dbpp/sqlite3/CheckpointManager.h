@@ -0,0 +1,119 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/util.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief When a CheckpointManager runs checkpoints
+///
+/// \since v1.0.0
+struct CheckpointPolicy {
+    /// \brief Run a PASSIVE checkpoint when this many pages in the WAL haven't been checkpointed
+    int lagPages = 1000;
+
+    /// \brief Run a PASSIVE checkpoint at least this often, if any page hasn't been checkpointed
+    std::chrono::milliseconds maxInterval{std::chrono::seconds(1)};
+
+    /// \brief Truncate the WAL when it has grown to this many pages
+    ///
+    /// The WAL is only truncated after a PASSIVE checkpoint has copied all of it, meaning
+    /// that no reader is using it. Truncation never waits for a lock, so it's skipped if a
+    /// writer is active. A writer that starts a transaction during the truncation waits for
+    /// it, so the writer connection should have a busy timeout. Negative values disable it.
+    int truncatePages = 4000;
+};
+
+/// \brief Statistics of a CheckpointManager
+///
+/// \since v1.0.0
+struct CheckpointStats {
+    int walPages = 0; ///< Pages in the WAL, as of the latest commit or checkpoint
+    int lagPages = 0; ///< Pages in the WAL that haven't been copied to the database
+    std::int64_t walBytes = 0; ///< Size of the WAL, as of the latest commit or checkpoint
+    std::uint64_t checkpoints = 0; ///< Number of PASSIVE checkpoints run
+    std::uint64_t truncations = 0; ///< Number of times the WAL was truncated
+    std::uint64_t busy = 0; ///< Number of checkpoints that couldn't run, since another connection held a lock
+    std::chrono::nanoseconds lastDuration{0}; ///< Duration of the latest checkpoint
+    std::chrono::nanoseconds sinceLastCheckpoint{0}; ///< Time since the latest checkpoint, or since the manager was started
+};
+
+/// \brief Checkpoints the WAL of a database on a background thread
+///
+/// With the default settings, SQLite runs a checkpoint as part of the commit that makes
+/// the WAL reach 1000 pages, which stalls that commit. The checkpoint manager disables these
+/// automatic checkpoints on the writer connection, and instead runs checkpoints on its own
+/// connection and thread, as decided by a CheckpointPolicy.
+///
+/// The database must be a file in WAL mode. Automatic checkpoints are enabled again when
+/// the manager is destroyed.
+///
+/// The manager learns about commits from the WAL hook of the writer, which is also what
+/// runs the automatic checkpoints. Running "PRAGMA wal_autocheckpoint" on the writer, or
+/// calling sqlite3_wal_autocheckpoint() or sqlite3_wal_hook(), replaces the manager's hook,
+/// so the manager stops seeing commits and automatic checkpoints are back on the commit
+/// path. stats() and requestCheckpoint() install the hook again. Since they use the writer
+/// connection for that, call them from a thread that may use it.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT CheckpointManager {
+    DBPP_NO_COPY_SEMANTICS(CheckpointManager);
+    DBPP_NO_MOVE_SEMANTICS(CheckpointManager);
+
+public:
+    class Impl;
+
+private:
+    std::shared_ptr<Impl> impl_;
+    std::thread thread_;
+
+public:
+    /// \brief Starts managing the checkpoints of the main database of a connection
+    ///
+    /// \param writer An sqlite3 connection, which writes to a database in WAL mode
+    /// \param policy When to run checkpoints
+    ///
+    /// \since v1.0.0
+    explicit CheckpointManager(Dbpp::Connection& writer, CheckpointPolicy policy = {});
+
+    /// \brief Destructor. Stops the background thread and enables automatic checkpoints again
+    ///
+    /// \since v1.0.0
+    ~CheckpointManager();
+
+    /// \brief Returns the WAL size and checkpoint statistics
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    CheckpointStats stats() const;
+
+    /// \brief Makes the background thread run a checkpoint now, without waiting for it
+    ///
+    /// \since v1.0.0
+    void requestCheckpoint();
+};
+
+} // namespace Dbpp::Sqlite3
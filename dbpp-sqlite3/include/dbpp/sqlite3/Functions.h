@@ -0,0 +1,475 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <sqlite3.h>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief Flags describing an SQL function. They can be combined with |
+///
+/// \since v1.0.0
+enum class FunctionFlag : int {
+    None = 0,
+    Deterministic = SQLITE_DETERMINISTIC, ///< The function always gives the same result for the same arguments, which lets SQLite factor out calls and use it in indexes
+#ifdef SQLITE_DIRECTONLY
+    DirectOnly = SQLITE_DIRECTONLY, ///< The function can only be called from top-level SQL, not from views, triggers or the schema
+#endif
+#ifdef SQLITE_INNOCUOUS
+    Innocuous = SQLITE_INNOCUOUS, ///< The function has no side effects and can't leak information, so it may be used in views and triggers even if trusted_schema is off
+#endif
+};
+
+/// \brief Combines function flags
+///
+/// \since v1.0.0
+constexpr FunctionFlag operator|(FunctionFlag a, FunctionFlag b) {
+    return static_cast<FunctionFlag>(static_cast<int>(a) | static_cast<int>(b));
+}
+
+/// \brief A read-only view of a blob
+///
+/// Used for blob arguments to SQL functions, to access the data without copying it. The
+/// data is only valid during the call.
+///
+/// \since v1.0.0
+struct BlobView {
+    const std::byte* data = nullptr;
+    std::size_t size = 0;
+
+    [[nodiscard]] const std::byte* begin() const { return data; }
+    [[nodiscard]] const std::byte* end() const { return data + size; } // NOLINT
+    [[nodiscard]] bool empty() const { return size == 0; }
+};
+
+namespace Detail {
+
+    template <typename T>
+    struct IsOptional : std::false_type {};
+
+    template <typename T>
+    struct IsOptional<std::optional<T>> : std::true_type {};
+
+    template <typename T>
+    inline constexpr bool IsByteV = std::is_same_v<T, std::byte> || std::is_same_v<T, char>
+                                    || std::is_same_v<T, unsigned char> || std::is_same_v<T, signed char>;
+
+    template <typename T>
+    struct IsByteVector : std::false_type {};
+
+    template <typename T>
+    struct IsByteVector<std::vector<T>> : std::bool_constant<IsByteV<T>> {};
+
+    template <typename T>
+    inline constexpr bool AlwaysFalseV = false;
+
+    // Converts a 64-bit integer to T, or returns std::nullopt if it's out of range. Unsigned
+    // types are converted from the bits of the value, like Dbpp::Result does
+    template <typename T>
+    std::optional<T> narrowInteger(sqlite3_int64 value) {
+        if constexpr (std::is_signed_v<T>) {
+            const auto narrowed = static_cast<T>(value);
+            if (static_cast<sqlite3_int64>(narrowed) != value)
+                return std::nullopt;
+            return narrowed;
+        } else {
+            const auto bits = static_cast<unsigned long long>(value);
+            const auto narrowed = static_cast<T>(bits);
+            if (static_cast<unsigned long long>(narrowed) != bits)
+                return std::nullopt;
+            return narrowed;
+        }
+    }
+
+    // The signature of a callable: lambdas, other function objects and function pointers
+    template <typename F>
+    struct FunctionTraits : FunctionTraits<decltype(&F::operator())> {};
+
+    template <typename R, typename... Args>
+    struct FunctionTraits<R (*)(Args...)> {
+        using ResultType = R;
+        using ArgumentTypes = std::tuple<std::remove_cv_t<std::remove_reference_t<Args>>...>;
+        static constexpr int Arity = sizeof...(Args);
+    };
+
+    template <typename R, typename... Args>
+    struct FunctionTraits<R (*)(Args...) noexcept> : FunctionTraits<R (*)(Args...)> {};
+
+    template <typename C, typename R, typename... Args>
+    struct FunctionTraits<R (C::*)(Args...)> : FunctionTraits<R (*)(Args...)> {};
+
+    template <typename C, typename R, typename... Args>
+    struct FunctionTraits<R (C::*)(Args...) const> : FunctionTraits<R (*)(Args...)> {};
+
+    template <typename C, typename R, typename... Args>
+    struct FunctionTraits<R (C::*)(Args...) noexcept> : FunctionTraits<R (*)(Args...)> {};
+
+    template <typename C, typename R, typename... Args>
+    struct FunctionTraits<R (C::*)(Args...) const noexcept> : FunctionTraits<R (*)(Args...)> {};
+
+    // Converts an argument of an SQL function to the type of the corresponding C++ parameter
+    template <typename T>
+    T fromValue(sqlite3_value* value) {
+        if constexpr (std::is_same_v<T, sqlite3_value*>) {
+            return value;
+        } else if constexpr (IsOptional<T>::value) {
+            if (sqlite3_value_type(value) == SQLITE_NULL)
+                return std::nullopt;
+            return fromValue<typename T::value_type>(value);
+        } else if constexpr (std::is_same_v<T, bool>) {
+            return sqlite3_value_int64(value) != 0;
+        } else if constexpr (std::is_integral_v<T>) {
+            const auto narrowed = narrowInteger<T>(sqlite3_value_int64(value));
+            if (!narrowed)
+                throw std::out_of_range("An integer argument is out of range of its parameter type");
+            return *narrowed;
+        } else if constexpr (std::is_floating_point_v<T>) {
+            return static_cast<T>(sqlite3_value_double(value));
+        } else if constexpr (std::is_same_v<T, std::string_view>) {
+            // The text must be fetched before its size, since it may be converted
+            const auto* text = reinterpret_cast<const char*>(sqlite3_value_text(value)); // NOLINT
+            return text ? std::string_view(text, static_cast<std::size_t>(sqlite3_value_bytes(value))) : std::string_view();
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            return std::string(fromValue<std::string_view>(value));
+        } else if constexpr (std::is_same_v<T, BlobView>) {
+            const auto* data = static_cast<const std::byte*>(sqlite3_value_blob(value));
+            return BlobView{data, data ? static_cast<std::size_t>(sqlite3_value_bytes(value)) : 0};
+        } else if constexpr (IsByteVector<T>::value) {
+            const auto blob = fromValue<BlobView>(value);
+            const auto* first = reinterpret_cast<const typename T::value_type*>(blob.data); // NOLINT
+            return T(first, first + blob.size); // NOLINT
+        } else {
+            static_assert(AlwaysFalseV<T>, "Unsupported SQL function parameter type");
+        }
+    }
+
+    // Sets the result of an SQL function from the value returned by the C++ function
+    template <typename T>
+    void setResult(sqlite3_context* context, const T& value) {
+        if constexpr (std::is_same_v<T, std::nullptr_t>) {
+            sqlite3_result_null(context);
+        } else if constexpr (IsOptional<T>::value) {
+            if (value)
+                setResult(context, *value);
+            else
+                sqlite3_result_null(context);
+        } else if constexpr (std::is_same_v<T, bool>) {
+            sqlite3_result_int(context, value ? 1 : 0);
+        } else if constexpr (std::is_integral_v<T>) {
+            if constexpr (std::is_unsigned_v<T> && sizeof(T) >= sizeof(sqlite3_int64)) {
+                if (value > static_cast<T>(std::numeric_limits<sqlite3_int64>::max())) {
+                    sqlite3_result_error(context, "The result is larger than the greatest signed 64-bit integer", -1);
+                    return;
+                }
+            }
+            sqlite3_result_int64(context, static_cast<sqlite3_int64>(value));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            sqlite3_result_double(context, static_cast<double>(value));
+        } else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+            sqlite3_result_text64(context, value.data(), value.size(), SQLITE_TRANSIENT, SQLITE_UTF8); // NOLINT
+        } else if constexpr (std::is_same_v<T, const char*>) {
+            if (value)
+                sqlite3_result_text(context, value, -1, SQLITE_TRANSIENT); // NOLINT
+            else
+                sqlite3_result_null(context);
+        } else if constexpr (std::is_same_v<T, BlobView>) {
+            sqlite3_result_blob64(context, value.data, value.size, SQLITE_TRANSIENT); // NOLINT
+        } else if constexpr (IsByteVector<T>::value) {
+            sqlite3_result_blob64(context, value.data(), value.size(), SQLITE_TRANSIENT); // NOLINT
+        } else {
+            static_assert(AlwaysFalseV<T>, "Unsupported SQL function result type");
+        }
+    }
+
+    // Calls a function with the SQL arguments converted to its parameter types
+    template <typename F, typename... Args, std::size_t... Is>
+    decltype(auto) invokeWithValues(F&& function, sqlite3_value** argv, std::tuple<Args...>* /* types */,
+                                    std::index_sequence<Is...> /* indexes */) {
+        return std::forward<F>(function)(fromValue<Args>(argv[Is])...); // NOLINT
+    }
+
+    template <typename Signature, typename F>
+    decltype(auto) invokeWithValues(F&& function, sqlite3_value** argv) {
+        using Args = typename FunctionTraits<Signature>::ArgumentTypes;
+        return invokeWithValues(std::forward<F>(function), argv, static_cast<Args*>(nullptr),
+                                std::make_index_sequence<std::tuple_size_v<Args>>());
+    }
+
+    // Calls a function, reporting any exception it throws as an SQL error
+    template <typename F>
+    void reportExceptions(sqlite3_context* context, F&& function) {
+        try {
+            std::forward<F>(function)();
+        } catch (const std::bad_alloc&) {
+            sqlite3_result_error_nomem(context);
+        } catch (const std::exception& e) {
+            sqlite3_result_error(context, e.what(), -1);
+        } catch (...) {
+            sqlite3_result_error(context, "Unknown exception in SQL function", -1);
+        }
+    }
+
+    // Calls a function with the given signature, and sets the result to what it returns
+    template <typename Signature, typename F>
+    void invokeAndSetResult(sqlite3_context* context, F&& function) {
+        reportExceptions(context, [&]() {
+            if constexpr (std::is_void_v<typename FunctionTraits<Signature>::ResultType>) {
+                std::forward<F>(function)();
+                sqlite3_result_null(context);
+            } else {
+                setResult(context, std::forward<F>(function)());
+            }
+        });
+    }
+
+    template <typename T>
+    void destroy(void* p) {
+        delete static_cast<T*>(p); // NOLINT
+    }
+
+    template <typename F>
+    void scalarFunction(sqlite3_context* context, int /* argc */, sqlite3_value** argv) {
+        auto& function = *static_cast<F*>(sqlite3_user_data(context));
+        invokeAndSetResult<F>(context, [&]() -> decltype(auto) {
+            return invokeWithValues<F>(function, argv);
+        });
+    }
+
+    // The aggregate context holds a pointer to the state of the group, which is copied from
+    // the prototype registered with the function when the first row is stepped
+    template <typename AggregateT>
+    AggregateT* aggregateState(sqlite3_context* context) {
+        auto** slot = static_cast<AggregateT**>(sqlite3_aggregate_context(context, sizeof(AggregateT*)));
+        if (!slot)
+            throw std::bad_alloc();
+        if (!*slot)
+            *slot = new AggregateT(*static_cast<const AggregateT*>(sqlite3_user_data(context))); // NOLINT
+        return *slot;
+    }
+
+    // Takes over the state of a group, or copies the prototype if no rows were stepped
+    template <typename AggregateT>
+    std::unique_ptr<AggregateT> releaseAggregateState(sqlite3_context* context) {
+        auto** slot = static_cast<AggregateT**>(sqlite3_aggregate_context(context, 0));
+        if (slot && *slot)
+            return std::unique_ptr<AggregateT>(std::exchange(*slot, nullptr));
+        return std::make_unique<AggregateT>(*static_cast<const AggregateT*>(sqlite3_user_data(context)));
+    }
+
+    template <typename AggregateT>
+    void aggregateStep(sqlite3_context* context, int /* argc */, sqlite3_value** argv) {
+        using Signature = decltype(&AggregateT::step);
+        reportExceptions(context, [&]() {
+            auto* state = aggregateState<AggregateT>(context);
+            invokeWithValues<Signature>([state](auto&&... args) { state->step(std::forward<decltype(args)>(args)...); }, argv);
+        });
+    }
+
+    template <typename AggregateT>
+    void aggregateFinal(sqlite3_context* context) {
+        using Signature = decltype(&AggregateT::final);
+        std::unique_ptr<AggregateT> state;
+        invokeAndSetResult<Signature>(context, [&]() -> decltype(auto) {
+            state = releaseAggregateState<AggregateT>(context);
+            return state->final();
+        });
+    }
+
+    template <typename WindowT>
+    void windowInverse(sqlite3_context* context, int /* argc */, sqlite3_value** argv) {
+        using Signature = decltype(&WindowT::inverse);
+        reportExceptions(context, [&]() {
+            auto* state = aggregateState<WindowT>(context);
+            invokeWithValues<Signature>([state](auto&&... args) { state->inverse(std::forward<decltype(args)>(args)...); }, argv);
+        });
+    }
+
+    template <typename WindowT>
+    void windowValue(sqlite3_context* context) {
+        using Signature = decltype(&WindowT::value);
+        invokeAndSetResult<Signature>(context, [&]() -> decltype(auto) {
+            return aggregateState<WindowT>(context)->value();
+        });
+    }
+
+    using ScalarCallback = void (*)(sqlite3_context*, int, sqlite3_value**);
+    using FinalCallback = void (*)(sqlite3_context*);
+    using UserData = std::unique_ptr<void, void (*)(void*)>;
+
+    // Registers a function. The connection takes over the user data, even if it fails
+    DBPP_SQLITE3_EXPORT void createFunction(Dbpp::Connection& db, std::string_view name, int argumentCount,
+                                            FunctionFlag flags, UserData userData, ScalarCallback function,
+                                            ScalarCallback step, FinalCallback final);
+
+    // Registers a window function. The connection takes over the user data, even if it fails
+    DBPP_SQLITE3_EXPORT void createWindowFunction(Dbpp::Connection& db, std::string_view name, int argumentCount,
+                                                  FunctionFlag flags, UserData userData, ScalarCallback step,
+                                                  FinalCallback final, FinalCallback value, ScalarCallback inverse);
+
+} // namespace Detail
+
+/// \brief Registers a C++ function as a scalar SQL function
+///
+/// The number and types of the SQL arguments are deduced from the parameters of the function,
+/// which can be a lambda, another function object or a function pointer. Arguments are converted
+/// with the sqlite3_value functions. Supported parameter types are:
+///
+/// - Integral and floating point types, and bool. Integers that don't fit the parameter type are reported as SQL errors
+/// - std::string_view and BlobView, which refer to the argument without copying it. They are only valid during the call
+/// - std::string and std::vector of std::byte, char, unsigned char or signed char
+/// - std::optional of any of the above, which is empty if the argument is NULL
+/// - sqlite3_value*, for direct access to the argument
+///
+/// The function may return any of the parameter types except sqlite3_value*, or std::nullptr_t or
+/// void for NULL. Exceptions thrown by the function are reported as SQL errors, with the message
+/// of the exception.
+///
+/// The function is registered for the given number of arguments only, so functions with the
+/// same name but a different number of arguments can be registered as well. Registering a
+/// function with the same name and number of arguments again replaces it.
+///
+/// \param db An sqlite3 connection
+/// \param name The name of the SQL function
+/// \param function The C++ function, which is moved into the connection
+/// \param flags Flags describing the function. Use FunctionFlag::Deterministic whenever possible
+///
+/// \since v1.0.0
+template <typename F>
+void registerFunction(Dbpp::Connection& db, std::string_view name, F function, FunctionFlag flags = FunctionFlag::None) {
+    using FunctionT = std::decay_t<F>;
+    Detail::UserData userData(new FunctionT(std::move(function)), &Detail::destroy<FunctionT>);
+    Detail::createFunction(db, name, Detail::FunctionTraits<FunctionT>::Arity, flags, std::move(userData),
+                           &Detail::scalarFunction<FunctionT>, nullptr, nullptr);
+}
+
+/// \brief Registers a C++ class as an aggregate SQL function
+///
+/// Each group of rows is aggregated by a copy of the prototype. Its step() member function is
+/// called with the arguments of each row, and then its final() member function returns the
+/// result. The arguments and result are converted like for registerFunction().
+///
+/// \code
+/// struct GeometricMean {
+///     double logSum = 0.0;
+///     long long count = 0;
+///
+///     void step(double value) { logSum += std::log(value); ++count; }
+///     std::optional<double> final() const {
+///         return count ? std::optional<double>(std::exp(logSum / count)) : std::nullopt;
+///     }
+/// };
+/// registerAggregate(db, "geomean", GeometricMean());
+/// \endcode
+///
+/// \tparam AggregateT A copyable class with non-overloaded step() and final() member functions
+/// \param db An sqlite3 connection
+/// \param name The name of the SQL function
+/// \param prototype The initial state of each group
+/// \param flags Flags describing the function
+///
+/// \since v1.0.0
+template <typename AggregateT>
+void registerAggregate(Dbpp::Connection& db, std::string_view name, AggregateT prototype, FunctionFlag flags = FunctionFlag::None) {
+    using StepSignature = decltype(&AggregateT::step);
+    Detail::UserData userData(new AggregateT(std::move(prototype)), &Detail::destroy<AggregateT>);
+    Detail::createFunction(db, name, Detail::FunctionTraits<StepSignature>::Arity, flags, std::move(userData),
+                           nullptr, &Detail::aggregateStep<AggregateT>, &Detail::aggregateFinal<AggregateT>);
+}
+
+/// \brief Registers a C++ class as an aggregate SQL function, with a default constructed prototype
+///
+/// \since v1.0.0
+template <typename AggregateT>
+void registerAggregate(Dbpp::Connection& db, std::string_view name, FunctionFlag flags = FunctionFlag::None) {
+    registerAggregate(db, name, AggregateT(), flags);
+}
+
+/// \brief Registers a C++ class as an aggregate window function
+///
+/// Like an aggregate registered with registerAggregate(), each partition is handled by a copy
+/// of the prototype, but rows can also leave the window frame. The class must have these
+/// non-overloaded member functions:
+///
+/// - step(), which adds the arguments of a row to the frame
+/// - inverse(), which removes the arguments of the oldest row in the frame. It takes the same parameters as step()
+/// - value(), which returns the result for the current frame
+/// - final(), which returns the result when the function is used as an ordinary aggregate, or the last result of a window
+///
+/// With an ordered window, SQLite streams the rows through step() and inverse(), so a moving
+/// aggregate is computed in a single pass.
+///
+/// \code
+/// struct MovingSum {
+///     double sum = 0.0;
+///
+///     void step(double value) { sum += value; }
+///     void inverse(double value) { sum -= value; }
+///     double value() const { return sum; }
+///     double final() const { return sum; }
+/// };
+/// registerWindowFunction<MovingSum>(db, "moving_sum");
+/// db.statement("SELECT t, moving_sum(v) OVER (ORDER BY t ROWS BETWEEN 9 PRECEDING AND CURRENT ROW) FROM series");
+/// \endcode
+///
+/// \tparam WindowT A copyable class with step(), inverse(), value() and final() member functions
+/// \param db An sqlite3 connection
+/// \param name The name of the SQL function
+/// \param prototype The initial state of each partition
+/// \param flags Flags describing the function
+///
+/// \since v1.0.0
+template <typename WindowT>
+void registerWindowFunction(Dbpp::Connection& db, std::string_view name, WindowT prototype, FunctionFlag flags = FunctionFlag::None) {
+    using StepSignature = decltype(&WindowT::step);
+    using InverseSignature = decltype(&WindowT::inverse);
+    static_assert(std::is_same_v<typename Detail::FunctionTraits<StepSignature>::ArgumentTypes,
+                                 typename Detail::FunctionTraits<InverseSignature>::ArgumentTypes>,
+                  "step() and inverse() must take the same parameters");
+
+    Detail::UserData userData(new WindowT(std::move(prototype)), &Detail::destroy<WindowT>);
+    Detail::createWindowFunction(db, name, Detail::FunctionTraits<StepSignature>::Arity, flags, std::move(userData),
+                                 &Detail::aggregateStep<WindowT>, &Detail::aggregateFinal<WindowT>,
+                                 &Detail::windowValue<WindowT>, &Detail::windowInverse<WindowT>);
+}
+
+/// \brief Registers a C++ class as an aggregate window function, with a default constructed prototype
+///
+/// \since v1.0.0
+template <typename WindowT>
+void registerWindowFunction(Dbpp::Connection& db, std::string_view name, FunctionFlag flags = FunctionFlag::None) {
+    registerWindowFunction(db, name, WindowT(), flags);
+}
+
+} // namespace Dbpp::Sqlite3
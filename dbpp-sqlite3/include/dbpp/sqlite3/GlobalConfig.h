@@ -0,0 +1,132 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/sqlite3/exports.h>
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief A memory allocator for SQLite, installed with GlobalConfig
+///
+/// Implements SQLite's sqlite3_mem_methods. The functions may be called from any thread,
+/// so they must be thread safe. SQLite frees memory with the allocator installed at the
+/// time of the free, so applyGlobalConfig() only replaces an allocator once all memory
+/// it provided has been freed.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT Allocator {
+public:
+    virtual ~Allocator() = default;
+
+    /// \brief Allocates at least size bytes, aligned to 8 bytes. Returns nullptr on failure
+    ///
+    /// \since v1.0.0
+    virtual void* allocate(std::size_t size) noexcept = 0;
+
+    /// \brief Frees memory returned by allocate() or reallocate()
+    ///
+    /// \since v1.0.0
+    virtual void deallocate(void* p) noexcept = 0;
+
+    /// \brief Resizes an allocation, like realloc(). Returns nullptr on failure, leaving p allocated
+    ///
+    /// \since v1.0.0
+    virtual void* reallocate(void* p, std::size_t size) noexcept = 0;
+
+    /// \brief Returns the usable size of an allocation, which is at least the size requested
+    ///
+    /// \since v1.0.0
+    virtual std::size_t allocationSize(void* p) noexcept = 0;
+
+    /// \brief Returns the size that allocate() would actually provide for a request
+    ///
+    /// SQLite uses this to make use of the whole allocation. The default rounds up to a
+    /// multiple of 8.
+    ///
+    /// \since v1.0.0
+    virtual std::size_t roundUp(std::size_t size) noexcept {
+        return (size + 7) & ~static_cast<std::size_t>(7);
+    }
+};
+
+/// \brief The size of the lookaside memory of each connection
+///
+/// Lookaside memory is a per connection pool of small fixed size slots, which SQLite uses
+/// for short lived objects instead of the general allocator. See sqlite3_db_config() with
+/// SQLITE_DBCONFIG_LOOKASIDE. Has no effect if SQLite was built with SQLITE_OMIT_LOOKASIDE,
+/// as some distributions do.
+///
+/// \since v1.0.0
+struct LookasideConfig {
+    int slotSize = 1200; ///< The size of each slot, in bytes, rounded down to a multiple of 8
+    int slotCount = 100; ///< The number of slots. 0 disables lookaside memory
+};
+
+/// \brief Preallocated memory for the page caches of all connections
+///
+/// See SQLITE_CONFIG_PAGECACHE. Pages that don't fit in it are allocated with the
+/// general allocator.
+///
+/// \since v1.0.0
+struct PageCacheConfig {
+    int pageSize = 4096; ///< The page size of the databases, which the slots are sized for
+    int pageCount = 0; ///< The number of pages to preallocate
+};
+
+/// \brief Process wide configuration of SQLite's memory subsystem
+///
+/// Applied with applyGlobalConfig(). Settings that are not set have SQLite's defaults.
+///
+/// \since v1.0.0
+struct GlobalConfig {
+    /// \brief The allocator for all memory allocated by SQLite. The system malloc if not set
+    std::shared_ptr<Allocator> allocator;
+
+    /// \brief Preallocated page cache memory
+    std::optional<PageCacheConfig> pageCache;
+
+    /// \brief Whether SQLite collects memory statistics. On by default
+    ///
+    /// Turning it off removes a mutex from every allocation, but disables the statistics of
+    /// memoryStats(), the heap limits, and so MemoryGovernor.
+    std::optional<bool> memoryStatus;
+
+    /// \brief The lookaside memory of the connections opened after the configuration is applied
+    std::optional<LookasideConfig> lookaside;
+};
+
+/// \brief Configures SQLite's memory subsystem
+///
+/// SQLite can only be configured while it's not initialized, so this calls sqlite3_shutdown()
+/// before applying the configuration. It must be called before the first connection is
+/// opened, or when all connections are closed, and throws Dbpp::Error if a connection opened
+/// by this library is still open. It also throws if memory allocated by SQLite is still in
+/// use, such as the values of CachedRows or a connection opened without this library,
+/// since it would otherwise be freed by a different allocator than the one that provided
+/// it. Applying a default constructed GlobalConfig restores the defaults.
+///
+/// \param config The configuration
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT void applyGlobalConfig(const GlobalConfig& config);
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,171 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/util.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief A kind of maintenance work
+///
+/// \since v1.0.0
+enum class MaintenanceTask {
+    Optimize, ///< PRAGMA optimize, which analyzes the tables whose statistics are likely stale
+    Analyze, ///< ANALYZE of a table that has had many rows changed
+    IncrementalVacuum, ///< PRAGMA incremental_vacuum, which returns free pages to the file system
+};
+
+/// \brief A piece of maintenance work that was done
+///
+/// \since v1.0.0
+struct MaintenanceReport {
+    MaintenanceTask task = MaintenanceTask::Optimize; ///< What was done
+    std::string table; ///< The table that was analyzed, for MaintenanceTask::Analyze
+    std::int64_t pages = 0; ///< The number of pages freed, for MaintenanceTask::IncrementalVacuum
+    std::chrono::nanoseconds duration{0}; ///< How long it took
+};
+
+/// \brief Statistics of a Maintenance
+///
+/// \since v1.0.0
+struct MaintenanceStats {
+    std::uint64_t optimizations = 0; ///< Number of times PRAGMA optimize has run
+    std::uint64_t tablesAnalyzed = 0; ///< Number of times a changed table has been analyzed
+    std::uint64_t pagesVacuumed = 0; ///< Number of pages freed by incremental vacuum
+    std::chrono::nanoseconds totalDuration{0}; ///< The time spent on all the work
+};
+
+/// \brief What a Maintenance does, and when
+///
+/// \since v1.0.0
+struct MaintenancePolicy {
+    /// \brief Run PRAGMA optimize this often. Zero or negative disables it
+    std::chrono::milliseconds optimizeInterval{std::chrono::minutes(10)};
+
+    /// \brief Analyze a table when this many of its rows have been changed through the
+    /// connection since it was last analyzed. Zero or negative disables it
+    std::int64_t analyzeAfterChanges = 10000;
+
+    /// \brief The number of rows of each index that ANALYZE examines, see PRAGMA analysis_limit
+    ///
+    /// Bounds the time of an ANALYZE of a large table, at the cost of less exact statistics.
+    /// Zero examines all rows.
+    int analysisLimit = 1000;
+
+    /// \brief The number of pages freed by each step of the incremental vacuum. Zero or
+    /// negative disables it
+    ///
+    /// Only done when the database has PRAGMA auto_vacuum = INCREMENTAL. Each step is a
+    /// short write transaction, so writers are never blocked for long.
+    int vacuumPagesPerStep = 100;
+
+    /// \brief Only vacuum when at least this many pages are free
+    std::int64_t vacuumMinFreePages = 1000;
+
+    /// \brief How often the background connection does maintenance. Zero makes the
+    /// Maintenance work on the caller's connection, when tick() is called
+    std::chrono::milliseconds backgroundInterval{0};
+
+    /// \brief How long each round of work on the background connection may take
+    std::chrono::milliseconds backgroundBudget{50};
+
+    /// \brief Optional. Called with each piece of work that was done
+    ///
+    /// In background mode, it's called on the background thread, and exceptions thrown by it
+    /// are ignored. Otherwise they're thrown by tick().
+    std::function<void(const MaintenanceReport& report)> onReport;
+};
+
+/// \brief Keeps the statistics of a database fresh, and its file compact
+///
+/// The work is split in small pieces, which are done within a time budget, so that it can
+/// be done in the idle moments of an application without holding locks for long. Unlike a
+/// full VACUUM, the incremental vacuum never locks the database for more than a step.
+///
+/// There are two ways to run it. Calling tick() with a budget in the idle moments of the
+/// thread that owns the connection does the work on that connection. With a
+/// backgroundInterval, it's instead done on a thread with its own connection to the
+/// database, which must then be a file. A busy timeout on the connections is recommended,
+/// since the work writes to the database. Before SQLite 3.46, PRAGMA optimize only
+/// considers the tables that have been queried on the connection it runs on, so in
+/// background mode it does next to nothing, and only the tables changed through the
+/// connection are analyzed.
+///
+/// The changes made through the connection decide which tables need to be analyzed. They
+/// are counted per table with SQLite's update hook, so changes SQLite doesn't report there,
+/// such as deleting all rows of a table without a WHERE clause, and changes made by other
+/// connections, are left to PRAGMA optimize.
+///
+/// The connection must outlive the maintenance.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT Maintenance {
+    DBPP_NO_COPY_SEMANTICS(Maintenance);
+    DBPP_NO_MOVE_SEMANTICS(Maintenance);
+
+public:
+    class Impl;
+
+private:
+    std::shared_ptr<Impl> impl_;
+    std::thread thread_;
+
+public:
+    /// \brief Starts tracking the changes made through a connection
+    ///
+    /// \param db An sqlite3 connection
+    /// \param policy What to do, and when
+    ///
+    /// \since v1.0.0
+    explicit Maintenance(Dbpp::Connection& db, MaintenancePolicy policy = {});
+
+    /// \brief Destructor. Stops the background thread, after the piece of work in progress
+    ///
+    /// \since v1.0.0
+    ~Maintenance();
+
+    /// \brief Does the work that is due, on the connection, for about the budget
+    ///
+    /// Each piece of work is started only if there is time left of the budget, so the
+    /// budget can be exceeded by the duration of one piece. Must not be called in background
+    /// mode, or while a transaction is open on the connection.
+    ///
+    /// \param budget How long to work
+    /// \return The work that was done
+    ///
+    /// \since v1.0.0
+    std::vector<MaintenanceReport> tick(std::chrono::milliseconds budget);
+
+    /// \brief Returns what has been done so far
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    MaintenanceStats stats() const;
+};
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,147 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/util.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief The memory use of SQLite when a MemoryGovernor reports pressure
+///
+/// \since v1.0.0
+struct MemoryPressure {
+    std::int64_t memoryUsed = 0; ///< Bytes of memory allocated by SQLite
+    std::int64_t limit = 0; ///< The heap limit that memoryUsed is compared to
+};
+
+/// \brief The memory budget enforced by a MemoryGovernor
+///
+/// \since v1.0.0
+struct MemoryBudget {
+    /// \brief Process wide soft heap limit in bytes, see sqlite3_soft_heap_limit64(). 0 for no limit
+    ///
+    /// When the limit is exceeded, SQLite frees unused cache pages before allocating more.
+    std::int64_t softHeapLimit = 0;
+
+    /// \brief Process wide hard heap limit in bytes, see sqlite3_hard_heap_limit64(). 0 for no limit
+    ///
+    /// Allocations that would exceed the limit fail, and the statements fail with SQLITE_NOMEM.
+    std::int64_t hardHeapLimit = 0;
+
+    /// \brief The size of the page cache of each managed connection, in bytes
+    ///
+    /// Set with PRAGMA cache_size. SQLite's default is 2000 KiB.
+    std::optional<std::int64_t> cacheSize;
+
+    /// \brief The number of cache pages at which a managed connection spills dirty pages to disk
+    ///
+    /// Set with PRAGMA cache_spill. A transaction that changes more pages than fit in the
+    /// cache spills them to the database file, so that its memory use is bounded. SQLite
+    /// spills when the larger of this and the cache size is exceeded, so this only has an
+    /// effect if it's larger than the cache size.
+    std::optional<int> cacheSpillPages;
+
+    /// \brief Called when SQLite's memory use reaches pressureThreshold of the heap limit
+    ///
+    /// The soft heap limit is used if set, otherwise the hard one. The callback is called on
+    /// a background thread of the governor, once each time the memory use rises above the
+    /// threshold. It's typically used to schedule a call to MemoryGovernor::releaseMemory().
+    std::function<void(const MemoryPressure& pressure)> onPressure;
+
+    /// \brief The fraction of the heap limit at which onPressure is called
+    double pressureThreshold = 0.9;
+
+    /// \brief How often the memory use is checked, when there is an onPressure callback
+    std::chrono::milliseconds pressureCheckInterval{100};
+
+    /// \brief Called by MemoryGovernor::releaseMemory()
+    ///
+    /// Used to drop memory held on behalf of SQLite by the application, such as idle
+    /// prepared statements kept by a pool, or the results in a QueryCache.
+    std::function<void()> onRelease;
+};
+
+/// \brief Keeps the memory used by SQLite and a set of connections within a budget
+///
+/// The heap limits apply to the whole process, so there should only be one governor at a
+/// time. The limits in effect before the governor was created are restored when it's
+/// destroyed. The page cache settings are applied to the connections passed to manage(),
+/// which typically are all the connections of a pool.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT MemoryGovernor {
+    DBPP_NO_COPY_SEMANTICS(MemoryGovernor);
+    DBPP_NO_MOVE_SEMANTICS(MemoryGovernor);
+
+public:
+    class Impl;
+
+private:
+    std::shared_ptr<Impl> impl_;
+    std::thread thread_;
+
+public:
+    /// \brief Applies the heap limits of a budget
+    ///
+    /// \param budget The budget
+    ///
+    /// \since v1.0.0
+    explicit MemoryGovernor(MemoryBudget budget);
+
+    /// \brief Destructor. Restores the previous heap limits
+    ///
+    /// The connections keep their page cache settings.
+    ///
+    /// \since v1.0.0
+    ~MemoryGovernor();
+
+    /// \brief Applies the page cache settings to a connection, and includes it in releaseMemory()
+    ///
+    /// The governor doesn't keep the connection open. Closed connections are forgotten.
+    ///
+    /// \param db An sqlite3 connection
+    ///
+    /// \since v1.0.0
+    void manage(Dbpp::Connection& db);
+
+    /// \brief Frees as much memory as possible
+    ///
+    /// Calls the onRelease callback of the budget, and then releases the unused page cache
+    /// memory of every managed connection with sqlite3_db_release_memory(). Pages in use by
+    /// open transactions can't be released.
+    ///
+    /// Unless the connections were opened with OpenFlag::FullMutex, this must only be called
+    /// while none of them is in use by another thread, such as when a pool has them all
+    /// checked in.
+    ///
+    /// \return The decrease in the number of bytes allocated by SQLite
+    ///
+    /// \since v1.0.0
+    std::int64_t releaseMemory();
+};
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,50 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <sqlite3.h>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief Specifies the mode in which to open an SQLite3 database
+///
+/// \since v1.0.0
+enum class OpenMode : unsigned int {
+    ReadOnly = SQLITE_OPEN_READONLY, /// Open it in read only mode. Fail if it does not exist
+    ReadWrite = SQLITE_OPEN_READWRITE, /// Open it in read-write mode. Fail if it does not exist
+    ReadWriteCreate = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, /// Open it in read-write mode, and create it if it does not exist
+};
+
+/// \brief Specifies how to open an SQLite3 database
+///
+/// \since v1.0.0
+enum class OpenFlag : unsigned int {
+    None = 0,
+    Uri = SQLITE_OPEN_URI, /// The filename can be interpreted as a URI if this flag is set
+    Memory = SQLITE_OPEN_MEMORY, /// The database will be opened as an in-memory database
+    NoMutex = SQLITE_OPEN_NOMUTEX, /// The new database connection will use the "multi-thread" threading mode. This means that separate threads are allowed to use SQLite at the same time, as long as each thread is using a different database connection
+    FullMutex = SQLITE_OPEN_FULLMUTEX, /// The new database connection will use the "serialized" threading mode. This means the multiple threads can safely attempt to use the same database connection at the same time
+    SharedCache = SQLITE_OPEN_SHAREDCACHE, /// The database is opened with shared cache enabled, overriding the default shared cache setting
+    PrivateCache = SQLITE_OPEN_PRIVATECACHE, /// The database is opened with shared cache disabled, overriding the default shared cache setting
+
+#ifdef SQLITE_OPEN_NOFOLLOW
+    NoFollow = SQLITE_OPEN_NOFOLLOW, /// The database filename is not allowed to be a symbolic link
+#endif
+};
+
+} // namespace Dbpp::Sqlite3
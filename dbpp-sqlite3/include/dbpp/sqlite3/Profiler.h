@@ -0,0 +1,132 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/util.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief Aggregated execution statistics for one normalized SQL statement
+///
+/// \since v1.0.0
+struct StatementProfile {
+    std::string sql; ///< The SQL text, with literals replaced by ? and whitespace collapsed
+    std::uint64_t calls = 0; ///< Number of completed executions
+    std::uint64_t rows = 0; ///< Total number of rows returned
+    std::chrono::nanoseconds totalTime{0}; ///< Total execution time
+    std::chrono::nanoseconds meanTime{0}; ///< Mean execution time
+    std::chrono::nanoseconds maxTime{0}; ///< Longest execution time
+    std::chrono::nanoseconds p50{0}; ///< Estimated median execution time
+    std::chrono::nanoseconds p95{0}; ///< Estimated 95th percentile execution time
+    std::chrono::nanoseconds p99{0}; ///< Estimated 99th percentile execution time
+};
+
+/// \brief Collects execution statistics per SQL statement
+///
+/// The profiler uses the SQLITE_TRACE_STMT, SQLITE_TRACE_ROW and SQLITE_TRACE_PROFILE
+/// events of sqlite3_trace_v2() to measure every statement executed on the attached
+/// connections. Statements are grouped by their normalized SQL text, so that statements
+/// only differing in literal values are counted together.
+///
+/// A profiler can be attached to several connections, for example all connections of
+/// a pool, and snapshots can be taken from any thread. The execution time percentiles are
+/// estimated from a logarithmic histogram, with a relative error below 20%.
+///
+/// The profiler detaches from all connections when it is destroyed.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT Profiler {
+    DBPP_NO_COPY_SEMANTICS(Profiler);
+    DBPP_NO_MOVE_SEMANTICS(Profiler);
+
+public:
+    class Impl;
+
+private:
+    std::shared_ptr<Impl> impl_;
+
+public:
+    /// \brief Constructs a profiler that isn't attached to any connection
+    ///
+    /// \since v1.0.0
+    Profiler();
+
+    /// \brief Destructor. Detaches the profiler from all connections
+    ///
+    /// \since v1.0.0
+    ~Profiler();
+
+    /// \brief Starts profiling the statements executed on an sqlite3 connection
+    ///
+    /// \param db An sqlite3 connection
+    ///
+    /// \since v1.0.0
+    void attach(Dbpp::Connection& db);
+
+    /// \brief Stops profiling the statements executed on an sqlite3 connection
+    ///
+    /// \param db An sqlite3 connection previously passed to attach()
+    ///
+    /// \since v1.0.0
+    void detach(Dbpp::Connection& db);
+
+    /// \brief Returns the statistics collected so far
+    ///
+    /// \return One entry per normalized statement, ordered by descending total time
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::vector<StatementProfile> snapshot() const;
+
+    /// \brief Returns the statistics collected so far, in the Prometheus text exposition format
+    ///
+    /// The execution times are exported as a summary named <prefix>_statement_duration_seconds,
+    /// and the number of rows as a counter named <prefix>_statement_rows_total, both labelled
+    /// with the normalized SQL text.
+    ///
+    /// \param prefix The prefix of the metric names
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::string prometheus(std::string_view prefix = "dbpp") const;
+
+    /// \brief Discards all statistics collected so far
+    ///
+    /// \since v1.0.0
+    void reset();
+};
+
+/// \brief Normalizes an SQL statement for aggregation
+///
+/// Replaces string and numeric literals with ?, collapses whitespace and removes
+/// comments and any trailing semicolon.
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT std::string normalizeSql(std::string_view sql);
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,310 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/Exception.h>
+#include <dbpp/MetaFunctions.h>
+#include <dbpp/PlaceholderBinder.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/sqlite3/Functions.h>
+#include <dbpp/util.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+#include <sqlite3.h>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief The rows returned by a statement, copied out of SQLite
+///
+/// The values keep their SQLite types, and are converted when they are read, the same
+/// way as the arguments of SQL functions, except that NULL values and integers out of range
+/// of the requested type throw, like they do in Connection::get(). std::string_view and
+/// BlobView values refer to the rows, and are valid for as long as the rows are.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT CachedRows {
+    DBPP_NO_COPY_SEMANTICS(CachedRows);
+    DBPP_NO_MOVE_SEMANTICS(CachedRows);
+
+    std::vector<std::string> columnNames_;
+    std::vector<sqlite3_value*> values_;
+    std::size_t bytes_ = 0;
+
+    [[nodiscard]]
+    sqlite3_value* value(std::size_t row, int column) const;
+
+public:
+    /// \brief Constructs an empty row set, with the columns of a statement
+    ///
+    /// \since v1.0.0
+    explicit CachedRows(sqlite3_stmt* stmt);
+
+    ~CachedRows();
+
+    /// \brief Copies the current row of a statement
+    ///
+    /// \since v1.0.0
+    void append(sqlite3_stmt* stmt);
+
+    /// \brief Returns the number of rows
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::size_t size() const;
+
+    /// \brief Returns true if there are no rows
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    bool empty() const { return values_.empty(); }
+
+    /// \brief Returns the number of columns
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    int columnCount() const { return static_cast<int>(columnNames_.size()); }
+
+    /// \brief Returns the name of a column
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    const std::string& columnName(int column) const;
+
+    /// \brief Returns the approximate memory used by the rows
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::size_t bytes() const { return bytes_; }
+
+    /// \brief Returns the value of a column of a row
+    ///
+    /// Throws if the value is NULL, unless T is std::optional.
+    ///
+    /// \tparam T The type to convert the value to
+    /// \param row The index of the row
+    /// \param column The index of the column
+    /// \throws Dbpp::Error If the value is NULL
+    /// \throws std::bad_cast If the value is an integer that doesn't fit in T
+    ///
+    /// \since v1.0.0
+    template <typename T>
+    [[nodiscard]]
+    T get(std::size_t row, int column) const {
+        auto* v = value(row, column);
+        if constexpr (Detail::IsOptional<T>::value) {
+            if (sqlite3_value_type(v) == SQLITE_NULL)
+                return std::nullopt;
+            return get<typename T::value_type>(row, column);
+        } else {
+            if (sqlite3_value_type(v) == SQLITE_NULL)
+                throw Dbpp::Error("Column value was NULL in retrieval");
+            if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool>) {
+                const auto narrowed = Detail::narrowInteger<T>(sqlite3_value_int64(v));
+                if (!narrowed)
+                    throw std::bad_cast();
+                return *narrowed;
+            } else {
+                return Detail::fromValue<T>(v);
+            }
+        }
+    }
+
+    /// \brief Returns the columns of a row as a tuple
+    ///
+    /// \since v1.0.0
+    template <typename... Ts>
+    [[nodiscard]]
+    std::tuple<Ts...> toTuple(std::size_t row) const {
+        return toTuple<Ts...>(row, std::index_sequence_for<Ts...>{});
+    }
+
+private:
+    template <typename... Ts, std::size_t... Is>
+    std::tuple<Ts...> toTuple(std::size_t row, std::index_sequence<Is...> /*unused*/) const {
+        return std::tuple<Ts...>(get<Ts>(row, static_cast<int>(Is))...);
+    }
+};
+
+/// \brief Settings of a QueryCache
+///
+/// \since v1.0.0
+struct QueryCacheOptions {
+    std::size_t maxBytes = 16 * 1024 * 1024; ///< Approximate memory limit of the cached rows. The least recently used entries are evicted
+    std::size_t maxEntryBytes = 1024 * 1024; ///< Results larger than this are not cached
+};
+
+/// \brief Statistics of a QueryCache
+///
+/// \since v1.0.0
+struct QueryCacheStats {
+    std::uint64_t hits = 0; ///< Lookups answered from the cache
+    std::uint64_t misses = 0; ///< Lookups that executed the statement
+    std::uint64_t bypasses = 0; ///< Executions that couldn't use the cache, since a transaction was open or the statement writes
+    std::uint64_t invalidations = 0; ///< Entries removed since a table they read was changed
+    std::uint64_t evictions = 0; ///< Entries removed to stay within the memory limit
+    std::size_t entries = 0; ///< Current number of entries
+    std::size_t bytes = 0; ///< Current approximate memory used by the entries
+
+    /// \brief Returns the share of the lookups answered from the cache
+    [[nodiscard]]
+    double hitRate() const {
+        const auto lookups = hits + misses;
+        return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+    }
+};
+
+namespace Detail {
+
+    // Serializes the values bound to a statement into a cache key
+    class DBPP_SQLITE3_EXPORT CacheKey final : public PlaceholderBinder {
+        std::string key_;
+
+        void addInteger(char tag, std::uint64_t value);
+
+    public:
+        explicit CacheKey(std::string_view sql);
+
+        [[nodiscard]]
+        const std::string& str() const { return key_; }
+
+        void bind(std::nullptr_t) override;
+        void bind(short value) override;
+        void bind(int value) override;
+        void bind(long value) override;
+        void bind(long long value) override;
+        void bind(unsigned short value) override;
+        void bind(unsigned int value) override;
+        void bind(unsigned long value) override;
+        void bind(unsigned long long value) override;
+        void bind(float value) override;
+        void bind(double value) override;
+        void bind(std::string_view value) override;
+        void bind(const std::pair<const unsigned char*, std::size_t>& data) override;
+    };
+
+} // namespace Detail
+
+/// \brief Caches the rows returned by read only statements, until the tables they read change
+///
+/// The cache is keyed by the SQL text and the bound values. While a statement is
+/// prepared, an authorizer callback records the tables it reads, including the tables
+/// read through views. The changes committed on the connection invalidate exactly the
+/// entries that read the changed tables, using subscribeToChanges(). Commits by other
+/// connections and schema changes are detected with the data_version and schema_version
+/// pragmas, and clear the whole cache.
+///
+/// Statements executed while a transaction is open, and statements that write, are never
+/// cached. Neither are changes to WITHOUT ROWID tables reported by SQLite, so statements
+/// reading them should not use the cache. Results of non-deterministic functions, such
+/// as random() or datetime('now'), are cached like any other.
+///
+/// The connection must outlive the cache.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT QueryCache {
+    DBPP_NO_COPY_SEMANTICS(QueryCache);
+    DBPP_NO_MOVE_SEMANTICS(QueryCache);
+
+public:
+    class Impl;
+
+private:
+    Dbpp::Connection& db_;
+    std::unique_ptr<Impl> impl_;
+
+    [[nodiscard]]
+    std::shared_ptr<const CachedRows> lookup(const std::string& key, const std::function<Dbpp::Statement()>& prepare);
+
+public:
+    /// \brief Constructs an empty cache for the statements executed on a connection
+    ///
+    /// \param db An sqlite3 connection
+    /// \param options Settings of the cache
+    ///
+    /// \since v1.0.0
+    explicit QueryCache(Dbpp::Connection& db, QueryCacheOptions options = {});
+
+    ~QueryCache();
+
+    /// \brief Returns all rows returned by a statement, from the cache if possible
+    ///
+    /// \param sql An SQL statement
+    /// \param args A list of values to be bound to placeholders in the SQL statement
+    /// \return The rows, which stay valid after the entry is invalidated
+    ///
+    /// \since v1.0.0
+    template <typename... Args>
+    [[nodiscard]]
+    std::shared_ptr<const CachedRows> rows(std::string_view sql, const Args&... args) {
+        Detail::CacheKey key(sql);
+        PlaceholderBinder& binder = key;
+        (binder.bind(args), ...);
+        return lookup(key.str(), [&] { return db_.statement(sql, args...); });
+    }
+
+    /// \brief Returns the first row returned by a statement, from the cache if possible
+    ///
+    /// Works like Connection::get().
+    ///
+    /// \tparam ReturnType... The return type - if there are multiple types a tuple will be returned, otherwise a single value will be returned
+    /// \param sql An SQL statement
+    /// \param args A list of values to be bound to placeholders in the SQL statement
+    /// \return A single value or a tuple representing the first row
+    /// \throws Dbpp::Error If the statement returned no rows
+    ///
+    /// \since v1.0.0
+    template <typename... ReturnType, typename... Args>
+    [[nodiscard]]
+    Dbpp::Detail::ScalarOrTupleT<ReturnType...> get(std::string_view sql, const Args&... args) {
+        const auto result = rows(sql, args...);
+        if (result->empty())
+            throw Dbpp::Error(std::string("get() expects at least one row. Statement: ") + std::string{sql});
+        if constexpr (Dbpp::Detail::IsScalarV<ReturnType...>) {
+            if (result->columnCount() != 1)
+                throw Dbpp::Error(std::string("get() expects a single column Result. Statement: ") + std::string{sql});
+            return result->template get<Dbpp::Detail::FirstTypeT<ReturnType...>>(0, 0);
+        } else {
+            return result->template toTuple<ReturnType...>(0);
+        }
+    }
+
+    /// \brief Removes all entries
+    ///
+    /// \since v1.0.0
+    void clear();
+
+    /// \brief Returns the statistics of the cache
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    QueryCacheStats stats() const;
+};
+
+} // namespace Dbpp::Sqlite3
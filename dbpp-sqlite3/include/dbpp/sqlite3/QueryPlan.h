@@ -0,0 +1,168 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/Exception.h>
+#include <dbpp/Statement.h>
+#include <dbpp/sqlite3/exports.h>
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief The sqlite3_stmt_status() counters of a statement
+///
+/// \since v1.0.0
+struct StatementStatus {
+    int fullScanSteps = 0; ///< Number of forward steps in full table scans
+    int sorts = 0; ///< Number of sort operations
+    int autoIndexRows = 0; ///< Number of rows inserted into automatic indexes
+    int vmSteps = 0; ///< Number of virtual machine operations
+    int reprepares = 0; ///< Number of times the statement was automatically re-prepared
+    int runs = 0; ///< Number of times the statement has been run
+    int filterHits = 0; ///< Number of join steps that passed a bloom filter. Zero if not supported by SQLite
+    int filterMisses = 0; ///< Number of join steps that were skipped by a bloom filter. Zero if not supported by SQLite
+    int memoryUsed = 0; ///< Approximate number of bytes of heap memory used by the statement
+};
+
+/// \brief A node in the tree returned by explainPlan()
+///
+/// \since v1.0.0
+struct QueryPlanNode {
+    int id = 0; ///< The id of the node, as reported by EXPLAIN QUERY PLAN
+    std::string detail; ///< The description of the step, e.g. "SCAN person"
+    std::vector<QueryPlanNode> children; ///< The sub-steps of this step
+};
+
+/// \brief The parsed output of EXPLAIN QUERY PLAN for a statement
+///
+/// \since v1.0.0
+struct QueryPlan {
+    std::vector<QueryPlanNode> nodes; ///< The top level steps of the plan
+
+    /// \brief Checks if the plan scans a table without using an index
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    DBPP_SQLITE3_EXPORT bool hasFullScan() const;
+
+    /// \brief Checks if the plan builds an automatic index
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    DBPP_SQLITE3_EXPORT bool hasAutomaticIndex() const;
+
+    /// \brief Formats the plan as an indented tree, in the style of the sqlite3 shell
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    DBPP_SQLITE3_EXPORT std::string toString() const;
+};
+
+/// \brief The sqlite3_stmt_scanstatus() statistics of one loop in a statement
+///
+/// \since v1.0.0
+struct ScanStatus {
+    std::string name; ///< The name of the table or index being scanned
+    std::string explain; ///< The EXPLAIN QUERY PLAN text of the loop
+    long long loops = 0; ///< Number of times the loop has been run
+    long long rowsVisited = 0; ///< Total number of rows visited by the loop
+    double estimatedRows = 0; ///< The query planner's estimate of rows visited per loop
+    int selectId = 0; ///< The id of the select statement the loop belongs to
+};
+
+/// \brief Thrown by statements violating the checks enabled by enablePlanAssertions()
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT QueryPlanViolation : public Dbpp::Error {
+    using Error::Error;
+};
+
+/// \brief Specifies the checks done by enablePlanAssertions()
+///
+/// \since v1.0.0
+struct PlanAssertions {
+    bool failOnFullScan = true; ///< Fail statements that step through a table in a full scan
+    bool failOnAutomaticIndex = true; ///< Fail statements that build an automatic index
+    std::function<bool(std::string_view sql)> ignore; ///< Optional. Statements for which this returns true are not checked
+};
+
+/// \brief Returns the sqlite3_stmt_status() counters of a statement
+///
+/// \param stmt A statement created from an sqlite3 connection
+/// \param reset If true, the counters are reset to zero after being read
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT StatementStatus statementStatus(Dbpp::Statement& stmt, bool reset = false);
+
+/// \brief Returns the query plan of a statement
+///
+/// Runs EXPLAIN QUERY PLAN for the SQL of the statement, and returns the steps as a tree.
+///
+/// \param stmt A statement created from an sqlite3 connection
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT QueryPlan explainPlan(Dbpp::Statement& stmt);
+
+/// \brief Returns true if the SQLite library collects the statistics returned by scanStatus()
+///
+/// This requires an SQLite library compiled with SQLITE_ENABLE_STMT_SCANSTATUS.
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT bool scanStatusSupported();
+
+/// \brief Returns the per-loop statistics of a statement
+///
+/// These statistics are only collected if scanStatusSupported() returns true. Otherwise
+/// an empty vector is returned.
+///
+/// \param stmt A statement created from an sqlite3 connection
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT std::vector<ScanStatus> scanStatus(Dbpp::Statement& stmt);
+
+/// \brief Makes statements on a connection throw if they use a full table scan or an automatic index
+///
+/// This is intended for test suites, to catch missing indexes before they show up as
+/// slow queries with production data volumes. The sqlite3_stmt_status() counters of a
+/// statement are checked every time it is stepped, and a QueryPlanViolation containing the
+/// query plan is thrown as soon as a violation is detected. Since the counters don't depend
+/// on the number of rows, the checks work on small test data sets too.
+///
+/// \param db An sqlite3 connection
+/// \param assertions The checks to enable
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT void enablePlanAssertions(Dbpp::Connection& db, PlanAssertions assertions = {});
+
+/// \brief Disables the checks enabled by enablePlanAssertions()
+///
+/// \param db An sqlite3 connection
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT void disablePlanAssertions(Dbpp::Connection& db);
+
+} // namespace Dbpp::Sqlite3
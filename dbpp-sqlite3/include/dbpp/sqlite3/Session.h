@@ -0,0 +1,207 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/Changes.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/sqlite3/Functions.h>
+#include <dbpp/util.h>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief Why a change in a changeset could not be applied as is
+///
+/// \since v1.0.0
+enum class ConflictType {
+    Data, ///< The row to update or delete exists, but its current values differ from the recorded old values
+    NotFound, ///< The row to update or delete does not exist
+    Conflict, ///< The primary key of the row to insert already exists
+    Constraint, ///< Applying the change would violate a constraint other than the primary key
+    ForeignKey, ///< Applying the changeset would leave foreign key violations behind
+};
+
+/// \brief What to do with a conflicting change
+///
+/// \since v1.0.0
+enum class ConflictAction {
+    Omit, ///< Skip the change, and continue with the next one
+    Replace, ///< Overwrite the conflicting row. Only allowed for ConflictType::Data and ConflictType::Conflict
+    Abort, ///< Roll back all changes made by the changeset, and throw an exception
+};
+
+/// \brief Describes a conflicting change, passed to a ConflictHandler
+///
+/// \since v1.0.0
+struct Conflict {
+    ConflictType type; ///< Why the change conflicts
+    ChangeOperation operation; ///< The kind of change
+    std::string_view table; ///< The name of the changed table. Only valid during the call
+};
+
+/// \brief Decides what to do with a change that conflicts with the target database
+///
+/// \since v1.0.0
+using ConflictHandler = std::function<ConflictAction(const Conflict&)>;
+
+/// \brief Returns true if the SQLite library was built with the session extension
+///
+/// When it returns false, constructing a Session or applying a changeset throws.
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT bool sessionsSupported();
+
+/// \brief Records the changes made to tables of a database, using the SQLite session extension
+///
+/// Only changes to the attached tables are recorded, and only tables with a primary key
+/// can be recorded. The changes are accumulated per row, so a row updated many times
+/// appears once, with its original and final values. The result is a changeset, which
+/// can be applied to another copy of the database with applyChangeset(), moving only the
+/// changed rows instead of the whole file.
+///
+/// The session keeps the connection open until it's destroyed.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT Session {
+    DBPP_NO_COPY_SEMANTICS(Session);
+
+public:
+    class Impl;
+
+private:
+    std::unique_ptr<Impl> impl_;
+
+public:
+    /// \brief Starts a session on a database of an sqlite3 connection
+    ///
+    /// No changes are recorded until a table is attached.
+    ///
+    /// \param db An sqlite3 connection
+    /// \param schema The database to record changes in, "main" or the name of an attached database
+    ///
+    /// \since v1.0.0
+    explicit Session(Dbpp::Connection& db, std::string_view schema = "main");
+
+    Session(Session&&) noexcept;
+    Session& operator=(Session&&) noexcept;
+
+    /// \brief Destructor. Stops recording and discards the changes
+    ///
+    /// \since v1.0.0
+    ~Session();
+
+    /// \brief Starts recording the changes made to a table
+    ///
+    /// The table does not need to exist yet.
+    ///
+    /// \param table The name of the table
+    /// \return The session itself
+    ///
+    /// \since v1.0.0
+    Session& attach(std::string_view table);
+
+    /// \brief Starts recording the changes made to all tables, including ones created later
+    ///
+    /// \return The session itself
+    ///
+    /// \since v1.0.0
+    Session& attachAll();
+
+    /// \brief Pauses or resumes the recording of changes
+    ///
+    /// Changes made while disabled are not recorded, but rows already recorded keep being
+    /// tracked.
+    ///
+    /// \param enabled True to record changes
+    ///
+    /// \since v1.0.0
+    void setEnabled(bool enabled);
+
+    /// \brief Returns true if changes are currently recorded
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    bool enabled() const;
+
+    /// \brief Returns true if no changes have been recorded
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    bool empty() const;
+
+    /// \brief Returns the changes recorded so far as a changeset
+    ///
+    /// A changeset contains the old values of updated and deleted rows, so that conflicts
+    /// can be detected when it's applied, and so that it can be inverted.
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::vector<std::byte> changeset() const;
+
+    /// \brief Returns the changes recorded so far as a patchset
+    ///
+    /// A patchset is smaller than a changeset, since it only contains the primary key of
+    /// deleted rows and the new values of updated columns. Rows updated or deleted at the
+    /// target are therefore not detected as conflicts when it's applied.
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::vector<std::byte> patchset() const;
+};
+
+/// \brief Applies a changeset or patchset to a database
+///
+/// All changes are applied in a single transaction, or a savepoint if a transaction is
+/// already open. Changes to tables that don't exist in the target, or have different
+/// primary keys, are skipped.
+///
+/// Without a handler, a conflict aborts the whole changeset. Exceptions thrown by the
+/// handler abort it as well, and are rethrown.
+///
+/// \param db An sqlite3 connection
+/// \param changeset The changeset or patchset
+/// \param handler Decides what to do with each conflicting change
+///
+/// \throws Dbpp::Error If the changeset was aborted, or could not be applied
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT void applyChangeset(Dbpp::Connection& db, BlobView changeset, const ConflictHandler& handler = {});
+
+/// \brief Applies a changeset or patchset to a database
+///
+/// \see applyChangeset(Dbpp::Connection&, BlobView, const ConflictHandler&)
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT void applyChangeset(Dbpp::Connection& db, const std::vector<std::byte>& changeset, const ConflictHandler& handler = {});
+
+/// \brief Returns the inverse of a changeset, which undoes its changes
+///
+/// Patchsets can't be inverted.
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT std::vector<std::byte> invertChangeset(BlobView changeset);
+
+} // namespace Dbpp::Sqlite3
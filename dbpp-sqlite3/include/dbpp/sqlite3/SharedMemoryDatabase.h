@@ -0,0 +1,105 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/sqlite3/OpenMode.h>
+#include <dbpp/util.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief A named in-memory database, shared by the connections of the process
+///
+/// A ":memory:" database is private to the connection that opened it. This one is stored by
+/// SQLite's memdb VFS under a name, and every connection returned by connect() uses the
+/// same copy of it. A pool of readers can then query one in-memory dataset concurrently,
+/// instead of each connection holding a duplicate.
+///
+/// The database exists while the object exists, or while a connection to it is open. When
+/// the last of them is gone, the contents are freed. Only one object may use a name at a
+/// time, and the name stays taken until the last connection returned by connect() is
+/// closed, so that a new object never gets the contents of a destroyed one. Connections
+/// opened with uri() directly don't keep the name taken.
+///
+/// Like a database file in rollback journal mode, a writer excludes the readers while it
+/// commits, so the connections should have a busy timeout if there are writes.
+///
+/// \since v1.0.0
+class DBPP_SQLITE3_EXPORT SharedMemoryDatabase {
+    DBPP_NO_COPY_SEMANTICS(SharedMemoryDatabase);
+
+public:
+    class Impl;
+
+private:
+    std::unique_ptr<Impl> impl_;
+
+public:
+    /// \brief Creates an empty database
+    ///
+    /// \param name The name of the database. A unique name is generated if it's empty
+    ///
+    /// \since v1.0.0
+    explicit SharedMemoryDatabase(std::string_view name = {});
+
+    /// \brief Creates a database with a copy of the main database of a connection
+    ///
+    /// \param source The connection to copy from, such as a connection to a database file
+    /// \param name The name of the database. A unique name is generated if it's empty
+    ///
+    /// \since v1.0.0
+    explicit SharedMemoryDatabase(Dbpp::Connection& source, std::string_view name = {});
+
+    SharedMemoryDatabase(SharedMemoryDatabase&&) noexcept;
+    SharedMemoryDatabase& operator=(SharedMemoryDatabase&&) noexcept;
+
+    /// \brief Destructor. The database is freed when the last connection to it is closed
+    ///
+    /// \since v1.0.0
+    ~SharedMemoryDatabase();
+
+    /// \brief Returns the name of the database
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    const std::string& name() const;
+
+    /// \brief Returns the URI that opens the database, when opened with OpenFlag::Uri
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    const std::string& uri() const;
+
+    /// \brief Opens a new connection to the database
+    ///
+    /// \param mode ReadOnly for a connection that only reads. The database always exists, so
+    ///        ReadWrite and ReadWriteCreate are the same
+    /// \param flags Flags affecting how the database is opened. OpenFlag::Uri is always added
+    /// \return The connection
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    Dbpp::Connection connect(OpenMode mode = OpenMode::ReadWrite, OpenFlag flags = OpenFlag::None) const;
+};
+
+} // namespace Dbpp::Sqlite3
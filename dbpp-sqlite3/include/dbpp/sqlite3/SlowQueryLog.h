@@ -0,0 +1,80 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief An entry in the slow query log
+///
+/// \since v1.0.0
+struct SlowQuery {
+    std::string sql; ///< The SQL of the statement, with the bound parameter values expanded
+    std::chrono::nanoseconds duration{0}; ///< Wall time from the first step until the statement was done or reset
+    long long rows = 0; ///< Number of rows produced
+    int vmSteps = 0; ///< Number of virtual machine operations executed
+    bool waitedOnLock = false; ///< True if the connection had to wait for a database lock during the execution
+    int resultCode = 0; ///< The result of the last step: SQLITE_DONE, SQLITE_ROW if the statement was reset before it was done, or the error of a failed step
+};
+
+/// \brief Settings for the slow query log
+///
+/// \since v1.0.0
+struct SlowQueryLog {
+    /// Executions that take at least this long are logged
+    std::chrono::nanoseconds threshold = std::chrono::milliseconds(100);
+
+    /// Only every N:th execution is timed. Use this to bring down the cost of the log on
+    /// busy connections. 1 means that all executions are timed
+    unsigned int sampleEvery = 1;
+
+    /// Called with each slow execution, from the thread that finished it, after the statement
+    /// has handled the result of the step. Exceptions thrown by it are ignored
+    std::function<void(const SlowQuery&)> callback;
+};
+
+/// \brief Enables the slow query log of a connection
+///
+/// The execution of a statement starts with its first step, and ends when it is done, reset,
+/// destroyed or a step fails. Executions that take at least the threshold are reported to the
+/// callback, including the failed ones, such as those that gave up waiting for a lock or were
+/// interrupted. Any previous settings are replaced. When the log is disabled, the statements
+/// only have to check a pointer each time they are stepped.
+///
+/// Waiting for locks only happens if a busy timeout has been set, see setBusyTimeout(). Lock
+/// waits are detected by the busy handler of dbpp, so they are not reported after
+/// "PRAGMA busy_timeout" or sqlite3_busy_timeout() has replaced it.
+///
+/// \param db An sqlite3 connection
+/// \param log The settings for the log. The callback must be set, and sampleEvery must not be 0
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT void enableSlowQueryLog(Dbpp::Connection& db, SlowQueryLog log);
+
+/// \brief Disables the slow query log of a connection
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT void disableSlowQueryLog(Dbpp::Connection& db);
+
+} // namespace Dbpp::Sqlite3
@@ -19,10 +19,31 @@
 
 #include <dbpp/Connection.h>
 #include <dbpp/sqlite3/exports.h>
+#include <dbpp/sqlite3/BackupJob.h>
+#include <dbpp/sqlite3/Cancellation.h>
+#include <dbpp/sqlite3/Changes.h>
+#include <dbpp/sqlite3/CheckpointManager.h>
+#include <dbpp/sqlite3/Functions.h>
+#include <dbpp/sqlite3/GlobalConfig.h>
+#include <dbpp/sqlite3/Maintenance.h>
+#include <dbpp/sqlite3/MemoryGovernor.h>
+#include <dbpp/sqlite3/OpenMode.h>
+#include <dbpp/sqlite3/Profiler.h>
+#include <dbpp/sqlite3/QueryCache.h>
+#include <dbpp/sqlite3/QueryPlan.h>
+#include <dbpp/sqlite3/Session.h>
+#include <dbpp/sqlite3/SharedMemoryDatabase.h>
+#include <dbpp/sqlite3/SlowQueryLog.h>
+#include <dbpp/sqlite3/Stats.h>
+#include <dbpp/sqlite3/VirtualTable.h>
 #include <dbpp/util.h>
 
+#include <chrono>
+#include <cstddef>
 #include <filesystem>
 #include <functional>
+#include <string_view>
+#include <vector>
 #include <sqlite3.h>
 
 /// \brief Namespace specific to the SQLite3 adapter
@@ -30,30 +51,12 @@
 /// \since v1.0.0
 namespace Dbpp::Sqlite3 {
 
-/// \brief Specifies the mode in which to open an SQLite3 database
+/// \brief Specifies how openFromMemory() uses a database image
 ///
 /// \since v1.0.0
-enum class OpenMode : unsigned int {
-    ReadOnly = SQLITE_OPEN_READONLY, /// Open it in read only mode. Fail if it does not exist
-    ReadWrite = SQLITE_OPEN_READWRITE, /// Open it in read-write mode. Fail if it does not exist
-    ReadWriteCreate = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, /// Open it in read-write mode, and create it if it does not exist
-};
-
-/// \brief Specifies how to open an SQLite3 database
-///
-/// \since v1.0.0
-enum class OpenFlag : unsigned int {
-    None = 0,
-    Uri = SQLITE_OPEN_URI, /// The filename can be interpreted as a URI if this flag is set
-    Memory = SQLITE_OPEN_MEMORY, /// The database will be opened as an in-memory database
-    NoMutex = SQLITE_OPEN_NOMUTEX, /// The new database connection will use the "multi-thread" threading mode. This means that separate threads are allowed to use SQLite at the same time, as long as each thread is using a different database connection
-    FullMutex = SQLITE_OPEN_FULLMUTEX, /// The new database connection will use the "serialized" threading mode. This means the multiple threads can safely attempt to use the same database connection at the same time
-    SharedCache = SQLITE_OPEN_SHAREDCACHE, /// The database is opened with shared cache enabled, overriding the default shared cache setting
-    PrivateCache = SQLITE_OPEN_PRIVATECACHE, /// The database is opened with shared cache disabled, overriding the default shared cache setting
-
-#ifdef SQLITE_OPEN_NOFOLLOW
-    NoFollow = SQLITE_OPEN_NOFOLLOW, /// The database filename is not allowed to be a symbolic link
-#endif
+enum class ImageMode {
+    Copy, ///< The image is copied, and the database can be modified and grow
+    BorrowReadOnly, ///< The image is used in place, and the database is read only. The image must outlive the connection
 };
 
 /// \brief Opens an SQLite3 database, and returns a connection to it
@@ -85,6 +88,58 @@ DBPP_SQLITE3_EXPORT Connection open(const std::filesystem::path &file, OpenMode
 /// \since v1.0.0
 DBPP_SQLITE3_EXPORT Connection open(const std::filesystem::path &file, OpenMode mode, OpenFlag flags);
 
+/// \brief Opens an in-memory SQLite3 database from an image of a database file
+///
+/// The image is typically the contents of a database file, or the result of serialize().
+/// Opening an image is much faster than restoring it page by page with backup(), and a
+/// copied image is independent of the original, so one image can be opened many times as
+/// scratch databases. A borrowed image is not copied at all, which suits a read only file
+/// mapped into memory.
+///
+/// \param image The database image
+/// \param mode Whether the image is copied, or borrowed and read only
+/// \param flags Flags affecting how the database is opened
+/// \return A connection to the database, with the image as its main database
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT Connection openFromMemory(BlobView image, ImageMode mode = ImageMode::Copy, OpenFlag flags = OpenFlag::None);
+
+/// \brief Opens an in-memory SQLite3 database from a copy of an image of a database file
+///
+/// \see openFromMemory(BlobView, ImageMode, OpenFlag)
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT Connection openFromMemory(const std::vector<std::byte>& image, OpenFlag flags = OpenFlag::None);
+
+/// \brief Returns an image of a database, as it would be stored in a database file
+///
+/// The image can be written to a file, or opened with openFromMemory().
+///
+/// \param db An sqlite3 connection
+/// \param schema The database to serialize, "main" or the name of an attached database
+/// \return The database image. It's empty if the database doesn't have any pages
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT std::vector<std::byte> serialize(Dbpp::Connection& db, std::string_view schema = "main");
+
+/// \brief Sets how long a connection waits for a database lock
+///
+/// When another connection holds a conflicting lock, the connection sleeps and retries until
+/// the lock is free or the timeout expires, after which the operation fails with SQLITE_BUSY.
+/// The default is to fail immediately.
+///
+/// The waiting is done by a busy handler that also counts the lock waits reported by the slow
+/// query log, and that stops waiting when the query limits of the connection are exceeded.
+/// "PRAGMA busy_timeout" and sqlite3_busy_timeout() replace that handler, so use this function
+/// instead. Calling it again installs the handler again.
+///
+/// \param db An sqlite3 connection
+/// \param timeout The longest time to wait for a lock. Zero disables waiting
+///
+/// \since v1.0.0
+DBPP_SQLITE3_EXPORT void setBusyTimeout(Dbpp::Connection& db, std::chrono::milliseconds timeout);
+
 /// \brief Backs up an SQLite3 database
 ///
 /// \param db A connection to the database that should be backed up
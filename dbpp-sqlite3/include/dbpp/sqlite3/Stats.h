@@ -0,0 +1,90 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief Process wide memory statistics of SQLite, from sqlite3_status64()
+///
+/// \since v1.0.0
+struct MemoryStats {
+    long long memoryUsed = 0; ///< Bytes of memory currently allocated by SQLite
+    long long memoryUsedHighwater = 0; ///< The highest value of memoryUsed
+    long long mallocCount = 0; ///< Number of currently outstanding allocations
+    long long mallocCountHighwater = 0; ///< The highest value of mallocCount
+    long long largestAllocation = 0; ///< Size in bytes of the largest allocation request
+    long long pageCacheUsed = 0; ///< Number of pages used from the SQLITE_CONFIG_PAGECACHE memory
+    long long pageCacheOverflow = 0; ///< Bytes of page cache allocations that didn't fit in the SQLITE_CONFIG_PAGECACHE memory
+    long long pageCacheOverflowHighwater = 0; ///< The highest value of pageCacheOverflow
+    long long largestPageCacheAllocation = 0; ///< Size in bytes of the largest page cache allocation request
+};
+
+/// \brief Memory and cache statistics of a connection, from sqlite3_db_status()
+///
+/// \since v1.0.0
+struct ConnectionStats {
+    long long cacheHits = 0; ///< Number of page cache hits
+    long long cacheMisses = 0; ///< Number of page cache misses
+    long long cacheWrites = 0; ///< Number of dirty pages written to disk
+    long long cacheSpills = 0; ///< Number of dirty pages written to disk in the middle of a transaction, since the cache was full
+    long long cacheUsed = 0; ///< Bytes of heap memory used by the page caches
+    long long cacheUsedShared = 0; ///< Like cacheUsed, but shared caches are divided evenly between the connections using them
+    long long lookasideUsed = 0; ///< Number of lookaside memory slots currently in use
+    long long lookasideUsedHighwater = 0; ///< The highest value of lookasideUsed
+    long long lookasideHits = 0; ///< Number of allocations satisfied from lookaside memory
+    long long lookasideMissesSize = 0; ///< Number of allocations too large for lookaside memory
+    long long lookasideMissesFull = 0; ///< Number of allocations that missed lookaside memory since it was full
+    long long schemaUsed = 0; ///< Bytes of heap memory used to store the schemas
+    long long statementUsed = 0; ///< Bytes of heap memory used by the prepared statements
+    bool deferredForeignKeys = false; ///< True if there are unresolved deferred foreign key constraints
+    MemoryStats memory; ///< The process wide memory statistics, at the time of the snapshot
+
+    /// \brief Returns the page cache hit ratio, or 0 if the cache hasn't been used
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    double cacheHitRatio() const {
+        const auto lookups = cacheHits + cacheMisses;
+        return lookups == 0 ? 0.0 : static_cast<double>(cacheHits) / static_cast<double>(lookups);
+    }
+};
+
+/// \brief Returns the memory and cache statistics of a connection
+///
+/// \param db An sqlite3 connection
+/// \param reset If true, the counters and highwater marks of the connection are reset after
+///        being read, so the next snapshot covers the interval since this one. The process
+///        wide highwater marks of ConnectionStats::memory are shared by all connections, and
+///        are only reset by memoryStats()
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT ConnectionStats stats(Dbpp::Connection& db, bool reset = false);
+
+/// \brief Returns the process wide memory statistics of SQLite
+///
+/// \param resetHighwater If true, the highwater marks are reset after being read
+///
+/// \since v1.0.0
+[[nodiscard]]
+DBPP_SQLITE3_EXPORT MemoryStats memoryStats(bool resetHighwater = false);
+
+} // namespace Dbpp::Sqlite3
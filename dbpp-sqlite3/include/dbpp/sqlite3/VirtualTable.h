@@ -0,0 +1,553 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/Connection.h>
+#include <dbpp/sqlite3/exports.h>
+#include <dbpp/sqlite3/Functions.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <sqlite3.h>
+
+namespace Dbpp::Sqlite3 {
+
+/// \brief Flags describing a column of a VirtualTable
+///
+/// \since v1.0.0
+enum class ColumnFlag : unsigned int {
+    None = 0,
+    Sorted = 1, ///< The rows are sorted in ascending order by this column, so equality constraints can be served by binary search
+};
+
+namespace Detail {
+
+    // Orders a C++ value against an SQL value, like SQLite orders values: numbers before text
+    // before blobs, with text compared as by the BINARY collation. NULL is ordered first.
+    // The affinity of the column is applied to the value first, as SQLite does when a column
+    // is compared to a literal or a parameter: text is converted to a number for numeric
+    // columns, and numbers to text for text columns
+    template <typename F>
+    int compareToValue(const F& field, sqlite3_value* value) {
+        auto order = [](const auto& a, const auto& b) { return (a > b) - (a < b); };
+        if constexpr (IsOptional<F>::value) {
+            if (!field)
+                return sqlite3_value_type(value) == SQLITE_NULL ? 0 : -1;
+            return compareToValue(*field, value);
+        } else {
+            const int type = std::is_arithmetic_v<F> ? sqlite3_value_numeric_type(value) : sqlite3_value_type(value);
+            if (type == SQLITE_NULL)
+                return 1;
+            if constexpr (std::is_arithmetic_v<F>) {
+                if (type == SQLITE_INTEGER) {
+                    const auto v = sqlite3_value_int64(value);
+                    if constexpr (std::is_floating_point_v<F>) {
+                        return order(static_cast<double>(field), static_cast<double>(v));
+                    } else if constexpr (std::is_unsigned_v<F>) {
+                        return v < 0 ? 1 : order(static_cast<unsigned long long>(field), static_cast<unsigned long long>(v));
+                    } else {
+                        return order(static_cast<long long>(field), static_cast<long long>(v));
+                    }
+                }
+                if (type == SQLITE_FLOAT)
+                    return order(static_cast<double>(field), sqlite3_value_double(value));
+                return -1; // Numbers come before text and blobs
+            } else if constexpr (std::is_same_v<F, std::string> || std::is_same_v<F, std::string_view>) {
+                if (type == SQLITE_BLOB)
+                    return -1;
+                // Numbers are compared as the text SQLite converts them to
+                return order(std::string_view(field).compare(fromValue<std::string_view>(value)), 0);
+            } else if constexpr (IsByteVector<F>::value) {
+                if (type != SQLITE_BLOB)
+                    return 1;
+                const auto blob = fromValue<BlobView>(value);
+                const auto common = std::min(field.size(), blob.size);
+                const int res = common ? std::memcmp(field.data(), blob.data, common) : 0;
+                return res != 0 ? order(res, 0) : order(field.size(), blob.size);
+            } else {
+                static_assert(AlwaysFalseV<F>, "Unsupported virtual table column type");
+            }
+        }
+    }
+
+    // The declared SQL type of a column
+    template <typename F>
+    constexpr const char* sqlType() {
+        if constexpr (IsOptional<F>::value)
+            return sqlType<typename F::value_type>();
+        else if constexpr (std::is_integral_v<F>)
+            return "INTEGER";
+        else if constexpr (std::is_floating_point_v<F>)
+            return "REAL";
+        else if constexpr (IsByteVector<F>::value)
+            return "BLOB";
+        else
+            return "TEXT";
+    }
+
+    // Sets the result to a value that stays unchanged while the statement runs, without copying it
+    template <typename F>
+    void setStaticResult(sqlite3_context* context, const F& value) {
+        if constexpr (IsOptional<F>::value) {
+            if (value)
+                setStaticResult(context, *value);
+            else
+                sqlite3_result_null(context);
+        } else if constexpr (std::is_same_v<F, std::string> || std::is_same_v<F, std::string_view>) {
+            sqlite3_result_text64(context, value.data(), value.size(), SQLITE_STATIC, SQLITE_UTF8); // NOLINT
+        } else if constexpr (IsByteVector<F>::value) {
+            sqlite3_result_blob64(context, value.data(), value.size(), SQLITE_STATIC); // NOLINT
+        } else {
+            setResult(context, value);
+        }
+    }
+
+    // Registers a module. The connection takes over the user data, even if it fails
+    DBPP_SQLITE3_EXPORT void createModule(Dbpp::Connection& db, std::string_view name, const sqlite3_module* module,
+                                          UserData userData);
+
+} // namespace Detail
+
+/// \brief Exposes the rows of a C++ container to SQL, as a read-only virtual table
+///
+/// The columns are defined by calling column() with a data member pointer, a member function
+/// pointer or any other callable taking a row. The table reads the rows directly from the
+/// container. Text and blob data members are returned to SQLite without being copied.
+///
+/// The rowid of a row is its index in the container. Equality constraints on the rowid are
+/// looked up directly, and equality constraints on columns with ColumnFlag::Sorted are served
+/// by binary search. Other equality constraints are checked in C++, before SQLite sees the row.
+/// These comparisons apply the affinity of the declared column type to the value, like SQLite
+/// does for literals and parameters, so WHERE name = 30 matches a name of "30".
+///
+/// \code
+/// struct Price {
+///     std::int64_t id;
+///     std::string symbol;
+///     double value;
+/// };
+/// std::vector<Price> prices = loadPrices(); // Sorted by id
+///
+/// VirtualTable<Price> table(prices);
+/// table.column("id", &Price::id, ColumnFlag::Sorted)
+///      .column("symbol", &Price::symbol)
+///      .column("value", &Price::value);
+/// registerVirtualTable(db, "prices", std::move(table));
+/// db.statement("SELECT o.id, p.value FROM orders o JOIN prices p ON p.id = o.price_id");
+/// \endcode
+///
+/// \tparam T The type of the rows
+///
+/// \since v1.0.0
+template <typename T>
+class VirtualTable {
+    struct Column {
+        std::string name;
+        const char* type;
+        ColumnFlag flags;
+        std::function<void(sqlite3_context*, const T&)> result;
+        std::function<int(const T&, sqlite3_value*)> compare;
+    };
+
+    std::function<std::size_t()> size_;
+    std::function<const T&(std::size_t)> row_;
+    std::vector<Column> columns_;
+
+    struct Table : sqlite3_vtab {
+        const VirtualTable* definition = nullptr;
+    };
+
+    // A filter that is checked for each row
+    struct Filter {
+        int column; // -1 is the rowid
+        sqlite3_value* value;
+    };
+
+    struct Cursor : sqlite3_vtab_cursor {
+        const VirtualTable* definition = nullptr;
+        std::size_t position = 0;
+        std::size_t end = 0;
+        std::vector<Filter> filters;
+
+        void clearFilters() {
+            for (auto& filter : filters)
+                sqlite3_value_free(filter.value);
+            filters.clear();
+        }
+
+        ~Cursor() { clearFilters(); }
+
+        [[nodiscard]]
+        bool matches() const {
+            for (const auto& filter : filters) {
+                if (filter.column < 0) {
+                    if (sqlite3_value_numeric_type(filter.value) != SQLITE_INTEGER
+                        || sqlite3_value_int64(filter.value) != static_cast<sqlite3_int64>(position))
+                        return false;
+                } else if (definition->columns_[static_cast<std::size_t>(filter.column)].compare(definition->row_(position), filter.value) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void skipToMatch() {
+            while (position < end && !matches())
+                ++position;
+        }
+    };
+
+    // Runs a callback, turning exceptions into SQLite error codes
+    template <typename F>
+    static int guarded(sqlite3_vtab* table, F&& callback) noexcept {
+        try {
+            return std::forward<F>(callback)();
+        } catch (const std::bad_alloc&) {
+            return SQLITE_NOMEM;
+        } catch (const std::exception& e) {
+            sqlite3_free(table->zErrMsg);
+            table->zErrMsg = sqlite3_mprintf("%s", e.what());
+            return SQLITE_ERROR;
+        } catch (...) {
+            return SQLITE_ERROR;
+        }
+    }
+
+    static bool isBinaryCollation(sqlite3_index_info* info, int constraint) {
+        const char* collation = sqlite3_vtab_collation(info, constraint);
+        return !collation || sqlite3_stricmp(collation, "BINARY") == 0;
+    }
+
+    static int xConnect(sqlite3* db, void* aux, int /* argc */, const char* const* /* argv */, sqlite3_vtab** result, char** /* error */) {
+        const auto* definition = static_cast<const VirtualTable*>(aux);
+        std::string sql = "CREATE TABLE x(";
+        for (const auto& column : definition->columns_) {
+            if (&column != &definition->columns_.front())
+                sql += ", ";
+            sql += '"';
+            for (char c : column.name)
+                sql.append(c == '"' ? 2 : 1, c);
+            sql += "\" ";
+            sql += column.type;
+        }
+        sql += ')';
+        int res = sqlite3_declare_vtab(db, sql.c_str());
+        if (res != SQLITE_OK)
+            return res;
+
+        auto* table = new (std::nothrow) Table();
+        if (!table)
+            return SQLITE_NOMEM;
+        table->definition = definition;
+        *result = table;
+        return SQLITE_OK;
+    }
+
+    static int xDisconnect(sqlite3_vtab* table) {
+        delete static_cast<Table*>(table); // NOLINT
+        return SQLITE_OK;
+    }
+
+    // The plan is passed to xFilter() as the index string, with a letter and a column for each
+    // argument: r for a rowid lookup, s for a binary search and f for a filter
+    static int xBestIndex(sqlite3_vtab* vtab, sqlite3_index_info* info) {
+        return guarded(vtab, [&]() {
+            const auto& definition = *static_cast<Table*>(vtab)->definition;
+            int rowidConstraint = -1;
+            int sortedConstraint = -1;
+            std::vector<int> filterConstraints;
+            for (int i = 0; i < info->nConstraint; ++i) {
+                const auto& constraint = info->aConstraint[i]; // NOLINT
+                if (!constraint.usable || constraint.op != SQLITE_INDEX_CONSTRAINT_EQ)
+                    continue;
+                if (constraint.iColumn < 0) {
+                    if (rowidConstraint < 0)
+                        rowidConstraint = i;
+                    else
+                        filterConstraints.push_back(i);
+                } else if (isBinaryCollation(info, i)) {
+                    const auto flags = definition.columns_[static_cast<std::size_t>(constraint.iColumn)].flags;
+                    if (flags == ColumnFlag::Sorted && sortedConstraint < 0)
+                        sortedConstraint = i;
+                    else
+                        filterConstraints.push_back(i);
+                }
+            }
+
+            std::string plan;
+            int argvIndex = 0;
+            auto use = [&](int constraint, char kind) {
+                info->aConstraintUsage[constraint].argvIndex = ++argvIndex; // NOLINT
+                info->aConstraintUsage[constraint].omit = 1; // NOLINT
+                plan += kind;
+                plan += std::to_string(info->aConstraint[constraint].iColumn); // NOLINT
+                plan += ',';
+            };
+            if (rowidConstraint >= 0)
+                use(rowidConstraint, 'r');
+            if (sortedConstraint >= 0)
+                use(sortedConstraint, 's');
+            for (int constraint : filterConstraints)
+                use(constraint, 'f');
+
+            const auto rows = static_cast<double>(std::max<std::size_t>(definition.size_(), 1));
+            if (rowidConstraint >= 0) {
+                info->estimatedCost = 1.0;
+                info->estimatedRows = 1;
+                info->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+            } else if (sortedConstraint >= 0) {
+                info->estimatedCost = std::log2(rows) + 10.0;
+                info->estimatedRows = 10;
+            } else {
+                info->estimatedCost = rows;
+                info->estimatedRows = static_cast<sqlite3_int64>(rows / std::pow(10.0, static_cast<double>(filterConstraints.size())));
+            }
+
+            // The rows are always returned in the order of the container
+            if (info->nOrderBy == 1 && !info->aOrderBy[0].desc) {
+                const int column = info->aOrderBy[0].iColumn;
+                if (column < 0 || definition.columns_[static_cast<std::size_t>(column)].flags == ColumnFlag::Sorted)
+                    info->orderByConsumed = 1;
+            }
+
+            if (!plan.empty()) {
+                info->idxStr = sqlite3_mprintf("%s", plan.c_str());
+                if (!info->idxStr)
+                    return SQLITE_NOMEM;
+                info->needToFreeIdxStr = 1;
+            }
+            return SQLITE_OK;
+        });
+    }
+
+    static int xOpen(sqlite3_vtab* vtab, sqlite3_vtab_cursor** result) {
+        auto* cursor = new (std::nothrow) Cursor();
+        if (!cursor)
+            return SQLITE_NOMEM;
+        cursor->definition = static_cast<Table*>(vtab)->definition;
+        *result = cursor;
+        return SQLITE_OK;
+    }
+
+    static int xClose(sqlite3_vtab_cursor* cursor) {
+        delete static_cast<Cursor*>(cursor); // NOLINT
+        return SQLITE_OK;
+    }
+
+    static int xFilter(sqlite3_vtab_cursor* vtabCursor, int /* idxNum */, const char* idxStr, int argc, sqlite3_value** argv) {
+        auto& cursor = *static_cast<Cursor*>(vtabCursor);
+        return guarded(vtabCursor->pVtab, [&]() {
+            const auto& definition = *cursor.definition;
+            cursor.clearFilters();
+            std::size_t begin = 0;
+            std::size_t end = definition.size_();
+
+            const char* plan = idxStr ? idxStr : "";
+            for (int i = 0; i < argc && *plan; ++i) {
+                const char kind = *plan++;
+                char* next = nullptr;
+                const auto column = static_cast<int>(std::strtol(plan, &next, 10));
+                plan = *next == ',' ? next + 1 : next;
+                sqlite3_value* value = argv[i]; // NOLINT
+
+                if (sqlite3_value_type(value) == SQLITE_NULL) {
+                    end = begin; // Nothing equals NULL
+                } else if (kind == 'r') {
+                    if (sqlite3_value_numeric_type(value) == SQLITE_INTEGER) {
+                        const auto rowid = sqlite3_value_int64(value);
+                        const auto position = static_cast<std::size_t>(rowid);
+                        if (rowid >= 0 && position >= begin && position < end) {
+                            begin = position;
+                            end = position + 1;
+                        } else {
+                            end = begin;
+                        }
+                    } else {
+                        end = begin;
+                    }
+                } else if (kind == 's') {
+                    const auto& compare = definition.columns_[static_cast<std::size_t>(column)].compare;
+                    auto bound = [&](std::size_t first, std::size_t last, bool upper) {
+                        while (first < last) {
+                            const auto middle = first + (last - first) / 2;
+                            const int order = compare(definition.row_(middle), value);
+                            if (order < 0 || (upper && order == 0))
+                                first = middle + 1;
+                            else
+                                last = middle;
+                        }
+                        return first;
+                    };
+                    const auto lower = bound(begin, end, false);
+                    end = bound(lower, end, true);
+                    begin = lower;
+                } else {
+                    sqlite3_value* copy = sqlite3_value_dup(value);
+                    if (!copy)
+                        return SQLITE_NOMEM;
+                    cursor.filters.push_back({column, copy});
+                }
+            }
+
+            cursor.position = begin;
+            cursor.end = std::max(begin, end);
+            cursor.skipToMatch();
+            return SQLITE_OK;
+        });
+    }
+
+    static int xNext(sqlite3_vtab_cursor* vtabCursor) {
+        auto& cursor = *static_cast<Cursor*>(vtabCursor);
+        return guarded(vtabCursor->pVtab, [&]() {
+            ++cursor.position;
+            cursor.skipToMatch();
+            return SQLITE_OK;
+        });
+    }
+
+    static int xEof(sqlite3_vtab_cursor* vtabCursor) {
+        const auto& cursor = *static_cast<Cursor*>(vtabCursor);
+        return cursor.position >= cursor.end ? 1 : 0;
+    }
+
+    static int xColumn(sqlite3_vtab_cursor* vtabCursor, sqlite3_context* context, int index) {
+        const auto& cursor = *static_cast<Cursor*>(vtabCursor);
+        return guarded(vtabCursor->pVtab, [&]() {
+            const auto& definition = *cursor.definition;
+            definition.columns_[static_cast<std::size_t>(index)].result(context, definition.row_(cursor.position));
+            return SQLITE_OK;
+        });
+    }
+
+    static int xRowid(sqlite3_vtab_cursor* vtabCursor, sqlite3_int64* result) {
+        *result = static_cast<sqlite3_int64>(static_cast<Cursor*>(vtabCursor)->position);
+        return SQLITE_OK;
+    }
+
+    template <typename U>
+    friend void registerVirtualTable(Dbpp::Connection& db, std::string_view name, VirtualTable<U> table);
+
+    static const sqlite3_module* sqliteModule() {
+        static const sqlite3_module module = []() {
+            sqlite3_module m{};
+            m.iVersion = 1;
+            m.xCreate = nullptr; // Eponymous only
+            m.xConnect = &VirtualTable::xConnect;
+            m.xBestIndex = &VirtualTable::xBestIndex;
+            m.xDisconnect = &VirtualTable::xDisconnect;
+            m.xDestroy = &VirtualTable::xDisconnect;
+            m.xOpen = &VirtualTable::xOpen;
+            m.xClose = &VirtualTable::xClose;
+            m.xFilter = &VirtualTable::xFilter;
+            m.xNext = &VirtualTable::xNext;
+            m.xEof = &VirtualTable::xEof;
+            m.xColumn = &VirtualTable::xColumn;
+            m.xRowid = &VirtualTable::xRowid;
+            return m;
+        }();
+        return &module;
+    }
+
+public:
+    /// \brief Creates a table of the rows in a container
+    ///
+    /// \param rows A random access container or range, such as std::vector or std::deque. It is
+    ///             referred to, not copied, so it must outlive the table. It may be changed
+    ///             between statements, but not while a statement that reads the table runs
+    ///
+    /// \since v1.0.0
+    template <typename Range>
+    explicit VirtualTable(const Range& rows)
+    : size_([&rows]() { return static_cast<std::size_t>(std::size(rows)); })
+    , row_([&rows](std::size_t index) -> const T& { return rows[index]; })
+    {}
+
+    /// \brief Creates a table of the rows in a temporary container, which the table takes over
+    ///
+    /// \param rows A random access container, such as std::vector or std::deque. It is moved
+    ///             into the table, so the rows can't be changed afterwards
+    ///
+    /// \since v1.0.0
+    template <typename Range, typename = std::enable_if_t<!std::is_lvalue_reference_v<Range> && !std::is_same_v<std::decay_t<Range>, VirtualTable>>>
+    explicit VirtualTable(Range&& rows)
+    {
+        auto owned = std::make_shared<const std::decay_t<Range>>(std::move(rows));
+        size_ = [owned]() { return static_cast<std::size_t>(std::size(*owned)); };
+        row_ = [owned](std::size_t index) -> const T& { return (*owned)[index]; };
+    }
+
+    /// \brief Adds a column
+    ///
+    /// \param name The name of the column
+    /// \param getter A pointer to a data member or member function of T, or a callable taking a
+    ///               const T&. Text and blob data members are returned without being copied.
+    ///               The supported types are those that can be returned from functions, see registerFunction()
+    /// \param flags Flags describing the column
+    /// \return The table, so calls can be chained
+    ///
+    /// \since v1.0.0
+    template <typename Getter>
+    VirtualTable& column(std::string name, Getter getter, ColumnFlag flags = ColumnFlag::None) {
+        using ResultT = std::invoke_result_t<const Getter&, const T&>;
+        using ValueT = std::remove_cv_t<std::remove_reference_t<ResultT>>;
+
+        Column c{std::move(name), Detail::sqlType<ValueT>(), flags, {}, {}};
+        c.result = [getter](sqlite3_context* context, const T& row) {
+            if constexpr (std::is_reference_v<ResultT>)
+                Detail::setStaticResult(context, std::invoke(getter, row));
+            else
+                Detail::setResult(context, std::invoke(getter, row));
+        };
+        c.compare = [getter](const T& row, sqlite3_value* value) {
+            return Detail::compareToValue(std::invoke(getter, row), value);
+        };
+        columns_.push_back(std::move(c));
+        return *this;
+    }
+};
+
+/// \brief Registers a virtual table on a connection
+///
+/// The table is eponymous, so it can be used in queries by its name directly, without
+/// CREATE VIRTUAL TABLE. Registering a table with the same name again replaces it.
+///
+/// \param db An sqlite3 connection
+/// \param name The name of the table
+/// \param table The table, which must have at least one column
+///
+/// \since v1.0.0
+template <typename T>
+void registerVirtualTable(Dbpp::Connection& db, std::string_view name, VirtualTable<T> table) {
+    if (table.columns_.empty())
+        throw Dbpp::Error("A virtual table must have at least one column");
+    Detail::UserData userData(new VirtualTable<T>(std::move(table)), &Detail::destroy<VirtualTable<T>>);
+    Detail::createModule(db, name, VirtualTable<T>::sqliteModule(), std::move(userData));
+}
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,341 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/BackupJob.h>
+
+#include "ConnectionState.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    struct DbDeleter {
+        void operator()(sqlite3* p) const { sqlite3_close_v2(p); }
+    };
+
+    struct BackupDeleter {
+        void operator()(sqlite3_backup* p) const { sqlite3_backup_finish(p); }
+    };
+
+    struct StmtDeleter {
+        void operator()(sqlite3_stmt* p) const { sqlite3_finalize(p); }
+    };
+
+    bool isBusy(int res) {
+        const int primary = res & 0xff;
+        return primary == SQLITE_BUSY || primary == SQLITE_LOCKED;
+    }
+
+    // Scales the number of pages per step towards the target step time, by at most a factor of two
+    int adjustPagesPerStep(int pages, std::chrono::nanoseconds elapsed, const BackupOptions& options) {
+        double factor = 2.0;
+        if (elapsed.count() > 0)
+            factor = std::clamp(static_cast<double>(std::chrono::nanoseconds(options.maxStepTime).count()) / static_cast<double>(elapsed.count()), 0.5, 2.0);
+        const auto scaled = static_cast<int>(std::min(static_cast<double>(pages) * factor, static_cast<double>(options.maxPagesPerStep)));
+        return std::clamp(scaled, options.minPagesPerStep, options.maxPagesPerStep);
+    }
+
+} // namespace
+
+class BackupJob::Impl {
+    ConnectionStatePtr state_;
+    std::filesystem::path destination_;
+    BackupOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    BackupStatus status_ = BackupStatus::Running;
+    bool pauseRequested_ = false;
+    bool cancelRequested_ = false;
+    bool usedVacuumInto_ = false;
+    BackupProgress progress_;
+    std::exception_ptr error_;
+
+    // Sleeps for the interval, and then while paused. Returns false if the job was cancelled
+    bool sleepBetweenSteps() {
+        std::unique_lock lock(mutex_);
+        changed_.wait_for(lock, options_.interval, [this] { return cancelRequested_; });
+        changed_.wait(lock, [this] { return cancelRequested_ || !pauseRequested_; });
+        if (!cancelRequested_)
+            status_ = BackupStatus::Running;
+        return !cancelRequested_;
+    }
+
+    void setProgress(const BackupProgress& progress) {
+        {
+            std::lock_guard lock(mutex_);
+            progress_ = progress;
+        }
+        if (options_.progressCallback)
+            options_.progressCallback(progress);
+    }
+
+    // Returns false if the job was cancelled
+    bool onlineBackup() {
+        std::unique_ptr<sqlite3, DbDeleter> dest;
+        {
+            sqlite3* p = nullptr;
+            const int res = sqlite3_open_v2(destination_.u8string().c_str(), &p,
+                                            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, nullptr);
+            dest.reset(p);
+            throwOnError(res, "Failed to open backup file");
+        }
+
+        std::unique_ptr<sqlite3_backup, BackupDeleter> backup(sqlite3_backup_init(dest.get(), "main", state_->db(), "main"));
+        if (!backup)
+            throwOnError(sqlite3_errcode(dest.get()), "Failed to create backup handle");
+
+        BackupProgress progress;
+        int pages = std::clamp(64, options_.minPagesPerStep, options_.maxPagesPerStep);
+        int copied = 0;
+        for (;;) {
+            const auto started = std::chrono::steady_clock::now();
+            const int res = sqlite3_backup_step(backup.get(), pages);
+            const auto elapsed = std::chrono::steady_clock::now() - started;
+            if (res == SQLITE_DONE)
+                break;
+            if (!isBusy(res)) {
+                throwOnError(res, "Backup operation failed");
+
+                progress.totalPages = sqlite3_backup_pagecount(backup.get());
+                progress.remainingPages = sqlite3_backup_remaining(backup.get());
+                progress.pagesPerStep = pages;
+                // Without a restart, each step adds its pages to the ones already copied
+                const int nowCopied = progress.totalPages - progress.remainingPages;
+                if (nowCopied < copied + pages)
+                    ++progress.restarts;
+                copied = nowCopied;
+                setProgress(progress);
+
+                if (options_.vacuumIntoAfterRestarts >= 0 && progress.restarts > options_.vacuumIntoAfterRestarts)
+                    return vacuumInto(std::move(backup), std::move(dest));
+                pages = adjustPagesPerStep(pages, elapsed, options_);
+            }
+            if (!sleepBetweenSteps())
+                return false;
+        }
+        progress.remainingPages = 0;
+        setProgress(progress);
+        return true;
+    }
+
+    // Returns false if the job was cancelled
+    bool vacuumInto(std::unique_ptr<sqlite3_backup, BackupDeleter> backup, std::unique_ptr<sqlite3, DbDeleter> dest) {
+        // Finishing the unfinished backup rolls back what it wrote, so the destination is as it was
+        backup.reset();
+        dest.reset();
+
+        // VACUUM INTO needs an empty destination. The copy is made next to the destination, and
+        // only replaces it when it's complete, so a failed or cancelled job leaves it as it was
+        auto temporary = destination_;
+        temporary += "-vacuum";
+        bool completed = false;
+        try {
+            completed = vacuumIntoFile(temporary);
+        } catch (...) {
+            std::error_code ignored;
+            std::filesystem::remove(temporary, ignored);
+            throw;
+        }
+        if (!completed) {
+            std::filesystem::remove(temporary);
+            return false;
+        }
+        std::filesystem::rename(temporary, destination_);
+
+        std::lock_guard lock(mutex_);
+        usedVacuumInto_ = true;
+        progress_.remainingPages = 0;
+        return true;
+    }
+
+    // Opens a read only connection to the source, so that VACUUM INTO neither holds the mutex
+    // of the application's connection nor runs under its progress handler, limits and hooks
+    [[nodiscard]]
+    std::unique_ptr<sqlite3, DbDeleter> openSource() const {
+        const char* file = sqlite3_db_filename(state_->db(), "main");
+        if (file == nullptr || *file == '\0')
+            throw Dbpp::Error("VACUUM INTO can only be used with a database file");
+        sqlite3* p = nullptr;
+        const int res = sqlite3_open_v2(file, &p, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, state_->vfsName());
+        std::unique_ptr<sqlite3, DbDeleter> db(p);
+        throwOnError(res, "Failed to open connection for VACUUM INTO");
+        return db;
+    }
+
+    // Returns false if the job was cancelled
+    bool vacuumIntoFile(const std::filesystem::path& path) {
+        std::filesystem::remove(path);
+        const auto source = openSource();
+        sqlite3_stmt* p = nullptr;
+        throwOnError(sqlite3_prepare_v2(source.get(), "VACUUM INTO ?", -1, &p, nullptr), "Failed to prepare VACUUM INTO");
+        std::unique_ptr<sqlite3_stmt, StmtDeleter> stmt(p);
+        const auto file = path.u8string();
+        throwOnError(sqlite3_bind_text(stmt.get(), 1, file.c_str(), static_cast<int>(file.size()), SQLITE_STATIC), "Failed to bind backup file name");
+        for (;;) {
+            const int res = sqlite3_step(stmt.get());
+            if (res == SQLITE_DONE)
+                return true;
+            if (!isBusy(res))
+                throwOnError(res, "VACUUM INTO failed");
+            (void) sqlite3_reset(stmt.get());
+            std::filesystem::remove(path);
+            if (!sleepBetweenSteps())
+                return false;
+        }
+    }
+
+public:
+    Impl(ConnectionStatePtr state, std::filesystem::path destination, BackupOptions options)
+    : state_(std::move(state)),
+      destination_(std::move(destination)),
+      options_(std::move(options))
+    {
+        if (options_.minPagesPerStep < 1 || options_.maxPagesPerStep < options_.minPagesPerStep)
+            throw Dbpp::Error("Invalid number of pages per backup step");
+    }
+
+    void run() {
+        BackupStatus status = BackupStatus::Failed;
+        try {
+            status = onlineBackup() ? BackupStatus::Completed : BackupStatus::Cancelled;
+        } catch (...) {
+            std::lock_guard lock(mutex_);
+            error_ = std::current_exception();
+        }
+        {
+            std::lock_guard lock(mutex_);
+            status_ = status;
+        }
+        changed_.notify_all();
+    }
+
+    void setPaused(bool paused) {
+        {
+            std::lock_guard lock(mutex_);
+            pauseRequested_ = paused;
+            if (status_ == BackupStatus::Running && paused)
+                status_ = BackupStatus::Paused;
+            else if (status_ == BackupStatus::Paused && !paused)
+                status_ = BackupStatus::Running;
+        }
+        changed_.notify_all();
+    }
+
+    void cancel() {
+        {
+            std::lock_guard lock(mutex_);
+            cancelRequested_ = true;
+        }
+        changed_.notify_all();
+    }
+
+    [[nodiscard]]
+    static bool stopped(BackupStatus status) {
+        return status == BackupStatus::Completed || status == BackupStatus::Cancelled || status == BackupStatus::Failed;
+    }
+
+    [[nodiscard]]
+    BackupStatus status() const {
+        std::lock_guard lock(mutex_);
+        return status_;
+    }
+
+    [[nodiscard]]
+    BackupProgress progress() const {
+        std::lock_guard lock(mutex_);
+        return progress_;
+    }
+
+    [[nodiscard]]
+    bool usedVacuumInto() const {
+        std::lock_guard lock(mutex_);
+        return usedVacuumInto_;
+    }
+
+    BackupStatus wait() {
+        std::unique_lock lock(mutex_);
+        changed_.wait(lock, [this] { return stopped(status_); });
+        if (error_)
+            std::rethrow_exception(error_);
+        return status_;
+    }
+
+    bool waitFor(std::chrono::milliseconds timeout) {
+        std::unique_lock lock(mutex_);
+        return changed_.wait_for(lock, timeout, [this] { return stopped(status_); });
+    }
+};
+
+BackupJob::BackupJob(Dbpp::Connection& db, std::filesystem::path destination, BackupOptions options)
+: impl_(std::make_shared<Impl>(connectionState(db), std::move(destination), std::move(options)))
+{
+    thread_ = std::thread([impl = impl_] { impl->run(); });
+}
+
+BackupJob::~BackupJob() {
+    impl_->cancel();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void
+BackupJob::pause() {
+    impl_->setPaused(true);
+}
+
+void
+BackupJob::resume() {
+    impl_->setPaused(false);
+}
+
+void
+BackupJob::cancel() {
+    impl_->cancel();
+}
+
+BackupStatus
+BackupJob::status() const {
+    return impl_->status();
+}
+
+BackupProgress
+BackupJob::progress() const {
+    return impl_->progress();
+}
+
+bool
+BackupJob::usedVacuumInto() const {
+    return impl_->usedVacuumInto();
+}
+
+BackupStatus
+BackupJob::wait() {
+    return impl_->wait();
+}
+
+bool
+BackupJob::waitFor(std::chrono::milliseconds timeout) {
+    return impl_->waitFor(timeout);
+}
+
+} // namespace Dbpp::Sqlite3
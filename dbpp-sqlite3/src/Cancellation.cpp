@@ -0,0 +1,134 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/Cancellation.h>
+
+#include "ConnectionState.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace Dbpp::Sqlite3 {
+
+class CancellationToken::Impl {
+    std::atomic<bool> cancelled_{false};
+    std::mutex mutex_;
+    std::vector<sqlite3*> connections_; // The connections with limits that use the token
+
+public:
+    void cancel() {
+        cancelled_.store(true, std::memory_order_relaxed);
+        std::lock_guard lock(mutex_);
+        for (auto* db : connections_)
+            sqlite3_interrupt(db);
+    }
+
+    [[nodiscard]]
+    bool isCancelled() const {
+        return cancelled_.load(std::memory_order_relaxed);
+    }
+
+    void addConnection(sqlite3* db) {
+        std::lock_guard lock(mutex_);
+        connections_.push_back(db);
+    }
+
+    void removeConnection(sqlite3* db) {
+        std::lock_guard lock(mutex_);
+        connections_.erase(std::find(connections_.begin(), connections_.end(), db));
+    }
+};
+
+CancellationToken::CancellationToken()
+: impl_(std::make_shared<Impl>())
+{}
+
+void
+CancellationToken::cancel() {
+    impl_->cancel();
+}
+
+bool
+CancellationToken::isCancelled() const {
+    return impl_->isCancelled();
+}
+
+class QueryLimitScope::Impl {
+    DBPP_NO_COPY_SEMANTICS(Impl);
+    DBPP_NO_MOVE_SEMANTICS(Impl);
+
+    ConnectionStatePtr state_;
+    std::shared_ptr<CancellationToken::Impl> token_;
+    ConnectionState::ListenerId id_;
+
+public:
+    Impl(ConnectionStatePtr state, std::shared_ptr<CancellationToken::Impl> token, QueryLimits limits)
+    : state_(std::move(state)),
+      token_(std::move(token)),
+      id_(state_->addQueryLimits(std::move(limits)))
+    {
+        // The state keeps the connection open, so the token can interrupt it until it's removed
+        if (token_)
+            token_->addConnection(state_->db());
+    }
+
+    ~Impl() {
+        if (token_)
+            token_->removeConnection(state_->db());
+        state_->removeQueryLimits(id_);
+    }
+};
+
+QueryLimitScope::QueryLimitScope() = default;
+
+QueryLimitScope::QueryLimitScope(std::unique_ptr<Impl> impl)
+: impl_(std::move(impl))
+{}
+
+QueryLimitScope::QueryLimitScope(QueryLimitScope&&) noexcept = default;
+QueryLimitScope& QueryLimitScope::operator=(QueryLimitScope&&) noexcept = default;
+QueryLimitScope::~QueryLimitScope() = default;
+
+void
+QueryLimitScope::release() {
+    impl_.reset();
+}
+
+QueryLimitScope limitQueries(Dbpp::Connection& db, QueryLimits limits) {
+    if (!limits.deadline && !limits.token)
+        throw Dbpp::Error("limitQueries() needs a deadline or a cancellation token");
+    if (limits.checkInterval <= 0)
+        throw Dbpp::Error("The check interval of the query limits must be positive");
+    auto token = limits.token ? limits.token->impl_ : nullptr;
+    return QueryLimitScope(std::make_unique<QueryLimitScope::Impl>(connectionState(db), std::move(token), std::move(limits)));
+}
+
+QueryLimitScope limitQueries(Dbpp::Connection& db, Deadline deadline) {
+    QueryLimits limits;
+    limits.deadline = deadline;
+    return limitQueries(db, std::move(limits));
+}
+
+QueryLimitScope limitQueries(Dbpp::Connection& db, CancellationToken token) {
+    QueryLimits limits;
+    limits.token = std::move(token);
+    return limitQueries(db, std::move(limits));
+}
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,63 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/Changes.h>
+
+#include "ConnectionState.h"
+
+namespace Dbpp::Sqlite3 {
+
+class ChangeSubscription::Impl {
+    DBPP_NO_COPY_SEMANTICS(Impl);
+    DBPP_NO_MOVE_SEMANTICS(Impl);
+
+    ConnectionStatePtr state_;
+    ConnectionState::ListenerId id_;
+
+public:
+    Impl(ConnectionStatePtr state, ChangeListener listener, std::vector<std::string> tables)
+    : state_(std::move(state)),
+      id_(state_->addChangeListener(std::move(listener), std::move(tables)))
+    {}
+
+    ~Impl() {
+        state_->removeChangeListener(id_);
+    }
+};
+
+ChangeSubscription::ChangeSubscription() = default;
+
+ChangeSubscription::ChangeSubscription(std::unique_ptr<Impl> impl)
+: impl_(std::move(impl))
+{}
+
+ChangeSubscription::ChangeSubscription(ChangeSubscription&&) noexcept = default;
+ChangeSubscription& ChangeSubscription::operator=(ChangeSubscription&&) noexcept = default;
+ChangeSubscription::~ChangeSubscription() = default;
+
+void
+ChangeSubscription::unsubscribe() {
+    impl_.reset();
+}
+
+ChangeSubscription subscribeToChanges(Dbpp::Connection& db, ChangeListener listener, std::vector<std::string> tables) {
+    if (!listener)
+        throw Dbpp::Error("subscribeToChanges() needs a listener");
+    return ChangeSubscription(std::make_unique<ChangeSubscription::Impl>(connectionState(db), std::move(listener), std::move(tables)));
+}
+
+} // namespace Dbpp::Sqlite3
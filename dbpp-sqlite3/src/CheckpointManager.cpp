@@ -0,0 +1,235 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/CheckpointManager.h>
+
+#include "ConnectionState.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    struct DbDeleter {
+        void operator()(sqlite3* p) const { sqlite3_close_v2(p); }
+    };
+
+    // Returns the single value returned by a pragma, or an empty string
+    std::string pragma(sqlite3* db, const char* sql) {
+        sqlite3_stmt* stmt = nullptr;
+        std::string value;
+        const int res = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+        if (res == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+            if (const auto* text = sqlite3_column_text(stmt, 0))
+                value = reinterpret_cast<const char*>(text); // NOLINT
+        }
+        sqlite3_finalize(stmt);
+        throwOnError(res, "Failed to prepare pragma");
+        return value;
+    }
+
+} // namespace
+
+class CheckpointManager::Impl {
+    DBPP_NO_COPY_SEMANTICS(Impl);
+    DBPP_NO_MOVE_SEMANTICS(Impl);
+
+    using Clock = std::chrono::steady_clock;
+
+    ConnectionStatePtr state_;
+    CheckpointPolicy policy_;
+    std::unique_ptr<sqlite3, DbDeleter> checkpointer_;
+    std::int64_t pageSize_ = 0;
+    ConnectionState::ListenerId listener_ = 0;
+
+    // Updated by the writer's commits and by the checkpoints
+    std::atomic<int> walPages_{0};
+    std::atomic<int> checkpointedLog_{0}; // Size of the WAL at the latest checkpoint
+    std::atomic<int> backfilled_{0}; // Pages copied to the database by the latest checkpoint
+    std::atomic<bool> pending_{false};
+
+    mutable std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stop_ = false;
+    bool requested_ = false;
+    CheckpointStats stats_;
+    Clock::time_point lastCheckpoint_ = Clock::now();
+
+    [[nodiscard]]
+    int lag(int walPages) const {
+        // The writer starts over from the beginning of the WAL after a complete checkpoint
+        if (walPages < checkpointedLog_.load(std::memory_order_relaxed))
+            return walPages;
+        return walPages - backfilled_.load(std::memory_order_relaxed);
+    }
+
+    // Called by the writer connection after each commit
+    void onCommit(const char* schema, int pages) {
+        if (std::strcmp(schema, "main") != 0)
+            return;
+        walPages_.store(pages, std::memory_order_relaxed);
+        // After a complete checkpoint the writer restarts the WAL, so nothing in it has been
+        // copied to the database yet
+        if (pages < checkpointedLog_.load(std::memory_order_relaxed)) {
+            checkpointedLog_.store(0, std::memory_order_relaxed);
+            backfilled_.store(0, std::memory_order_relaxed);
+        }
+        if (lag(pages) >= policy_.lagPages && !pending_.exchange(true))
+            requestCheckpoint();
+    }
+
+    void checkpoint() {
+        int log = 0;
+        int copied = 0;
+        const auto started = Clock::now();
+        int res = sqlite3_wal_checkpoint_v2(checkpointer_.get(), "main", SQLITE_CHECKPOINT_PASSIVE, &log, &copied);
+        const auto finished = Clock::now();
+        pending_.store(false);
+
+        bool truncated = false;
+        if (res == SQLITE_OK) {
+            checkpointedLog_.store(log, std::memory_order_relaxed);
+            backfilled_.store(copied, std::memory_order_relaxed);
+            walPages_.store(log, std::memory_order_relaxed);
+
+            // When all of the WAL was copied, no reader needs it. The checkpointer has no busy
+            // handler, so truncating fails at once instead of waiting if a writer is active
+            if (policy_.truncatePages >= 0 && log >= policy_.truncatePages && copied == log) {
+                truncated = sqlite3_wal_checkpoint_v2(checkpointer_.get(), "main", SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr) == SQLITE_OK;
+                if (truncated) {
+                    checkpointedLog_.store(0, std::memory_order_relaxed);
+                    backfilled_.store(0, std::memory_order_relaxed);
+                    walPages_.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::lock_guard lock(mutex_);
+        if (res == SQLITE_OK) {
+            ++stats_.checkpoints;
+            stats_.lastDuration = finished - started;
+            lastCheckpoint_ = finished;
+        } else {
+            ++stats_.busy;
+        }
+        if (truncated)
+            ++stats_.truncations;
+    }
+
+public:
+    Impl(ConnectionStatePtr state, CheckpointPolicy policy)
+    : state_(std::move(state)),
+      policy_(policy)
+    {
+        const char* file = sqlite3_db_filename(state_->db(), "main");
+        if (file == nullptr || *file == '\0')
+            throw Dbpp::Error("A checkpoint manager can only be used with a database file");
+
+        sqlite3* p = nullptr;
+        const int res = sqlite3_open_v2(file, &p, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, state_->vfsName());
+        checkpointer_.reset(p);
+        throwOnError(res, "Failed to open connection for checkpoints");
+        if (pragma(checkpointer_.get(), "PRAGMA journal_mode") != "wal")
+            throw Dbpp::Error("A checkpoint manager can only be used with a database in WAL mode");
+        pageSize_ = std::stoll(pragma(checkpointer_.get(), "PRAGMA page_size"));
+
+        listener_ = state_->addWalListener([this](const char* schema, int pages) { onCommit(schema, pages); });
+    }
+
+    ~Impl() {
+        state_->removeWalListener(listener_);
+    }
+
+    void run() {
+        for (;;) {
+            {
+                std::unique_lock lock(mutex_);
+                const bool requested = wakeup_.wait_for(lock, policy_.maxInterval, [this] { return stop_ || requested_; });
+                if (stop_)
+                    return;
+                requested_ = false;
+                if (!requested && lag(walPages_.load(std::memory_order_relaxed)) == 0)
+                    continue;
+            }
+            checkpoint();
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        wakeup_.notify_all();
+    }
+
+    // Installs the WAL hook of the writer again, in case it has been replaced
+    void restoreWalHook() {
+        state_->restoreWalHook();
+    }
+
+    void requestCheckpoint() {
+        {
+            std::lock_guard lock(mutex_);
+            requested_ = true;
+        }
+        wakeup_.notify_all();
+    }
+
+    [[nodiscard]]
+    CheckpointStats stats() const {
+        const int pages = walPages_.load(std::memory_order_relaxed);
+        std::lock_guard lock(mutex_);
+        CheckpointStats stats = stats_;
+        stats.walPages = pages;
+        stats.lagPages = lag(pages);
+        // A WAL has a 32 byte header, and a 24 byte header per page
+        stats.walBytes = pages > 0 ? 32 + pages * (pageSize_ + 24) : 0;
+        stats.sinceLastCheckpoint = Clock::now() - lastCheckpoint_;
+        return stats;
+    }
+};
+
+CheckpointManager::CheckpointManager(Dbpp::Connection& writer, CheckpointPolicy policy)
+: impl_(std::make_shared<Impl>(connectionState(writer), policy))
+{
+    thread_ = std::thread([impl = impl_] { impl->run(); });
+}
+
+CheckpointManager::~CheckpointManager() {
+    impl_->stop();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+CheckpointStats
+CheckpointManager::stats() const {
+    impl_->restoreWalHook();
+    return impl_->stats();
+}
+
+void
+CheckpointManager::requestCheckpoint() {
+    impl_->restoreWalHook();
+    impl_->requestCheckpoint();
+}
+
+} // namespace Dbpp::Sqlite3
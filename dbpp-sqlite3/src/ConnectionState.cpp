@@ -0,0 +1,460 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "ConnectionState.h"
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <limits>
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    class DbMutexLock {
+        DBPP_NO_COPY_SEMANTICS(DbMutexLock);
+        DBPP_NO_MOVE_SEMANTICS(DbMutexLock);
+
+        sqlite3_mutex* mutex_;
+
+    public:
+        explicit DbMutexLock(sqlite3* db)
+        : mutex_(sqlite3_db_mutex(db))
+        {
+            sqlite3_mutex_enter(mutex_);
+        }
+
+        ~DbMutexLock() {
+            sqlite3_mutex_leave(mutex_);
+        }
+    };
+
+    std::atomic<int> openConnectionCount{0};
+
+} // namespace
+
+ConnectionState::ConnectionState(sqlite3* db)
+: db_(db)
+{
+    openConnectionCount.fetch_add(1, std::memory_order_relaxed);
+    sqlite3_busy_handler(db_, busyCallback, this);
+    // Fails if lookaside memory is already in use, and then the connection keeps the default
+    if (auto lookaside = defaultLookaside())
+        sqlite3_db_config(db_, SQLITE_DBCONFIG_LOOKASIDE, nullptr, lookaside->slotSize, lookaside->slotCount);
+}
+
+ConnectionState::~ConnectionState() {
+    sqlite3_close_v2(db_);
+    openConnectionCount.fetch_sub(1, std::memory_order_relaxed);
+}
+
+const char* ConnectionState::vfsName() const {
+    sqlite3_vfs* vfs = nullptr;
+    if (sqlite3_file_control(db_, "main", SQLITE_FCNTL_VFS_POINTER, &vfs) != SQLITE_OK || vfs == nullptr)
+        return nullptr;
+    return vfs->zName;
+}
+
+int ConnectionState::openConnections() {
+    return openConnectionCount.load(std::memory_order_relaxed);
+}
+
+int ConnectionState::traceCallback(unsigned int type, void* context, void* p, void* x) {
+    auto* self = static_cast<ConnectionState*>(context);
+    for (auto& entry : self->traceListeners_) {
+        if (entry.mask & type)
+            entry.listener(type, p, x);
+    }
+    return 0;
+}
+
+void ConnectionState::installTraceCallback() {
+    unsigned int mask = 0;
+    for (const auto& entry : traceListeners_)
+        mask |= entry.mask;
+    if (mask == 0)
+        sqlite3_trace_v2(db_, 0, nullptr, nullptr);
+    else
+        sqlite3_trace_v2(db_, mask, traceCallback, this);
+}
+
+ConnectionState::ListenerId ConnectionState::addTraceListener(unsigned int mask, TraceListener listener) {
+    DbMutexLock lock(db_);
+    auto id = nextListenerId_++;
+    traceListeners_.push_back({id, mask, std::move(listener)});
+    installTraceCallback();
+    return id;
+}
+
+void ConnectionState::removeTraceListener(ListenerId id) {
+    DbMutexLock lock(db_);
+    traceListeners_.erase(std::remove_if(traceListeners_.begin(), traceListeners_.end(),
+                                         [id](const TraceEntry& entry) { return entry.id == id; }),
+                          traceListeners_.end());
+    installTraceCallback();
+}
+
+int ConnectionState::walCallback(void* context, sqlite3* /*db*/, const char* schema, int pages) {
+    auto* self = static_cast<ConnectionState*>(context);
+    for (auto& [id, listener] : self->walListeners_)
+        listener(schema, pages);
+    return SQLITE_OK;
+}
+
+ConnectionState::ListenerId ConnectionState::addWalListener(WalListener listener) {
+    DbMutexLock lock(db_);
+    if (walListeners_.empty()) {
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db_, "PRAGMA wal_autocheckpoint", -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+            walAutoCheckpoint_ = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+        sqlite3_wal_hook(db_, walCallback, this);
+    }
+    auto id = nextListenerId_++;
+    walListeners_.emplace_back(id, std::move(listener));
+    return id;
+}
+
+void ConnectionState::removeWalListener(ListenerId id) {
+    DbMutexLock lock(db_);
+    walListeners_.erase(std::remove_if(walListeners_.begin(), walListeners_.end(),
+                                       [id](const auto& entry) { return entry.first == id; }),
+                        walListeners_.end());
+    if (walListeners_.empty())
+        sqlite3_wal_autocheckpoint(db_, walAutoCheckpoint_); // Also replaces the hook
+}
+
+void ConnectionState::restoreWalHook() {
+    DbMutexLock lock(db_);
+    if (!walListeners_.empty())
+        sqlite3_wal_hook(db_, walCallback, this);
+}
+
+void ConnectionState::updateCallback(void* context, int op, const char* /*schema*/, const char* table, sqlite3_int64 rowid) {
+    auto* self = static_cast<ConnectionState*>(context);
+    if (!self->changeCounters_.empty()) {
+        try {
+            auto count = self->pendingCounts_.find(std::string_view(table));
+            if (count == self->pendingCounts_.end())
+                count = self->pendingCounts_.emplace(table, 0).first;
+            ++count->second;
+        } catch (...) { // NOLINT(bugprone-empty-catch)
+            // The counts are estimates anyway, see addChangeCounter()
+        }
+    }
+    if (self->changeListeners_.empty() || self->changesLost_)
+        return;
+    const auto operation = op == SQLITE_INSERT ? ChangeOperation::Insert
+                         : op == SQLITE_UPDATE ? ChangeOperation::Update
+                         : ChangeOperation::Delete;
+    // An exception must not unwind through SQLite, so if the change can't be recorded, the
+    // listeners are told that anything may have changed instead
+    try {
+        self->pendingChanges_.push_back({table, operation, rowid});
+    } catch (...) {
+        self->changesLost_ = true;
+        std::vector<RowChange>().swap(self->pendingChanges_);
+    }
+}
+
+int ConnectionState::commitCallback(void* context) {
+    // The listeners can't use the connection from within the hook, so they are called
+    // after the committing statement has returned
+    static_cast<ConnectionState*>(context)->committing_ = true;
+    return 0;
+}
+
+void ConnectionState::rollbackCallback(void* context) {
+    auto* self = static_cast<ConnectionState*>(context);
+    self->pendingChanges_.clear();
+    self->changesLost_ = false;
+    self->pendingCounts_.clear();
+    self->committing_ = false;
+}
+
+void ConnectionState::installChangeHooks() {
+    if (!changeListeners_.empty() || !changeCounters_.empty()) {
+        sqlite3_update_hook(db_, updateCallback, this);
+        sqlite3_commit_hook(db_, commitCallback, this);
+        sqlite3_rollback_hook(db_, rollbackCallback, this);
+        return;
+    }
+    sqlite3_update_hook(db_, nullptr, nullptr);
+    sqlite3_commit_hook(db_, nullptr, nullptr);
+    sqlite3_rollback_hook(db_, nullptr, nullptr);
+    pendingCounts_.clear();
+    committing_ = false;
+}
+
+ConnectionState::ListenerId ConnectionState::addChangeListener(ChangeListener listener, std::vector<std::string> tables) {
+    DbMutexLock lock(db_);
+    auto id = nextListenerId_++;
+    std::sort(tables.begin(), tables.end());
+    changeListeners_.push_back({id, std::move(listener), std::move(tables)});
+    if (changeListeners_.size() == 1) {
+        installChangeHooks();
+        installAuthorizer();
+    }
+    return id;
+}
+
+void ConnectionState::removeChangeListener(ListenerId id) {
+    DbMutexLock lock(db_);
+    changeListeners_.erase(std::remove_if(changeListeners_.begin(), changeListeners_.end(),
+                                          [id](const ChangeEntry& entry) { return entry.id == id; }),
+                           changeListeners_.end());
+    if (changeListeners_.empty()) {
+        pendingChanges_.clear();
+        changesLost_ = false;
+        installChangeHooks();
+        installAuthorizer();
+    }
+}
+
+ConnectionState::ListenerId ConnectionState::addChangeCounter(ChangeCounter counter) {
+    DbMutexLock lock(db_);
+    auto id = nextListenerId_++;
+    changeCounters_.emplace_back(id, std::move(counter));
+    if (changeCounters_.size() == 1)
+        installChangeHooks();
+    return id;
+}
+
+void ConnectionState::removeChangeCounter(ListenerId id) {
+    DbMutexLock lock(db_);
+    changeCounters_.erase(std::remove_if(changeCounters_.begin(), changeCounters_.end(),
+                                         [id](const auto& entry) { return entry.first == id; }),
+                          changeCounters_.end());
+    if (changeCounters_.empty()) {
+        pendingCounts_.clear();
+        installChangeHooks();
+    }
+}
+
+int ConnectionState::authorizerCallback(void* context, int action, const char* arg1, const char* /*arg2*/,
+                                        const char* /*schema*/, const char* /*trigger*/) {
+    auto* self = static_cast<ConnectionState*>(context);
+    if (action == SQLITE_READ && self->readTables_ && arg1)
+        self->readTables_->emplace_back(arg1);
+    // Deleting all rows of a table is optimized to not visit the rows, unless the
+    // authorizer ignores the deletion, and then the update hook is not called
+    if (action == SQLITE_DELETE && !self->changeListeners_.empty())
+        return SQLITE_IGNORE;
+    return SQLITE_OK;
+}
+
+void ConnectionState::installAuthorizer() {
+    if (readRecorders_ > 0 || !changeListeners_.empty())
+        sqlite3_set_authorizer(db_, authorizerCallback, this);
+    else
+        sqlite3_set_authorizer(db_, nullptr, nullptr);
+}
+
+void ConnectionState::addReadRecorder() {
+    DbMutexLock lock(db_);
+    if (readRecorders_++ == 0)
+        installAuthorizer();
+}
+
+void ConnectionState::removeReadRecorder() {
+    DbMutexLock lock(db_);
+    if (--readRecorders_ == 0)
+        installAuthorizer();
+}
+
+void ConnectionState::recordReadTables(std::vector<std::string>* tables) {
+    DbMutexLock lock(db_);
+    readTables_ = tables;
+}
+
+int ConnectionState::progressCallback(void* context) {
+    return static_cast<ConnectionState*>(context)->exceededLimit() != ExceededLimit::None ? 1 : 0;
+}
+
+ConnectionState::ExceededLimit ConnectionState::exceededLimit() const {
+    if (queryLimitsSuspended)
+        return ExceededLimit::None;
+    bool deadlineNeeded = false;
+    for (const auto& entry : queryLimits_) {
+        if (entry.limits.token && entry.limits.token->isCancelled())
+            return ExceededLimit::Cancelled;
+        deadlineNeeded = deadlineNeeded || entry.limits.deadline;
+    }
+    if (!deadlineNeeded)
+        return ExceededLimit::None;
+    const auto now = std::chrono::steady_clock::now();
+    for (const auto& entry : queryLimits_) {
+        if (entry.limits.deadline && now >= *entry.limits.deadline)
+            return ExceededLimit::DeadlinePassed;
+    }
+    return ExceededLimit::None;
+}
+
+void ConnectionState::installProgressHandler() {
+    hasQueryLimits_.store(!queryLimits_.empty(), std::memory_order_relaxed);
+    if (queryLimits_.empty()) {
+        sqlite3_progress_handler(db_, 0, nullptr, nullptr);
+        return;
+    }
+    int interval = std::numeric_limits<int>::max();
+    for (const auto& entry : queryLimits_)
+        interval = std::min(interval, entry.limits.checkInterval);
+    sqlite3_progress_handler(db_, std::max(interval, 1), progressCallback, this);
+}
+
+ConnectionState::ListenerId ConnectionState::addQueryLimits(QueryLimits limits) {
+    DbMutexLock lock(db_);
+    auto id = nextListenerId_++;
+    queryLimits_.push_back({id, std::move(limits)});
+    installProgressHandler();
+    return id;
+}
+
+void ConnectionState::removeQueryLimits(ListenerId id) {
+    DbMutexLock lock(db_);
+    queryLimits_.erase(std::remove_if(queryLimits_.begin(), queryLimits_.end(),
+                                      [id](const QueryLimitEntry& entry) { return entry.id == id; }),
+                       queryLimits_.end());
+    installProgressHandler();
+}
+
+void ConnectionState::throwIfLimitExceeded(int errcode) const {
+    if (errcode != SQLITE_INTERRUPT && errcode != SQLITE_BUSY)
+        return;
+    ExceededLimit exceeded = ExceededLimit::None;
+    {
+        DbMutexLock lock(db_);
+        exceeded = exceededLimit();
+    }
+    switch (exceeded) {
+        case ExceededLimit::Cancelled:
+            throw QueryCancelled(errcode, "The statement was cancelled");
+        case ExceededLimit::DeadlinePassed:
+            throw DeadlineExceeded(errcode, "The statement did not finish before its deadline");
+        case ExceededLimit::None:
+        default:
+            break;
+    }
+}
+
+void ConnectionState::afterCommit() noexcept {
+    committing_ = false;
+    // If the commit failed with SQLITE_BUSY, the transaction is still open, and the hook
+    // is called again when the commit is retried. Failed commits are rolled back otherwise
+    if (!sqlite3_get_autocommit(db_))
+        return;
+    deliverChanges();
+}
+
+void ConnectionState::deliverChanges() noexcept {
+    std::vector<RowChange> changes;
+    bool lost = false;
+    ChangeCounts counts;
+    std::vector<ChangeEntry> listeners;
+    std::vector<std::pair<ListenerId, ChangeCounter>> counters;
+    {
+        DbMutexLock lock(db_);
+        changes.swap(pendingChanges_);
+        std::swap(lost, changesLost_);
+        counts.swap(pendingCounts_);
+        try {
+            // Listeners may unsubscribe while being called
+            if (!counts.empty())
+                counters = changeCounters_;
+            if (!changes.empty() || lost) {
+                listeners = changeListeners_;
+                if (lost)
+                    changes.assign(1, RowChange{{}, ChangeOperation::Update, 0});
+            }
+        } catch (...) {
+            changesLost_ = !changeListeners_.empty(); // Reported with the next transaction instead
+            return;
+        }
+    }
+
+    // The transaction is committed, so a failing listener can't be reported by the committing
+    // statement, which would make it look like the commit failed
+    for (const auto& [id, counter] : counters) {
+        try {
+            counter(counts);
+        } catch (...) { // NOLINT(bugprone-empty-catch)
+        }
+    }
+    if (changes.empty())
+        return;
+    std::sort(changes.begin(), changes.end());
+    changes.erase(std::unique(changes.begin(), changes.end()), changes.end());
+
+    std::vector<RowChange> filtered;
+    for (const auto& entry : listeners) {
+        try {
+            const auto* batch = &changes;
+            if (!entry.tables.empty() && !lost) {
+                filtered.clear();
+                std::copy_if(changes.begin(), changes.end(), std::back_inserter(filtered), [&entry](const RowChange& change) {
+                    return std::binary_search(entry.tables.begin(), entry.tables.end(), change.table);
+                });
+                if (filtered.empty())
+                    continue;
+                batch = &filtered;
+            }
+            entry.listener(*batch);
+        } catch (...) { // NOLINT(bugprone-empty-catch)
+        }
+    }
+}
+
+int ConnectionState::busyCallback(void* context, int count) {
+    // The same backoff as sqlite3_busy_timeout(), which can't be used since it replaces the handler
+    static constexpr int delays[] = { 1, 2, 5, 10, 15, 20, 25, 25, 25, 50, 50, 100 };
+    static constexpr int totals[] = { 0, 1, 3,  8, 18, 33, 53, 78, 103, 128, 178, 228 };
+    static constexpr int numDelays = static_cast<int>(sizeof(delays) / sizeof(delays[0]));
+
+    auto* self = static_cast<ConnectionState*>(context);
+    const int timeout = self->busyTimeoutMs_.load(std::memory_order_relaxed);
+    if (timeout <= 0 || self->exceededLimit() != ExceededLimit::None)
+        return 0;
+    if (count == 0)
+        self->lockWaits_.fetch_add(1, std::memory_order_relaxed);
+
+    int delay = 0;
+    int prior = 0;
+    if (count < numDelays) {
+        delay = delays[count];
+        prior = totals[count];
+    } else {
+        delay = delays[numDelays - 1];
+        prior = totals[numDelays - 1] + delay * (count - (numDelays - 1));
+    }
+    if (prior + delay > timeout) {
+        delay = timeout - prior;
+        if (delay <= 0)
+            return 0;
+    }
+    sqlite3_sleep(delay);
+    return 1;
+}
+
+void ConnectionState::setBusyTimeout(std::chrono::milliseconds timeout) {
+    const auto ms = std::min<std::chrono::milliseconds::rep>(std::max<std::chrono::milliseconds::rep>(timeout.count(), 0),
+                                                             std::numeric_limits<int>::max());
+    busyTimeoutMs_.store(static_cast<int>(ms), std::memory_order_relaxed);
+    sqlite3_busy_handler(db_, busyCallback, this);
+}
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,302 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+// Internal header, shared by the source files of the sqlite3 adapter. Not installed.
+
+#include <dbpp/Connection.h>
+#include <dbpp/Exception.h>
+#include <dbpp/Statement.h>
+#include <dbpp/sqlite3/Cancellation.h>
+#include <dbpp/sqlite3/Changes.h>
+#include <dbpp/sqlite3/GlobalConfig.h>
+#include <dbpp/sqlite3/OpenMode.h>
+#include <dbpp/sqlite3/QueryPlan.h>
+#include <dbpp/sqlite3/SlowQueryLog.h>
+#include <dbpp/util.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <sqlite3.h>
+
+namespace Dbpp::Sqlite3 {
+
+class Sqlite3Error final : public Dbpp::ErrorWithCode {
+public:
+    using ErrorWithCode::ErrorWithCode;
+
+    [[nodiscard]]
+    const char* what() const noexcept override  {
+        static std::string msg;
+        msg = std::string(ErrorWithCode::what()) + ": " + sqlite3_errstr(static_cast<int>(code));
+        return msg.c_str();
+    }
+};
+
+// Takes a string_view, so that successful calls, which are the hot path, don't allocate
+inline void throwOnError(int errcode, std::string_view message) {
+    if (errcode != SQLITE_OK)
+        throw Sqlite3Error(errcode, std::string(message));
+}
+
+// Settings and sampling state of an enabled slow query log
+struct SlowQueryLogState {
+    SlowQueryLog settings;
+    std::atomic<unsigned int> executions{0};
+
+    explicit SlowQueryLogState(SlowQueryLog log)
+    : settings(std::move(log))
+    {}
+
+    // Decides if the next execution should be timed
+    bool sample() {
+        return executions.fetch_add(1, std::memory_order_relaxed) % settings.sampleEvery == 0;
+    }
+};
+
+// State belonging to an open database connection, which owns the sqlite3 handle.
+//
+// SQLite only allows a single callback per hook and connection. This class installs
+// the hooks and dispatches them to any number of listeners, so that the optional
+// components of the adapter (profiler etc) can be used at the same time.
+//
+// Listeners are added and removed while holding the connection mutex, which SQLite
+// also holds while invoking the hooks.
+class ConnectionState {
+    DBPP_NO_COPY_SEMANTICS(ConnectionState);
+    DBPP_NO_MOVE_SEMANTICS(ConnectionState);
+
+public:
+    using ListenerId = std::size_t;
+    using TraceListener = std::function<void(unsigned int type, void* p, void* x)>;
+    using WalListener = std::function<void(const char* schema, int pages)>;
+    using ChangeCounts = std::map<std::string, std::int64_t, std::less<>>; // Row changes per table
+    using ChangeCounter = std::function<void(const ChangeCounts& counts)>;
+
+private:
+    struct TraceEntry {
+        ListenerId id;
+        unsigned int mask;
+        TraceListener listener;
+    };
+
+    sqlite3* db_;
+    ListenerId nextListenerId_ = 0;
+    std::vector<TraceEntry> traceListeners_;
+    std::vector<std::pair<ListenerId, WalListener>> walListeners_;
+    struct ChangeEntry {
+        ListenerId id;
+        ChangeListener listener;
+        std::vector<std::string> tables;
+    };
+    std::vector<ChangeEntry> changeListeners_;
+    std::vector<std::pair<ListenerId, ChangeCounter>> changeCounters_;
+    struct QueryLimitEntry {
+        ListenerId id;
+        QueryLimits limits;
+    };
+    std::vector<QueryLimitEntry> queryLimits_;
+    std::atomic<bool> hasQueryLimits_{false};
+    std::vector<RowChange> pendingChanges_; // Changes made by the current transaction
+    bool changesLost_ = false; // Set if a change couldn't be recorded, since memory ran out
+    ChangeCounts pendingCounts_; // Rows changed per table by the current transaction, for the counters
+    bool committing_ = false;
+    std::vector<std::string>* readTables_ = nullptr;
+    int readRecorders_ = 0;
+    int walAutoCheckpoint_ = 0; // The setting to restore when the last WAL listener is removed
+    std::atomic<int> busyTimeoutMs_{0};
+    std::atomic<unsigned long> lockWaits_{0};
+
+    static int traceCallback(unsigned int type, void* context, void* p, void* x);
+    static int busyCallback(void* context, int count);
+    static int walCallback(void* context, sqlite3* db, const char* schema, int pages);
+    static void updateCallback(void* context, int op, const char* schema, const char* table, sqlite3_int64 rowid);
+    static int commitCallback(void* context);
+    static void rollbackCallback(void* context);
+    static int progressCallback(void* context);
+    static int authorizerCallback(void* context, int action, const char* arg1, const char* arg2, const char* schema, const char* trigger);
+    void installAuthorizer();
+    void installChangeHooks();
+    void installProgressHandler();
+    enum class ExceededLimit { None, Cancelled, DeadlinePassed };
+    ExceededLimit exceededLimit() const;
+    void deliverChanges() noexcept;
+    void installTraceCallback();
+
+public:
+    // Set by enablePlanAssertions(). Checked by the statements every time they are stepped
+    std::unique_ptr<PlanAssertions> planAssertions;
+
+    // Set by enableSlowQueryLog(). Checked by the statements every time they are stepped. Shared,
+    // so that a callback that disables or replaces the log isn't destroyed while it runs
+    std::shared_ptr<SlowQueryLogState> slowQueryLog;
+
+    // Kept alive until the connection is closed, such as the name of a SharedMemoryDatabase
+    std::shared_ptr<const void> keepAlive;
+
+    // Set while rolling back, which is how the work of a stopped statement is abandoned,
+    // so it must not be stopped by the query limits itself
+    bool queryLimitsSuspended = false;
+
+    explicit ConnectionState(sqlite3* db);
+
+    ~ConnectionState();
+
+    [[nodiscard]]
+    sqlite3* db() const { return db_; }
+
+    // The name of the VFS of the main database, for opening more connections to it, or
+    // nullptr for the default VFS
+    [[nodiscard]]
+    const char* vfsName() const;
+
+    // Adds a listener for the sqlite3_trace_v2() events in mask
+    ListenerId addTraceListener(unsigned int mask, TraceListener listener);
+
+    void removeTraceListener(ListenerId id);
+
+    // Adds a listener for commits to a database in WAL mode, which is passed the number of
+    // pages in the WAL. Automatic checkpoints are disabled while there are listeners, since
+    // they use the same hook
+    ListenerId addWalListener(WalListener listener);
+
+    void removeWalListener(ListenerId id);
+
+    // Installs the hook of the WAL listeners again, if "PRAGMA wal_autocheckpoint" or
+    // sqlite3_wal_hook() has replaced it
+    void restoreWalHook();
+
+    // Adds a listener for the rows changed by committed transactions, optionally limited to some tables
+    ListenerId addChangeListener(ChangeListener listener, std::vector<std::string> tables);
+
+    void removeChangeListener(ListenerId id);
+
+    // Adds a listener for the number of rows changed per table by committed transactions. Cheaper
+    // than a change listener, since the changes aren't recorded one by one. Unlike with change
+    // listeners, deleting all rows of a table without a WHERE clause isn't counted, since that
+    // would disable SQLite's optimization of it
+    ListenerId addChangeCounter(ChangeCounter counter);
+
+    void removeChangeCounter(ListenerId id);
+
+    // True when a transaction with change listeners or counters has started to commit. Checked by the
+    // statements after every step
+    [[nodiscard]]
+    bool committing() const { return committing_; }
+
+    // Called after a step while committing. Delivers the changes if the transaction committed.
+    // Exceptions thrown by the listeners are dropped, since the commit has succeeded
+    void afterCommit() noexcept;
+
+    // Installs the authorizer needed by recordReadTables(). Setting the authorizer makes
+    // SQLite prepare all statements again, so it's kept while there are recorders
+    void addReadRecorder();
+
+    void removeReadRecorder();
+
+    // Records the names of the tables read by the statements prepared until it's called
+    // with nullptr. The names may be repeated. Requires a read recorder
+    void recordReadTables(std::vector<std::string>* tables);
+
+    // Adds limits on the statements stepped until it's removed. Checked by a progress handler
+    ListenerId addQueryLimits(QueryLimits limits);
+
+    void removeQueryLimits(ListenerId id);
+
+    // True if there are query limits. Checked by the statements before their first step,
+    // since short statements don't reach the progress handler
+    [[nodiscard]]
+    bool hasQueryLimits() const { return hasQueryLimits_.load(std::memory_order_relaxed); }
+
+    // Throws QueryCancelled or DeadlineExceeded if a step that failed with errcode was stopped
+    // by the query limits. Called by the statements when a step fails
+    void throwIfLimitExceeded(int errcode) const;
+
+    // Sets how long to wait for a database lock before failing with SQLITE_BUSY. Also installs
+    // the busy handler again, in case "PRAGMA busy_timeout" has replaced it
+    void setBusyTimeout(std::chrono::milliseconds timeout);
+
+    // Number of times the connection has had to wait for a database lock
+    [[nodiscard]]
+    unsigned long lockWaits() const { return lockWaits_.load(std::memory_order_relaxed); }
+
+    // Number of connections that are open, which applyGlobalConfig() requires to be 0
+    [[nodiscard]]
+    static int openConnections();
+};
+
+using ConnectionStatePtr = std::shared_ptr<ConnectionState>;
+
+// Times an execution of a statement for the slow query log. Owned by the statement
+class SlowQueryTimer {
+    enum class Phase { Idle, Timing, Skipping };
+
+    Phase phase_ = Phase::Idle;
+    std::chrono::steady_clock::time_point started_;
+    long long rows_ = 0;
+    int lastResult_ = SQLITE_OK;
+    int vmStepsAtStart_ = 0;
+    unsigned long lockWaitsAtStart_ = 0;
+
+public:
+    // True between the first step of an execution and its end
+    [[nodiscard]]
+    bool active() const { return phase_ != Phase::Idle; }
+
+    // Called before sqlite3_step(), when the slow query log is enabled
+    void beforeStep(ConnectionState& state, sqlite3_stmt* stmt);
+
+    // Called with the result of sqlite3_step(), when active. Doesn't throw
+    void afterStep(ConnectionState& state, sqlite3_stmt* stmt, int res) noexcept;
+
+    // Ends the execution, when the statement is reset or destroyed while active. Exceptions
+    // thrown by the callback are dropped, so they can't replace the statement's own errors
+    void finish(ConnectionState& state, sqlite3_stmt* stmt) noexcept;
+};
+
+// Returns the lookaside configuration of new connections, set by applyGlobalConfig()
+[[nodiscard]]
+std::optional<LookasideConfig> defaultLookaside();
+
+// Returns the state of an sqlite3 connection. Throws if db is not an sqlite3 connection
+[[nodiscard]]
+ConnectionStatePtr connectionState(Dbpp::Connection& db);
+
+// Opens a connection with a VFS by name, or the default VFS if it's nullptr. Used to open
+// more connections to the database of a connection, with vfsName()
+[[nodiscard]]
+Dbpp::Connection openWithVfs(const std::filesystem::path& file, OpenMode mode, const char* vfs);
+
+// Returns the handle of an sqlite3 statement. Throws if stmt is not an sqlite3 statement
+[[nodiscard]]
+sqlite3_stmt* statementHandle(Dbpp::Statement& stmt);
+
+// Throws QueryPlanViolation if the statement has violated the assertions
+void checkPlanAssertions(const PlanAssertions& assertions, sqlite3_stmt* stmt);
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,53 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/Functions.h>
+
+#include "ConnectionState.h"
+
+namespace Dbpp::Sqlite3::Detail {
+
+void createFunction(Dbpp::Connection& db, std::string_view name, int argumentCount, FunctionFlag flags,
+                    UserData userData, ScalarCallback function, ScalarCallback step, FinalCallback final) {
+    auto state = connectionState(db);
+    const std::string functionName(name);
+    auto destroy = userData.get_deleter();
+
+    // SQLite calls the destructor of the user data if the registration fails as well
+    int res = sqlite3_create_function_v2(state->db(), functionName.c_str(), argumentCount,
+                                         SQLITE_UTF8 | static_cast<int>(flags), userData.release(),
+                                         function, step, final, destroy);
+    if (res != SQLITE_OK)
+        throwOnError(res, "Failed to register the SQL function " + functionName);
+}
+
+void createWindowFunction(Dbpp::Connection& db, std::string_view name, int argumentCount, FunctionFlag flags,
+                          UserData userData, ScalarCallback step, FinalCallback final, FinalCallback value,
+                          ScalarCallback inverse) {
+    auto state = connectionState(db);
+    const std::string functionName(name);
+    auto destroy = userData.get_deleter();
+
+    // SQLite calls the destructor of the user data if the registration fails as well
+    int res = sqlite3_create_window_function(state->db(), functionName.c_str(), argumentCount,
+                                             SQLITE_UTF8 | static_cast<int>(flags), userData.release(),
+                                             step, final, value, inverse, destroy);
+    if (res != SQLITE_OK)
+        throwOnError(res, "Failed to register the SQL window function " + functionName);
+}
+
+} // namespace Dbpp::Sqlite3::Detail
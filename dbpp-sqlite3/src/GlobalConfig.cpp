@@ -0,0 +1,174 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/GlobalConfig.h>
+
+#include "ConnectionState.h"
+
+#include <atomic>
+#include <limits>
+#include <mutex>
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    struct GlobalState {
+        std::mutex mutex;
+        std::optional<sqlite3_mem_methods> defaultMethods; // The methods SQLite started with
+        bool counting = false; // True while the methods below are installed
+        std::shared_ptr<Allocator> allocator; // Used by the methods below if set. Only changed while SQLite is shut down
+        std::atomic<long long> blocks{0}; // The number of blocks allocated with the methods below and not yet freed
+        std::unique_ptr<std::byte[]> pageCache; // NOLINT(modernize-avoid-c-arrays)
+        std::optional<LookasideConfig> lookaside;
+    };
+
+    // Never destroyed, since SQLite may free memory during the destruction of other statics
+    GlobalState& globalState() {
+        static auto* state = new GlobalState; // NOLINT(cppcoreguidelines-owning-memory)
+        return *state;
+    }
+
+    int toInt(std::size_t size) {
+        return size > static_cast<std::size_t>(std::numeric_limits<int>::max()) ? std::numeric_limits<int>::max() : static_cast<int>(size);
+    }
+
+    // SQLite frees memory through the methods installed at the time of the free, so the
+    // methods can only be changed when no blocks are allocated. These call the custom
+    // allocator and count its blocks. They also wrap the default methods while memory
+    // statistics are off, since SQLITE_STATUS_MALLOC_COUNT isn't kept then. Otherwise the
+    // default methods are installed directly, so the default configuration pays nothing
+    // for the counting
+    void* allocatorMalloc(int size) {
+        auto& state = globalState();
+        void* p = state.allocator ? state.allocator->allocate(static_cast<std::size_t>(size)) : state.defaultMethods->xMalloc(size);
+        if (p)
+            ++state.blocks;
+        return p;
+    }
+
+    void allocatorFree(void* p) {
+        if (!p)
+            return;
+        auto& state = globalState();
+        if (state.allocator)
+            state.allocator->deallocate(p);
+        else
+            state.defaultMethods->xFree(p);
+        --state.blocks;
+    }
+
+    void* allocatorRealloc(void* p, int size) {
+        auto& state = globalState();
+        return state.allocator ? state.allocator->reallocate(p, static_cast<std::size_t>(size)) : state.defaultMethods->xRealloc(p, size);
+    }
+
+    int allocatorSize(void* p) {
+        auto& state = globalState();
+        return state.allocator ? toInt(state.allocator->allocationSize(p)) : state.defaultMethods->xSize(p);
+    }
+
+    int allocatorRoundup(int size) {
+        auto& state = globalState();
+        return state.allocator ? toInt(state.allocator->roundUp(static_cast<std::size_t>(size))) : state.defaultMethods->xRoundup(size);
+    }
+
+    int allocatorInit(void* /*unused*/) {
+        auto& state = globalState();
+        return state.allocator ? SQLITE_OK : state.defaultMethods->xInit(state.defaultMethods->pAppData);
+    }
+
+    void allocatorShutdown(void* /*unused*/) {
+        auto& state = globalState();
+        if (!state.allocator)
+            state.defaultMethods->xShutdown(state.defaultMethods->pAppData);
+    }
+
+    // Returns the number of blocks SQLite has allocated and not freed. Without the counting
+    // methods that's only known if SQLite collects memory statistics, as it does unless built
+    // with SQLITE_DEFAULT_MEMSTATUS=0 before the first configuration, and as applyGlobalConfig()
+    // makes sure of after it
+    long long outstandingBlocks(const GlobalState& state) {
+        if (state.counting)
+            return state.blocks;
+        sqlite3_int64 current = 0;
+        sqlite3_int64 highwater = 0;
+        sqlite3_status64(SQLITE_STATUS_MALLOC_COUNT, &current, &highwater, 0);
+        return current;
+    }
+
+    void configure(int result, const char* what) {
+        throwOnError(result, std::string("Failed to configure ") + what);
+    }
+
+} // namespace
+
+std::optional<LookasideConfig> defaultLookaside() {
+    auto& state = globalState();
+    std::lock_guard lock(state.mutex);
+    return state.lookaside;
+}
+
+void applyGlobalConfig(const GlobalConfig& config) {
+    auto& state = globalState();
+    std::lock_guard lock(state.mutex);
+    if (ConnectionState::openConnections() > 0)
+        throw Dbpp::Error("The SQLite configuration can't be changed while connections are open");
+    if (config.pageCache && (config.pageCache->pageSize < 512 || config.pageCache->pageCount < 0))
+        throw Dbpp::Error("Invalid page cache configuration");
+
+    configure(sqlite3_shutdown(), "SQLite");
+    if (outstandingBlocks(state) > 0) {
+        sqlite3_initialize();
+        throw Dbpp::Error("The SQLite configuration can't be changed while memory allocated by SQLite is still in use");
+    }
+
+    if (!state.defaultMethods) {
+        sqlite3_mem_methods methods{};
+        configure(sqlite3_config(SQLITE_CONFIG_GETMALLOC, &methods), "the allocator");
+        state.defaultMethods = methods;
+    }
+    const bool memoryStatus = config.memoryStatus.value_or(true);
+    const bool counting = config.allocator || !memoryStatus;
+    if (counting) {
+        const sqlite3_mem_methods wrapper{allocatorMalloc, allocatorFree, allocatorRealloc, allocatorSize,
+                                          allocatorRoundup, allocatorInit, allocatorShutdown, nullptr};
+        configure(sqlite3_config(SQLITE_CONFIG_MALLOC, &wrapper), "the allocator");
+    } else {
+        configure(sqlite3_config(SQLITE_CONFIG_MALLOC, &*state.defaultMethods), "the allocator");
+    }
+    state.counting = counting;
+    state.allocator = config.allocator;
+
+    state.pageCache.reset();
+    if (config.pageCache && config.pageCache->pageCount > 0) {
+        int headerSize = 0;
+        configure(sqlite3_config(SQLITE_CONFIG_PCACHE_HDRSZ, &headerSize), "the page cache");
+        const int slotSize = (config.pageCache->pageSize + headerSize + 7) & ~7;
+        state.pageCache = std::make_unique<std::byte[]>(static_cast<std::size_t>(slotSize) * static_cast<std::size_t>(config.pageCache->pageCount)); // NOLINT(modernize-avoid-c-arrays)
+        configure(sqlite3_config(SQLITE_CONFIG_PAGECACHE, state.pageCache.get(), slotSize, config.pageCache->pageCount), "the page cache");
+    } else {
+        configure(sqlite3_config(SQLITE_CONFIG_PAGECACHE, nullptr, 0, 0), "the page cache");
+    }
+
+    configure(sqlite3_config(SQLITE_CONFIG_MEMSTATUS, memoryStatus ? 1 : 0), "the memory statistics");
+    state.lookaside = config.lookaside;
+
+    configure(sqlite3_initialize(), "SQLite");
+}
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,307 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/Maintenance.h>
+
+#include <dbpp/sqlite3/Sqlite3.h>
+
+#include "ConnectionState.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <optional>
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    std::string quoteIdentifier(const std::string& name) {
+        std::string quoted = "\"";
+        for (char c : name) {
+            if (c == '"')
+                quoted += '"';
+            quoted += c;
+        }
+        quoted += '"';
+        return quoted;
+    }
+
+    // Sets PRAGMA analysis_limit for the lifetime of the object
+    class AnalysisLimit {
+        DBPP_NO_COPY_SEMANTICS(AnalysisLimit);
+        DBPP_NO_MOVE_SEMANTICS(AnalysisLimit);
+
+        Dbpp::Connection& db_;
+        std::int64_t previous_;
+
+    public:
+        AnalysisLimit(Dbpp::Connection& db, int limit)
+        : db_(db),
+          previous_(db.get<std::int64_t>("PRAGMA analysis_limit"))
+        {
+            db_.exec("PRAGMA analysis_limit = " + std::to_string(limit));
+        }
+
+        ~AnalysisLimit() {
+            try {
+                db_.exec("PRAGMA analysis_limit = " + std::to_string(previous_));
+            } catch (const Dbpp::Error&) { // NOLINT(bugprone-empty-catch)
+            }
+        }
+    };
+
+} // namespace
+
+class Maintenance::Impl {
+    DBPP_NO_COPY_SEMANTICS(Impl);
+    DBPP_NO_MOVE_SEMANTICS(Impl);
+
+    using Clock = std::chrono::steady_clock;
+
+    MaintenancePolicy policy_;
+    Dbpp::Connection& db_;
+    ConnectionStatePtr state_;
+    std::optional<Dbpp::Connection> background_;
+    ConnectionState::ListenerId counter_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stop_ = false;
+    std::map<std::string, std::int64_t> changedRows_; // Rows changed per table since it was analyzed
+    Clock::time_point lastOptimize_ = Clock::now();
+    MaintenanceStats stats_;
+
+    // Called after each commit on the connection, on the thread that committed
+    void onChanges(const ConnectionState::ChangeCounts& counts) {
+        std::lock_guard lock(mutex_);
+        for (const auto& [table, rows] : counts) {
+            if (table.rfind("sqlite_", 0) != 0)
+                changedRows_[table] += rows;
+        }
+    }
+
+    [[nodiscard]]
+    bool optimizeDue(Clock::time_point now) const {
+        std::lock_guard lock(mutex_);
+        return policy_.optimizeInterval.count() > 0 && now - lastOptimize_ >= policy_.optimizeInterval;
+    }
+
+    // Returns a table that has had enough rows changed to be analyzed
+    [[nodiscard]]
+    std::optional<std::string> nextTableToAnalyze(const std::vector<std::string>& skip) const {
+        if (policy_.analyzeAfterChanges <= 0)
+            return std::nullopt;
+        std::lock_guard lock(mutex_);
+        for (const auto& [table, rows] : changedRows_) {
+            if (rows >= policy_.analyzeAfterChanges && std::find(skip.begin(), skip.end(), table) == skip.end())
+                return table;
+        }
+        return std::nullopt;
+    }
+
+    void record(std::vector<MaintenanceReport>& reports, MaintenanceReport report) {
+        {
+            std::lock_guard lock(mutex_);
+            switch (report.task) {
+            case MaintenanceTask::Optimize:
+                ++stats_.optimizations;
+                lastOptimize_ = Clock::now();
+                break;
+            case MaintenanceTask::Analyze:
+                ++stats_.tablesAnalyzed;
+                changedRows_.erase(report.table);
+                break;
+            case MaintenanceTask::IncrementalVacuum:
+                stats_.pagesVacuumed += static_cast<std::uint64_t>(report.pages);
+                break;
+            default:
+                break;
+            }
+            stats_.totalDuration += report.duration;
+        }
+        if (policy_.onReport)
+            policy_.onReport(report);
+        reports.push_back(std::move(report));
+    }
+
+    void optimize(Dbpp::Connection& db, std::vector<MaintenanceReport>& reports) {
+        MaintenanceReport report;
+        report.task = MaintenanceTask::Optimize;
+        const auto started = Clock::now();
+        // PRAGMA optimize only considers the tables the connection has queried, which the
+        // background connection hasn't. 0x10000 makes it consider all tables, from SQLite
+        // 3.46, and older versions ignore it
+        db.exec(&db == &db_ ? "PRAGMA optimize" : "PRAGMA optimize(0x1fffe)");
+        report.duration = Clock::now() - started;
+        record(reports, std::move(report));
+    }
+
+    void analyze(Dbpp::Connection& db, const std::string& table, std::vector<MaintenanceReport>& reports) {
+        MaintenanceReport report;
+        report.task = MaintenanceTask::Analyze;
+        report.table = table;
+        const auto started = Clock::now();
+        // The table may have been dropped since it was changed
+        if (db.getOptional<int>("SELECT 1 FROM sqlite_schema WHERE type = 'table' AND name = ?", table))
+            db.exec("ANALYZE " + quoteIdentifier(table));
+        report.duration = Clock::now() - started;
+        record(reports, std::move(report));
+    }
+
+    // Frees pages in steps of vacuumPagesPerStep until none are free, or the time is up
+    void vacuum(Dbpp::Connection& db, Clock::time_point deadline, std::vector<MaintenanceReport>& reports) {
+        if (policy_.vacuumPagesPerStep <= 0 || db.get<int>("PRAGMA auto_vacuum") != 2)
+            return;
+        auto freePages = db.get<std::int64_t>("PRAGMA freelist_count");
+        if (freePages == 0 || freePages < policy_.vacuumMinFreePages)
+            return;
+
+        const auto sql = "PRAGMA incremental_vacuum(" + std::to_string(policy_.vacuumPagesPerStep) + ")";
+        while (freePages > 0 && Clock::now() < deadline) {
+            MaintenanceReport report;
+            report.task = MaintenanceTask::IncrementalVacuum;
+            const auto started = Clock::now();
+            // Not exec(), which steps once: the pragma frees one page per step, so it must be
+            // stepped until done, as execScript() does
+            db.execScript(sql);
+            const auto remaining = db.get<std::int64_t>("PRAGMA freelist_count");
+            report.duration = Clock::now() - started;
+            report.pages = freePages - remaining;
+            freePages = remaining;
+            if (report.pages <= 0)
+                break;
+            record(reports, std::move(report));
+        }
+    }
+
+    std::vector<MaintenanceReport> work(Dbpp::Connection& db, Clock::duration budget) {
+        const auto deadline = Clock::now() + budget;
+        std::vector<MaintenanceReport> reports;
+        {
+            AnalysisLimit limit(db, policy_.analysisLimit);
+            if (optimizeDue(Clock::now()))
+                optimize(db, reports);
+            std::vector<std::string> analyzed;
+            while (Clock::now() < deadline) {
+                auto table = nextTableToAnalyze(analyzed);
+                if (!table)
+                    break;
+                analyze(db, *table, reports);
+                analyzed.push_back(std::move(*table));
+            }
+        }
+        if (Clock::now() < deadline)
+            vacuum(db, deadline, reports);
+        return reports;
+    }
+
+public:
+    Impl(Dbpp::Connection& db, MaintenancePolicy policy)
+    : policy_(std::move(policy)),
+      db_(db),
+      state_(connectionState(db))
+    {
+        if (policy_.analysisLimit < 0)
+            throw Dbpp::Error("The analysis limit of a maintenance policy can't be negative");
+        if (policy_.backgroundInterval.count() < 0)
+            throw Dbpp::Error("The background interval of a maintenance policy can't be negative");
+        if (isBackground()) {
+            const char* file = sqlite3_db_filename(state_->db(), "main");
+            if (file == nullptr || *file == '\0')
+                throw Dbpp::Error("Background maintenance can only be used with a database file");
+            background_.emplace(openWithVfs(file, OpenMode::ReadWrite, state_->vfsName()));
+            setBusyTimeout(*background_, policy_.backgroundBudget);
+        }
+        // Only the number of rows changed per table is needed, so the changes aren't recorded one by one
+        counter_ = state_->addChangeCounter([this](const ConnectionState::ChangeCounts& counts) { onChanges(counts); });
+    }
+
+    ~Impl() {
+        state_->removeChangeCounter(counter_);
+    }
+
+    [[nodiscard]]
+    bool isBackground() const {
+        return policy_.backgroundInterval.count() > 0;
+    }
+
+    std::vector<MaintenanceReport> tick(std::chrono::milliseconds budget) {
+        if (isBackground())
+            throw Dbpp::Error("Maintenance::tick() can't be called when the maintenance is done in the background");
+        if (sqlite3_get_autocommit(state_->db()) == 0)
+            throw Dbpp::Error("Maintenance::tick() can't be called while a transaction is open");
+        return work(db_, budget);
+    }
+
+    void run() {
+        for (;;) {
+            {
+                std::unique_lock lock(mutex_);
+                if (wakeup_.wait_for(lock, policy_.backgroundInterval, [this] { return stop_; }))
+                    return;
+            }
+            try {
+                (void) work(*background_, policy_.backgroundBudget);
+            } catch (const Dbpp::Error&) { // NOLINT(bugprone-empty-catch)
+                // Typically a lock held by another connection. The work is retried in the next round
+            } catch (...) { // NOLINT(bugprone-empty-catch)
+                // Thrown by onReport, which has nobody to report to on this thread
+            }
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        wakeup_.notify_all();
+    }
+
+    [[nodiscard]]
+    MaintenanceStats stats() const {
+        std::lock_guard lock(mutex_);
+        return stats_;
+    }
+};
+
+Maintenance::Maintenance(Dbpp::Connection& db, MaintenancePolicy policy)
+: impl_(std::make_shared<Impl>(db, std::move(policy)))
+{
+    if (impl_->isBackground())
+        thread_ = std::thread([impl = impl_] { impl->run(); });
+}
+
+Maintenance::~Maintenance() {
+    impl_->stop();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+std::vector<MaintenanceReport>
+Maintenance::tick(std::chrono::milliseconds budget) {
+    return impl_->tick(budget);
+}
+
+MaintenanceStats
+Maintenance::stats() const {
+    return impl_->stats();
+}
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,164 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/MemoryGovernor.h>
+
+#include "ConnectionState.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Dbpp::Sqlite3 {
+
+class MemoryGovernor::Impl {
+    DBPP_NO_COPY_SEMANTICS(Impl);
+    DBPP_NO_MOVE_SEMANTICS(Impl);
+
+    MemoryBudget budget_;
+    std::int64_t previousSoftLimit_;
+    std::int64_t previousHardLimit_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stop_ = false;
+    std::vector<std::weak_ptr<ConnectionState>> connections_;
+
+    // The limit that the memory use is compared to for the pressure callback
+    [[nodiscard]]
+    std::int64_t pressureLimit() const {
+        return budget_.softHeapLimit > 0 ? budget_.softHeapLimit : budget_.hardHeapLimit;
+    }
+
+public:
+    explicit Impl(MemoryBudget budget)
+    : budget_(std::move(budget)),
+      previousSoftLimit_(sqlite3_soft_heap_limit64(-1)),
+      previousHardLimit_(sqlite3_hard_heap_limit64(-1))
+    {
+        if (budget_.softHeapLimit < 0 || budget_.hardHeapLimit < 0)
+            throw Dbpp::Error("The heap limits of a memory budget can't be negative");
+        if (budget_.onPressure && (budget_.pressureThreshold <= 0.0 || budget_.pressureCheckInterval.count() <= 0))
+            throw Dbpp::Error("The pressure threshold and check interval of a memory budget must be positive");
+        // The soft limit is capped by the hard limit, so the hard limit is set first
+        sqlite3_hard_heap_limit64(budget_.hardHeapLimit);
+        sqlite3_soft_heap_limit64(budget_.softHeapLimit);
+    }
+
+    ~Impl() {
+        sqlite3_hard_heap_limit64(previousHardLimit_);
+        sqlite3_soft_heap_limit64(previousSoftLimit_);
+    }
+
+    [[nodiscard]]
+    bool monitorsPressure() const {
+        return budget_.onPressure && pressureLimit() > 0;
+    }
+
+    void run() {
+        const auto threshold = static_cast<std::int64_t>(static_cast<double>(pressureLimit()) * budget_.pressureThreshold);
+        bool above = false;
+        std::unique_lock lock(mutex_);
+        while (!wakeup_.wait_for(lock, budget_.pressureCheckInterval, [this] { return stop_; })) {
+            const auto used = sqlite3_memory_used();
+            if (used < threshold) {
+                above = false;
+                continue;
+            }
+            if (above)
+                continue;
+            above = true;
+            lock.unlock();
+            try {
+                budget_.onPressure({used, pressureLimit()});
+            } catch (...) { // NOLINT(bugprone-empty-catch) - there is no one to report it to on this thread
+            }
+            lock.lock();
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        wakeup_.notify_all();
+    }
+
+    void manage(Dbpp::Connection& db) {
+        auto state = connectionState(db);
+        if (budget_.cacheSize) {
+            // Negative sizes are in KiB
+            const auto kib = std::max<std::int64_t>(*budget_.cacheSize / 1024, 1);
+            db.exec("PRAGMA cache_size = -" + std::to_string(kib));
+        }
+        if (budget_.cacheSpillPages)
+            db.exec("PRAGMA cache_spill = " + std::to_string(*budget_.cacheSpillPages));
+
+        std::lock_guard lock(mutex_);
+        connections_.erase(std::remove_if(connections_.begin(), connections_.end(),
+                                          [](const auto& connection) { return connection.expired(); }),
+                           connections_.end());
+        connections_.push_back(std::move(state));
+    }
+
+    std::int64_t releaseMemory() {
+        const auto before = sqlite3_memory_used();
+        if (budget_.onRelease)
+            budget_.onRelease();
+
+        std::vector<ConnectionStatePtr> states;
+        {
+            std::lock_guard lock(mutex_);
+            for (const auto& connection : connections_) {
+                if (auto state = connection.lock())
+                    states.push_back(std::move(state));
+            }
+        }
+        for (const auto& state : states)
+            sqlite3_db_release_memory(state->db());
+        states.clear();
+        return std::max<std::int64_t>(before - sqlite3_memory_used(), 0);
+    }
+};
+
+MemoryGovernor::MemoryGovernor(MemoryBudget budget)
+: impl_(std::make_shared<Impl>(std::move(budget)))
+{
+    if (impl_->monitorsPressure())
+        thread_ = std::thread([impl = impl_] { impl->run(); });
+}
+
+MemoryGovernor::~MemoryGovernor() {
+    impl_->stop();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void
+MemoryGovernor::manage(Dbpp::Connection& db) {
+    impl_->manage(db);
+}
+
+std::int64_t
+MemoryGovernor::releaseMemory() {
+    return impl_->releaseMemory();
+}
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,426 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/Profiler.h>
+
+#include "ConnectionState.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <list>
+#include <locale>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    // Four buckets per power of two, covering the whole range of 64-bit nanosecond counts
+    constexpr int SubBuckets = 4;
+    constexpr std::size_t BucketCount = 64 * SubBuckets;
+
+    std::size_t bucketOf(std::uint64_t ns) {
+        if (ns == 0)
+            return 0;
+        int exponent = 0;
+        double mantissa = std::frexp(static_cast<double>(ns), &exponent); // ns = mantissa * 2^exponent, mantissa in [0.5, 1)
+        auto sub = static_cast<int>((mantissa - 0.5) * 2 * SubBuckets);
+        return std::min(static_cast<std::size_t>((exponent - 1) * SubBuckets + sub), BucketCount - 1);
+    }
+
+    std::uint64_t bucketUpperBound(std::size_t bucket) {
+        auto exponent = static_cast<int>(bucket / SubBuckets) + 1;
+        auto sub = static_cast<int>(bucket % SubBuckets);
+        return static_cast<std::uint64_t>(std::ldexp(0.5 + (sub + 1) / (2.0 * SubBuckets), exponent));
+    }
+
+    struct Aggregate {
+        std::string sql;
+        std::uint64_t calls = 0;
+        std::uint64_t rows = 0;
+        std::uint64_t totalNs = 0;
+        std::uint64_t maxNs = 0;
+        std::array<std::uint64_t, BucketCount> histogram{};
+
+        [[nodiscard]]
+        std::uint64_t percentile(double q) const {
+            auto rank = static_cast<std::uint64_t>(std::ceil(q * static_cast<double>(calls)));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < histogram.size(); ++i) {
+                seen += histogram[i];
+                if (seen >= rank && seen > 0)
+                    return std::min(bucketUpperBound(i), maxNs);
+            }
+            return maxNs;
+        }
+    };
+
+    bool isIdentifierChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$' || static_cast<unsigned char>(c) >= 0x80;
+    }
+
+    bool isDigit(char c) {
+        return std::isdigit(static_cast<unsigned char>(c)) != 0;
+    }
+
+    void appendEscapedLabel(std::string& out, std::string_view value) {
+        for (char c : value) {
+            switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            default: out += c; break;
+            }
+        }
+    }
+
+    std::string formatSeconds(std::chrono::nanoseconds ns) {
+        std::ostringstream os;
+        os.imbue(std::locale::classic());
+        os.precision(9);
+        os << std::chrono::duration<double>(ns).count();
+        return os.str();
+    }
+
+} // namespace
+
+std::string normalizeSql(std::string_view sql) {
+    std::string out;
+    out.reserve(sql.size());
+    bool pendingSpace = false;
+    auto emit = [&](std::string_view text) {
+        if (pendingSpace && !out.empty())
+            out += ' ';
+        pendingSpace = false;
+        out += text;
+    };
+
+    std::size_t i = 0;
+    const auto n = sql.size();
+    while (i < n) {
+        const char c = sql[i];
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            pendingSpace = true;
+            ++i;
+        } else if (c == '-' && i + 1 < n && sql[i + 1] == '-') {
+            while (i < n && sql[i] != '\n')
+                ++i;
+            pendingSpace = true;
+        } else if (c == '/' && i + 1 < n && sql[i + 1] == '*') {
+            auto end = sql.find("*/", i + 2);
+            i = end == std::string_view::npos ? n : end + 2;
+            pendingSpace = true;
+        } else if (c == '\'') {
+            // String literal, where '' is an escaped quote
+            ++i;
+            while (i < n) {
+                if (sql[i] == '\'' && i + 1 < n && sql[i + 1] == '\'')
+                    i += 2;
+                else if (sql[i++] == '\'')
+                    break;
+            }
+            emit("?");
+        } else if (c == '"' || c == '`' || c == '[') {
+            // Quoted identifier, kept as it is
+            const char close = c == '[' ? ']' : c;
+            auto start = i++;
+            while (i < n && sql[i] != close)
+                ++i;
+            i = std::min(i + 1, n);
+            emit(sql.substr(start, i - start));
+        } else if ((c == 'x' || c == 'X') && i + 1 < n && sql[i + 1] == '\'') {
+            // Blob literal
+            i = sql.find('\'', i + 2);
+            i = i == std::string_view::npos ? n : i + 1;
+            emit("?");
+        } else if (isDigit(c) || (c == '.' && i + 1 < n && isDigit(sql[i + 1]))) {
+            // Numeric literal, including hexadecimal and exponents
+            ++i;
+            while (i < n && (isIdentifierChar(sql[i]) || sql[i] == '.'
+                             || ((sql[i] == '+' || sql[i] == '-') && (sql[i - 1] == 'e' || sql[i - 1] == 'E'))))
+                ++i;
+            emit("?");
+        } else if (c == '?') {
+            // Numbered placeholders are normalized to plain ones
+            ++i;
+            while (i < n && isDigit(sql[i]))
+                ++i;
+            emit("?");
+        } else if (isIdentifierChar(c)) {
+            auto start = i;
+            while (i < n && isIdentifierChar(sql[i]))
+                ++i;
+            emit(sql.substr(start, i - start));
+        } else if (c == ';') {
+            ++i;
+            pendingSpace = true;
+            if (sql.find_first_not_of(" \t\r\n;", i) != std::string_view::npos)
+                emit(";");
+        } else {
+            emit(sql.substr(i, 1));
+            ++i;
+        }
+    }
+    return out;
+}
+
+class Profiler::Impl {
+    DBPP_NO_COPY_SEMANTICS(Impl);
+    DBPP_NO_MOVE_SEMANTICS(Impl);
+
+    struct Attachment {
+        std::weak_ptr<ConnectionState> state;
+        ConnectionState::ListenerId listenerId = 0;
+
+        // Only accessed from the trace callbacks of the connection, so it needs no locking
+        std::unordered_map<sqlite3_stmt*, std::uint64_t> rowsInFlight;
+        sqlite3_stmt* lastStmt = nullptr;
+        std::uint64_t* lastRows = nullptr;
+    };
+
+    // Protects the attachments. Never held while taking mutex_, but it is held while taking the
+    // connection mutex, which in turn is held by SQLite when calling the trace callback
+    std::mutex attachMutex_;
+    std::list<Attachment> attachments_;
+
+    // Normalizing is the expensive part of recording, so the aggregates are looked up by
+    // the raw SQL text first. SQL with inlined literals has unlimited distinct texts, so only
+    // the most recently used ones are kept
+    static constexpr std::size_t RawSqlCacheSize = 1024;
+    using RawSqlEntry = std::pair<std::string, Aggregate*>;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Aggregate> byNormalizedSql_;
+    std::list<RawSqlEntry> rawSql_; // Most recently used first. Owns the keys of byRawSql_
+    std::unordered_map<std::string_view, std::list<RawSqlEntry>::iterator> byRawSql_;
+
+    void record(sqlite3_stmt* stmt, std::uint64_t ns, std::uint64_t rows) {
+        const char* sqlText = sqlite3_sql(stmt);
+        if (sqlText == nullptr)
+            return;
+        std::string_view raw(sqlText);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        Aggregate* found = nullptr;
+        auto it = byRawSql_.find(raw);
+        if (it != byRawSql_.end()) {
+            rawSql_.splice(rawSql_.begin(), rawSql_, it->second);
+            found = it->second->second;
+        } else {
+            auto normalized = normalizeSql(raw);
+            found = &byNormalizedSql_[normalized];
+            if (found->sql.empty())
+                found->sql = std::move(normalized);
+            if (rawSql_.size() == RawSqlCacheSize) {
+                byRawSql_.erase(rawSql_.back().first);
+                rawSql_.pop_back();
+            }
+            rawSql_.emplace_front(raw, found);
+            byRawSql_.emplace(rawSql_.front().first, rawSql_.begin());
+        }
+
+        auto& aggregate = *found;
+        ++aggregate.calls;
+        aggregate.rows += rows;
+        aggregate.totalNs += ns;
+        aggregate.maxNs = std::max(aggregate.maxNs, ns);
+        ++aggregate.histogram[bucketOf(ns)];
+    }
+
+    void onTrace(Attachment& a, unsigned int type, void* p, void* x) {
+        auto* stmt = static_cast<sqlite3_stmt*>(p);
+        switch (type) {
+        case SQLITE_TRACE_STMT: {
+            // Statements run by triggers are reported with their text prefixed by a comment
+            const auto* text = static_cast<const char*>(x);
+            if (text != nullptr && text[0] == '-' && text[1] == '-')
+                break;
+            a.lastRows = &a.rowsInFlight[stmt];
+            a.lastStmt = stmt;
+            *a.lastRows = 0;
+            break;
+        }
+        case SQLITE_TRACE_ROW:
+            if (stmt != a.lastStmt) {
+                a.lastRows = &a.rowsInFlight[stmt];
+                a.lastStmt = stmt;
+            }
+            ++*a.lastRows;
+            break;
+        case SQLITE_TRACE_PROFILE: {
+            std::uint64_t rows = 0;
+            auto it = a.rowsInFlight.find(stmt);
+            if (it != a.rowsInFlight.end()) {
+                rows = it->second;
+                a.rowsInFlight.erase(it);
+            }
+            if (stmt == a.lastStmt) {
+                a.lastStmt = nullptr;
+                a.lastRows = nullptr;
+            }
+            auto ns = *static_cast<const sqlite3_int64*>(x);
+            record(stmt, static_cast<std::uint64_t>(std::max<sqlite3_int64>(ns, 0)), rows);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+public:
+    Impl() = default;
+
+    ~Impl() {
+        std::lock_guard<std::mutex> lock(attachMutex_);
+        for (auto& a : attachments_) {
+            if (auto state = a.state.lock())
+                state->removeTraceListener(a.listenerId);
+        }
+    }
+
+    void attach(const ConnectionStatePtr& state) {
+        std::lock_guard<std::mutex> lock(attachMutex_);
+        for (auto& a : attachments_) {
+            if (a.state.lock() == state)
+                return;
+        }
+        auto& a = attachments_.emplace_back();
+        a.state = state;
+        try {
+            a.listenerId = state->addTraceListener(SQLITE_TRACE_STMT | SQLITE_TRACE_ROW | SQLITE_TRACE_PROFILE,
+                                                   [this, &a](unsigned int type, void* p, void* x) { onTrace(a, type, p, x); });
+        } catch (...) {
+            attachments_.pop_back();
+            throw;
+        }
+    }
+
+    void detach(const ConnectionStatePtr& state) {
+        std::lock_guard<std::mutex> lock(attachMutex_);
+        for (auto it = attachments_.begin(); it != attachments_.end();) {
+            auto attached = it->state.lock();
+            if (attached == state) {
+                state->removeTraceListener(it->listenerId);
+                it = attachments_.erase(it);
+            } else if (!attached) {
+                it = attachments_.erase(it); // The connection has been closed
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    [[nodiscard]]
+    std::vector<StatementProfile> snapshot() const {
+        std::vector<StatementProfile> profiles;
+        std::lock_guard<std::mutex> lock(mutex_);
+        profiles.reserve(byNormalizedSql_.size());
+        for (const auto& [sql, aggregate] : byNormalizedSql_) {
+            StatementProfile p;
+            p.sql = aggregate.sql;
+            p.calls = aggregate.calls;
+            p.rows = aggregate.rows;
+            p.totalTime = std::chrono::nanoseconds(aggregate.totalNs);
+            p.meanTime = std::chrono::nanoseconds(aggregate.calls ? aggregate.totalNs / aggregate.calls : 0);
+            p.maxTime = std::chrono::nanoseconds(aggregate.maxNs);
+            p.p50 = std::chrono::nanoseconds(aggregate.percentile(0.50));
+            p.p95 = std::chrono::nanoseconds(aggregate.percentile(0.95));
+            p.p99 = std::chrono::nanoseconds(aggregate.percentile(0.99));
+            profiles.push_back(std::move(p));
+        }
+        std::sort(profiles.begin(), profiles.end(), [](const StatementProfile& a, const StatementProfile& b) {
+            return a.totalTime > b.totalTime || (a.totalTime == b.totalTime && a.sql < b.sql);
+        });
+        return profiles;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        byRawSql_.clear();
+        rawSql_.clear();
+        byNormalizedSql_.clear();
+    }
+};
+
+Profiler::Profiler()
+: impl_(std::make_shared<Impl>())
+{}
+
+Profiler::~Profiler() = default;
+
+void Profiler::attach(Dbpp::Connection& db) {
+    impl_->attach(connectionState(db));
+}
+
+void Profiler::detach(Dbpp::Connection& db) {
+    impl_->detach(connectionState(db));
+}
+
+std::vector<StatementProfile> Profiler::snapshot() const {
+    return impl_->snapshot();
+}
+
+std::string Profiler::prometheus(std::string_view prefix) const {
+    const auto profiles = snapshot();
+    const std::string duration = std::string(prefix) + "_statement_duration_seconds";
+    const std::string rows = std::string(prefix) + "_statement_rows_total";
+
+    std::string out;
+    auto label = [&out](const StatementProfile& p) {
+        out += "{sql=\"";
+        appendEscapedLabel(out, p.sql);
+        out += '"';
+    };
+
+    out += "# HELP " + duration + " Time spent executing SQL statements\n";
+    out += "# TYPE " + duration + " summary\n";
+    for (const auto& p : profiles) {
+        const std::pair<const char*, std::chrono::nanoseconds> quantiles[] = {{"0.5", p.p50}, {"0.95", p.p95}, {"0.99", p.p99}}; // NOLINT
+        for (const auto& [quantile, value] : quantiles) {
+            out += duration;
+            label(p);
+            out += ",quantile=\"";
+            out += quantile;
+            out += "\"} " + formatSeconds(value) + '\n';
+        }
+        out += duration + "_sum";
+        label(p);
+        out += "} " + formatSeconds(p.totalTime) + '\n';
+        out += duration + "_count";
+        label(p);
+        out += "} " + std::to_string(p.calls) + '\n';
+    }
+
+    out += "# HELP " + rows + " Rows returned by SQL statements\n";
+    out += "# TYPE " + rows + " counter\n";
+    for (const auto& p : profiles) {
+        out += rows;
+        label(p);
+        out += "} " + std::to_string(p.rows) + '\n';
+    }
+    return out;
+}
+
+void Profiler::reset() {
+    impl_->reset();
+}
+
+} // namespace Dbpp::Sqlite3
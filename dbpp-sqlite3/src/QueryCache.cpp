@@ -0,0 +1,356 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/QueryCache.h>
+#include <dbpp/sqlite3/Changes.h>
+
+#include "ConnectionState.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    // Approximate size of an sqlite3_value, not counting its text or blob
+    constexpr std::size_t ValueOverhead = 64;
+
+} // namespace
+
+CachedRows::CachedRows(sqlite3_stmt* stmt) {
+    const int count = sqlite3_column_count(stmt);
+    columnNames_.reserve(static_cast<std::size_t>(count));
+    for (int i = 0; i < count; ++i) {
+        const char* name = sqlite3_column_name(stmt, i);
+        columnNames_.emplace_back(name ? name : "");
+        bytes_ += sizeof(std::string) + columnNames_.back().size();
+    }
+}
+
+CachedRows::~CachedRows() {
+    for (auto* value : values_)
+        sqlite3_value_free(value);
+}
+
+void
+CachedRows::append(sqlite3_stmt* stmt) {
+    for (int i = 0; i < columnCount(); ++i) {
+        auto* value = sqlite3_value_dup(sqlite3_column_value(stmt, i));
+        if (value == nullptr)
+            throw Sqlite3Error(SQLITE_NOMEM, "Failed to copy result value");
+        values_.push_back(value);
+        bytes_ += sizeof(value) + ValueOverhead;
+        const int type = sqlite3_value_type(value);
+        if (type == SQLITE_TEXT || type == SQLITE_BLOB)
+            bytes_ += static_cast<std::size_t>(sqlite3_value_bytes(value));
+    }
+}
+
+std::size_t
+CachedRows::size() const {
+    return columnNames_.empty() ? 0 : values_.size() / columnNames_.size();
+}
+
+const std::string&
+CachedRows::columnName(int column) const {
+    if (column < 0 || column >= columnCount())
+        throw Dbpp::Error("Column index out of range");
+    return columnNames_[static_cast<std::size_t>(column)];
+}
+
+sqlite3_value*
+CachedRows::value(std::size_t row, int column) const {
+    if (row >= size() || column < 0 || column >= columnCount())
+        throw Dbpp::Error("Row or column index out of range");
+    return values_[row * columnNames_.size() + static_cast<std::size_t>(column)];
+}
+
+namespace Detail {
+
+    CacheKey::CacheKey(std::string_view sql)
+    : key_(sql)
+    {
+        key_ += '\0';
+    }
+
+    void CacheKey::addInteger(char tag, std::uint64_t value) {
+        key_ += tag;
+        char bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        key_.append(bytes, sizeof(bytes));
+    }
+
+    // All integers that SQLite stores the same way get the same key
+    void CacheKey::bind(std::nullptr_t) { key_ += 'n'; }
+    void CacheKey::bind(short value) { addInteger('i', static_cast<std::uint64_t>(static_cast<std::int64_t>(value))); }
+    void CacheKey::bind(int value) { addInteger('i', static_cast<std::uint64_t>(static_cast<std::int64_t>(value))); }
+    void CacheKey::bind(long value) { addInteger('i', static_cast<std::uint64_t>(static_cast<std::int64_t>(value))); }
+    void CacheKey::bind(long long value) { addInteger('i', static_cast<std::uint64_t>(static_cast<std::int64_t>(value))); }
+    void CacheKey::bind(unsigned short value) { addInteger('i', value); }
+    void CacheKey::bind(unsigned int value) { addInteger('i', value); }
+    void CacheKey::bind(unsigned long value) { addInteger('i', value); }
+    void CacheKey::bind(unsigned long long value) { addInteger('i', value); }
+    void CacheKey::bind(float value) { bind(static_cast<double>(value)); }
+
+    void CacheKey::bind(double value) {
+        std::uint64_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        addInteger('d', bits);
+    }
+
+    void CacheKey::bind(std::string_view value) {
+        addInteger('s', value.size());
+        key_ += value;
+    }
+
+    void CacheKey::bind(const std::pair<const unsigned char*, std::size_t>& data) {
+        addInteger('b', data.second);
+        key_.append(reinterpret_cast<const char*>(data.first), data.second); // NOLINT
+    }
+
+} // namespace Detail
+
+class QueryCache::Impl {
+    DBPP_NO_COPY_SEMANTICS(Impl);
+    DBPP_NO_MOVE_SEMANTICS(Impl);
+
+    struct Entry {
+        std::shared_ptr<const CachedRows> rows;
+        std::vector<std::string> tables;
+        std::list<const std::string*>::iterator lru;
+    };
+
+    struct StmtDeleter {
+        void operator()(sqlite3_stmt* p) const { sqlite3_finalize(p); }
+    };
+
+    ConnectionStatePtr state_;
+    QueryCacheOptions options_;
+    std::unique_ptr<sqlite3_stmt, StmtDeleter> versions_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::unordered_map<std::string, std::unordered_set<std::string>> keysByTable_;
+    std::list<const std::string*> lru_; // Keys of entries_, most recently used first
+    QueryCacheStats stats_;
+    sqlite3_int64 dataVersion_ = -1;
+    sqlite3_int64 schemaVersion_ = -1;
+
+    ChangeSubscription subscription_;
+
+    void erase(std::unordered_map<std::string, Entry>::iterator it) {
+        for (const auto& table : it->second.tables) {
+            auto keys = keysByTable_.find(table);
+            keys->second.erase(it->first);
+            if (keys->second.empty())
+                keysByTable_.erase(keys);
+        }
+        lru_.erase(it->second.lru);
+        stats_.bytes -= it->second.rows->bytes();
+        entries_.erase(it);
+    }
+
+    void invalidateAll() {
+        stats_.invalidations += entries_.size();
+        entries_.clear();
+        keysByTable_.clear();
+        lru_.clear();
+        stats_.bytes = 0;
+    }
+
+    // Clears the cache if another connection has committed, or the schema has changed
+    void checkVersions() {
+        const int res = sqlite3_step(versions_.get());
+        if (res == SQLITE_ROW) {
+            const auto dataVersion = sqlite3_column_int64(versions_.get(), 0);
+            const auto schemaVersion = sqlite3_column_int64(versions_.get(), 1);
+            if (dataVersion != dataVersion_ || schemaVersion != schemaVersion_)
+                invalidateAll();
+            dataVersion_ = dataVersion;
+            schemaVersion_ = schemaVersion;
+        } else {
+            invalidateAll();
+        }
+        (void) sqlite3_reset(versions_.get());
+    }
+
+public:
+    Impl(ConnectionStatePtr state, Dbpp::Connection& db, QueryCacheOptions options)
+    : state_(std::move(state)),
+      options_(options)
+    {
+        sqlite3_stmt* p = nullptr;
+        throwOnError(sqlite3_prepare_v3(state_->db(), "SELECT data_version, schema_version FROM pragma_data_version, pragma_schema_version",
+                                        -1, SQLITE_PREPARE_PERSISTENT, &p, nullptr),
+                     "Failed to prepare version check");
+        versions_.reset(p);
+
+        subscription_ = subscribeToChanges(db, [this](const std::vector<RowChange>& changes) { invalidate(changes); });
+        state_->addReadRecorder();
+    }
+
+    ~Impl() {
+        state_->removeReadRecorder();
+    }
+
+    [[nodiscard]]
+    sqlite3* db() const { return state_->db(); }
+
+    [[nodiscard]]
+    const ConnectionStatePtr& state() const { return state_; }
+
+    [[nodiscard]]
+    std::shared_ptr<const CachedRows> find(const std::string& key) {
+        std::lock_guard lock(mutex_);
+        checkVersions();
+        auto it = entries_.find(key);
+        if (it == entries_.end())
+            return nullptr;
+        ++stats_.hits;
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return it->second.rows;
+    }
+
+    void store(const std::string& key, std::shared_ptr<const CachedRows> rows, std::vector<std::string> tables) {
+        std::lock_guard lock(mutex_);
+        ++stats_.misses;
+        if (rows->bytes() > options_.maxEntryBytes || rows->bytes() > options_.maxBytes)
+            return;
+        if (auto existing = entries_.find(key); existing != entries_.end())
+            erase(existing);
+
+        std::sort(tables.begin(), tables.end());
+        tables.erase(std::unique(tables.begin(), tables.end()), tables.end());
+        stats_.bytes += rows->bytes();
+        auto [it, inserted] = entries_.emplace(key, Entry{std::move(rows), std::move(tables), {}});
+        lru_.push_front(&it->first);
+        it->second.lru = lru_.begin();
+        for (const auto& table : it->second.tables)
+            keysByTable_[table].insert(it->first);
+
+        while (stats_.bytes > options_.maxBytes) {
+            erase(entries_.find(*lru_.back()));
+            ++stats_.evictions;
+        }
+    }
+
+    void bypassed() {
+        std::lock_guard lock(mutex_);
+        ++stats_.bypasses;
+    }
+
+    void invalidate(const std::vector<RowChange>& changes) {
+        std::lock_guard lock(mutex_);
+        try {
+            for (auto change = changes.begin(); change != changes.end(); ++change) {
+                // The changes are sorted by table
+                if (change != changes.begin() && change->table == std::prev(change)->table)
+                    continue;
+                // The changes weren't recorded, so any table may have changed
+                if (change->table.empty()) {
+                    invalidateAll();
+                    return;
+                }
+                auto keys = keysByTable_.find(change->table);
+                if (keys == keysByTable_.end())
+                    continue;
+                const std::vector<std::string> invalid(keys->second.begin(), keys->second.end());
+                for (const auto& key : invalid) {
+                    erase(entries_.find(key));
+                    ++stats_.invalidations;
+                }
+            }
+        } catch (...) {
+            // Exceptions from the listeners are dropped, and stale entries must not remain
+            invalidateAll();
+        }
+    }
+
+    void clear() {
+        std::lock_guard lock(mutex_);
+        entries_.clear();
+        keysByTable_.clear();
+        lru_.clear();
+        stats_.bytes = 0;
+    }
+
+    [[nodiscard]]
+    QueryCacheStats stats() const {
+        std::lock_guard lock(mutex_);
+        auto stats = stats_;
+        stats.entries = entries_.size();
+        return stats;
+    }
+};
+
+QueryCache::QueryCache(Dbpp::Connection& db, QueryCacheOptions options)
+: db_(db),
+  impl_(std::make_unique<Impl>(connectionState(db), db, options))
+{}
+
+QueryCache::~QueryCache() = default;
+
+std::shared_ptr<const CachedRows>
+QueryCache::lookup(const std::string& key, const std::function<Dbpp::Statement()>& prepare) {
+    // Reads within a transaction may see its uncommitted changes
+    const bool cacheable = sqlite3_get_autocommit(impl_->db()) != 0;
+    if (cacheable) {
+        if (auto rows = impl_->find(key))
+            return rows;
+    }
+
+    std::vector<std::string> tables;
+    auto statement = [&] {
+        struct Recording {
+            ConnectionState& state;
+            ~Recording() { state.recordReadTables(nullptr); }
+        } recording{*impl_->state()};
+        impl_->state()->recordReadTables(&tables);
+        return prepare();
+    }();
+
+    auto* handle = statementHandle(statement);
+    auto rows = std::make_shared<CachedRows>(handle);
+    for (auto& row : statement) {
+        (void) row;
+        rows->append(handle);
+    }
+
+    if (cacheable && sqlite3_stmt_readonly(handle))
+        impl_->store(key, rows, std::move(tables));
+    else
+        impl_->bypassed();
+    return rows;
+}
+
+void
+QueryCache::clear() {
+    impl_->clear();
+}
+
+QueryCacheStats
+QueryCache::stats() const {
+    return impl_->stats();
+}
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,206 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/QueryPlan.h>
+
+#include "ConnectionState.h"
+
+#include <map>
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    bool isFullScan(const std::string& detail) {
+        // "SCAN person" is a full table scan, while "SCAN person USING INDEX ..." and
+        // "SCAN CONSTANT ROW" are not. SQLite versions before 3.36 say "SCAN TABLE person"
+        return detail.compare(0, 5, "SCAN ") == 0
+               && detail.find(" USING ") == std::string::npos
+               && detail.find("VIRTUAL TABLE") == std::string::npos
+               && detail != "SCAN CONSTANT ROW";
+    }
+
+    bool isAutomaticIndex(const std::string& detail) {
+        return detail.find("AUTOMATIC") != std::string::npos;
+    }
+
+    template <typename Predicate>
+    bool anyNode(const std::vector<QueryPlanNode>& nodes, Predicate pred) {
+        for (const auto& node : nodes) {
+            if (pred(node.detail) || anyNode(node.children, pred))
+                return true;
+        }
+        return false;
+    }
+
+    void appendTree(std::string& out, const std::vector<QueryPlanNode>& nodes, const std::string& prefix) {
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            const bool last = i + 1 == nodes.size();
+            out += prefix + (last ? "`--" : "|--") + nodes[i].detail + '\n';
+            appendTree(out, nodes[i].children, prefix + (last ? "   " : "|  "));
+        }
+    }
+
+    QueryPlan explain(sqlite3* db, const char* sql) {
+        struct Row {
+            int id;
+            int parent;
+            std::string detail;
+        };
+        std::vector<Row> rows;
+        {
+            const std::string explainSql = std::string("EXPLAIN QUERY PLAN ") + sql;
+            sqlite3_stmt* stmt; // NOLINT - initialized by sqlite3_prepare_v2
+            throwOnError(sqlite3_prepare_v2(db, explainSql.c_str(), -1, &stmt, nullptr), "Failed to prepare statement " + explainSql);
+            std::unique_ptr<sqlite3_stmt, int (*)(sqlite3_stmt*)> guard(stmt, sqlite3_finalize);
+            int res = SQLITE_OK;
+            while ((res = sqlite3_step(stmt)) == SQLITE_ROW) {
+                const auto* detail = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)); // NOLINT
+                rows.push_back({sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), detail ? detail : ""});
+            }
+            if (res != SQLITE_DONE)
+                throwOnError(res, "Failed to explain statement");
+        }
+
+        // Children always come after their parents, so the tree can be built bottom-up
+        std::map<int, std::vector<QueryPlanNode>> childrenOf;
+        QueryPlan plan;
+        for (auto it = rows.rbegin(); it != rows.rend(); ++it) {
+            QueryPlanNode node;
+            node.id = it->id;
+            node.detail = std::move(it->detail);
+            auto children = childrenOf.find(node.id);
+            if (children != childrenOf.end()) {
+                node.children.assign(std::make_move_iterator(children->second.rbegin()), std::make_move_iterator(children->second.rend()));
+                childrenOf.erase(children);
+            }
+            childrenOf[it->parent].push_back(std::move(node));
+        }
+        auto roots = childrenOf.find(0);
+        if (roots != childrenOf.end())
+            plan.nodes.assign(std::make_move_iterator(roots->second.rbegin()), std::make_move_iterator(roots->second.rend()));
+        return plan;
+    }
+
+} // namespace
+
+bool QueryPlan::hasFullScan() const {
+    return anyNode(nodes, isFullScan);
+}
+
+bool QueryPlan::hasAutomaticIndex() const {
+    return anyNode(nodes, isAutomaticIndex);
+}
+
+std::string QueryPlan::toString() const {
+    std::string out = "QUERY PLAN\n";
+    appendTree(out, nodes, "");
+    return out;
+}
+
+StatementStatus statementStatus(Dbpp::Statement& stmt, bool reset) {
+    auto* handle = statementHandle(stmt);
+    const int resetFlag = reset ? 1 : 0;
+    StatementStatus status;
+    status.fullScanSteps = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_FULLSCAN_STEP, resetFlag);
+    status.sorts = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_SORT, resetFlag);
+    status.autoIndexRows = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_AUTOINDEX, resetFlag);
+    status.vmSteps = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_VM_STEP, resetFlag);
+    status.reprepares = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_REPREPARE, resetFlag);
+    status.runs = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_RUN, resetFlag);
+#ifdef SQLITE_STMTSTATUS_FILTER_HIT
+    status.filterHits = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_FILTER_HIT, resetFlag);
+    status.filterMisses = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_FILTER_MISS, resetFlag);
+#endif
+    status.memoryUsed = sqlite3_stmt_status(handle, SQLITE_STMTSTATUS_MEMUSED, 0);
+    return status;
+}
+
+QueryPlan explainPlan(Dbpp::Statement& stmt) {
+    auto* handle = statementHandle(stmt);
+    return explain(sqlite3_db_handle(handle), sqlite3_sql(handle));
+}
+
+// DBPP_SQLITE3_HAVE_SCANSTATUS is set by the build when the SQLite library exports
+// sqlite3_stmt_scanstatus(). SQLITE_ENABLE_STMT_SCANSTATUS is set when SQLite is built
+// together with dbpp
+#if defined(DBPP_SQLITE3_HAVE_SCANSTATUS) || defined(SQLITE_ENABLE_STMT_SCANSTATUS)
+bool scanStatusSupported() {
+    return true;
+}
+#else
+bool scanStatusSupported() {
+    return false;
+}
+#endif
+
+std::vector<ScanStatus> scanStatus(Dbpp::Statement& stmt) {
+    std::vector<ScanStatus> loops;
+#if defined(DBPP_SQLITE3_HAVE_SCANSTATUS) || defined(SQLITE_ENABLE_STMT_SCANSTATUS)
+    auto* handle = statementHandle(stmt);
+    for (int idx = 0;; ++idx) {
+        sqlite3_int64 nLoop = 0;
+        if (sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_NLOOP, &nLoop) != 0)
+            break;
+        ScanStatus loop;
+        loop.loops = nLoop;
+        sqlite3_int64 nVisit = 0;
+        sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_NVISIT, &nVisit);
+        loop.rowsVisited = nVisit;
+        sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_EST, &loop.estimatedRows);
+        const char* text = nullptr;
+        sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_NAME, &text);
+        loop.name = text ? text : "";
+        text = nullptr;
+        sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_EXPLAIN, &text);
+        loop.explain = text ? text : "";
+        sqlite3_stmt_scanstatus(handle, idx, SQLITE_SCANSTAT_SELECTID, &loop.selectId);
+        loops.push_back(std::move(loop));
+    }
+#else
+    (void) statementHandle(stmt); // Still reject statements from other adapters
+#endif
+    return loops;
+}
+
+void enablePlanAssertions(Dbpp::Connection& db, PlanAssertions assertions) {
+    connectionState(db)->planAssertions = std::make_unique<PlanAssertions>(std::move(assertions));
+}
+
+void disablePlanAssertions(Dbpp::Connection& db) {
+    connectionState(db)->planAssertions.reset();
+}
+
+void checkPlanAssertions(const PlanAssertions& assertions, sqlite3_stmt* stmt) {
+    const bool autoIndex = assertions.failOnAutomaticIndex && sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0) > 0;
+    const bool fullScan = assertions.failOnFullScan && sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0) > 0;
+    if (!autoIndex && !fullScan)
+        return;
+
+    const char* sql = sqlite3_sql(stmt);
+    if (assertions.ignore && assertions.ignore(sql))
+        return;
+
+    // Building an automatic index also scans the table, so report the more specific problem first
+    std::string message = autoIndex ? "Automatic index built by statement: " : "Full table scan in statement: ";
+    message += sql;
+    message += '\n';
+    message += explain(sqlite3_db_handle(stmt), sql).toString();
+    throw QueryPlanViolation(message);
+}
+
+} // namespace Dbpp::Sqlite3
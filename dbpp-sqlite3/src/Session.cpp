@@ -0,0 +1,258 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/Session.h>
+
+#include "ConnectionState.h"
+
+#include <exception>
+#include <limits>
+#include <string>
+
+// sqlite3.h only declares the session extension when SQLITE_ENABLE_SESSION is defined.
+// The build defines it for this file when the library provides the extension.
+
+namespace Dbpp::Sqlite3 {
+
+#ifdef DBPP_SQLITE3_HAVE_SESSION
+
+namespace {
+
+    struct BufferDeleter {
+        void operator()(void* p) const { sqlite3_free(p); }
+    };
+
+    using Buffer = std::unique_ptr<void, BufferDeleter>;
+
+    std::vector<std::byte> toVector(const Buffer& buffer, int size) {
+        const auto* first = static_cast<const std::byte*>(buffer.get());
+        return {first, first + size};
+    }
+
+    int checkedSize(BlobView changeset) {
+        if (changeset.size > static_cast<std::size_t>(std::numeric_limits<int>::max()))
+            throw Dbpp::Error("Changeset is too large");
+        return static_cast<int>(changeset.size);
+    }
+
+    ConflictType conflictType(int conflict) {
+        switch (conflict) {
+            case SQLITE_CHANGESET_DATA: return ConflictType::Data;
+            case SQLITE_CHANGESET_NOTFOUND: return ConflictType::NotFound;
+            case SQLITE_CHANGESET_CONFLICT: return ConflictType::Conflict;
+            case SQLITE_CHANGESET_CONSTRAINT: return ConflictType::Constraint;
+            default: return ConflictType::ForeignKey;
+        }
+    }
+
+    ChangeOperation changeOperation(int op) {
+        switch (op) {
+            case SQLITE_INSERT: return ChangeOperation::Insert;
+            case SQLITE_UPDATE: return ChangeOperation::Update;
+            default: return ChangeOperation::Delete;
+        }
+    }
+
+    struct ApplyContext {
+        const ConflictHandler& handler;
+        std::exception_ptr exception;
+    };
+
+    int conflictCallback(void* context, int conflict, sqlite3_changeset_iter* iter) {
+        auto& ctx = *static_cast<ApplyContext*>(context);
+        if (!ctx.handler)
+            return SQLITE_CHANGESET_ABORT;
+
+        try {
+            const char* table = nullptr;
+            int columns = 0;
+            int op = 0;
+            throwOnError(sqlite3changeset_op(iter, &table, &columns, &op, nullptr), "Failed to read conflicting change");
+
+            const Conflict c{conflictType(conflict), changeOperation(op), table};
+            switch (ctx.handler(c)) {
+                case ConflictAction::Omit:
+                    return SQLITE_CHANGESET_OMIT;
+                case ConflictAction::Replace:
+                    if (c.type != ConflictType::Data && c.type != ConflictType::Conflict)
+                        throw Dbpp::Error("ConflictAction::Replace is only allowed for data and primary key conflicts");
+                    return SQLITE_CHANGESET_REPLACE;
+                case ConflictAction::Abort:
+                default:
+                    break;
+            }
+        } catch (...) {
+            ctx.exception = std::current_exception();
+        }
+        return SQLITE_CHANGESET_ABORT;
+    }
+
+} // namespace
+
+class Session::Impl {
+    DBPP_NO_COPY_SEMANTICS(Impl);
+    DBPP_NO_MOVE_SEMANTICS(Impl);
+
+    ConnectionStatePtr state_; // Keeps the connection open for as long as the session exists
+    sqlite3_session* session_ = nullptr;
+
+public:
+    Impl(ConnectionStatePtr state, const std::string& schema)
+    : state_(std::move(state))
+    {
+        throwOnError(sqlite3session_create(state_->db(), schema.c_str(), &session_), "Failed to create session");
+    }
+
+    ~Impl() {
+        sqlite3session_delete(session_);
+    }
+
+    [[nodiscard]]
+    sqlite3_session* session() const { return session_; }
+};
+
+bool sessionsSupported() {
+    return true;
+}
+
+Session::Session(Dbpp::Connection& db, std::string_view schema)
+: impl_(std::make_unique<Impl>(connectionState(db), std::string(schema)))
+{}
+
+Session::Session(Session&&) noexcept = default;
+Session& Session::operator=(Session&&) noexcept = default;
+Session::~Session() = default;
+
+Session&
+Session::attach(std::string_view table) {
+    const std::string name(table);
+    throwOnError(sqlite3session_attach(impl_->session(), name.c_str()), "Failed to attach table to session");
+    return *this;
+}
+
+Session&
+Session::attachAll() {
+    throwOnError(sqlite3session_attach(impl_->session(), nullptr), "Failed to attach tables to session");
+    return *this;
+}
+
+void
+Session::setEnabled(bool enabled) {
+    (void) sqlite3session_enable(impl_->session(), enabled ? 1 : 0);
+}
+
+bool
+Session::enabled() const {
+    return sqlite3session_enable(impl_->session(), -1) != 0;
+}
+
+bool
+Session::empty() const {
+    return sqlite3session_isempty(impl_->session()) != 0;
+}
+
+std::vector<std::byte>
+Session::changeset() const {
+    int size = 0;
+    void* p = nullptr;
+    const int res = sqlite3session_changeset(impl_->session(), &size, &p);
+    Buffer buffer(p);
+    throwOnError(res, "Failed to create changeset");
+    return toVector(buffer, size);
+}
+
+std::vector<std::byte>
+Session::patchset() const {
+    int size = 0;
+    void* p = nullptr;
+    const int res = sqlite3session_patchset(impl_->session(), &size, &p);
+    Buffer buffer(p);
+    throwOnError(res, "Failed to create patchset");
+    return toVector(buffer, size);
+}
+
+void
+applyChangeset(Dbpp::Connection& db, BlobView changeset, const ConflictHandler& handler) {
+    const auto size = checkedSize(changeset);
+    ApplyContext context{handler, nullptr};
+    // sqlite3changeset_apply() only reads the changeset, even though it takes a non-const pointer
+    auto* data = const_cast<std::byte*>(changeset.data); // NOLINT
+    const int res = sqlite3changeset_apply(connectionState(db)->db(), size, data, nullptr, conflictCallback, &context);
+    if (context.exception)
+        std::rethrow_exception(context.exception);
+    throwOnError(res, "Failed to apply changeset");
+}
+
+std::vector<std::byte>
+invertChangeset(BlobView changeset) {
+    const auto size = checkedSize(changeset);
+    int invertedSize = 0;
+    void* p = nullptr;
+    const int res = sqlite3changeset_invert(size, changeset.data, &invertedSize, &p);
+    Buffer buffer(p);
+    throwOnError(res, "Failed to invert changeset");
+    return toVector(buffer, invertedSize);
+}
+
+#else // DBPP_SQLITE3_HAVE_SESSION
+
+namespace {
+
+    [[noreturn]] void throwUnsupported() {
+        throw Dbpp::Error("The SQLite library was built without the session extension");
+    }
+
+} // namespace
+
+class Session::Impl {};
+
+bool sessionsSupported() {
+    return false;
+}
+
+Session::Session(Dbpp::Connection&, std::string_view) {
+    throwUnsupported();
+}
+
+Session::Session(Session&&) noexcept = default;
+Session& Session::operator=(Session&&) noexcept = default;
+Session::~Session() = default;
+
+Session& Session::attach(std::string_view) { throwUnsupported(); }
+Session& Session::attachAll() { throwUnsupported(); }
+void Session::setEnabled(bool) { throwUnsupported(); }
+bool Session::enabled() const { throwUnsupported(); }
+bool Session::empty() const { throwUnsupported(); }
+std::vector<std::byte> Session::changeset() const { throwUnsupported(); }
+std::vector<std::byte> Session::patchset() const { throwUnsupported(); }
+
+void applyChangeset(Dbpp::Connection&, BlobView, const ConflictHandler&) {
+    throwUnsupported();
+}
+
+std::vector<std::byte> invertChangeset(BlobView) {
+    throwUnsupported();
+}
+
+#endif // DBPP_SQLITE3_HAVE_SESSION
+
+void
+applyChangeset(Dbpp::Connection& db, const std::vector<std::byte>& changeset, const ConflictHandler& handler) {
+    applyChangeset(db, BlobView{changeset.data(), changeset.size()}, handler);
+}
+
+} // namespace Dbpp::Sqlite3
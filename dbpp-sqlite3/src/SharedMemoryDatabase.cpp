@@ -0,0 +1,170 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/SharedMemoryDatabase.h>
+
+#include <dbpp/sqlite3/Sqlite3.h>
+
+#include "ConnectionState.h"
+
+#include <cctype>
+#include <mutex>
+#include <set>
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    // The names of the databases that have an object
+    struct NameRegistry {
+        std::mutex mutex;
+        std::set<std::string, std::less<>> names;
+        unsigned long long nextId = 0;
+    };
+
+    NameRegistry& nameRegistry() {
+        static NameRegistry registry;
+        return registry;
+    }
+
+    std::string reserveName(std::string_view name) {
+        auto& registry = nameRegistry();
+        std::lock_guard lock(registry.mutex);
+        std::string reserved(name);
+        if (reserved.empty()) {
+            do {
+                reserved = "dbpp-shared-" + std::to_string(registry.nextId++);
+            } while (registry.names.count(reserved) != 0);
+        }
+        if (!registry.names.insert(reserved).second)
+            throw Dbpp::Error("A shared in-memory database named " + reserved + " already exists");
+        return reserved;
+    }
+
+    // Holds a name in the registry. Shared by the object and its connections, since memdb
+    // keeps the database until the last connection to it is closed
+    class NameReservation {
+        DBPP_NO_COPY_SEMANTICS(NameReservation);
+        DBPP_NO_MOVE_SEMANTICS(NameReservation);
+
+        std::string name_;
+
+    public:
+        explicit NameReservation(std::string_view name)
+        : name_(reserveName(name))
+        {}
+
+        ~NameReservation() {
+            auto& registry = nameRegistry();
+            std::lock_guard lock(registry.mutex);
+            registry.names.erase(name_);
+        }
+
+        [[nodiscard]]
+        const std::string& name() const { return name_; }
+    };
+
+    // A name starting with a slash makes memdb share the database between connections
+    std::string memdbUri(std::string_view name) {
+        static constexpr char hex[] = "0123456789ABCDEF";
+        std::string uri = "file:/";
+        for (const char c : name) {
+            const auto u = static_cast<unsigned char>(c);
+            if (std::isalnum(u) || c == '-' || c == '.' || c == '_' || c == '~' || c == '/') {
+                uri += c;
+            } else {
+                uri += '%';
+                uri += hex[u >> 4U]; // NOLINT
+                uri += hex[u & 0xFU]; // NOLINT
+            }
+        }
+        uri += "?vfs=memdb";
+        return uri;
+    }
+
+} // namespace
+
+class SharedMemoryDatabase::Impl {
+    DBPP_NO_COPY_SEMANTICS(Impl);
+    DBPP_NO_MOVE_SEMANTICS(Impl);
+
+    std::shared_ptr<const NameReservation> name_;
+    std::string uri_;
+    std::unique_ptr<Dbpp::Connection> anchor_; // Keeps the database alive
+
+public:
+    explicit Impl(std::string_view name)
+    : name_(std::make_shared<const NameReservation>(name)),
+      uri_(memdbUri(name_->name())),
+      anchor_(std::make_unique<Dbpp::Connection>(connect(OpenMode::ReadWriteCreate, OpenFlag::None)))
+    {}
+
+    [[nodiscard]]
+    const std::string& name() const { return name_->name(); }
+
+    [[nodiscard]]
+    const std::string& uri() const { return uri_; }
+
+    [[nodiscard]]
+    Dbpp::Connection connect(OpenMode mode, OpenFlag flags) const {
+        auto db = open(uri_, mode, static_cast<OpenFlag>(static_cast<unsigned int>(flags) | static_cast<unsigned int>(OpenFlag::Uri)));
+        connectionState(db)->keepAlive = name_;
+        return db;
+    }
+
+    void copyFrom(Dbpp::Connection& source) {
+        auto* destination = connectionState(*anchor_)->db();
+        auto* backup = sqlite3_backup_init(destination, "main", connectionState(source)->db(), "main");
+        if (!backup)
+            throwOnError(sqlite3_errcode(destination), "Failed to copy the database");
+        const int res = sqlite3_backup_step(backup, -1);
+        sqlite3_backup_finish(backup);
+        if (res != SQLITE_DONE)
+            throwOnError(res, "Failed to copy the database");
+    }
+};
+
+SharedMemoryDatabase::SharedMemoryDatabase(std::string_view name)
+: impl_(std::make_unique<Impl>(name))
+{}
+
+SharedMemoryDatabase::SharedMemoryDatabase(Dbpp::Connection& source, std::string_view name)
+: impl_(std::make_unique<Impl>(name))
+{
+    impl_->copyFrom(source);
+}
+
+SharedMemoryDatabase::SharedMemoryDatabase(SharedMemoryDatabase&&) noexcept = default;
+SharedMemoryDatabase& SharedMemoryDatabase::operator=(SharedMemoryDatabase&&) noexcept = default;
+SharedMemoryDatabase::~SharedMemoryDatabase() = default;
+
+const std::string&
+SharedMemoryDatabase::name() const {
+    return impl_->name();
+}
+
+const std::string&
+SharedMemoryDatabase::uri() const {
+    return impl_->uri();
+}
+
+Dbpp::Connection
+SharedMemoryDatabase::connect(OpenMode mode, OpenFlag flags) const {
+    return impl_->connect(mode, flags);
+}
+
+} // namespace Dbpp::Sqlite3
@@ -0,0 +1,91 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/SlowQueryLog.h>
+
+#include "ConnectionState.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace Dbpp::Sqlite3 {
+
+void SlowQueryTimer::beforeStep(ConnectionState& state, sqlite3_stmt* stmt) {
+    if (phase_ != Phase::Idle)
+        return;
+    if (!state.slowQueryLog->sample()) {
+        phase_ = Phase::Skipping;
+        return;
+    }
+    phase_ = Phase::Timing;
+    rows_ = 0;
+    lastResult_ = SQLITE_OK;
+    vmStepsAtStart_ = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+    lockWaitsAtStart_ = state.lockWaits();
+    started_ = std::chrono::steady_clock::now();
+}
+
+void SlowQueryTimer::afterStep(ConnectionState& state, sqlite3_stmt* stmt, int res) noexcept {
+    lastResult_ = res;
+    if (res == SQLITE_ROW)
+        ++rows_;
+    else
+        finish(state, stmt); // Failed executions are logged too, since giving up is often what made them slow
+}
+
+void SlowQueryTimer::finish(ConnectionState& state, sqlite3_stmt* stmt) noexcept {
+    const auto duration = std::chrono::steady_clock::now() - started_;
+    const bool timed = phase_ == Phase::Timing;
+    phase_ = Phase::Idle;
+
+    // The log may have been disabled since the execution started
+    if (!timed || !state.slowQueryLog || duration < state.slowQueryLog->settings.threshold)
+        return;
+
+    try {
+        const auto log = state.slowQueryLog;
+        SlowQuery entry;
+        char* expanded = sqlite3_expanded_sql(stmt);
+        if (expanded) {
+            std::unique_ptr<char, decltype(&sqlite3_free)> owner(expanded, sqlite3_free);
+            entry.sql = expanded;
+        } else {
+            entry.sql = sqlite3_sql(stmt);
+        }
+        entry.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
+        entry.rows = rows_;
+        entry.vmSteps = std::max(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0) - vmStepsAtStart_, 0);
+        entry.waitedOnLock = state.lockWaits() != lockWaitsAtStart_;
+        entry.resultCode = lastResult_;
+        log->settings.callback(entry);
+    } catch (...) { // NOLINT(bugprone-empty-catch) - the entry is dropped rather than replacing the statement's result
+    }
+}
+
+void enableSlowQueryLog(Dbpp::Connection& db, SlowQueryLog log) {
+    if (!log.callback)
+        throw Error("The slow query log needs a callback");
+    if (log.sampleEvery == 0)
+        throw Error("The sample rate of the slow query log must be at least 1");
+    connectionState(db)->slowQueryLog = std::make_shared<SlowQueryLogState>(std::move(log));
+}
+
+void disableSlowQueryLog(Dbpp::Connection& db) {
+    connectionState(db)->slowQueryLog.reset();
+}
+
+} // namespace Dbpp::Sqlite3
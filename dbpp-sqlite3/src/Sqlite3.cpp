@@ -22,7 +22,10 @@
 #include <dbpp/adapter/PreparedStatement.h>
 #include <dbpp/sqlite3/Sqlite3.h>
 
+#include "ConnectionState.h"
+
 #include <cassert>
+#include <cstring>
 #include <filesystem>
 #include <functional>
 #include <limits>
@@ -34,23 +37,6 @@ namespace Dbpp::Sqlite3 {
 using Sqlite3HandleT = std::shared_ptr<struct sqlite3>;
 using StmtHandleT = std::shared_ptr<sqlite3_stmt>;
 
-class Sqlite3Error final : public Dbpp::ErrorWithCode {
-public:
-    using ErrorWithCode::ErrorWithCode;
-
-    [[nodiscard]]
-    const char* what() const noexcept override  {
-        static std::string msg;
-        msg = std::string(ErrorWithCode::what()) + ": " + sqlite3_errstr(static_cast<int>(code));
-        return msg.c_str();
-    }
-};
-
-static void throwOnError(int errcode, const std::string& message) {
-    if (errcode != SQLITE_OK)
-        throw Sqlite3Error(errcode, message);
-}
-
 class Result;
 
 struct ColInfo {
@@ -202,10 +188,11 @@ public:
 
 class Statement final : public Adapter::PreparedStatement {
 private:
-    Sqlite3HandleT connectionHandle_;
+    ConnectionStatePtr state_;
     StmtHandleT handle_;
     ColInfoPtr colInfo_;
     int placeholderPosition_ = 0;
+    SlowQueryTimer slowQueryTimer_;
 
     static void throwOnBindError(int errcode) {
         throwOnError(errcode, "Error when binding value to placeholder");
@@ -223,18 +210,34 @@ private:
     }
 
 public:
-    Statement(Sqlite3HandleT conn, std::string_view sql)
-    : connectionHandle_(std::move(conn)) {
+    // If tail is given, sql may contain several statements, and tail is set to the part after
+    // the first one. The handle is null if there is no statement before the tail
+    Statement(ConnectionStatePtr state, std::string_view sql, std::string_view* tail = nullptr)
+    : state_(std::move(state)) {
         sqlite3_stmt* stmt; // NOLINT - stmt gets initialized by the call to sqlite3_prepare
-        int res = sqlite3_prepare_v2(connectionHandle_.get(),
+        const char* tailp = nullptr;
+        int res = sqlite3_prepare_v2(state_->db(),
                 sql.data(), static_cast<int>(sql.length()),
-                &stmt, nullptr);
-        throwOnError(res, std::string{"Failed to prepare statement "} + std::string{sql});
+                &stmt, tail ? &tailp : nullptr);
+        if (res != SQLITE_OK)
+            throwOnError(res, std::string{"Failed to prepare statement "} + std::string{sql});
+        if (tail)
+            *tail = sql.substr(static_cast<std::size_t>(tailp - sql.data()));
         handle_ = StmtHandleT(stmt, sqlite3_finalize);
         colInfo_ = std::make_shared<ColInfo>();
         colInfo_->numCols = sqlite3_column_count(handle_.get());
     }
 
+    ~Statement() override {
+        if (slowQueryTimer_.active())
+            slowQueryTimer_.finish(*state_, handle_.get());
+    }
+
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+    Statement(Statement&&) = delete;
+    Statement& operator=(Statement&&) = delete;
+
     void preBind(std::size_t numParameters) override {
         auto count = static_cast<std::size_t>(sqlite3_bind_parameter_count(handle_.get()));
         if (numParameters == count)
@@ -288,24 +291,53 @@ public:
 
     [[nodiscard]]
     Adapter::ResultPtr step() override {
+        if (state_->hasQueryLimits() && !sqlite3_stmt_busy(handle_.get()))
+            state_->throwIfLimitExceeded(SQLITE_INTERRUPT);
+        if (state_->slowQueryLog)
+            slowQueryTimer_.beforeStep(*state_, handle_.get());
         int res = sqlite3_step(handle_.get());
-        if (res != SQLITE_DONE && res != SQLITE_ROW)
+        if (res != SQLITE_DONE && res != SQLITE_ROW) {
+            if (slowQueryTimer_.active())
+                slowQueryTimer_.afterStep(*state_, handle_.get(), res);
+            try {
+                state_->throwIfLimitExceeded(res);
+            } catch (const QueryCancelled&) {
+                // Makes the statement ready to be executed again, without reporting the error again
+                sqlite3_reset(handle_.get());
+                throw;
+            }
             throwOnError(res, "Failed to step/execute statement");
-        return std::make_shared<Result>(connectionHandle_, handle_, colInfo_);
+        }
+        if (state_->committing())
+            state_->afterCommit();
+        if (slowQueryTimer_.active())
+            slowQueryTimer_.afterStep(*state_, handle_.get(), res);
+        if (state_->planAssertions)
+            checkPlanAssertions(*state_->planAssertions, handle_.get());
+        return std::make_shared<Result>(Sqlite3HandleT(state_, state_->db()), handle_, colInfo_);
     }
 
     void reset() override {
         int res = sqlite3_reset(handle_.get());
+        if (slowQueryTimer_.active())
+            slowQueryTimer_.finish(*state_, handle_.get());
         throwOnError(res, "Failed to reset statement");
     }
 
     void resetAndClearBindings() override {
         int res = sqlite3_reset(handle_.get());
+        if (slowQueryTimer_.active())
+            slowQueryTimer_.finish(*state_, handle_.get());
         throwOnError(res, "Failed to reset statement");
         res = sqlite3_clear_bindings(handle_.get());
         throwOnError(res, "Failed to clear statement bindings");
         placeholderPosition_ = 0;
     }
+
+    [[nodiscard]]
+    sqlite3_stmt* handle() const {
+        return handle_.get();
+    }
 };
 
 class Connection final : public Adapter::Connection {
@@ -313,18 +345,20 @@ class Connection final : public Adapter::Connection {
 public:
 
 private:
-    Sqlite3HandleT handle_;
+    ConnectionStatePtr state_;
+    Sqlite3HandleT handle_; // Aliases state_, so statements and results keep the state alive
 
 public:
-    Connection(const std::filesystem::path& filename, OpenMode mode, OpenFlag flags) {
+    Connection(const std::filesystem::path& filename, OpenMode mode, OpenFlag flags, const char* vfs = nullptr) {
         struct sqlite3* conn; // NOLINT
-        int res = sqlite3_open_v2(filename.u8string().c_str(), &conn, static_cast<int>(static_cast<unsigned int>(mode) | static_cast<unsigned int>(flags)), nullptr);
+        int res = sqlite3_open_v2(filename.u8string().c_str(), &conn, static_cast<int>(static_cast<unsigned int>(mode) | static_cast<unsigned int>(flags)), vfs);
         if (res != SQLITE_OK) {
             if (conn != nullptr)
                 sqlite3_close(conn);
             throw Sqlite3Error(res, "Failed to open database");
         }
-        handle_ = Sqlite3HandleT(conn, sqlite3_close_v2);
+        state_ = std::make_shared<ConnectionState>(conn);
+        handle_ = Sqlite3HandleT(state_, conn);
     }
 
     [[nodiscard]]
@@ -344,24 +378,48 @@ public:
     }
 
     void rollback() override {
-        auto res = createStatement("ROLLBACK")->step();
-        (void) res;
+        // SQLite has already rolled back the transaction if a write in it was interrupted
+        if (sqlite3_get_autocommit(state_->db()) != 0)
+            return;
+        state_->queryLimitsSuspended = true;
+        try {
+            auto res = createStatement("ROLLBACK")->step();
+            (void) res;
+        } catch (...) {
+            state_->queryLimitsSuspended = false;
+            throw;
+        }
+        state_->queryLimitsSuspended = false;
     }
 
     [[nodiscard]] Adapter::PreparedStatementPtr createPreparedStatement(std::string_view sql) override {
-        return std::make_shared<Statement>(handle_, sql);
+        return std::make_shared<Statement>(state_, sql);
     }
 
     [[nodiscard]] Adapter::StatementPtr createStatement(std::string_view sql) override {
-        return std::make_shared<Statement>(handle_, sql);
+        return std::make_shared<Statement>(state_, sql);
+    }
+
+    [[nodiscard]] Adapter::StatementPtr createScriptStatement(std::string_view sql, std::string_view& tail) override {
+        auto st = std::make_shared<Statement>(state_, sql, &tail);
+        if (!st->handle())
+            return nullptr;
+        return st;
     }
 
     [[nodiscard]]
     static std::shared_ptr<Connection> getImpl(Dbpp::Connection& db) {
+        if (db.adapterName() != "sqlite3")
+            throw Error("The function can only be called with an sqlite3 connection");
         return std::dynamic_pointer_cast<Connection>(Adapter::Connection::getImpl(db));
     }
 
-    void backup(const std::filesystem::path& file, int pagesPerStep, int sleepPerStepMs, std::function<void(int,int)>& progressCallback) {
+    [[nodiscard]]
+    const ConnectionStatePtr& state() const {
+        return state_;
+    }
+
+    void backup(const std::filesystem::path& file, int pagesPerStep, int sleepPerStepMs, std::function<void(int,int)>& progressCallback, Instrumentation* instrumentation) {
         struct DbDeleter {
             void operator()(struct sqlite3 *p) { sqlite3_close(p); }
         };
@@ -389,7 +447,11 @@ public:
         }
 
         for (;;) {
-            auto res = sqlite3_backup_step(backupHandle.get(), pagesPerStep);
+            int res = SQLITE_OK;
+            {
+                Dbpp::Detail::InstrumentationScope scope(instrumentation, Instrumentation::Operation::BackupStep, nullptr);
+                res = sqlite3_backup_step(backupHandle.get(), pagesPerStep);
+            }
             if (res == SQLITE_OK)
                 progressCallback(sqlite3_backup_remaining(backupHandle.get()),
                                   sqlite3_backup_pagecount(backupHandle.get()));
@@ -403,11 +465,26 @@ public:
     }
 };
 
+ConnectionStatePtr connectionState(Dbpp::Connection& db) {
+    return Sqlite3::Connection::getImpl(db)->state();
+}
+
+sqlite3_stmt* statementHandle(Dbpp::Statement& stmt) {
+    auto impl = std::dynamic_pointer_cast<Sqlite3::Statement>(Adapter::Statement::getImpl(stmt));
+    if (!impl)
+        throw Error("The function can only be called with a statement from an sqlite3 connection");
+    return impl->handle();
+}
+
 [[nodiscard]]
 Dbpp::Connection open(const std::filesystem::path& file, OpenMode mode, OpenFlag flags) {
     return Adapter::ConnectionPtr(new Sqlite3::Connection(file, mode, flags));
 }
 
+Dbpp::Connection openWithVfs(const std::filesystem::path& file, OpenMode mode, const char* vfs) {
+    return Adapter::ConnectionPtr(new Sqlite3::Connection(file, mode, OpenFlag::None, vfs));
+}
+
 [[nodiscard]]
 Dbpp::Connection open(const std::filesystem::path& file, OpenMode mode) {
     return open(file, mode, OpenFlag::None);
@@ -418,6 +495,60 @@ Dbpp::Connection open(const std::filesystem::path& file) {
     return open(file, OpenMode::ReadWriteCreate, OpenFlag::None);
 }
 
+Dbpp::Connection openFromMemory(BlobView image, ImageMode mode, OpenFlag flags) {
+    if (image.size > static_cast<std::size_t>(std::numeric_limits<sqlite3_int64>::max()))
+        throw Error("The database image is too large");
+    const auto size = static_cast<sqlite3_int64>(image.size);
+
+    auto impl = std::make_shared<Sqlite3::Connection>(":memory:", OpenMode::ReadWriteCreate, flags);
+    unsigned char* data = nullptr;
+    unsigned int deserializeFlags = 0;
+    if (mode == ImageMode::Copy) {
+        // SQLite frees the copy when the connection is closed, or if deserializing fails
+        data = static_cast<unsigned char*>(sqlite3_malloc64(static_cast<sqlite3_uint64>(image.size)));
+        if (data == nullptr && size > 0)
+            throw Sqlite3Error(SQLITE_NOMEM, "Failed to copy database image");
+        if (size > 0)
+            std::memcpy(data, image.data, image.size);
+        deserializeFlags = SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE;
+    } else {
+        // SQLite never writes to a read only image
+        data = reinterpret_cast<unsigned char*>(const_cast<std::byte*>(image.data)); // NOLINT
+        deserializeFlags = SQLITE_DESERIALIZE_READONLY;
+    }
+    throwOnError(sqlite3_deserialize(impl->state()->db(), "main", data, size, size, deserializeFlags),
+                 "Failed to open database image");
+    return Adapter::ConnectionPtr(std::move(impl));
+}
+
+Dbpp::Connection openFromMemory(const std::vector<std::byte>& image, OpenFlag flags) {
+    return openFromMemory(BlobView{image.data(), image.size()}, ImageMode::Copy, flags);
+}
+
+std::vector<std::byte> serialize(Dbpp::Connection& db, std::string_view schema) {
+    const std::string name(schema);
+    auto* conn = connectionState(db)->db();
+    sqlite3_int64 size = 0;
+
+    // In-memory databases can be read in place, which saves a copy
+    if (const auto* data = reinterpret_cast<const std::byte*>(sqlite3_serialize(conn, name.c_str(), &size, SQLITE_SERIALIZE_NOCOPY))) // NOLINT
+        return {data, data + size};
+    if (size < 0)
+        throw Error("Failed to serialize database " + name);
+    if (size == 0)
+        return {};
+
+    std::unique_ptr<unsigned char, void(*)(void*)> copy(sqlite3_serialize(conn, name.c_str(), &size, 0), sqlite3_free);
+    if (!copy)
+        throw Sqlite3Error(SQLITE_NOMEM, "Failed to serialize database " + name);
+    const auto* data = reinterpret_cast<const std::byte*>(copy.get()); // NOLINT
+    return {data, data + size};
+}
+
+void setBusyTimeout(Dbpp::Connection& db, std::chrono::milliseconds timeout) {
+    connectionState(db)->setBusyTimeout(timeout);
+}
+
 void backup(Dbpp::Connection &db, const std::filesystem::path& file, int pagesPerStep, int sleepTimePerStepMs) {
     auto progressFuncNoOp = [](int /*unused*/, int /*unused*/){};
     backup(db, file, pagesPerStep, sleepTimePerStepMs, progressFuncNoOp);
@@ -427,7 +558,7 @@ void backup(Dbpp::Connection& db, const std::filesystem::path& file, int pagesPe
     if (db.adapterName() != "sqlite3")
         throw Error("dbpp::sqlite3::backup() can only be called with an sqlite3 connection");
     auto impl = Sqlite3::Connection::getImpl(db);
-    impl->backup(file, pagesPerStep, sleepTimePerStepMs, progressCallback);
+    impl->backup(file, pagesPerStep, sleepTimePerStepMs, progressCallback, db.instrumentation());
 }
 
 } // namespace Dbpp::Sqlite3
@@ -0,0 +1,90 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/Stats.h>
+
+#include "ConnectionState.h"
+
+namespace Dbpp::Sqlite3 {
+
+namespace {
+
+    struct DbStatus {
+        long long current = 0;
+        long long highwater = 0;
+    };
+
+    DbStatus dbStatus(sqlite3* db, int op, bool reset) {
+        int current = 0;
+        int highwater = 0;
+        throwOnError(sqlite3_db_status(db, op, &current, &highwater, reset ? 1 : 0), "Failed to retrieve connection status");
+        return {current, highwater};
+    }
+
+    DbStatus status(int op, bool resetHighwater) {
+        sqlite3_int64 current = 0;
+        sqlite3_int64 highwater = 0;
+        throwOnError(sqlite3_status64(op, &current, &highwater, resetHighwater ? 1 : 0), "Failed to retrieve memory status");
+        return {current, highwater};
+    }
+
+} // namespace
+
+MemoryStats memoryStats(bool resetHighwater) {
+    MemoryStats stats;
+    auto memoryUsed = status(SQLITE_STATUS_MEMORY_USED, resetHighwater);
+    stats.memoryUsed = memoryUsed.current;
+    stats.memoryUsedHighwater = memoryUsed.highwater;
+    auto mallocCount = status(SQLITE_STATUS_MALLOC_COUNT, resetHighwater);
+    stats.mallocCount = mallocCount.current;
+    stats.mallocCountHighwater = mallocCount.highwater;
+    stats.largestAllocation = status(SQLITE_STATUS_MALLOC_SIZE, resetHighwater).highwater;
+    stats.pageCacheUsed = status(SQLITE_STATUS_PAGECACHE_USED, resetHighwater).current;
+    auto overflow = status(SQLITE_STATUS_PAGECACHE_OVERFLOW, resetHighwater);
+    stats.pageCacheOverflow = overflow.current;
+    stats.pageCacheOverflowHighwater = overflow.highwater;
+    stats.largestPageCacheAllocation = status(SQLITE_STATUS_PAGECACHE_SIZE, resetHighwater).highwater;
+    return stats;
+}
+
+ConnectionStats stats(Dbpp::Connection& db, bool reset) {
+    auto* handle = connectionState(db)->db();
+
+    ConnectionStats stats;
+    stats.cacheHits = dbStatus(handle, SQLITE_DBSTATUS_CACHE_HIT, reset).current;
+    stats.cacheMisses = dbStatus(handle, SQLITE_DBSTATUS_CACHE_MISS, reset).current;
+    stats.cacheWrites = dbStatus(handle, SQLITE_DBSTATUS_CACHE_WRITE, reset).current;
+#ifdef SQLITE_DBSTATUS_CACHE_SPILL
+    stats.cacheSpills = dbStatus(handle, SQLITE_DBSTATUS_CACHE_SPILL, reset).current;
+#endif
+    stats.cacheUsed = dbStatus(handle, SQLITE_DBSTATUS_CACHE_USED, false).current;
+    stats.cacheUsedShared = dbStatus(handle, SQLITE_DBSTATUS_CACHE_USED_SHARED, false).current;
+    auto lookasideUsed = dbStatus(handle, SQLITE_DBSTATUS_LOOKASIDE_USED, reset);
+    stats.lookasideUsed = lookasideUsed.current;
+    stats.lookasideUsedHighwater = lookasideUsed.highwater;
+    stats.lookasideHits = dbStatus(handle, SQLITE_DBSTATUS_LOOKASIDE_HIT, reset).highwater;
+    stats.lookasideMissesSize = dbStatus(handle, SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, reset).highwater;
+    stats.lookasideMissesFull = dbStatus(handle, SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, reset).highwater;
+    stats.schemaUsed = dbStatus(handle, SQLITE_DBSTATUS_SCHEMA_USED, false).current;
+    stats.statementUsed = dbStatus(handle, SQLITE_DBSTATUS_STMT_USED, false).current;
+    stats.deferredForeignKeys = dbStatus(handle, SQLITE_DBSTATUS_DEFERRED_FKS, false).current != 0;
+    // The process wide highwater marks are shared by all connections, so they're only reset by memoryStats()
+    stats.memory = memoryStats(false);
+    return stats;
+}
+
+} // namespace Dbpp::Sqlite3
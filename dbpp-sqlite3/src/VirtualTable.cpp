@@ -0,0 +1,35 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include <dbpp/sqlite3/VirtualTable.h>
+
+#include "ConnectionState.h"
+
+namespace Dbpp::Sqlite3::Detail {
+
+void createModule(Dbpp::Connection& db, std::string_view name, const sqlite3_module* module, UserData userData) {
+    auto state = connectionState(db);
+    const std::string moduleName(name);
+    auto destroy = userData.get_deleter();
+
+    // SQLite calls the destructor of the user data if the registration fails as well
+    int res = sqlite3_create_module_v2(state->db(), moduleName.c_str(), module, userData.release(), destroy);
+    if (res != SQLITE_OK)
+        throwOnError(res, "Failed to register the virtual table " + moduleName);
+}
+
+} // namespace Dbpp::Sqlite3::Detail
@@ -25,11 +25,22 @@
 #include <dbpp/StatementBuilder.h>
 #include <dbpp/adapter/Types.h>
 
+#include <cstddef>
+#include <functional>
 #include <string>
 #include <string_view>
+#include <tuple>
 
 namespace Dbpp {
 
+/// \brief Specifies how Connection::execScript() executes the statements of a script
+///
+/// \since v1.0.0
+enum class ScriptMode {
+    Autocommit, ///< Each statement is executed on its own, or in the transaction that is already open
+    Transaction, ///< The whole script is executed in one transaction, which is rolled back if a statement fails
+};
+
 /// \brief A connection object represents a connection to a database
 ///
 /// Before you can use this library, you need to have at least
@@ -46,6 +57,9 @@ class DBPP_EXPORT Connection {
 
 private:
     Adapter::ConnectionPtr impl_;
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    InstrumentationPtr instrumentation_;
+#endif
 
     [[nodiscard]]
     Statement createStatement(std::string_view sql) const;
@@ -53,6 +67,9 @@ private:
     [[nodiscard]]
     PreparedStatement createPreparedStatement(std::string_view sql) const;
 
+    std::size_t runScript(std::string_view sql, ScriptMode mode, std::size_t numParameterPacks,
+                          const std::function<void(Statement& statement, std::size_t index)>& bind);
+
 public:
     /// \brief Construct a connection object
     ///
@@ -97,6 +114,7 @@ public:
     /// \since v1.0.0
     inline Statement statement(const StatementBuilder& builder) {
         auto st = createStatement(builder.sql());
+        Detail::InstrumentationScope scope(st.instrumentation(), Instrumentation::Operation::Bind, st.impl_.get());
         builder.bindToStatement(*st.impl_);
         return st;
     }
@@ -119,6 +137,7 @@ public:
     /// \since v1.0.0
     inline PreparedStatement preparedStatement(const StatementBuilder& builder) {
         auto st = preparedStatement(builder.sql());
+        Detail::InstrumentationScope scope(st.instrumentation(), Instrumentation::Operation::Bind, st.impl_.get());
         builder.bindToStatement(*st.impl_);
         return st;
     }
@@ -231,6 +250,48 @@ public:
         return row.template getOptional<T>(0);
     }
 
+    /// \brief Executes a script of SQL statements
+    ///
+    /// The statements are separated by semicolons, and executed one at a time, in order. Each
+    /// statement is prepared from where the previous one ended, so the script is only parsed
+    /// once, and a statement may use the tables created by the ones before it. Each statement
+    /// is stepped until it has no more results, which are discarded.
+    ///
+    /// In ScriptMode::Transaction, the script must not begin or end transactions itself.
+    ///
+    /// \param sql The SQL statements
+    /// \param mode Specifies if the script is executed in one transaction
+    /// \return The number of statements executed
+    ///
+    /// \since v1.0.0
+    inline std::size_t execScript(std::string_view sql, ScriptMode mode = ScriptMode::Autocommit) {
+        return runScript(sql, mode, 0, nullptr);
+    }
+
+    /// \brief Executes a script of SQL statements, with parameters for each statement
+    ///
+    /// Works like execScript(std::string_view, ScriptMode), and binds the values of the n:th
+    /// parameter pack to the placeholders of the n:th statement. Statements after the last pack
+    /// are executed without parameters. An Error is thrown after the script has been executed
+    /// if it has fewer statements than there are packs.
+    ///
+    /// \param sql The SQL statements
+    /// \param mode Specifies if the script is executed in one transaction
+    /// \param parameters One std::tuple of values per statement
+    /// \return The number of statements executed
+    ///
+    /// \since v1.0.0
+    template <typename... ParameterPacks>
+    std::size_t execScript(std::string_view sql, ScriptMode mode, const ParameterPacks&... parameters) {
+        return runScript(sql, mode, sizeof...(ParameterPacks), [&parameters...](Statement& st, std::size_t index) {
+            auto bindPack = [&st](const auto& pack) {
+                std::apply([&st](const auto&... values) { st.bind(values...); }, pack);
+            };
+            std::size_t i = 0;
+            ((i++ == index ? bindPack(parameters) : void()), ...);
+        });
+    }
+
     /// \brief Begins a transaction
     ///
     /// \since v1.0.0
@@ -250,6 +311,27 @@ public:
     ///
     /// \since v1.0.0
     const std::string& adapterName() const;
+
+    /// \brief Sets the instrumentation of this connection
+    ///
+    /// The instrumentation is used by the connection, and the statements created after this
+    /// call. Without one, the global instrumentation is used. See Instrumentation for details.
+    ///
+    /// \param instrumentation The instrumentation, or nullptr to use the global instrumentation
+    ///
+    /// \since v1.0.0
+    void setInstrumentation(InstrumentationPtr instrumentation);
+
+    /// \brief Returns the instrumentation in effect for this connection
+    ///
+    /// This is the instrumentation set with setInstrumentation(), or the global one. It can be
+    /// used by adapters to report adapter-specific operations.
+    ///
+    /// \return The instrumentation, or nullptr if there is none
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    Instrumentation* instrumentation() const;
 };
 
 /// \brief RAII class for scoped transaction handling
@@ -0,0 +1,236 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/config.h>
+#include <dbpp/exports.h>
+#include <dbpp/util.h>
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace Dbpp {
+
+/// \brief Interface for receiving timing events from dbpp
+///
+/// An instrumentation object is notified at the start and the end of each database
+/// operation, which makes it possible to correlate the time spent in the database with
+/// other activities, such as the handling of a request.
+///
+/// Instrumentation can be set for a single connection, with Connection::setInstrumentation(),
+/// or for all connections without one, with Instrumentation::setGlobal(). The callbacks are
+/// made from the thread performing the operation, so implementations used by several
+/// threads must be thread safe.
+///
+/// If dbpp is built with DBPP_ENABLE_INSTRUMENTATION turned off, the hooks are removed at
+/// compile time and no callbacks are made.
+///
+/// \since v1.0.0
+class DBPP_EXPORT Instrumentation {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// \brief The operations that are reported
+    ///
+    /// \since v1.0.0
+    enum class Operation {
+        Prepare, ///< A statement is created from an SQL string
+        Bind, ///< Values are bound to the placeholders of a statement
+        Step, ///< A statement is executed, or stepped to its next row
+        Begin, ///< A transaction is begun
+        Commit, ///< A transaction is committed
+        Rollback, ///< A transaction is rolled back
+        BackupStep, ///< A step of an online backup, in adapters that support it
+    };
+
+    /// \brief Describes an operation
+    ///
+    /// \since v1.0.0
+    struct Event {
+        Operation operation = Operation::Step; ///< The operation
+        const void* statement = nullptr; ///< Identifies the statement, or nullptr for operations on the connection. Only set in onEnd() for Prepare events
+        std::string_view sql; ///< The SQL of the statement, for Prepare events. Empty for other events
+        Clock::time_point start; ///< When the operation started
+        Clock::time_point end; ///< When the operation ended. Same as start in onStart()
+        bool failed = false; ///< True if the operation ended with an exception. Only set in onEnd()
+    };
+
+    virtual ~Instrumentation() = default;
+
+    /// \brief Called when an operation starts
+    ///
+    /// \since v1.0.0
+    virtual void onStart(const Event& event) = 0;
+
+    /// \brief Called when an operation ends, even if it fails
+    ///
+    /// This function must not throw, since it's called while exceptions are propagating
+    ///
+    /// \since v1.0.0
+    virtual void onEnd(const Event& event) = 0;
+
+    /// \brief Returns the name of an operation, e.g. "step"
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    static const char* operationName(Operation operation);
+
+    /// \brief Sets the instrumentation used by connections without their own
+    ///
+    /// The caller keeps the ownership of the object, which must stay alive until it has
+    /// been replaced and no operations using it are in progress.
+    ///
+    /// \param instrumentation The instrumentation, or nullptr to remove it
+    ///
+    /// \since v1.0.0
+    static void setGlobal(Instrumentation* instrumentation);
+
+    /// \brief Returns the instrumentation set with setGlobal(), or nullptr
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    static Instrumentation* global();
+};
+
+using InstrumentationPtr = std::shared_ptr<Instrumentation>;
+
+/// \brief Instrumentation that keeps the latest operations in a ring buffer
+///
+/// The recorded operations can be written in the Chrome trace event format, which can be
+/// viewed in chrome://tracing or Perfetto.
+///
+/// \since v1.0.0
+class DBPP_EXPORT TraceRecorder final : public Instrumentation {
+    DBPP_NO_COPY_SEMANTICS(TraceRecorder);
+    DBPP_NO_MOVE_SEMANTICS(TraceRecorder);
+
+    struct Record {
+        Operation operation;
+        const void* statement;
+        std::string sql;
+        Clock::time_point start;
+        Clock::time_point end;
+        bool failed;
+        std::thread::id thread;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<Record> records_;
+    std::size_t capacity_;
+    std::size_t next_ = 0;
+
+public:
+    /// \brief Constructor
+    ///
+    /// \param capacity The number of operations to keep, which are allocated up front. When full, the oldest are overwritten
+    ///
+    /// \since v1.0.0
+    explicit TraceRecorder(std::size_t capacity = 65536);
+
+    ~TraceRecorder() override = default;
+
+    void onStart(const Event& event) override;
+
+    void onEnd(const Event& event) noexcept override;
+
+    /// \brief Returns the number of recorded operations
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::size_t size() const;
+
+    /// \brief Removes all recorded operations
+    ///
+    /// \since v1.0.0
+    void clear();
+
+    /// \brief Writes the recorded operations as Chrome trace event JSON, oldest first
+    ///
+    /// \since v1.0.0
+    void writeChromeTrace(std::ostream& out) const;
+
+    /// \brief Returns the recorded operations as Chrome trace event JSON, oldest first
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::string chromeTrace() const;
+};
+
+namespace Detail {
+
+// Reports an operation to an instrumentation, from construction to destruction.
+// Does nothing if the instrumentation is nullptr, or if instrumentation is disabled
+class InstrumentationScope {
+    DBPP_NO_COPY_SEMANTICS(InstrumentationScope);
+    DBPP_NO_MOVE_SEMANTICS(InstrumentationScope);
+
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    Instrumentation* instrumentation_;
+    Instrumentation::Event event_;
+    int uncaughtExceptions_ = 0;
+
+public:
+    InstrumentationScope(Instrumentation* instrumentation, Instrumentation::Operation operation, const void* statement, std::string_view sql = {})
+    : instrumentation_(instrumentation)
+    {
+        if (instrumentation_) {
+            event_.operation = operation;
+            event_.statement = statement;
+            event_.sql = sql;
+            event_.start = event_.end = Instrumentation::Clock::now();
+            uncaughtExceptions_ = std::uncaught_exceptions();
+            instrumentation_->onStart(event_);
+        }
+    }
+
+    ~InstrumentationScope() {
+        if (instrumentation_) {
+            event_.end = Instrumentation::Clock::now();
+            event_.failed = std::uncaught_exceptions() > uncaughtExceptions_;
+            try {
+                instrumentation_->onEnd(event_);
+            } catch (...) { // NOLINT(bugprone-empty-catch) - onEnd() must not throw, but this may be called while an exception propagates
+            }
+        }
+    }
+
+    // Sets the statement reported to onEnd(), for operations that create it
+    void setStatement(const void* statement) {
+        event_.statement = statement;
+    }
+#else
+public:
+    InstrumentationScope(Instrumentation* /*unused*/, Instrumentation::Operation /*unused*/, const void* /*unused*/, std::string_view /*unused*/ = {}) {}
+
+    ~InstrumentationScope() = default;
+
+    void setStatement(const void* /*unused*/) {}
+#endif
+};
+
+} // namespace Detail
+
+} // namespace Dbpp
@@ -0,0 +1,368 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <dbpp/config.h>
+#include <dbpp/exports.h>
+#include <dbpp/util.h>
+#include <dbpp/Connection.h>
+
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace Dbpp {
+
+template <typename Compare, typename... Ts>
+class MergedRows;
+
+/// \brief Routes queries to one of several connections, based on a shard key
+///
+/// Point operations are sent to the single connection that owns a key, using
+/// shardFor(). Queries that need data from every shard can be fanned out with
+/// gather() or mergeOrdered(), which execute the statement on all shards in
+/// parallel, so that the latency is that of the slowest shard rather than the
+/// sum of all of them.
+///
+/// Each shard connection is used by at most one thread at a time, so the
+/// connections don't need to be opened in a serialized threading mode.
+///
+/// \since v1.0.0
+class DBPP_EXPORT ShardedConnection {
+    DBPP_NO_COPY_SEMANTICS(ShardedConnection);
+
+public:
+    /// \brief Maps a key to a shard index in the range [0, shardCount)
+    ///
+    /// \since v1.0.0
+    using ShardFunction = std::function<std::size_t(std::string_view key, std::size_t shardCount)>;
+
+private:
+    std::vector<Connection> shards_;
+    ShardFunction shardFunction_;
+
+    void forEachShard(const std::function<void(std::size_t, Connection&)>& func);
+
+public:
+    /// \brief Constructs a sharded connection using the default shard function
+    ///
+    /// The default shard function is a 64-bit FNV-1a hash of the key, modulo the number
+    /// of shards. It gives the same result on every platform, so it can be used to decide
+    /// where data is stored.
+    ///
+    /// \param shards The connections to the shards. There must be at least one
+    ///
+    /// \since v1.0.0
+    explicit ShardedConnection(std::vector<Connection> shards);
+
+    /// \brief Constructs a sharded connection using a custom shard function
+    ///
+    /// \param shards The connections to the shards. There must be at least one
+    /// \param shardFunction Function that maps a key to a shard index
+    ///
+    /// \since v1.0.0
+    ShardedConnection(std::vector<Connection> shards, ShardFunction shardFunction);
+
+    /// \brief Move constructor
+    ///
+    /// \since v1.0.0
+    ShardedConnection(ShardedConnection&&) noexcept;
+
+    /// \brief Move assignment
+    ///
+    /// \since v1.0.0
+    ShardedConnection& operator=(ShardedConnection&&) noexcept;
+
+    ~ShardedConnection();
+
+    /// \brief Returns the number of shards
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::size_t shardCount() const;
+
+    /// \brief Returns the connection to the shard with the specified index
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    Connection& shard(std::size_t index);
+
+    /// \brief Returns the index of the shard that owns the specified key
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    std::size_t shardIndex(std::string_view key) const;
+
+    /// \brief Returns the index of the shard that owns the specified integer key
+    ///
+    /// The key is routed as its decimal string representation, so that 42 and "42"
+    /// end up on the same shard.
+    ///
+    /// \since v1.0.0
+    template <typename Key, typename std::enable_if_t<std::is_integral_v<Key>, int> = 0>
+    [[nodiscard]]
+    std::size_t shardIndex(Key key) const {
+        char buf[24]; // NOLINT - large enough for any 64-bit integer including sign
+        auto [end, ec] = std::to_chars(std::begin(buf), std::end(buf), key);
+        (void) ec;
+        return shardIndex(std::string_view(buf, static_cast<std::size_t>(end - std::begin(buf))));
+    }
+
+    /// \brief Returns the connection to the shard that owns the specified key
+    ///
+    /// \since v1.0.0
+    template <typename Key>
+    [[nodiscard]]
+    Connection& shardFor(const Key& key) {
+        return shard(shardIndex(key));
+    }
+
+    /// \brief Executes a query on all shards in parallel, and concatenates the results
+    ///
+    /// The rows from each shard are kept in the order they were returned, and the
+    /// shards follow each other in shard index order.
+    ///
+    /// \tparam Ts The types of the columns in the result
+    /// \param sql An SQL statement
+    /// \param args A list of values to be bound to placeholders in the SQL statement, on every shard
+    /// \return All rows from all shards
+    ///
+    /// \since v1.0.0
+    template <typename... Ts, typename... Args>
+    [[nodiscard]]
+    std::vector<std::tuple<Ts...>> gather(std::string_view sql, const Args&... args) {
+        std::vector<std::vector<std::tuple<Ts...>>> perShard(shards_.size());
+        forEachShard([&](std::size_t index, Connection& db) {
+            for (auto&& row : db.statement(sql, args...).template as<Ts...>())
+                perShard[index].push_back(row);
+        });
+
+        std::size_t total = 0;
+        for (const auto& rows : perShard)
+            total += rows.size();
+
+        std::vector<std::tuple<Ts...>> all;
+        all.reserve(total);
+        for (auto& rows : perShard)
+            std::move(rows.begin(), rows.end(), std::back_inserter(all));
+        return all;
+    }
+
+    /// \brief Executes an ordered query on all shards, and merges the results
+    ///
+    /// Every shard must return its rows sorted in ascending order of the tuple of
+    /// columns, typically by having the ORDER BY columns first in the select list.
+    /// See mergeOrderedBy() to use another ordering.
+    ///
+    /// \tparam Ts The types of the columns in the result
+    /// \param sql An SQL statement
+    /// \param args A list of values to be bound to placeholders in the SQL statement, on every shard
+    /// \return An iterable object producing the merged rows as tuples
+    ///
+    /// \since v1.0.0
+    template <typename... Ts, typename... Args>
+    [[nodiscard]]
+    MergedRows<std::less<std::tuple<Ts...>>, Ts...> mergeOrdered(std::string_view sql, const Args&... args) {
+        return mergeOrderedBy<Ts...>(std::less<std::tuple<Ts...>>(), sql, args...);
+    }
+
+    /// \brief Executes an ordered query on all shards, and merges the results
+    ///
+    /// All shards execute the statement in parallel until they have produced their first
+    /// row, which is where a sorting query spends most of its time. The remaining rows are
+    /// then merged as they are consumed, so the result sets are never materialised as a whole.
+    ///
+    /// \tparam Ts The types of the columns in the result
+    /// \param compare A strict weak ordering of std::tuple<Ts...>, matching the ORDER BY clause
+    /// \param sql An SQL statement
+    /// \param args A list of values to be bound to placeholders in the SQL statement, on every shard
+    /// \return An iterable object producing the merged rows as tuples
+    ///
+    /// \since v1.0.0
+    template <typename... Ts, typename Compare, typename... Args>
+    [[nodiscard]]
+    MergedRows<Compare, Ts...> mergeOrderedBy(Compare compare, std::string_view sql, const Args&... args) {
+        std::vector<std::optional<Statement>> statements(shards_.size());
+        std::vector<std::optional<std::tuple<Ts...>>> heads(shards_.size());
+        forEachShard([&](std::size_t index, Connection& db) {
+            statements[index].emplace(db.statement(sql, args...));
+            auto res = statements[index]->step();
+            if (!res.empty())
+                heads[index] = res.template toTuple<Ts...>();
+        });
+        return MergedRows<Compare, Ts...>(std::move(compare), std::move(statements), std::move(heads));
+    }
+};
+
+/// \brief The result of ShardedConnection::mergeOrdered(), performing a k-way merge of the shards
+///
+/// \tparam Compare The ordering of the rows
+/// \tparam Ts The types of the columns in the result
+///
+/// \since v1.0.0
+template <typename Compare, typename... Ts>
+class MergedRows {
+    DBPP_NO_COPY_SEMANTICS(MergedRows);
+
+    friend class ShardedConnection;
+
+    using TupleT = std::tuple<Ts...>;
+
+    Compare compare_;
+    std::vector<std::optional<Statement>> statements_;
+    std::vector<std::optional<TupleT>> heads_;
+    std::vector<std::size_t> heap_; // Indices of shards with a pending row, as a min-heap
+
+    MergedRows(Compare compare, std::vector<std::optional<Statement>> statements, std::vector<std::optional<TupleT>> heads)
+    : compare_(std::move(compare))
+    , statements_(std::move(statements))
+    , heads_(std::move(heads))
+    {
+        for (std::size_t i = 0; i < heads_.size(); ++i) {
+            if (heads_[i])
+                heap_.push_back(i);
+        }
+        std::make_heap(heap_.begin(), heap_.end(), heapOrder());
+    }
+
+    // std::*_heap keeps the greatest element first, so the order is reversed.
+    // Ties are broken by shard index, to make the merge deterministic
+    auto heapOrder() {
+        return [this](std::size_t a, std::size_t b) {
+            if (compare_(*heads_[b], *heads_[a]))
+                return true;
+            if (compare_(*heads_[a], *heads_[b]))
+                return false;
+            return a > b;
+        };
+    }
+
+    [[nodiscard]]
+    bool done() const { return heap_.empty(); }
+
+    [[nodiscard]]
+    const TupleT& front() const { return *heads_[heap_.front()]; }
+
+    void advance() {
+        if (heap_.empty())
+            return;
+        std::pop_heap(heap_.begin(), heap_.end(), heapOrder());
+        auto index = heap_.back();
+        auto res = statements_[index]->step();
+        if (res.empty()) {
+            heads_[index].reset();
+            heap_.pop_back();
+        } else {
+            heads_[index] = res.template toTuple<Ts...>();
+            std::push_heap(heap_.begin(), heap_.end(), heapOrder());
+        }
+    }
+
+public:
+    /// \brief Iterates over the merged rows
+    ///
+    /// \since v1.0.0
+    class Iterator {
+        friend class MergedRows;
+
+        MergedRows* rows_ = nullptr;
+
+        explicit Iterator(MergedRows* rows)
+        : rows_(rows->done() ? nullptr : rows)
+        {}
+
+    public:
+        using value_type = TupleT; // NOLINT
+
+        /// \brief Default constructor, constructs an end iterator
+        ///
+        /// \since v1.0.0
+        Iterator() = default;
+
+        /// \brief Dereferencing operator
+        ///
+        /// \since v1.0.0
+        [[nodiscard]]
+        const TupleT& operator*() const { return rows_->front(); }
+
+        /// \brief Dereferencing operator
+        ///
+        /// \since v1.0.0
+        [[nodiscard]]
+        const TupleT* operator->() const { return &rows_->front(); }
+
+        /// \brief Checks if two iterators are equal
+        ///
+        /// \since v1.0.0
+        [[nodiscard]]
+        bool operator==(const Iterator& that) const { return rows_ == that.rows_; }
+
+        /// \brief Checks if two iterators are different
+        ///
+        /// \since v1.0.0
+        [[nodiscard]]
+        bool operator!=(const Iterator& that) const { return !(*this == that); }
+
+        /// \brief Moves on to the next row in the merged order
+        ///
+        /// \since v1.0.0
+        Iterator& operator++() {
+            if (rows_) {
+                rows_->advance();
+                if (rows_->done())
+                    rows_ = nullptr;
+            }
+            return *this;
+        }
+    };
+
+    using iterator = Iterator;
+
+    ~MergedRows() = default;
+
+    /// \brief Move constructor
+    ///
+    /// \since v1.0.0
+    MergedRows(MergedRows&&) noexcept = default;
+
+    /// \brief Move assignment
+    ///
+    /// \since v1.0.0
+    MergedRows& operator=(MergedRows&&) noexcept = default;
+
+    /// \brief Returns an iterator to the first row
+    ///
+    /// Rows are consumed while iterating, so the rows can only be iterated over once
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    iterator begin() { return iterator(this); }
+
+    /// \brief Returns the end iterator
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    iterator end() { return {}; }
+};
+
+} // namespace Dbpp
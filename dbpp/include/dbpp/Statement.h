@@ -19,6 +19,7 @@
 
 #include <dbpp/config.h>
 #include <dbpp/exports.h>
+#include <dbpp/Instrumentation.h>
 #include <dbpp/MetaFunctions.h>
 #include <dbpp/Result.h>
 #include <dbpp/util.h>
@@ -51,9 +52,23 @@ class DBPP_EXPORT Statement {
     DBPP_NO_COPY_SEMANTICS(Statement);
     friend class Connection;
     friend class BindHelper;
+    friend class Adapter::Statement;
 
 protected:
     Adapter::StatementPtr impl_;
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    InstrumentationPtr instrumentation_;
+#endif
+
+    // The instrumentation of the connection that created the statement, or the global one
+    [[nodiscard]]
+    Instrumentation* instrumentation() const {
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+        return instrumentation_ ? instrumentation_.get() : Instrumentation::global();
+#else
+        return nullptr;
+#endif
+    }
 
 public:
     using Iterator = StatementIterator;
@@ -112,6 +127,7 @@ public:
 protected:
     template <typename... Ts>
     void bind(Ts&&... parameters) {
+        Detail::InstrumentationScope scope(sizeof...(Ts) > 0 ? instrumentation() : nullptr, Instrumentation::Operation::Bind, impl_.get());
         impl_->preBind(sizeof...(Ts));
         std::size_t numBound = 0;
         try {
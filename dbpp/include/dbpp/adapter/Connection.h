@@ -22,6 +22,7 @@
 #include <dbpp/util.h>
 
 #include <dbpp/Connection.h>
+#include <dbpp/Exception.h>
 #include <dbpp/adapter/Types.h>
 
 #include <string_view>
@@ -49,6 +50,24 @@ public:
     [[nodiscard]]
     virtual StatementPtr createStatement(std::string_view sql) = 0;
 
+    /// \brief Creates a new statement for the first SQL statement in a string of several
+    ///
+    /// Used by Dbpp::Connection::execScript() to execute a script one statement at a time. The
+    /// default implementation throws Dbpp::Error, for drivers that can't split a script.
+    ///
+    /// \param sql A string with zero or more SQL statements
+    /// \param tail Set to the part of sql that follows the statement
+    /// \return The statement, or nullptr if the part of sql before tail has no statement,
+    ///         such as when it is only whitespace and comments
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    virtual StatementPtr createScriptStatement(std::string_view sql, std::string_view& tail) {
+        (void) sql;
+        (void) tail;
+        throw Error("The " + adapterName() + " adapter can't execute scripts");
+    }
+
     /// \brief Begins a transaction
     ///
     /// \since v1.0.0
@@ -24,6 +24,10 @@
 #include <dbpp/adapter/Types.h>
 #include <dbpp/PlaceholderBinder.h>
 
+namespace Dbpp {
+class Statement;
+} // namespace Dbpp
+
 namespace Dbpp::Adapter {
 
 /// \brief Interface class for database adapters
@@ -62,6 +66,20 @@ public:
     /// \since v1.0.0
     [[nodiscard]]
     virtual ResultPtr step() = 0;
+
+    /// \brief Retrieves a shared pointer to the adapter-specific statement object
+    ///
+    /// This function can be used when implementing extra functions for an adapter
+    /// that are not part of the generic interface provided by dbpp, such as the
+    /// statementStatus() function in Dbpp::Sqlite3
+    ///
+    /// \param stmt The statement object
+    ///
+    /// \return A shared pointer to the adapter-specific object
+    ///
+    /// \since v1.0.0
+    [[nodiscard]]
+    static StatementPtr getImpl(Dbpp::Statement& stmt);
 };
 
 } // namespace Dbpp::Adapter
@@ -21,4 +21,6 @@
 #include <dbpp/Connection.h>
 #include <dbpp/Statement.h>
 #include <dbpp/Result.h>
+#include <dbpp/ShardedConnection.h>
 #include <dbpp/Exception.h>
+#include <dbpp/Instrumentation.h>
@@ -17,17 +17,75 @@
 
 #include "dbpp/Connection.h"
 #include "dbpp/adapter/Connection.h"
+#include "dbpp/Exception.h"
 
 namespace Dbpp {
 
 PreparedStatement
 Connection::createPreparedStatement(std::string_view sql) const {
-    return PreparedStatement(impl_->createPreparedStatement(sql));
+    Detail::InstrumentationScope scope(instrumentation(), Instrumentation::Operation::Prepare, nullptr, sql);
+    PreparedStatement st(impl_->createPreparedStatement(sql));
+    scope.setStatement(st.impl_.get());
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    st.instrumentation_ = instrumentation_;
+#endif
+    return st;
 }
 
 Statement
 Connection::createStatement(std::string_view sql) const {
-    return Statement(impl_->createStatement(sql));
+    Detail::InstrumentationScope scope(instrumentation(), Instrumentation::Operation::Prepare, nullptr, sql);
+    Statement st(impl_->createStatement(sql));
+    scope.setStatement(st.impl_.get());
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    st.instrumentation_ = instrumentation_;
+#endif
+    return st;
+}
+
+std::size_t
+Connection::runScript(std::string_view sql, ScriptMode mode, std::size_t numParameterPacks,
+                      const std::function<void(Statement& statement, std::size_t index)>& bind) {
+    std::size_t count = 0;
+    auto run = [&]() {
+        while (!sql.empty()) {
+            std::string_view tail;
+            Adapter::StatementPtr impl;
+            {
+                Detail::InstrumentationScope scope(instrumentation(), Instrumentation::Operation::Prepare, nullptr, sql);
+                impl = impl_->createScriptStatement(sql, tail);
+                scope.setStatement(impl.get());
+            }
+            if (tail.size() >= sql.size())
+                break; // Nothing but whitespace and comments left
+            sql = tail;
+            if (!impl)
+                continue;
+
+            Statement st(std::move(impl));
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+            st.instrumentation_ = instrumentation_;
+#endif
+            if (count < numParameterPacks)
+                bind(st, count);
+            else
+                st.bind();
+            while (!st.step().empty()) {
+            }
+            ++count;
+        }
+        if (count < numParameterPacks)
+            throw Error("The script has fewer statements than the number of parameter packs provided");
+    };
+
+    if (mode == ScriptMode::Transaction) {
+        Transaction tx(*this);
+        run();
+        tx.commit();
+    } else {
+        run();
+    }
+    return count;
 }
 
 Connection::Connection(Adapter::ConnectionPtr c)
@@ -36,25 +94,50 @@ Connection::Connection(Adapter::ConnectionPtr c)
 
 Connection::Connection(Connection&& that) noexcept
 : impl_(std::move(that.impl_))
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+, instrumentation_(std::move(that.instrumentation_))
+#endif
 {}
 
 Connection& Connection::operator=(Connection&& that) noexcept {
     impl_ = std::move(that.impl_);
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    instrumentation_ = std::move(that.instrumentation_);
+#endif
     return *this;
 }
 
 void Connection::begin() {
+    Detail::InstrumentationScope scope(instrumentation(), Instrumentation::Operation::Begin, nullptr);
     impl_->begin();
 }
 
 void Connection::commit() {
+    Detail::InstrumentationScope scope(instrumentation(), Instrumentation::Operation::Commit, nullptr);
     impl_->commit();
 }
 
 void Connection::rollback() {
+    Detail::InstrumentationScope scope(instrumentation(), Instrumentation::Operation::Rollback, nullptr);
     impl_->rollback();
 }
 
+void Connection::setInstrumentation(InstrumentationPtr instrumentation) {
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    instrumentation_ = std::move(instrumentation);
+#else
+    (void) instrumentation;
+#endif
+}
+
+Instrumentation* Connection::instrumentation() const {
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    return instrumentation_ ? instrumentation_.get() : Instrumentation::global();
+#else
+    return nullptr;
+#endif
+}
+
 const std::string& Connection::adapterName() const {
     return impl_->adapterName();
 }
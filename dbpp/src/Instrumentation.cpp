@@ -0,0 +1,166 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "dbpp/Instrumentation.h"
+#include "dbpp/Exception.h"
+
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+
+namespace Dbpp {
+
+namespace {
+
+    std::atomic<Instrumentation*> globalInstrumentation{nullptr};
+
+    void writeJsonString(std::ostream& out, std::string_view str) {
+        out << '"';
+        for (char c : str) {
+            switch (c) {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\r': out << "\\r"; break;
+                case '\t': out << "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c)); // NOLINT
+                        out << escaped;
+                    } else {
+                        out << c;
+                    }
+                    break;
+            }
+        }
+        out << '"';
+    }
+
+    double microseconds(Instrumentation::Clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    }
+
+} // namespace
+
+const char* Instrumentation::operationName(Operation operation) {
+    switch (operation) {
+        case Operation::Prepare: return "prepare";
+        case Operation::Bind: return "bind";
+        case Operation::Step: return "step";
+        case Operation::Begin: return "begin";
+        case Operation::Commit: return "commit";
+        case Operation::Rollback: return "rollback";
+        case Operation::BackupStep: return "backup step";
+        default: return "unknown";
+    }
+}
+
+void Instrumentation::setGlobal(Instrumentation* instrumentation) {
+    globalInstrumentation.store(instrumentation, std::memory_order_release);
+}
+
+Instrumentation* Instrumentation::global() {
+    return globalInstrumentation.load(std::memory_order_acquire);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+TraceRecorder::TraceRecorder(std::size_t capacity)
+: capacity_(capacity)
+{
+    if (capacity_ == 0)
+        throw Error("The capacity of a TraceRecorder must be at least 1");
+    // So that onEnd() never has to grow the buffer
+    records_.reserve(capacity_);
+}
+
+void TraceRecorder::onStart(const Event& /*event*/) {
+    // Operations are recorded as complete events when they end
+}
+
+void TraceRecorder::onEnd(const Event& event) noexcept {
+    try {
+        Record record{event.operation, event.statement, std::string(event.sql), event.start, event.end, event.failed, std::this_thread::get_id()};
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (records_.size() < capacity_)
+            records_.push_back(std::move(record));
+        else
+            records_[next_] = std::move(record);
+        next_ = (next_ + 1) % capacity_;
+    } catch (...) { // NOLINT(bugprone-empty-catch) - the record is dropped if its SQL can't be copied
+    }
+}
+
+std::size_t TraceRecorder::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_.size();
+}
+
+void TraceRecorder::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    records_.clear();
+    next_ = 0;
+}
+
+void TraceRecorder::writeChromeTrace(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::fixed;
+    out.precision(3);
+    out << "{\"traceEvents\":[";
+    // When the buffer has wrapped around, the oldest record is the next one to be overwritten
+    const std::size_t first = records_.size() < capacity_ ? 0 : next_;
+    for (std::size_t i = 0; i < records_.size(); ++i) {
+        const auto& record = records_[(first + i) % records_.size()];
+        if (i > 0)
+            out << ',';
+        out << "{\"name\":\"" << operationName(record.operation) << "\",\"cat\":\"dbpp\",\"ph\":\"X\""
+            << ",\"ts\":" << microseconds(record.start.time_since_epoch())
+            << ",\"dur\":" << microseconds(record.end - record.start)
+            << ",\"pid\":1,\"tid\":" << std::hash<std::thread::id>{}(record.thread)
+            << ",\"args\":{";
+        bool hasArgs = false;
+        if (record.statement) {
+            std::ostringstream id;
+            id << record.statement;
+            out << "\"statement\":\"" << id.str() << '"';
+            hasArgs = true;
+        }
+        if (!record.sql.empty()) {
+            out << (hasArgs ? "," : "") << "\"sql\":";
+            writeJsonString(out, record.sql);
+            hasArgs = true;
+        }
+        if (record.failed)
+            out << (hasArgs ? "," : "") << "\"failed\":true";
+        out << "}}";
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+std::string TraceRecorder::chromeTrace() const {
+    std::ostringstream out;
+    writeChromeTrace(out);
+    return out.str();
+}
+
+} // namespace Dbpp
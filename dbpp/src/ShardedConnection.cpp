@@ -0,0 +1,106 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "dbpp/ShardedConnection.h"
+#include "dbpp/Exception.h"
+
+#include <cstdint>
+#include <exception>
+#include <future>
+
+static std::size_t fnv1a(std::string_view key, std::size_t shardCount) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (char c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<std::size_t>(hash % shardCount);
+}
+
+namespace Dbpp {
+
+ShardedConnection::ShardedConnection(std::vector<Connection> shards)
+: ShardedConnection(std::move(shards), fnv1a)
+{}
+
+ShardedConnection::ShardedConnection(std::vector<Connection> shards, ShardFunction shardFunction)
+: shards_(std::move(shards))
+, shardFunction_(std::move(shardFunction))
+{
+    if (shards_.empty())
+        throw Error("A ShardedConnection needs at least one shard");
+    if (!shardFunction_)
+        throw Error("A ShardedConnection needs a shard function");
+}
+
+ShardedConnection::ShardedConnection(ShardedConnection&& that) noexcept = default;
+
+ShardedConnection& ShardedConnection::operator=(ShardedConnection&& that) noexcept = default;
+
+ShardedConnection::~ShardedConnection() = default;
+
+std::size_t ShardedConnection::shardCount() const {
+    return shards_.size();
+}
+
+Connection& ShardedConnection::shard(std::size_t index) {
+    if (index >= shards_.size())
+        throw Error("Shard index out of bounds");
+    return shards_[index];
+}
+
+std::size_t ShardedConnection::shardIndex(std::string_view key) const {
+    auto index = shardFunction_(key, shards_.size());
+    if (index >= shards_.size())
+        throw Error("The shard function returned an index out of bounds");
+    return index;
+}
+
+void ShardedConnection::forEachShard(const std::function<void(std::size_t, Connection&)>& func) {
+    // The last shard is handled on the calling thread, which also means
+    // that there are no extra threads at all with a single shard
+    const auto last = shards_.size() - 1;
+    std::vector<std::future<void>> pending;
+    pending.reserve(last);
+    for (std::size_t i = 0; i < last; ++i)
+        pending.push_back(std::async(std::launch::async, func, i, std::ref(shards_[i])));
+
+    std::exception_ptr lastError;
+    try {
+        func(last, shards_[last]);
+    } catch (...) {
+        lastError = std::current_exception();
+    }
+
+    // Wait for all shards before reporting anything, since the tasks refer to our stack.
+    // If several shards fail, the error from the one with the lowest index is reported
+    std::exception_ptr error;
+    for (auto& f : pending) {
+        try {
+            f.get();
+        } catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (!error)
+        error = lastError;
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // namespace Dbpp
@@ -34,10 +34,16 @@ Statement::Statement(Adapter::StatementPtr p)
 
 Statement::Statement(Statement&& that) noexcept
 : impl_(std::move(that.impl_))
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+, instrumentation_(std::move(that.instrumentation_))
+#endif
 {}
 
 Statement& Statement::operator=(Statement&& that) noexcept {
     impl_ = std::move(that.impl_);
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    instrumentation_ = std::move(that.instrumentation_);
+#endif
 
     return *this;
 }
@@ -51,6 +57,7 @@ StatementIterator Statement::end() {
 }
 
 Result Statement::step() {
+    Detail::InstrumentationScope scope(instrumentation(), Instrumentation::Operation::Step, impl_.get());
     return Result(impl_->step());
 }
 
@@ -60,6 +67,12 @@ std::string Statement::sql() const {
 
 //////////////////////////////////////////////////////////////////////////////
 
+Adapter::StatementPtr Adapter::Statement::getImpl(Dbpp::Statement& stmt) {
+    return stmt.impl_;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 StatementIterator& StatementIterator::operator++() {
     if (stmt_) {
         res_ = stmt_->step();
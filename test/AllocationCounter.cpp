@@ -0,0 +1,83 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Per thread, so that allocations made by other threads don't disturb the tests
+thread_local std::size_t allocationCount = 0;
+thread_local std::size_t allocatedBytes = 0;
+
+void* countedAlloc(std::size_t size) noexcept {
+    ++allocationCount;
+    allocatedBytes += size;
+    return std::malloc(size == 0 ? 1 : size); // NOLINT
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    if (void* p = countedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    if (void* p = countedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); } // NOLINT
+void operator delete[](void* p) noexcept { std::free(p); } // NOLINT
+void operator delete(void* p, std::size_t) noexcept { std::free(p); } // NOLINT
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); } // NOLINT
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); } // NOLINT
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); } // NOLINT
+
+AllocationCounter::AllocationCounter()
+: startCount_(allocationCount)
+, startBytes_(allocatedBytes)
+{}
+
+void
+AllocationCounter::reset() {
+    startCount_ = allocationCount;
+    startBytes_ = allocatedBytes;
+}
+
+std::size_t
+AllocationCounter::count() const {
+    return allocationCount - startCount_;
+}
+
+std::size_t
+AllocationCounter::bytes() const {
+    return allocatedBytes - startBytes_;
+}
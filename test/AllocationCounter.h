@@ -0,0 +1,43 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <cstddef>
+
+// Counts the allocations made through the global operator new by the current thread,
+// from when it was constructed. AllocationCounter.cpp replaces operator new and delete
+// to make this possible, so it's linked into the test runner and the benchmarks that
+// count allocations. Memory that SQLite allocates itself isn't counted.
+class AllocationCounter {
+    std::size_t startCount_;
+    std::size_t startBytes_;
+
+public:
+    AllocationCounter();
+
+    // Restarts the counting
+    void reset();
+
+    // The number of allocations so far
+    [[nodiscard]]
+    std::size_t count() const;
+
+    // The number of bytes allocated so far
+    [[nodiscard]]
+    std::size_t bytes() const;
+};
@@ -0,0 +1,49 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "CountingVfs.h"
+
+#include <stdexcept>
+
+CountingVfs::CountingVfs()
+: vfs_{}
+{
+    vfs_.parent = sqlite3_vfs_find(nullptr);
+    if (vfs_.parent == nullptr)
+        throw std::runtime_error("There is no default VFS");
+    vfs_.base = *vfs_.parent;
+    vfs_.base.zName = Name;
+    vfs_.base.pNext = nullptr;
+    vfs_.base.xOpen = open;
+    if (sqlite3_vfs_register(&vfs_.base, 0) != SQLITE_OK)
+        throw std::runtime_error("Failed to register the counting VFS");
+}
+
+CountingVfs::~CountingVfs() {
+    sqlite3_vfs_unregister(&vfs_.base);
+}
+
+int CountingVfs::open(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags, int* outFlags) {
+    auto* self = reinterpret_cast<Vfs*>(vfs); // NOLINT
+    if (flags & SQLITE_OPEN_MAIN_DB)
+        ++self->opens;
+    return self->parent->xOpen(self->parent, name, file, flags, outFlags);
+}
+
+std::string CountingVfs::uri(const std::filesystem::path& file) {
+    return "file:" + file.generic_string() + "?vfs=" + Name;
+}
@@ -0,0 +1,55 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <sqlite3.h>
+
+// A VFS that passes everything on to the default VFS, and counts the database files opened
+// through it. Used to check that the connections a component opens on its own use the VFS
+// of the application's connection. Registered under Name while it exists
+class CountingVfs {
+    struct Vfs {
+        sqlite3_vfs base;
+        sqlite3_vfs* parent;
+        std::atomic<int> opens{0};
+    };
+
+    Vfs vfs_;
+
+    static int open(sqlite3_vfs* vfs, const char* name, sqlite3_file* file, int flags, int* outFlags);
+
+public:
+    static constexpr const char* Name = "dbpp-test-counting";
+
+    CountingVfs();
+    ~CountingVfs();
+
+    CountingVfs(const CountingVfs&) = delete;
+    CountingVfs& operator=(const CountingVfs&) = delete;
+
+    // The number of main database files opened so far
+    [[nodiscard]]
+    int opens() const { return vfs_.opens.load(); }
+
+    // A URI that opens a file with this VFS, for Sqlite3::open() with OpenFlag::Uri
+    [[nodiscard]]
+    static std::string uri(const std::filesystem::path& file);
+};
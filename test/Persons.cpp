@@ -17,18 +17,29 @@
 
 #include "Persons.h"
 
+#include <iterator>
+
 Persons::Persons()
 : db(Dbpp::Sqlite3::open(":memory:"))
 {}
 
+Persons::Persons(Dbpp::Connection connection)
+: db(std::move(connection))
+{}
+
 void
-Persons::populate() {
+Persons::createTable() {
     db.exec("CREATE TABLE person ("
             " id INTEGER PRIMARY KEY AUTOINCREMENT,"
             " name TEXT NOT NULL,"
             " age INTEGER NOT NULL,"
             " spouse_id INTEGER REFERENCES person(id)"
             ")");
+}
+
+void
+Persons::populate() {
+    createTable();
 
     johnDoe_.id = db.exec("INSERT INTO person (name, age) VALUES ('John Doe', 48)").getInsertId();
     janeDoe_.id = db.exec("INSERT INTO person (name, age) VALUES ('Jane Doe', 45)").getInsertId();
@@ -38,3 +49,37 @@ Persons::populate() {
     johnDoe_.spouseId = janeDoe_.id;
     janeDoe_.spouseId = johnDoe_.id;
 }
+
+Persons::Person
+Persons::generate(std::int64_t index) {
+    static const char* const firstNames[] = {
+        "Anna", "Erik", "Maria", "Lars", "Karin", "Johan", "Eva", "Nils",
+        "Sara", "Olof", "Lena", "Per", "Ida", "Karl", "Elin", "Sven"};
+    static const char* const lastNames[] = {
+        "Berg", "Lind", "Holm", "Ek", "Strom", "Dahl", "Lund", "Sjo",
+        "Nord", "Wall", "Falk", "Ask", "Bjork", "Alm", "Hed", "Vik"};
+    constexpr std::uint64_t FirstCount = std::size(firstNames);
+    constexpr std::uint64_t LastCount = std::size(lastNames);
+
+    // Spread consecutive indexes over names and ages
+    const auto n = static_cast<std::uint64_t>(index) * 2654435761U;
+    Person p;
+    p.name = firstNames[n % FirstCount];
+    p.name += ' ';
+    p.name += lastNames[(n / FirstCount) % LastCount];
+    p.age = static_cast<int>(18 + (n / (FirstCount * LastCount)) % 80);
+    p.id = 0;
+    return p;
+}
+
+void
+Persons::insertGenerated(std::int64_t count, const std::string& suffix) {
+    Dbpp::Transaction tx(db);
+    auto insert = db.preparedStatement("INSERT INTO person (name, age) VALUES (?, ?)");
+    for (std::int64_t i = 0; i < count; ++i) {
+        auto p = generate(i);
+        insert.rebind(p.name + suffix, p.age);
+        (void) insert.step();
+    }
+    tx.commit();
+}
@@ -42,5 +42,15 @@ public:
     inline const Person& andersSvensson() { return andersSvensson_; }
 
     Persons();
+    explicit Persons(Dbpp::Connection connection);
+    void createTable();
     void populate();
+
+    // Synthetic persons, for bulk loads. The same index always gives the same person, and
+    // the names are short enough to not need heap allocations
+    static Person generate(std::int64_t index);
+
+    // Inserts the synthetic persons 0 to count - 1 in a single transaction, with a suffix
+    // appended to their names
+    void insertGenerated(std::int64_t count, const std::string& suffix = {});
 };
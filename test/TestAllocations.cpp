@@ -0,0 +1,96 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "AllocationCounter.h"
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+using namespace Dbpp;
+
+TEST_CASE("Allocations", "[api]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.createTable();
+
+    constexpr std::int64_t Rows = 100;
+    persons.insertGenerated(Rows, " with a name too long for small strings");
+
+    // Each step allocates the Result it returns, including the final empty one
+    SECTION("Statement iteration") {
+        auto st = db.statement("SELECT age FROM person");
+        long long sum = 0;
+        AllocationCounter counter;
+        for (auto& res : st)
+            sum += res.get<int>(0);
+        REQUIRE(sum > 0);
+        REQUIRE(counter.count() <= Rows + 1);
+    }
+
+    SECTION("StatementTupleIterator") {
+        auto st = db.statement("SELECT id, age FROM person");
+        long long sum = 0;
+        AllocationCounter counter;
+        for (auto [id, age] : std::move(st).as<std::int64_t, int>())
+            sum += id + age;
+        REQUIRE(sum > 0);
+        REQUIRE(counter.count() <= Rows + 1);
+    }
+
+    SECTION("PreparedStatement::rebind()") {
+        auto select = db.preparedStatement("SELECT age FROM person WHERE id = ?");
+        select.rebind(1);
+        (void) select.step();
+        long long sum = 0;
+        AllocationCounter counter;
+        for (std::int64_t id = 1; id <= Rows; ++id) {
+            select.rebind(id);
+            sum += select.step().get<int>(0);
+        }
+        REQUIRE(sum > 0);
+        REQUIRE(counter.count() == Rows); // Binding and resetting don't allocate
+    }
+
+    SECTION("Connection::get()") {
+        long long sum = 0;
+        AllocationCounter counter;
+        for (std::int64_t id = 1; id <= Rows; ++id)
+            sum += db.get<int>("SELECT age FROM person WHERE id = ?", id);
+        REQUIRE(sum > 0);
+        REQUIRE(counter.count() <= 4 * Rows); // The statement, its handle, its column info and the result
+    }
+
+    SECTION("Result::get() into a reused string") {
+        auto st = db.statement("SELECT name FROM person");
+        std::string name;
+        name.reserve(256);
+        std::size_t length = 0;
+        AllocationCounter counter;
+        for (auto& res : st) {
+            res.get(0, name);
+            length += name.size();
+        }
+        REQUIRE(length > Rows * 16);
+        REQUIRE(counter.count() <= Rows + 1); // Only the results, since the string is large enough
+
+        st = db.statement("SELECT name FROM person");
+        counter.reset();
+        for (auto& res : st)
+            length += res.get<std::string>(0).size();
+        REQUIRE(counter.count() <= 2 * Rows + 1);
+    }
+}
@@ -0,0 +1,174 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <filesystem>
+
+using namespace Dbpp;
+using namespace std::chrono_literals;
+
+TEST_CASE("Sqlite3::BackupJob", "[sqlite3]") {
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto source = dir / "dbpp_test_backup_source.db";
+    const auto destination = dir / "dbpp_test_backup_destination.db";
+    for (const auto& file : {source, destination})
+        std::filesystem::remove(file);
+
+    {
+        Persons persons(Sqlite3::open(source));
+        persons.populate();
+        persons.db.exec("PRAGMA journal_mode=WAL");
+        persons.insertGenerated(5000);
+        const auto rows = persons.db.get<int>("SELECT COUNT(*) FROM person");
+
+        SECTION("Completing a backup") {
+            std::vector<int> remaining;
+            Sqlite3::BackupOptions options;
+            options.progressCallback = [&](const Sqlite3::BackupProgress& p) { remaining.push_back(p.remainingPages); };
+            options.maxPagesPerStep = 16;
+            options.interval = 0ms;
+
+            Sqlite3::BackupJob job(persons.db, destination, options);
+            REQUIRE(job.wait() == Sqlite3::BackupStatus::Completed);
+            REQUIRE(job.status() == Sqlite3::BackupStatus::Completed);
+            REQUIRE_FALSE(job.usedVacuumInto());
+            REQUIRE(job.progress().remainingPages == 0);
+            REQUIRE(job.progress().totalPages > 16);
+            REQUIRE(remaining.size() > 1);
+            REQUIRE(std::is_sorted(remaining.rbegin(), remaining.rend()));
+
+            auto copy = Sqlite3::open(destination);
+            REQUIRE(copy.get<int>("SELECT COUNT(*) FROM person") == rows);
+        }
+
+        SECTION("Pausing and cancelling") {
+            Sqlite3::BackupOptions options;
+            options.maxPagesPerStep = 1;
+            options.interval = 10ms;
+
+            Sqlite3::BackupJob job(persons.db, destination, options);
+            job.pause();
+            REQUIRE(job.status() == Sqlite3::BackupStatus::Paused);
+            REQUIRE_FALSE(job.waitFor(50ms));
+            const auto paused = job.progress().remainingPages;
+            REQUIRE_FALSE(job.waitFor(50ms));
+            REQUIRE(job.progress().remainingPages == paused);
+
+            job.resume();
+            REQUIRE(job.status() == Sqlite3::BackupStatus::Running);
+            job.cancel();
+            REQUIRE(job.wait() == Sqlite3::BackupStatus::Cancelled);
+        }
+
+        SECTION("Falling back to VACUUM INTO") {
+            Sqlite3::BackupOptions options;
+            options.maxPagesPerStep = 1;
+            options.interval = 1ms;
+            options.vacuumIntoAfterRestarts = 2;
+
+            // VACUUM INTO runs on a connection of its own, so the limits of the source
+            // connection don't stop it, and the source connection can be used meanwhile
+            Sqlite3::CancellationToken token;
+            token.cancel();
+            auto limits = Sqlite3::limitQueries(persons.db, {std::nullopt, token});
+            std::atomic<bool> fallback{false};
+            options.progressCallback = [&](const Sqlite3::BackupProgress& p) {
+                if (p.restarts > options.vacuumIntoAfterRestarts)
+                    fallback = true;
+            };
+
+            auto writer = Sqlite3::open(source);
+            Sqlite3::setBusyTimeout(writer, 1s);
+            int written = 0;
+            Sqlite3::BackupJob job(persons.db, destination, options);
+            while (!job.waitFor(1ms)) {
+                if (fallback) {
+                    limits.release();
+                    REQUIRE(persons.db.get<int>("SELECT COUNT(*) FROM person") >= rows);
+                    continue;
+                }
+                writer.exec("INSERT INTO person (name, age) VALUES ('Sven Berg', 30)");
+                ++written;
+            }
+            REQUIRE(job.wait() == Sqlite3::BackupStatus::Completed);
+            REQUIRE(job.usedVacuumInto());
+            REQUIRE(job.progress().restarts > 2);
+
+            auto copy = Sqlite3::open(destination);
+            const auto copied = copy.get<int>("SELECT COUNT(*) FROM person");
+            REQUIRE(copied >= rows);
+            REQUIRE(copied <= rows + written);
+        }
+
+        SECTION("Cancelling VACUUM INTO leaves the destination as it was") {
+            {
+                auto previous = Sqlite3::open(destination);
+                previous.exec("CREATE TABLE previous_backup (x INTEGER)");
+            }
+
+            // The first step is followed by a write, which restarts the backup. Then an
+            // exclusive lock on the source makes VACUUM INTO wait. Readers are only locked
+            // out by writers in rollback journal mode
+            persons.db.exec("PRAGMA journal_mode=DELETE");
+            auto writer = Sqlite3::open(source);
+            auto blocker = Sqlite3::open(source);
+            std::atomic<bool> blocked{false};
+            Sqlite3::BackupOptions options;
+            options.maxPagesPerStep = 1;
+            options.interval = 1ms;
+            options.vacuumIntoAfterRestarts = 0;
+            options.progressCallback = [&](const Sqlite3::BackupProgress& p) {
+                if (p.restarts == 0) {
+                    writer.exec("INSERT INTO person (name, age) VALUES ('Sven Berg', 30)");
+                } else if (!blocked) {
+                    blocker.exec("BEGIN EXCLUSIVE");
+                    blocked = true;
+                }
+            };
+
+            Sqlite3::BackupJob job(persons.db, destination, options);
+            while (!blocked && !job.waitFor(1ms)) {
+            }
+            REQUIRE_FALSE(job.waitFor(20ms));
+            job.cancel();
+            REQUIRE(job.wait() == Sqlite3::BackupStatus::Cancelled);
+            REQUIRE_FALSE(job.usedVacuumInto());
+            blocker.exec("ROLLBACK");
+
+            REQUIRE_FALSE(std::filesystem::exists(destination.string() + "-vacuum"));
+            auto copy = Sqlite3::open(destination);
+            REQUIRE(copy.get<int>("SELECT COUNT(*) FROM sqlite_master WHERE name = 'previous_backup'") == 1);
+            REQUIRE(copy.get<int>("SELECT COUNT(*) FROM sqlite_master WHERE name = 'person'") == 0);
+        }
+
+        SECTION("Failures are rethrown by wait()") {
+            Sqlite3::BackupJob job(persons.db, dir / "nonexistent_dbpp_dir" / "backup.db");
+            REQUIRE_THROWS_AS(job.wait(), Error);
+            REQUIRE(job.status() == Sqlite3::BackupStatus::Failed);
+        }
+    }
+
+    for (const auto& file : {source, destination}) {
+        std::filesystem::remove(file);
+        std::filesystem::remove(file.string() + "-wal");
+        std::filesystem::remove(file.string() + "-shm");
+    }
+}
@@ -0,0 +1,155 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+using namespace Dbpp;
+using namespace std::chrono_literals;
+
+namespace {
+
+    const auto endless = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) SELECT COUNT(*) FROM c";
+
+} // namespace
+
+TEST_CASE("Sqlite3 query limits", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+
+    SECTION("Deadlines") {
+        const auto started = std::chrono::steady_clock::now();
+        {
+            auto scope = Sqlite3::limitQueries(db, started + 50ms);
+            REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+            REQUIRE_THROWS_AS(db.get<int>(endless), Sqlite3::DeadlineExceeded);
+            REQUIRE(std::chrono::steady_clock::now() - started < 5s);
+            REQUIRE_THROWS_AS(db.exec("UPDATE person SET age = age + 1"), Sqlite3::DeadlineExceeded);
+        }
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+        REQUIRE(db.get<int>("SELECT SUM(age) FROM person") == 48 + 45 + 38);
+    }
+
+    SECTION("Cancellation from another thread") {
+        Sqlite3::CancellationToken token;
+        auto scope = Sqlite3::limitQueries(db, token);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+
+        std::thread canceller([token]() mutable {
+            std::this_thread::sleep_for(50ms);
+            token.cancel();
+        });
+        bool deadlineExceeded = true;
+        try {
+            (void) db.get<int>(endless);
+        } catch (const Sqlite3::QueryCancelled& e) {
+            deadlineExceeded = dynamic_cast<const Sqlite3::DeadlineExceeded*>(&e) != nullptr;
+            REQUIRE(e.code == SQLITE_INTERRUPT);
+        }
+        canceller.join();
+        REQUIRE_FALSE(deadlineExceeded);
+        REQUIRE(token.isCancelled());
+        REQUIRE_THROWS_AS(db.get<int>("SELECT COUNT(*) FROM person"), Sqlite3::QueryCancelled);
+
+        scope.release();
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+    }
+
+    SECTION("Stopped statements can be executed again") {
+        auto select = db.preparedStatement("SELECT COUNT(*) FROM person WHERE age > ?");
+        Sqlite3::QueryLimits limits;
+        limits.token = Sqlite3::CancellationToken();
+        limits.token->cancel();
+        {
+            auto scope = Sqlite3::limitQueries(db, limits);
+            select.rebind(40);
+            REQUIRE_THROWS_AS(select.step(), Sqlite3::QueryCancelled);
+        }
+        select.rebind(40);
+        REQUIRE(select.step().get<int>(0) == 2);
+    }
+
+    SECTION("Transactions are rolled back") {
+        {
+            auto scope = Sqlite3::limitQueries(db, std::chrono::steady_clock::now() + 50ms);
+            Transaction tx(db);
+            db.exec("DELETE FROM person");
+            REQUIRE_THROWS_AS(db.get<int>(endless), Sqlite3::DeadlineExceeded);
+        }
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+
+        // An interrupted write makes SQLite roll back the transaction itself
+        {
+            Transaction tx(db);
+            auto scope = Sqlite3::limitQueries(db, std::chrono::steady_clock::now() + 20ms);
+            REQUIRE_THROWS_AS(db.exec("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n)"
+                                      " INSERT INTO person (name, age) SELECT 'Nobody', 1 FROM n"), Sqlite3::DeadlineExceeded);
+        }
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+    }
+
+    SECTION("Nested scopes") {
+        Sqlite3::QueryLimits limits;
+        limits.token = Sqlite3::CancellationToken();
+        auto outer = Sqlite3::limitQueries(db, limits);
+        {
+            auto inner = Sqlite3::limitQueries(db, std::chrono::steady_clock::now() + 20ms);
+            REQUIRE_THROWS_AS(db.get<int>(endless), Sqlite3::DeadlineExceeded);
+        }
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+        limits.token->cancel();
+        REQUIRE_THROWS_AS(db.get<int>("SELECT COUNT(*) FROM person"), Sqlite3::QueryCancelled);
+    }
+
+    SECTION("Limits are required") {
+        REQUIRE_THROWS_AS(Sqlite3::limitQueries(db, Sqlite3::QueryLimits()), Error);
+        Sqlite3::QueryLimits limits;
+        limits.deadline = std::chrono::steady_clock::now();
+        limits.checkInterval = 0;
+        REQUIRE_THROWS_AS(Sqlite3::limitQueries(db, limits), Error);
+    }
+}
+
+TEST_CASE("Sqlite3 query limits while waiting for a lock", "[sqlite3]") {
+    const auto file = std::filesystem::temp_directory_path() / "dbpp_test_cancellation.db";
+    std::filesystem::remove(file);
+    {
+        Persons persons(Sqlite3::open(file));
+        persons.populate();
+        Sqlite3::setBusyTimeout(persons.db, 10s);
+        auto other = Sqlite3::open(file);
+        other.exec("BEGIN IMMEDIATE");
+
+        const auto started = std::chrono::steady_clock::now();
+        auto scope = Sqlite3::limitQueries(persons.db, started + 100ms);
+        try {
+            persons.db.exec("UPDATE person SET age = 0");
+            FAIL("The update should have been stopped");
+        } catch (const Sqlite3::DeadlineExceeded& e) {
+            REQUIRE(e.code == SQLITE_BUSY);
+        }
+        REQUIRE(std::chrono::steady_clock::now() - started < 5s);
+        other.exec("ROLLBACK");
+    }
+    std::filesystem::remove(file);
+}
@@ -0,0 +1,133 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+using namespace Dbpp;
+using Sqlite3::ChangeOperation;
+using Sqlite3::RowChange;
+
+TEST_CASE("Sqlite3 change notifications", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+    db.exec("CREATE TABLE pet (id INTEGER PRIMARY KEY, name TEXT)");
+
+    std::vector<std::vector<RowChange>> batches;
+    auto subscription = Sqlite3::subscribeToChanges(db, [&](const std::vector<RowChange>& changes) {
+        batches.push_back(changes);
+    });
+    const auto janeId = persons.janeDoe().id;
+
+    SECTION("Autocommit statements") {
+        auto id = db.exec("INSERT INTO pet (name) VALUES ('Rex')").getInsertId();
+        db.exec("UPDATE person SET age = age + 1 WHERE id = ?", janeId);
+        REQUIRE(batches == std::vector<std::vector<RowChange>>{
+            {{"pet", ChangeOperation::Insert, id}},
+            {{"person", ChangeOperation::Update, janeId}},
+        });
+    }
+
+    SECTION("Deleting every row reports each row") {
+        db.exec("INSERT INTO pet (id, name) VALUES (1, 'Rex'), (2, 'Fido')");
+        batches.clear();
+        db.exec("DELETE FROM pet");
+        REQUIRE(batches == std::vector<std::vector<RowChange>>{{
+            {"pet", ChangeOperation::Delete, 1},
+            {"pet", ChangeOperation::Delete, 2},
+        }});
+    }
+
+    SECTION("Transactions are delivered in one batch when committed") {
+        Transaction tx(db);
+        db.exec("UPDATE person SET age = age + 1 WHERE id = ?", janeId);
+        db.exec("UPDATE person SET age = age + 1 WHERE id = ?", janeId);
+        db.exec("INSERT INTO pet (id, name) VALUES (7, 'Rex')");
+        db.exec("DELETE FROM person WHERE id = ?", persons.andersSvensson().id);
+        REQUIRE(batches.empty());
+        tx.commit();
+
+        std::vector<RowChange> expected{
+            {"person", ChangeOperation::Update, janeId},
+            {"person", ChangeOperation::Delete, persons.andersSvensson().id},
+            {"pet", ChangeOperation::Insert, 7},
+        };
+        std::sort(expected.begin(), expected.end());
+        REQUIRE(batches == std::vector<std::vector<RowChange>>{expected});
+    }
+
+    SECTION("Rolled back transactions are discarded") {
+        {
+            Transaction tx(db);
+            db.exec("DELETE FROM pet");
+            db.exec("UPDATE person SET age = 0");
+        }
+        REQUIRE_THROWS_AS(db.exec("INSERT INTO person (name, age) VALUES (NULL, 1)"), Error);
+        db.exec("INSERT INTO pet (id, name) VALUES (1, 'Rex')");
+        REQUIRE(batches == std::vector<std::vector<RowChange>>{{{"pet", ChangeOperation::Insert, 1}}});
+    }
+
+    SECTION("Filtering on tables") {
+        std::vector<RowChange> pets;
+        auto petSubscription = Sqlite3::subscribeToChanges(db, [&](const std::vector<RowChange>& changes) {
+            pets.insert(pets.end(), changes.begin(), changes.end());
+        }, {"pet"});
+        db.exec("UPDATE person SET age = age + 1");
+        REQUIRE(pets.empty());
+        db.exec("INSERT INTO pet (id, name) VALUES (3, 'Rex')");
+        REQUIRE(pets == std::vector<RowChange>{{"pet", ChangeOperation::Insert, 3}});
+        REQUIRE(batches.size() == 2);
+    }
+
+    SECTION("Listeners can use the connection and unsubscribe") {
+        std::vector<std::string> names;
+        subscription = Sqlite3::subscribeToChanges(db, [&](const std::vector<RowChange>& changes) {
+            for (const auto& change : changes)
+                names.push_back(db.get<std::string>("SELECT name FROM person WHERE id = ?", change.rowid));
+            subscription.unsubscribe();
+        }, {"person"});
+        db.exec("UPDATE person SET age = 1 WHERE id = ?", janeId);
+        db.exec("UPDATE person SET age = 2 WHERE id = ?", janeId);
+        REQUIRE(names == std::vector<std::string>{"Jane Doe"});
+        REQUIRE(batches.empty());
+    }
+
+    SECTION("Exceptions thrown by listeners are ignored") {
+        subscription = Sqlite3::subscribeToChanges(db, [](const std::vector<RowChange>&) {
+            throw std::runtime_error("Listener failed");
+        });
+        // Called after the failing listener
+        auto recorder = Sqlite3::subscribeToChanges(db, [&](const std::vector<RowChange>& changes) {
+            batches.push_back(changes);
+        });
+        db.exec("UPDATE person SET age = 1 WHERE id = ?", janeId);
+        REQUIRE(db.get<int>("SELECT age FROM person WHERE id = ?", janeId) == 1);
+        REQUIRE(batches.size() == 1);
+
+        {
+            Transaction tx(db);
+            db.exec("UPDATE person SET age = 2 WHERE id = ?", janeId);
+            tx.commit();
+        }
+        REQUIRE(db.execScript("UPDATE person SET age = age + 1 WHERE id = ?;", ScriptMode::Transaction,
+                              std::make_tuple(janeId)) == 1);
+        REQUIRE(db.get<int>("SELECT age FROM person WHERE id = ?", janeId) == 3);
+        REQUIRE(batches.size() == 3);
+    }
+}
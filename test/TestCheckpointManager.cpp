@@ -0,0 +1,183 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "CountingVfs.h"
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+using namespace Dbpp;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Polls a condition for up to two seconds
+template <typename Condition>
+bool eventually(Condition condition) {
+    for (int i = 0; i < 200; ++i) {
+        if (condition())
+            return true;
+        std::this_thread::sleep_for(10ms);
+    }
+    return condition();
+}
+
+} // namespace
+
+TEST_CASE("Sqlite3::CheckpointManager", "[sqlite3]") {
+    const auto file = std::filesystem::temp_directory_path() / "dbpp_test_checkpoints.db";
+    const auto wal = std::filesystem::path(file.string() + "-wal");
+    std::filesystem::remove(file);
+
+    {
+        Persons persons(Sqlite3::open(file));
+        Connection& db = persons.db;
+        Sqlite3::setBusyTimeout(db, 1s);
+
+        SECTION("Requires a database in WAL mode") {
+            REQUIRE_THROWS_AS(Sqlite3::CheckpointManager(db), Error);
+            Persons inMemory;
+            REQUIRE_THROWS_AS(Sqlite3::CheckpointManager(inMemory.db), Error);
+        }
+
+        db.exec("PRAGMA journal_mode=WAL");
+        persons.populate();
+        db.exec("PRAGMA wal_checkpoint(TRUNCATE)");
+        auto insert = [&](int count) {
+            for (int i = 0; i < count; ++i) {
+                auto p = Persons::generate(i);
+                db.exec("INSERT INTO person (name, age) VALUES (?, ?)", p.name, p.age);
+            }
+        };
+
+        SECTION("Checkpoints when the lag is large enough") {
+            Sqlite3::CheckpointPolicy policy;
+            policy.lagPages = 20;
+            policy.maxInterval = 1h;
+            policy.truncatePages = -1;
+            {
+                Sqlite3::CheckpointManager manager(db, policy);
+                REQUIRE(db.get<int>("PRAGMA wal_autocheckpoint") == 0);
+
+                insert(5);
+                auto stats = manager.stats();
+                REQUIRE(stats.walPages >= 5);
+                REQUIRE(stats.lagPages == stats.walPages);
+                REQUIRE(stats.walBytes > stats.walPages * 1024);
+                REQUIRE(stats.checkpoints == 0);
+
+                insert(20);
+                REQUIRE(eventually([&] { return manager.stats().lagPages < policy.lagPages; }));
+                REQUIRE(manager.stats().checkpoints >= 1);
+                REQUIRE(manager.stats().walPages > 0); // Not truncated
+
+                const auto checkpoints = manager.stats().checkpoints;
+                manager.requestCheckpoint();
+                REQUIRE(eventually([&] { return manager.stats().checkpoints == checkpoints + 1; }));
+            }
+            REQUIRE(db.get<int>("PRAGMA wal_autocheckpoint") == 1000);
+        }
+
+        SECTION("The lag is counted from the start of a restarted WAL") {
+            Sqlite3::CheckpointPolicy policy;
+            policy.lagPages = 20;
+            policy.maxInterval = 1h;
+            policy.truncatePages = -1;
+            Sqlite3::CheckpointManager manager(db, policy);
+
+            int maxWalPages = 0;
+            for (int i = 0; i < 200; ++i) {
+                insert(1);
+                maxWalPages = std::max(maxWalPages, manager.stats().walPages);
+                std::this_thread::sleep_for(2ms);
+            }
+            REQUIRE(manager.stats().checkpoints >= 3);
+            REQUIRE(maxWalPages < policy.lagPages * 3 / 2);
+            REQUIRE(manager.stats().lagPages < policy.lagPages * 3 / 2);
+        }
+
+        SECTION("PRAGMA wal_autocheckpoint doesn't disable the manager for good") {
+            Sqlite3::CheckpointPolicy policy;
+            policy.lagPages = 1000000;
+            policy.maxInterval = 1h;
+            Sqlite3::CheckpointManager manager(db, policy);
+
+            db.exec("PRAGMA wal_autocheckpoint=1000");
+            insert(5);
+            REQUIRE(manager.stats().walPages == 0); // The commits weren't seen
+            REQUIRE(db.get<int>("PRAGMA wal_autocheckpoint") == 0);
+            insert(1);
+            REQUIRE(manager.stats().walPages >= 6);
+        }
+
+        SECTION("Checkpoints periodically") {
+            Sqlite3::CheckpointPolicy policy;
+            policy.lagPages = 1000000;
+            policy.maxInterval = 20ms;
+            policy.truncatePages = -1;
+            Sqlite3::CheckpointManager manager(db, policy);
+            insert(5);
+            REQUIRE(eventually([&] { return manager.stats().lagPages == 0; }));
+            REQUIRE(manager.stats().checkpoints >= 1);
+            REQUIRE(manager.stats().sinceLastCheckpoint < 2s);
+        }
+
+        SECTION("Truncates the WAL when no reader uses it") {
+            Sqlite3::CheckpointPolicy policy;
+            policy.lagPages = 5;
+            policy.maxInterval = 10ms;
+            policy.truncatePages = 10;
+            Sqlite3::CheckpointManager manager(db, policy);
+
+            auto reader = Sqlite3::open(file);
+            reader.begin();
+            REQUIRE(reader.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+            insert(20);
+            REQUIRE(eventually([&] { return manager.stats().checkpoints >= 2; }));
+            REQUIRE(manager.stats().truncations == 0);
+            REQUIRE(manager.stats().lagPages > 0); // The reader's snapshot is still needed
+
+            reader.commit();
+            REQUIRE(eventually([&] { return manager.stats().truncations >= 1; }));
+            REQUIRE(std::filesystem::file_size(wal) == 0);
+            REQUIRE(manager.stats().walPages == 0);
+            REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count + 20);
+        }
+    }
+
+    for (const auto& f : {file, wal, std::filesystem::path(file.string() + "-shm")})
+        std::filesystem::remove(f);
+}
+
+TEST_CASE("Sqlite3::CheckpointManager uses the VFS of the connection", "[sqlite3]") {
+    const auto file = std::filesystem::temp_directory_path() / "dbpp_test_checkpoints_vfs.db";
+    std::filesystem::remove(file);
+    {
+        CountingVfs vfs;
+        auto db = Sqlite3::open(CountingVfs::uri(file), Sqlite3::OpenMode::ReadWriteCreate, Sqlite3::OpenFlag::Uri);
+        db.exec("PRAGMA journal_mode=WAL");
+        REQUIRE(vfs.opens() == 1);
+        Sqlite3::CheckpointManager manager(db);
+        REQUIRE(vfs.opens() == 2);
+    }
+    for (const auto& suffix : {"", "-wal", "-shm"})
+        std::filesystem::remove(file.string() + suffix);
+}
@@ -171,6 +171,42 @@ TEST_CASE("Connection", "[api]") {
         db.exec("DELETE FROM person WHERE id = ?", id);
     }
 
+    SECTION("Connection::execScript()") {
+        auto count = db.execScript(R"(
+            -- Pets and their owners
+            CREATE TABLE pet (id INTEGER PRIMARY KEY, owner_id INTEGER REFERENCES person(id), name TEXT);
+            CREATE INDEX pet_owner ON pet (owner_id);;
+            INSERT INTO pet (owner_id, name) SELECT id, 'Rex' FROM person;
+            SELECT * FROM pet; /* Results are discarded */
+            UPDATE pet SET name = 'Fido' WHERE id = 1
+        )");
+        REQUIRE(count == 5);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM pet WHERE name = 'Rex'") == persons.Count - 1);
+        REQUIRE(db.execScript("") == 0);
+        REQUIRE(db.execScript(" -- Nothing to do\n ; ") == 0);
+
+        count = db.execScript("INSERT INTO pet (owner_id, name) VALUES (?, ?); DELETE FROM pet WHERE name = ?; SELECT 1",
+                              ScriptMode::Autocommit, std::make_tuple(persons.janeDoe().id, "Bella"), std::make_tuple("Rex"));
+        REQUIRE(count == 3);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM pet") == 2);
+        REQUIRE(db.get<std::string>("SELECT group_concat(name) FROM (SELECT name FROM pet ORDER BY name)") == "Bella,Fido");
+
+        REQUIRE_THROWS_AS(db.execScript("DELETE FROM pet WHERE name = ?"), TooFewParametersProvided);
+        REQUIRE_THROWS_AS(db.execScript("SELECT 1", ScriptMode::Autocommit, std::make_tuple(), std::make_tuple()), Error);
+
+        SECTION("Autocommit") {
+            REQUIRE_THROWS_AS(db.execScript("DELETE FROM pet; INSERT INTO nonexistent VALUES (1)"), Error);
+            REQUIRE(db.get<int>("SELECT COUNT(*) FROM pet") == 0);
+        }
+
+        SECTION("Transaction") {
+            REQUIRE_THROWS_AS(db.execScript("DELETE FROM pet; INSERT INTO nonexistent VALUES (1)", ScriptMode::Transaction), Error);
+            REQUIRE(db.get<int>("SELECT COUNT(*) FROM pet") == 2);
+            REQUIRE(db.execScript("DELETE FROM pet; DELETE FROM person", ScriptMode::Transaction) == 2);
+            REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == 0);
+        }
+    }
+
     SECTION("Connection::adapterName()") {
         REQUIRE(db.adapterName() == "sqlite3");
     }
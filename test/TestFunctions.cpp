@@ -0,0 +1,202 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <stdexcept>
+
+using namespace Dbpp;
+
+namespace {
+
+int twice(int value) {
+    return 2 * value;
+}
+
+struct SumOfAges {
+    long long sum = 0;
+    long long count = 0;
+    int bonus = 0;
+
+    void step(int age) {
+        sum += age + bonus;
+        ++count;
+    }
+
+    [[nodiscard]]
+    std::optional<long long> final() const {
+        return count ? std::optional<long long>(sum) : std::nullopt;
+    }
+};
+
+struct MovingSum {
+    long long sum = 0;
+    std::shared_ptr<int> inversions = std::make_shared<int>(0);
+
+    void step(long long value) { sum += value; }
+    void inverse(long long value) {
+        sum -= value;
+        ++*inversions;
+    }
+    [[nodiscard]] long long value() const { return sum; }
+    [[nodiscard]] long long final() const { return sum; }
+};
+
+} // namespace
+
+TEST_CASE("Sqlite3 SQL functions", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+
+    SECTION("registerFunction(), deduced argument types") {
+        Sqlite3::registerFunction(db, "initials", [](std::string_view name) {
+            std::string initials;
+            bool wordStart = true;
+            for (char c : name) {
+                if (wordStart && c != ' ')
+                    initials += c;
+                wordStart = c == ' ';
+            }
+            return initials;
+        });
+        REQUIRE(db.get<std::string>("SELECT initials(name) FROM person WHERE id = ?", persons.andersSvensson().id) == "AS");
+
+        Sqlite3::registerFunction(db, "scale", [](double value, std::optional<double> factor) {
+            return value * factor.value_or(10.0);
+        }, Sqlite3::FunctionFlag::Deterministic);
+        REQUIRE(db.get<double>("SELECT scale(1.5, 2)") == Approx(3.0));
+        REQUIRE(db.get<double>("SELECT scale(1.5, NULL)") == Approx(15.0));
+
+        Sqlite3::registerFunction(db, "twice", &twice);
+        REQUIRE(db.get<int>("SELECT SUM(twice(age)) FROM person") == 2 * (48 + 45 + 38));
+    }
+
+    SECTION("registerFunction(), blobs and NULL") {
+        Sqlite3::registerFunction(db, "checksum", [](Sqlite3::BlobView blob) {
+            long long sum = 0;
+            for (auto b : blob)
+                sum += std::to_integer<int>(b);
+            return sum;
+        });
+        REQUIRE(db.get<long long>("SELECT checksum(x'010203ff')") == 1 + 2 + 3 + 255);
+
+        Sqlite3::registerFunction(db, "reversed", [](const std::vector<unsigned char>& blob) {
+            return std::vector<unsigned char>(blob.rbegin(), blob.rend());
+        });
+        REQUIRE(db.get<std::vector<unsigned char>>("SELECT reversed(x'0102')") == std::vector<unsigned char>{2, 1});
+
+        Sqlite3::registerFunction(db, "no_result", []() {});
+        REQUIRE(db.exec("SELECT no_result()").isNull(0));
+    }
+
+    SECTION("registerFunction(), in queries") {
+        Sqlite3::registerFunction(db, "score", [](int age, std::string_view name) {
+            return age * 100 + static_cast<int>(name.size());
+        }, Sqlite3::FunctionFlag::Deterministic);
+
+        auto names = db.statement("SELECT name FROM person WHERE score(age, name) > 4500 ORDER BY score(age, name) DESC");
+        std::vector<std::string> result;
+        for (auto [name] : std::move(names).as<std::string>())
+            result.push_back(name);
+        REQUIRE(result == std::vector<std::string>{persons.johnDoe().name, persons.janeDoe().name});
+
+        // Only deterministic functions may be used in indexes
+        db.exec("CREATE INDEX person_score ON person(score(age, name))");
+        Sqlite3::registerFunction(db, "volatile_score", [](int age) { return age; });
+        REQUIRE_THROWS_AS(db.exec("CREATE INDEX person_volatile ON person(volatile_score(age))"), ErrorWithCode);
+    }
+
+    SECTION("registerFunction(), exceptions become SQL errors") {
+        Sqlite3::registerFunction(db, "fail", [](int) -> int { throw std::runtime_error("no way"); });
+        try {
+            db.exec("SELECT fail(1)");
+            FAIL("No exception thrown");
+        } catch (const ErrorWithCode& e) {
+            REQUIRE(e.code == SQLITE_ERROR);
+        }
+
+        // Integers that don't fit the parameter type aren't truncated
+        Sqlite3::registerFunction(db, "twice", &twice);
+        REQUIRE(db.get<int>("SELECT twice(-1000000)") == -2000000);
+        REQUIRE_THROWS_AS(db.exec("SELECT twice(5000000000)"), ErrorWithCode);
+        Sqlite3::registerFunction(db, "small", [](unsigned char value) { return value; });
+        REQUIRE(db.get<int>("SELECT small(255)") == 255);
+        REQUIRE_THROWS_AS(db.exec("SELECT small(256)"), ErrorWithCode);
+        REQUIRE_THROWS_AS(db.exec("SELECT small(-1)"), ErrorWithCode);
+    }
+
+    SECTION("registerFunction(), the function is destroyed with the connection") {
+        auto owned = std::make_shared<int>(7);
+        {
+            auto other = Sqlite3::open(":memory:");
+            Sqlite3::registerFunction(other, "seven", [owned]() { return *owned; });
+            REQUIRE(other.get<int>("SELECT seven()") == 7);
+            REQUIRE(owned.use_count() == 2);
+
+            // Replacing it destroys the old one
+            Sqlite3::registerFunction(other, "seven", [owned]() { return *owned; });
+            REQUIRE(owned.use_count() == 2);
+        }
+        REQUIRE(owned.use_count() == 1);
+    }
+
+    SECTION("registerAggregate()") {
+        Sqlite3::registerAggregate<SumOfAges>(db, "sum_of_ages", Sqlite3::FunctionFlag::Deterministic);
+        REQUIRE(db.get<long long>("SELECT sum_of_ages(age) FROM person") == 48 + 45 + 38);
+        REQUIRE(db.exec("SELECT sum_of_ages(age) FROM person WHERE age > 100").isNull(0));
+
+        // Each group gets its own copy of the prototype
+        SumOfAges withBonus;
+        withBonus.bonus = 1;
+        Sqlite3::registerAggregate(db, "sum_of_ages_plus_one", withBonus);
+        auto groups = db.statement("SELECT age > 40, sum_of_ages_plus_one(age) FROM person GROUP BY age > 40 ORDER BY 1");
+        std::vector<std::pair<int, long long>> result;
+        for (auto [older, sum] : std::move(groups).as<int, long long>())
+            result.emplace_back(older, sum);
+        REQUIRE(result == std::vector<std::pair<int, long long>>{{0, 39}, {1, 49 + 46}});
+    }
+
+    SECTION("registerWindowFunction()") {
+        db.exec("CREATE TABLE series (t INTEGER PRIMARY KEY, v INTEGER NOT NULL)");
+        for (int t = 1; t <= 5; ++t)
+            db.exec("INSERT INTO series (t, v) VALUES (?, ?)", t, t * 10);
+
+        MovingSum prototype;
+        Sqlite3::registerWindowFunction(db, "moving_sum", prototype, Sqlite3::FunctionFlag::Deterministic);
+
+        auto moving = db.statement("SELECT moving_sum(v) OVER (ORDER BY t ROWS BETWEEN 1 PRECEDING AND CURRENT ROW) FROM series ORDER BY t");
+        std::vector<long long> sums;
+        for (auto [sum] : std::move(moving).as<long long>())
+            sums.push_back(sum);
+        REQUIRE(sums == std::vector<long long>{10, 30, 50, 70, 90});
+        REQUIRE(*prototype.inversions > 0);
+
+        // An empty frame gives the value of a fresh copy of the prototype
+        auto lagging = db.statement("SELECT moving_sum(v) OVER (ORDER BY t ROWS BETWEEN 2 PRECEDING AND 1 PRECEDING) FROM series ORDER BY t");
+        sums.clear();
+        for (auto [sum] : std::move(lagging).as<long long>())
+            sums.push_back(sum);
+        REQUIRE(sums == std::vector<long long>{0, 10, 30, 50, 70});
+
+        // It can be used as an ordinary aggregate as well
+        REQUIRE(db.get<long long>("SELECT moving_sum(v) FROM series") == 150);
+    }
+}
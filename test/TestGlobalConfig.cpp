@@ -0,0 +1,148 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+using namespace Dbpp;
+
+namespace {
+
+    // Stores the size of each allocation in front of it
+    class CountingAllocator final : public Sqlite3::Allocator {
+        static constexpr std::size_t HeaderSize = 16;
+
+        static void* header(void* p) { return static_cast<char*>(p) - HeaderSize; } // NOLINT
+
+    public:
+        std::atomic<long long> allocations{0};
+        std::atomic<long long> frees{0};
+
+        void* allocate(std::size_t size) noexcept override {
+            auto* p = static_cast<char*>(std::malloc(size + HeaderSize)); // NOLINT
+            if (!p)
+                return nullptr;
+            std::memcpy(p, &size, sizeof(size));
+            ++allocations;
+            return p + HeaderSize; // NOLINT
+        }
+
+        void deallocate(void* p) noexcept override {
+            if (!p)
+                return;
+            ++frees;
+            std::free(header(p)); // NOLINT
+        }
+
+        void* reallocate(void* p, std::size_t size) noexcept override {
+            auto* q = static_cast<char*>(std::realloc(header(p), size + HeaderSize)); // NOLINT
+            if (!q)
+                return nullptr;
+            std::memcpy(q, &size, sizeof(size));
+            return q + HeaderSize; // NOLINT
+        }
+
+        std::size_t allocationSize(void* p) noexcept override {
+            std::size_t size = 0;
+            std::memcpy(&size, header(p), sizeof(size));
+            return size;
+        }
+    };
+
+} // namespace
+
+TEST_CASE("Sqlite3::applyGlobalConfig()", "[sqlite3]") {
+    auto allocator = std::make_shared<CountingAllocator>();
+
+    SECTION("Allocator, page cache and lookaside") {
+        Sqlite3::GlobalConfig config;
+        config.allocator = allocator;
+        config.pageCache = Sqlite3::PageCacheConfig{4096, 64};
+        config.lookaside = Sqlite3::LookasideConfig{256, 50};
+        Sqlite3::applyGlobalConfig(config);
+        {
+            Persons persons;
+            persons.populate();
+            REQUIRE(persons.db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+            REQUIRE(allocator->allocations > 0);
+            REQUIRE(Sqlite3::memoryStats().pageCacheUsed > 0);
+            if (!sqlite3_compileoption_used("OMIT_LOOKASIDE"))
+                REQUIRE(Sqlite3::stats(persons.db).lookasideHits > 0);
+
+            REQUIRE_THROWS_AS(Sqlite3::applyGlobalConfig({}), Error);
+        }
+
+        Sqlite3::applyGlobalConfig({});
+        const long long allocations = allocator->allocations;
+        REQUIRE(allocations == allocator->frees);
+        {
+            Persons persons;
+            persons.populate();
+            REQUIRE(Sqlite3::memoryStats().pageCacheUsed == 0);
+        }
+        REQUIRE(allocator->allocations == allocations);
+    }
+
+    SECTION("The allocator isn't replaced while memory it provided is in use") {
+        Sqlite3::GlobalConfig config;
+        config.allocator = allocator;
+        Sqlite3::applyGlobalConfig(config);
+        std::shared_ptr<const Sqlite3::CachedRows> rows;
+        {
+            Persons persons;
+            persons.populate();
+            Sqlite3::QueryCache cache(persons.db);
+            rows = cache.rows("SELECT name FROM person ORDER BY id");
+        }
+        REQUIRE_THROWS_AS(Sqlite3::applyGlobalConfig({}), Error);
+        REQUIRE(rows->get<std::string>(0, 0) == "John Doe");
+
+        const long long frees = allocator->frees;
+        rows.reset();
+        REQUIRE(allocator->frees > frees);
+        Sqlite3::applyGlobalConfig({});
+        REQUIRE(allocator->allocations == allocator->frees);
+    }
+
+    SECTION("Memory statistics can be turned off") {
+        Sqlite3::GlobalConfig config;
+        config.memoryStatus = false;
+        config.lookaside = Sqlite3::LookasideConfig{0, 0};
+        Sqlite3::applyGlobalConfig(config);
+        {
+            Persons persons;
+            persons.populate();
+            REQUIRE(persons.db.get<int>("SELECT SUM(age) FROM person") == 48 + 45 + 38);
+            REQUIRE(Sqlite3::stats(persons.db).lookasideHits == 0);
+        }
+        Sqlite3::applyGlobalConfig({});
+        Persons persons;
+        persons.populate();
+        REQUIRE(Sqlite3::memoryStats().memoryUsed > 0);
+    }
+
+    SECTION("Invalid page cache") {
+        Sqlite3::GlobalConfig config;
+        config.pageCache = Sqlite3::PageCacheConfig{100, 10};
+        REQUIRE_THROWS_AS(Sqlite3::applyGlobalConfig(config), Error);
+    }
+}
@@ -0,0 +1,165 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+using namespace Dbpp;
+
+namespace {
+
+class EventLog final : public Instrumentation {
+public:
+    std::vector<std::string> events;
+    std::vector<Event> ended;
+
+    void onStart(const Event& event) override {
+        events.push_back(std::string("start ") + operationName(event.operation));
+    }
+
+    void onEnd(const Event& event) override {
+        events.push_back(std::string("end ") + operationName(event.operation));
+        ended.push_back(event);
+    }
+};
+
+class ThrowingInstrumentation final : public Instrumentation {
+public:
+    void onStart(const Event& /*event*/) override {}
+
+    void onEnd(const Event& /*event*/) override {
+        throw std::runtime_error("onEnd");
+    }
+};
+
+} // namespace
+
+TEST_CASE("Instrumentation", "[api]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+
+    auto log = std::make_shared<EventLog>();
+
+#ifdef DBPP_ENABLE_INSTRUMENTATION
+    SECTION("Connection instrumentation") {
+        db.setInstrumentation(log);
+        REQUIRE(db.instrumentation() == log.get());
+
+        db.exec("SELECT name FROM person WHERE id = ?", persons.johnDoe().id);
+        REQUIRE(log->events == std::vector<std::string>{"start prepare", "end prepare", "start bind", "end bind", "start step", "end step"});
+        REQUIRE(log->ended[0].sql == "SELECT name FROM person WHERE id = ?");
+        REQUIRE(log->ended[0].statement != nullptr);
+        REQUIRE(log->ended[1].statement == log->ended[0].statement);
+        REQUIRE(log->ended[2].statement == log->ended[0].statement);
+        REQUIRE(log->ended[2].sql.empty());
+        REQUIRE(log->ended[2].end >= log->ended[2].start);
+        REQUIRE_FALSE(log->ended[2].failed);
+
+        // Statements without parameters don't report binding
+        log->events.clear();
+        {
+            Transaction tx(db);
+            db.exec("DELETE FROM person");
+            tx.commit();
+        }
+        REQUIRE(log->events == std::vector<std::string>{"start begin", "end begin", "start prepare", "end prepare",
+                                                        "start step", "end step", "start commit", "end commit"});
+
+        log->events.clear();
+        db.begin();
+        db.rollback();
+        REQUIRE(log->events.back() == "end rollback");
+
+        log->events.clear();
+        log->ended.clear();
+        REQUIRE_THROWS(db.exec("SELECT * FROM no_such_table"));
+        REQUIRE(log->events == std::vector<std::string>{"start prepare", "end prepare"});
+        REQUIRE(log->ended[0].failed);
+
+        db.setInstrumentation(nullptr);
+        log->events.clear();
+        db.exec("SELECT 1");
+        REQUIRE(log->events.empty());
+    }
+
+    SECTION("Global instrumentation") {
+        EventLog global;
+        Instrumentation::setGlobal(&global);
+        db.exec("SELECT 1");
+        REQUIRE(global.events.size() == 4);
+
+        // The connection's own instrumentation takes precedence
+        db.setInstrumentation(log);
+        db.exec("SELECT 1");
+        REQUIRE(global.events.size() == 4);
+        REQUIRE(log->events.size() == 4);
+
+        Instrumentation::setGlobal(nullptr);
+        REQUIRE(Instrumentation::global() == nullptr);
+    }
+
+    SECTION("Exceptions thrown by onEnd() are dropped") {
+        db.setInstrumentation(std::make_shared<ThrowingInstrumentation>());
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+        REQUIRE_THROWS_AS(db.exec("SELECT * FROM no_such_table"), ErrorWithCode);
+    }
+
+    SECTION("Backup steps") {
+        const auto file = std::filesystem::temp_directory_path() / "dbpp-test-instrumentation-backup.db";
+        db.setInstrumentation(log);
+        Sqlite3::backup(db, file, 1, 0);
+        std::filesystem::remove(file);
+        REQUIRE(std::count(log->events.begin(), log->events.end(), "end backup step") > 0);
+    }
+
+    SECTION("TraceRecorder") {
+        auto recorder = std::make_shared<TraceRecorder>(4);
+        db.setInstrumentation(recorder);
+        db.exec("SELECT name FROM person WHERE name = ?", "John \"JD\" Doe");
+        REQUIRE(recorder->size() == 3);
+
+        const auto trace = recorder->chromeTrace();
+        REQUIRE(trace.find("{\"traceEvents\":[{\"name\":\"prepare\",\"cat\":\"dbpp\",\"ph\":\"X\"") == 0);
+        REQUIRE(trace.find(R"("sql":"SELECT name FROM person WHERE name = ?")") != std::string::npos);
+        REQUIRE(trace.find("\"name\":\"step\"") != std::string::npos);
+        REQUIRE(trace.find("\"displayTimeUnit\":\"ms\"}") != std::string::npos);
+
+        // The oldest records are overwritten when it's full
+        db.exec("SELECT 1");
+        REQUIRE(recorder->size() == 4);
+        REQUIRE(recorder->chromeTrace().find("{\"traceEvents\":[{\"name\":\"bind\"") == 0);
+
+        recorder->clear();
+        REQUIRE(recorder->size() == 0);
+        REQUIRE(recorder->chromeTrace() == "{\"traceEvents\":[],\"displayTimeUnit\":\"ms\"}");
+        REQUIRE_THROWS_AS(TraceRecorder(0), Error);
+    }
+#else
+    SECTION("Instrumentation is compiled out") {
+        db.setInstrumentation(log);
+        db.exec("SELECT 1");
+        REQUIRE(log->events.empty());
+        REQUIRE(db.instrumentation() == nullptr);
+    }
+#endif
+}
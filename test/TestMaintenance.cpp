@@ -0,0 +1,186 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "CountingVfs.h"
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+using namespace Dbpp;
+using namespace std::chrono_literals;
+
+namespace {
+
+// Only the work that is enabled explicitly by each test
+Sqlite3::MaintenancePolicy nothing() {
+    Sqlite3::MaintenancePolicy policy;
+    policy.optimizeInterval = 0ms;
+    policy.analyzeAfterChanges = 0;
+    policy.vacuumPagesPerStep = 0;
+    return policy;
+}
+
+} // namespace
+
+TEST_CASE("Sqlite3::Maintenance", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+
+    SECTION("Analyzes the tables that have had enough rows changed") {
+        persons.createTable();
+        auto policy = nothing();
+        policy.analyzeAfterChanges = 50;
+        policy.analysisLimit = 10;
+        Sqlite3::Maintenance maintenance(db, policy);
+
+        persons.insertGenerated(49);
+        REQUIRE(maintenance.tick(1s).empty());
+
+        persons.insertGenerated(1);
+        auto reports = maintenance.tick(1s);
+        REQUIRE(reports.size() == 1);
+        REQUIRE(reports[0].task == Sqlite3::MaintenanceTask::Analyze);
+        REQUIRE(reports[0].table == "person");
+        REQUIRE(db.get<int>("SELECT count(*) FROM sqlite_stat1 WHERE tbl = 'person'") == 1);
+        REQUIRE(db.get<int>("PRAGMA analysis_limit") == 0);
+
+        REQUIRE(maintenance.tick(1s).empty());
+        REQUIRE(maintenance.stats().tablesAnalyzed == 1);
+    }
+
+    SECTION("Counting the changes doesn't slow down deleting all rows") {
+        persons.createTable();
+        auto policy = nothing();
+        policy.analyzeAfterChanges = 50;
+        Sqlite3::Maintenance maintenance(db, policy);
+        persons.insertGenerated(1000);
+
+        // SQLite clears the table without visiting the rows, unless the update hook must see them
+        auto st = db.statement("DELETE FROM person");
+        for (auto&& row : st)
+            (void) row;
+        REQUIRE(Sqlite3::statementStatus(st).vmSteps < 100);
+        REQUIRE(db.get<int>("SELECT count(*) FROM person") == 0);
+
+        auto reports = maintenance.tick(1s);
+        REQUIRE(reports.size() == 1);
+        REQUIRE(reports[0].table == "person");
+    }
+
+    SECTION("Runs PRAGMA optimize when it's due") {
+        persons.populate();
+        auto policy = nothing();
+        policy.optimizeInterval = 1ms;
+        std::vector<Sqlite3::MaintenanceReport> reported;
+        policy.onReport = [&](const Sqlite3::MaintenanceReport& report) { reported.push_back(report); };
+        Sqlite3::Maintenance maintenance(db, policy);
+
+        std::this_thread::sleep_for(5ms);
+        auto reports = maintenance.tick(1s);
+        REQUIRE(reports.size() == 1);
+        REQUIRE(reports[0].task == Sqlite3::MaintenanceTask::Optimize);
+        REQUIRE(reported.size() == 1);
+        REQUIRE(maintenance.stats().optimizations == 1);
+    }
+
+    SECTION("Frees pages with incremental vacuum") {
+        db.exec("PRAGMA auto_vacuum = INCREMENTAL");
+        persons.createTable();
+        persons.insertGenerated(2000, std::string(100, 'x'));
+        db.exec("DELETE FROM person");
+        const auto freePages = db.get<std::int64_t>("PRAGMA freelist_count");
+        REQUIRE(freePages > 10);
+
+        auto policy = nothing();
+        policy.vacuumPagesPerStep = 5;
+        policy.vacuumMinFreePages = 10;
+        Sqlite3::Maintenance maintenance(db, policy);
+
+        REQUIRE(maintenance.tick(0ms).empty());
+
+        auto reports = maintenance.tick(10s);
+        REQUIRE(reports.size() > 1);
+        for (const auto& report : reports) {
+            REQUIRE(report.task == Sqlite3::MaintenanceTask::IncrementalVacuum);
+            REQUIRE(report.pages <= 5);
+        }
+        REQUIRE(db.get<std::int64_t>("PRAGMA freelist_count") == 0);
+        REQUIRE(maintenance.stats().pagesVacuumed == static_cast<std::uint64_t>(freePages));
+    }
+
+    SECTION("Doesn't vacuum databases without incremental auto vacuum") {
+        persons.createTable();
+        persons.insertGenerated(500, std::string(100, 'x'));
+        db.exec("DELETE FROM person");
+        auto policy = nothing();
+        policy.vacuumMinFreePages = 1;
+        Sqlite3::Maintenance maintenance(db, policy);
+        REQUIRE(maintenance.tick(1s).empty());
+        REQUIRE(db.get<std::int64_t>("PRAGMA freelist_count") > 0);
+    }
+
+    SECTION("Can't tick while a transaction is open") {
+        persons.createTable();
+        Sqlite3::Maintenance maintenance(db, nothing());
+        Transaction tx(db);
+        REQUIRE_THROWS_AS(maintenance.tick(1s), Error);
+    }
+
+    SECTION("Background maintenance requires a database file") {
+        auto policy = nothing();
+        policy.backgroundInterval = 10ms;
+        REQUIRE_THROWS_AS(Sqlite3::Maintenance(db, policy), Error);
+    }
+}
+
+TEST_CASE("Sqlite3::Maintenance in the background", "[sqlite3]") {
+    const auto file = std::filesystem::temp_directory_path() / "dbpp_test_maintenance.db";
+    std::filesystem::remove(file);
+    {
+        CountingVfs vfs;
+        Persons persons(Sqlite3::open(CountingVfs::uri(file), Sqlite3::OpenMode::ReadWriteCreate, Sqlite3::OpenFlag::Uri));
+        Connection& db = persons.db;
+        Sqlite3::setBusyTimeout(db, 1s);
+        db.exec("PRAGMA journal_mode=WAL");
+        persons.createTable();
+
+        auto policy = nothing();
+        policy.analyzeAfterChanges = 10;
+        policy.backgroundInterval = 10ms;
+        // Exceptions thrown on the background thread are ignored
+        policy.onReport = [](const Sqlite3::MaintenanceReport&) { throw std::runtime_error("onReport"); };
+        Sqlite3::Maintenance maintenance(db, policy);
+        REQUIRE_THROWS_AS(maintenance.tick(1s), Error);
+        REQUIRE(vfs.opens() == 2); // The background connection uses the VFS of db
+
+        persons.insertGenerated(10);
+        bool analyzed = false;
+        for (int i = 0; i < 200 && !analyzed; ++i) {
+            std::this_thread::sleep_for(10ms);
+            analyzed = maintenance.stats().tablesAnalyzed == 1;
+        }
+        REQUIRE(analyzed);
+        REQUIRE(db.get<int>("SELECT count(*) FROM sqlite_stat1 WHERE tbl = 'person'") == 1);
+    }
+    std::filesystem::remove(file);
+    std::filesystem::remove(file.string() + "-wal");
+    std::filesystem::remove(file.string() + "-shm");
+}
@@ -0,0 +1,112 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+using namespace Dbpp;
+using namespace std::chrono_literals;
+
+TEST_CASE("Sqlite3::MemoryGovernor", "[sqlite3]") {
+    const auto softLimit = sqlite3_soft_heap_limit64(-1);
+    const auto hardLimit = sqlite3_hard_heap_limit64(-1);
+
+    SECTION("Heap limits are applied and restored") {
+        {
+            Sqlite3::MemoryBudget budget;
+            budget.softHeapLimit = 256 * 1024 * 1024;
+            budget.hardHeapLimit = 512 * 1024 * 1024;
+            Sqlite3::MemoryGovernor governor(budget);
+            REQUIRE(sqlite3_soft_heap_limit64(-1) == budget.softHeapLimit);
+            REQUIRE(sqlite3_hard_heap_limit64(-1) == budget.hardHeapLimit);
+        }
+        REQUIRE(sqlite3_soft_heap_limit64(-1) == softLimit);
+        REQUIRE(sqlite3_hard_heap_limit64(-1) == hardLimit);
+
+        Sqlite3::MemoryBudget invalid;
+        invalid.softHeapLimit = -1;
+        REQUIRE_THROWS_AS(Sqlite3::MemoryGovernor(invalid), Error);
+    }
+
+    SECTION("Page cache settings and releasing memory") {
+        const auto file = std::filesystem::temp_directory_path() / "dbpp_test_memory_governor.db";
+        std::filesystem::remove(file);
+        {
+            Persons persons(Sqlite3::open(file));
+            Connection& db = persons.db;
+            persons.createTable();
+            db.execScript("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000) "
+                          "INSERT INTO person (name, age) SELECT printf('Person %d with a long name', i), i % 100 FROM n");
+
+            Sqlite3::MemoryBudget budget;
+            budget.cacheSize = 8 * 1024 * 1024;
+            budget.cacheSpillPages = 5000;
+            int released = 0;
+            budget.onRelease = [&released] { ++released; };
+            Sqlite3::MemoryGovernor governor(budget);
+            governor.manage(db);
+            REQUIRE(db.get<int>("PRAGMA cache_size") == -8192);
+            REQUIRE(db.get<int>("PRAGMA cache_spill") == 5000);
+
+            REQUIRE(db.get<int>("SELECT COUNT(*) FROM person WHERE name LIKE '%long%'") == 20000);
+            const auto cacheUsed = Sqlite3::stats(db).cacheUsed;
+            REQUIRE(cacheUsed > 100000);
+
+            REQUIRE(governor.releaseMemory() > 0);
+            REQUIRE(released == 1);
+            REQUIRE(Sqlite3::stats(db).cacheUsed < cacheUsed / 2);
+        }
+        std::filesystem::remove(file);
+    }
+
+    SECTION("Memory pressure") {
+        Persons persons;
+        persons.populate();
+        std::atomic<int> calls{0};
+        std::atomic<std::int64_t> limit{0};
+
+        Sqlite3::MemoryBudget budget;
+        budget.softHeapLimit = sqlite3_memory_used() / 2 + 1;
+        budget.pressureCheckInterval = 5ms;
+        budget.onPressure = [&](const Sqlite3::MemoryPressure& pressure) {
+            REQUIRE(pressure.memoryUsed >= pressure.limit * 9 / 10);
+            limit = pressure.limit;
+            ++calls;
+        };
+        {
+            Sqlite3::MemoryGovernor governor(budget);
+            for (int i = 0; i < 500 && calls == 0; ++i)
+                std::this_thread::sleep_for(10ms);
+        }
+        REQUIRE(calls == 1);
+        REQUIRE(limit == budget.softHeapLimit);
+
+        calls = 0;
+        budget.softHeapLimit = 1LL << 40;
+        {
+            Sqlite3::MemoryGovernor governor(budget);
+            std::this_thread::sleep_for(50ms);
+        }
+        REQUIRE(calls == 0);
+    }
+}
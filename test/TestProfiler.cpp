@@ -0,0 +1,110 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+using namespace Dbpp;
+
+static const Sqlite3::StatementProfile* findProfile(const std::vector<Sqlite3::StatementProfile>& profiles, std::string_view sql) {
+    for (const auto& p : profiles) {
+        if (p.sql == sql)
+            return &p;
+    }
+    return nullptr;
+}
+
+TEST_CASE("Sqlite3::normalizeSql()", "[sqlite3]") {
+    REQUIRE(Sqlite3::normalizeSql("SELECT  *\n FROM person WHERE id = 12;") == "SELECT * FROM person WHERE id = ?");
+    REQUIRE(Sqlite3::normalizeSql("SELECT name FROM person WHERE name = 'O''Brien' AND age > 3.5e+2") == "SELECT name FROM person WHERE name = ? AND age > ?");
+    REQUIRE(Sqlite3::normalizeSql("SELECT t1.x, \"col 2\" FROM t1 -- comment\n WHERE y = ?3 /* another */") == "SELECT t1.x, \"col 2\" FROM t1 WHERE y = ?");
+    REQUIRE(Sqlite3::normalizeSql("INSERT INTO blobs VALUES (x'00ff', 0x1F, -.5)") == "INSERT INTO blobs VALUES (?, ?, -?)");
+}
+
+TEST_CASE("Sqlite3::Profiler", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+
+    Sqlite3::Profiler profiler;
+    profiler.attach(db);
+    profiler.attach(db); // Attaching twice has no effect
+
+    SECTION("Statements are aggregated by normalized SQL") {
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person WHERE age > 40") == 2);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person WHERE age > 30") == 3);
+        for (int i = 0; i < 3; ++i) {
+            int count = 0;
+            for (auto&& row : db.statement("SELECT name FROM person WHERE age > ?", 0)) {
+                (void) row;
+                ++count;
+            }
+            REQUIRE(count == persons.Count);
+        }
+
+        auto profiles = profiler.snapshot();
+        const auto* count = findProfile(profiles, "SELECT COUNT(*) FROM person WHERE age > ?");
+        REQUIRE(count != nullptr);
+        REQUIRE(count->calls == 2);
+        REQUIRE(count->rows == 2);
+
+        const auto* names = findProfile(profiles, "SELECT name FROM person WHERE age > ?");
+        REQUIRE(names != nullptr);
+        REQUIRE(names->calls == 3);
+        REQUIRE(names->rows == 3 * persons.Count);
+        REQUIRE(names->totalTime >= names->maxTime);
+        REQUIRE(names->meanTime <= names->maxTime);
+        REQUIRE(names->p50 <= names->p95);
+        REQUIRE(names->p95 <= names->p99);
+        REQUIRE(names->p99 <= names->maxTime);
+
+        for (std::size_t i = 1; i < profiles.size(); ++i)
+            REQUIRE(profiles[i - 1].totalTime >= profiles[i].totalTime);
+    }
+
+    SECTION("Statements with many distinct literals are still aggregated") {
+        for (int i = 0; i < 3000; ++i)
+            REQUIRE(db.get<int>("SELECT COUNT(*) FROM person WHERE age > " + std::to_string(i % 2000)) >= 0);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person WHERE age > 0") == persons.Count);
+
+        auto profiles = profiler.snapshot();
+        const auto* count = findProfile(profiles, "SELECT COUNT(*) FROM person WHERE age > ?");
+        REQUIRE(count != nullptr);
+        REQUIRE(count->calls == 3001);
+    }
+
+    SECTION("Prometheus export") {
+        db.exec("UPDATE person SET age = age + 1 WHERE name = \"name\"");
+        auto text = profiler.prometheus("myapp");
+        REQUIRE(text.find("# TYPE myapp_statement_duration_seconds summary\n") != std::string::npos);
+        REQUIRE(text.find("# TYPE myapp_statement_rows_total counter\n") != std::string::npos);
+        REQUIRE(text.find(R"(myapp_statement_duration_seconds_count{sql="UPDATE person SET age = age + ? WHERE name = \"name\""} 1)") != std::string::npos);
+        REQUIRE(text.find(R"(myapp_statement_duration_seconds{sql="UPDATE person SET age = age + ? WHERE name = \"name\"",quantile="0.99"} )") != std::string::npos);
+    }
+
+    SECTION("reset() and detach()") {
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+        REQUIRE_FALSE(profiler.snapshot().empty());
+        profiler.reset();
+        REQUIRE(profiler.snapshot().empty());
+
+        profiler.detach(db);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+        REQUIRE(profiler.snapshot().empty());
+    }
+}
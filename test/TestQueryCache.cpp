@@ -0,0 +1,166 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <typeinfo>
+
+using namespace Dbpp;
+
+TEST_CASE("Sqlite3::QueryCache", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+    db.exec("CREATE TABLE pet (id INTEGER PRIMARY KEY, owner_id INTEGER, name TEXT)");
+    db.exec("CREATE VIEW adult AS SELECT * FROM person WHERE age >= 40");
+    db.exec("INSERT INTO pet (owner_id, name) VALUES (?, 'Rex')", persons.janeDoe().id);
+
+    Sqlite3::QueryCache cache(db);
+    const auto sumOfAges = "SELECT SUM(age) FROM person";
+    const int ages = 48 + 45 + 38;
+
+    SECTION("Repeated statements are answered from the cache") {
+        REQUIRE(cache.get<int>(sumOfAges) == ages);
+        REQUIRE(cache.get<int>(sumOfAges) == ages);
+        REQUIRE(cache.get<std::string>("SELECT name FROM person WHERE id = ?", persons.janeDoe().id) == "Jane Doe");
+        REQUIRE(cache.get<std::string>("SELECT name FROM person WHERE id = ?", static_cast<short>(persons.janeDoe().id)) == "Jane Doe");
+        REQUIRE(cache.get<std::string>("SELECT name FROM person WHERE id = ?", persons.johnDoe().id) == "John Doe");
+
+        auto stats = cache.stats();
+        REQUIRE(stats.hits == 2);
+        REQUIRE(stats.misses == 3);
+        REQUIRE(stats.entries == 3);
+        REQUIRE(stats.bytes > 0);
+        REQUIRE(stats.hitRate() == Approx(0.4));
+
+        auto rows = cache.rows("SELECT id, name, age FROM person ORDER BY id");
+        REQUIRE(rows->size() == Persons::Count);
+        REQUIRE(rows->columnCount() == 3);
+        REQUIRE(rows->columnName(1) == "name");
+        REQUIRE(rows->get<std::string_view>(2, 1) == "Anders Svensson");
+        REQUIRE(rows->toTuple<std::int64_t, std::string, int>(0) == std::make_tuple(persons.johnDoe().id, std::string("John Doe"), 48));
+        REQUIRE(rows == cache.rows("SELECT id, name, age FROM person ORDER BY id"));
+        REQUIRE_THROWS_AS(rows->get<int>(3, 0), Error);
+        REQUIRE_THROWS_AS(cache.get<int>("SELECT id FROM person WHERE id < 0"), Error);
+    }
+
+    SECTION("Values are converted like Connection::get() does") {
+        const auto noAges = "SELECT SUM(age) FROM person WHERE age < 0";
+        REQUIRE_THROWS_WITH(cache.get<int>(noAges), "Column value was NULL in retrieval");
+        REQUIRE_THROWS_AS(cache.get<std::string>(noAges), Error);
+        REQUIRE(cache.get<std::optional<int>>(noAges) == std::nullopt);
+        REQUIRE(cache.get<std::optional<int>>(sumOfAges) == ages);
+        REQUIRE_THROWS_AS(db.get<int>(noAges), Error);
+
+        const auto large = "SELECT 5000000000";
+        REQUIRE_THROWS_AS(cache.get<int>(large), std::bad_cast);
+        REQUIRE_THROWS_AS(cache.get<std::optional<std::uint32_t>>(large), std::bad_cast);
+        REQUIRE_THROWS_AS(cache.get<short>("SELECT 40000"), std::bad_cast);
+        REQUIRE_THROWS_AS(cache.get<unsigned int>("SELECT -1"), std::bad_cast);
+        REQUIRE_THROWS_AS(db.get<int>(large), std::bad_cast);
+        REQUIRE(cache.get<std::int64_t>(large) == 5000000000);
+        REQUIRE(cache.get<short>("SELECT -32768") == -32768);
+    }
+
+    SECTION("Commits invalidate the entries that read the changed tables") {
+        const auto petCount = "SELECT COUNT(*) FROM pet";
+        const auto adults = "SELECT COUNT(*) FROM adult";
+        const auto owners = "SELECT p.name FROM person p JOIN pet ON pet.owner_id = p.id";
+        REQUIRE(cache.get<int>(sumOfAges) == ages);
+        REQUIRE(cache.get<int>(petCount) == 1);
+        REQUIRE(cache.get<int>(adults) == 2);
+        REQUIRE(cache.get<std::string>(owners) == "Jane Doe");
+
+        db.exec("INSERT INTO pet (owner_id, name) VALUES (?, 'Fido')", persons.johnDoe().id);
+        REQUIRE(cache.stats().invalidations == 2);
+        REQUIRE(cache.get<int>(sumOfAges) == ages);
+        REQUIRE(cache.get<int>(adults) == 2);
+        REQUIRE(cache.stats().hits == 2);
+        REQUIRE(cache.get<int>(petCount) == 2);
+
+        db.exec("UPDATE person SET age = 20 WHERE id = ?", persons.johnDoe().id);
+        REQUIRE(cache.get<int>(sumOfAges) == ages - 28);
+        REQUIRE(cache.get<int>(adults) == 1);
+        REQUIRE(cache.get<int>(petCount) == 2);
+
+        db.exec("DELETE FROM pet");
+        REQUIRE(cache.get<int>(petCount) == 0);
+    }
+
+    SECTION("Transactions and writes bypass the cache") {
+        REQUIRE(cache.get<int>(sumOfAges) == ages);
+        {
+            Transaction tx(db);
+            db.exec("UPDATE person SET age = 0");
+            REQUIRE(cache.get<int>(sumOfAges) == 0);
+        }
+        REQUIRE(cache.get<int>(sumOfAges) == ages);
+        REQUIRE(cache.rows("UPDATE pet SET name = 'Max' RETURNING name")->get<std::string>(0, 0) == "Max");
+        REQUIRE(cache.rows("UPDATE pet SET name = 'Bo' RETURNING name")->get<std::string>(0, 0) == "Bo");
+        REQUIRE(cache.stats().bypasses == 3);
+        REQUIRE(cache.stats().hits == 1);
+    }
+
+    SECTION("Schema changes clear the cache") {
+        REQUIRE(cache.get<int>(sumOfAges) == ages);
+        db.exec("CREATE TABLE extra (x)");
+        REQUIRE(cache.get<int>(sumOfAges) == ages);
+        REQUIRE(cache.stats().hits == 0);
+    }
+
+    SECTION("Memory limits") {
+        Sqlite3::QueryCacheOptions options;
+        options.maxBytes = 4000;
+        options.maxEntryBytes = 2000;
+        Sqlite3::QueryCache small(db, options);
+
+        REQUIRE(small.rows("SELECT zeroblob(3000)")->get<Sqlite3::BlobView>(0, 0).size == 3000);
+        REQUIRE(small.stats().entries == 0);
+        for (int i = 0; i < 100; ++i)
+            REQUIRE(small.get<int>("SELECT ? + 1", i) == i + 1);
+        auto stats = small.stats();
+        REQUIRE(stats.bytes <= options.maxBytes);
+        REQUIRE(stats.evictions > 0);
+        REQUIRE(stats.entries + stats.evictions == 100);
+        REQUIRE(small.get<int>("SELECT ? + 1", 99) == 100);
+        REQUIRE(small.stats().hits == 1);
+
+        small.clear();
+        REQUIRE(small.stats().entries == 0);
+        REQUIRE(small.stats().bytes == 0);
+    }
+}
+
+TEST_CASE("Sqlite3::QueryCache with several connections", "[sqlite3]") {
+    const auto file = std::filesystem::temp_directory_path() / "dbpp_test_query_cache.db";
+    std::filesystem::remove(file);
+    {
+        Persons persons(Sqlite3::open(file));
+        persons.populate();
+        auto other = Sqlite3::open(file);
+
+        Sqlite3::QueryCache cache(persons.db);
+        REQUIRE(cache.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+        other.exec("DELETE FROM person WHERE age < 40");
+        REQUIRE(cache.get<int>("SELECT COUNT(*) FROM person") == Persons::Count - 1);
+    }
+    std::filesystem::remove(file);
+}
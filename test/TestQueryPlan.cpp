@@ -0,0 +1,114 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+using namespace Dbpp;
+
+static const char* const AutoIndexQuery = "SELECT a.name FROM person a, person b WHERE a.age = b.age + 3";
+
+TEST_CASE("Sqlite3 statement status and query plans", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+
+    SECTION("statementStatus()") {
+        auto st = db.statement("SELECT name FROM person WHERE age > ? ORDER BY name", 40);
+        int rows = 0;
+        for (auto&& row : st) {
+            (void) row;
+            ++rows;
+        }
+        REQUIRE(rows == 2);
+
+        auto status = Sqlite3::statementStatus(st);
+        REQUIRE(status.fullScanSteps > 0);
+        REQUIRE(status.sorts == 1);
+        REQUIRE(status.vmSteps > 0);
+        REQUIRE(status.runs == 1);
+        REQUIRE(status.memoryUsed > 0);
+
+        status = Sqlite3::statementStatus(st, true);
+        REQUIRE(status.vmSteps > 0);
+        status = Sqlite3::statementStatus(st);
+        REQUIRE(status.vmSteps == 0);
+        REQUIRE(status.fullScanSteps == 0);
+    }
+
+    SECTION("explainPlan()") {
+        auto scan = db.statement("SELECT name FROM person WHERE age > ?", 40);
+        auto plan = Sqlite3::explainPlan(scan);
+        REQUIRE(plan.nodes.size() == 1);
+        REQUIRE(plan.hasFullScan());
+        REQUIRE_FALSE(plan.hasAutomaticIndex());
+        REQUIRE(plan.toString() == "QUERY PLAN\n`--SCAN person\n");
+
+        auto lookup = db.statement("SELECT name FROM person WHERE id = ?", persons.johnDoe().id);
+        plan = Sqlite3::explainPlan(lookup);
+        REQUIRE_FALSE(plan.hasFullScan());
+        REQUIRE(plan.nodes.at(0).detail.find("SEARCH person") == 0);
+
+        auto nested = db.statement("SELECT name FROM person WHERE id IN (SELECT spouse_id FROM person WHERE age > 40)");
+        plan = Sqlite3::explainPlan(nested);
+        REQUIRE(plan.hasFullScan());
+        bool hasChildren = false;
+        for (const auto& node : plan.nodes)
+            hasChildren = hasChildren || !node.children.empty();
+        REQUIRE(hasChildren);
+
+        auto join = db.statement(AutoIndexQuery);
+        REQUIRE(Sqlite3::explainPlan(join).hasAutomaticIndex());
+    }
+
+    SECTION("scanStatus()") {
+        auto st = db.statement("SELECT name FROM person");
+        for (auto&& row : st)
+            (void) row;
+        auto loops = Sqlite3::scanStatus(st);
+        if (Sqlite3::scanStatusSupported()) {
+            REQUIRE(loops.size() == 1);
+            REQUIRE(loops[0].rowsVisited == persons.Count);
+        } else {
+            REQUIRE(loops.empty());
+        }
+    }
+
+    SECTION("enablePlanAssertions()") {
+        Sqlite3::enablePlanAssertions(db);
+
+        REQUIRE(db.get<std::string>("SELECT name FROM person WHERE id = ?", persons.janeDoe().id) == persons.janeDoe().name);
+        REQUIRE_THROWS_AS(db.get<int>("SELECT COUNT(*) FROM person WHERE age > 40"), Sqlite3::QueryPlanViolation);
+        REQUIRE_THROWS_WITH(db.exec(AutoIndexQuery), Catch::Contains("Automatic index") && Catch::Contains("AUTOMATIC"));
+
+        Sqlite3::PlanAssertions onlyAutoIndexes;
+        onlyAutoIndexes.failOnFullScan = false;
+        Sqlite3::enablePlanAssertions(db, onlyAutoIndexes);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person WHERE age > 40") == 2);
+        REQUIRE_THROWS_AS(db.exec(AutoIndexQuery), Sqlite3::QueryPlanViolation);
+
+        Sqlite3::PlanAssertions withIgnore;
+        withIgnore.ignore = [](std::string_view sql) { return sql.find("age > 40") != std::string_view::npos; };
+        Sqlite3::enablePlanAssertions(db, withIgnore);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person WHERE age > 40") == 2);
+        REQUIRE_THROWS_AS(db.get<int>("SELECT COUNT(*) FROM person WHERE age > 30"), Sqlite3::QueryPlanViolation);
+
+        Sqlite3::disablePlanAssertions(db);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person WHERE age > 30") == 3);
+    }
+}
@@ -0,0 +1,82 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+using namespace Dbpp;
+
+TEST_CASE("Sqlite3 serialize() and openFromMemory()", "[sqlite3]") {
+    Persons persons;
+    persons.populate();
+    const auto image = Sqlite3::serialize(persons.db);
+    REQUIRE(image.size() % 512 == 0);
+    REQUIRE(image.size() >= 1024);
+
+    SECTION("Copied images") {
+        auto copy = Sqlite3::openFromMemory(image);
+        REQUIRE(copy.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+        copy.exec("INSERT INTO person (name, age) VALUES ('Sven Berg', 30)");
+        copy.exec("CREATE TABLE extra (x BLOB)");
+        copy.exec("INSERT INTO extra VALUES (zeroblob(100000))"); // The image can grow
+        REQUIRE(copy.get<int>("SELECT COUNT(*) FROM person") == Persons::Count + 1);
+        REQUIRE(persons.db.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+
+        // Round trip
+        auto again = Sqlite3::openFromMemory(Sqlite3::serialize(copy));
+        REQUIRE(again.get<int>("SELECT COUNT(*) FROM person") == Persons::Count + 1);
+        REQUIRE(again.get<int>("SELECT length(x) FROM extra") == 100000);
+    }
+
+    SECTION("Borrowed images") {
+        auto borrowed = Sqlite3::openFromMemory({image.data(), image.size()}, Sqlite3::ImageMode::BorrowReadOnly);
+        REQUIRE(borrowed.get<std::string>("SELECT name FROM person WHERE id = ?", persons.janeDoe().id) == "Jane Doe");
+        REQUIRE_THROWS_AS(borrowed.exec("DELETE FROM person"), Error);
+        REQUIRE(Sqlite3::serialize(borrowed) == image);
+    }
+
+    SECTION("File databases") {
+        const auto file = std::filesystem::temp_directory_path() / "dbpp_test_serialize.db";
+        std::filesystem::remove(file);
+        {
+            Persons onDisk(Sqlite3::open(file));
+            onDisk.populate();
+            auto fromFile = Sqlite3::serialize(onDisk.db);
+            std::ifstream in(file, std::ios::binary);
+            std::vector<char> contents{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+            REQUIRE(fromFile.size() == contents.size());
+            REQUIRE(std::equal(fromFile.begin(), fromFile.end(), contents.begin(), [](std::byte b, char c) {
+                return b == static_cast<std::byte>(c);
+            }));
+        }
+        std::filesystem::remove(file);
+    }
+
+    SECTION("Invalid input") {
+        REQUIRE_THROWS_AS((void) Sqlite3::serialize(persons.db, "nonexistent"), Error);
+
+        std::vector<std::byte> garbage(4096, std::byte{42});
+        auto db = Sqlite3::openFromMemory(garbage);
+        REQUIRE_THROWS_AS(db.exec("SELECT * FROM sqlite_master"), Error);
+    }
+}
@@ -0,0 +1,130 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+using namespace Dbpp;
+
+namespace {
+
+std::vector<std::string> contents(Connection& db) {
+    std::vector<std::string> rows;
+    for (auto [id, name, age] : db.statement("SELECT id, name, age FROM person ORDER BY id").as<std::int64_t, std::string, int>())
+        rows.push_back(std::to_string(id) + " " + name + " " + std::to_string(age));
+    return rows;
+}
+
+} // namespace
+
+TEST_CASE("Sqlite3 sessions", "[sqlite3]") {
+    if (!Sqlite3::sessionsSupported()) {
+        Persons source;
+        REQUIRE_THROWS_AS(Sqlite3::Session(source.db), Error);
+        return;
+    }
+
+    Persons source;
+    Persons replica;
+    source.populate();
+    replica.populate();
+    const auto original = contents(source.db);
+
+    Sqlite3::Session session(source.db);
+    session.attach("person");
+    REQUIRE(session.enabled());
+    REQUIRE(session.empty());
+
+    auto change = [&] {
+        source.db.exec("INSERT INTO person (name, age) VALUES ('Sven Berg', 30)");
+        source.db.exec("UPDATE person SET age = age + 1 WHERE id = ?", source.janeDoe().id);
+        source.db.exec("DELETE FROM person WHERE id = ?", source.andersSvensson().id);
+    };
+
+    SECTION("Replicating the changes") {
+        change();
+        REQUIRE_FALSE(session.empty());
+
+        auto changeset = session.changeset();
+        auto patchset = session.patchset();
+        REQUIRE(patchset.size() < changeset.size());
+
+        Persons other;
+        other.populate();
+        Sqlite3::applyChangeset(replica.db, changeset);
+        Sqlite3::applyChangeset(other.db, patchset);
+        REQUIRE(contents(replica.db) == contents(source.db));
+        REQUIRE(contents(other.db) == contents(source.db));
+
+        Sqlite3::applyChangeset(source.db, Sqlite3::invertChangeset({changeset.data(), changeset.size()}));
+        REQUIRE(contents(source.db) == original);
+    }
+
+    SECTION("Only attached tables are recorded") {
+        source.db.exec("CREATE TABLE other (id INTEGER PRIMARY KEY, x INTEGER)");
+        source.db.exec("INSERT INTO other (x) VALUES (1)");
+        REQUIRE(session.empty());
+
+        session.setEnabled(false);
+        REQUIRE_FALSE(session.enabled());
+        change();
+        REQUIRE(session.empty());
+
+        session.setEnabled(true);
+        session.attachAll();
+        source.db.exec("INSERT INTO other (x) VALUES (2)");
+        REQUIRE_FALSE(session.empty());
+    }
+
+    SECTION("Conflicts") {
+        change();
+        auto changeset = session.changeset();
+        replica.db.exec("UPDATE person SET age = 20 WHERE id = ?", replica.janeDoe().id);
+        auto janesAge = [&] {
+            return replica.db.get<int>("SELECT age FROM person WHERE id = ?", replica.janeDoe().id);
+        };
+
+        REQUIRE_THROWS_AS(Sqlite3::applyChangeset(replica.db, changeset), Error);
+        REQUIRE(contents(replica.db).size() == original.size());
+        REQUIRE(janesAge() == 20);
+
+        std::vector<Sqlite3::ConflictType> conflicts;
+        Sqlite3::applyChangeset(replica.db, changeset, [&](const Sqlite3::Conflict& c) {
+            conflicts.push_back(c.type);
+            REQUIRE(c.table == "person");
+            REQUIRE(c.operation == Sqlite3::ChangeOperation::Update);
+            return Sqlite3::ConflictAction::Omit;
+        });
+        REQUIRE(conflicts == std::vector<Sqlite3::ConflictType>{Sqlite3::ConflictType::Data});
+        REQUIRE(janesAge() == 20);
+        REQUIRE(contents(replica.db).size() == original.size()); // One inserted and one deleted
+
+        Sqlite3::applyChangeset(replica.db, changeset, [](const Sqlite3::Conflict& c) {
+            return c.type == Sqlite3::ConflictType::Data ? Sqlite3::ConflictAction::Replace : Sqlite3::ConflictAction::Omit;
+        });
+        REQUIRE(janesAge() == source.janeDoe().age + 1);
+
+        replica.db.exec("UPDATE person SET age = 20 WHERE id = ?", replica.janeDoe().id);
+        REQUIRE_THROWS_WITH(
+            Sqlite3::applyChangeset(replica.db, changeset, [](const Sqlite3::Conflict&) -> Sqlite3::ConflictAction {
+                throw std::runtime_error("No thanks");
+            }),
+            "No thanks");
+        REQUIRE(janesAge() == 20);
+    }
+}
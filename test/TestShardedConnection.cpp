@@ -0,0 +1,100 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+using namespace Dbpp;
+
+static ShardedConnection makeShards(std::size_t count) {
+    std::vector<Connection> shards;
+    for (std::size_t i = 0; i < count; ++i) {
+        shards.push_back(Sqlite3::open(":memory:"));
+        shards.back().exec("CREATE TABLE item (id INTEGER PRIMARY KEY, name TEXT NOT NULL)");
+    }
+    return ShardedConnection(std::move(shards));
+}
+
+TEST_CASE("ShardedConnection", "[api]") {
+    auto sharded = makeShards(3);
+    const int itemCount = 100;
+    for (int id = 0; id < itemCount; ++id)
+        sharded.shardFor(id).exec("INSERT INTO item (id, name) VALUES (?, ?)", id, "item " + std::to_string(id));
+
+    SECTION("shardIndex() and shardFor()") {
+        REQUIRE(sharded.shardCount() == 3);
+        REQUIRE(sharded.shardIndex(42) == sharded.shardIndex("42"));
+        REQUIRE(sharded.shardIndex("some key") == sharded.shardIndex(std::string("some key")));
+        for (int id = 0; id < itemCount; ++id)
+            REQUIRE(sharded.shardFor(id).get<int>("SELECT COUNT(*) FROM item WHERE id = ?", id) == 1);
+
+        // Every shard should get some of the keys
+        for (std::size_t i = 0; i < sharded.shardCount(); ++i)
+            REQUIRE(sharded.shard(i).get<int>("SELECT COUNT(*) FROM item") > 0);
+
+        REQUIRE_THROWS_AS(sharded.shard(3), Error);
+    }
+
+    SECTION("Custom shard function") {
+        std::vector<Connection> shards;
+        shards.push_back(Sqlite3::open(":memory:"));
+        shards.push_back(Sqlite3::open(":memory:"));
+        ShardedConnection byLength(std::move(shards), [](std::string_view key, std::size_t count) { return key.size() % count; });
+        REQUIRE(byLength.shardIndex("ab") == 0);
+        REQUIRE(byLength.shardIndex("abc") == 1);
+
+        std::vector<Connection> single;
+        single.push_back(Sqlite3::open(":memory:"));
+        ShardedConnection broken(std::move(single), [](std::string_view /*unused*/, std::size_t count) { return count; });
+        REQUIRE_THROWS_AS(broken.shardIndex("key"), Error);
+
+        REQUIRE_THROWS_AS(ShardedConnection(std::vector<Connection>{}), Error);
+    }
+
+    SECTION("gather()") {
+        auto rows = sharded.gather<int, std::string>("SELECT id, name FROM item WHERE id >= ?", 10);
+        REQUIRE(rows.size() == itemCount - 10);
+        long long sum = 0;
+        for (const auto& [id, name] : rows) {
+            REQUIRE(name == "item " + std::to_string(id));
+            sum += id;
+        }
+        REQUIRE(sum == (itemCount * (itemCount - 1)) / 2 - 45);
+
+        REQUIRE_THROWS_AS(sharded.gather<int>("SELECT no_such_column FROM item"), Error);
+    }
+
+    SECTION("mergeOrdered()") {
+        std::vector<int> ids;
+        for (auto&& [id, name] : sharded.mergeOrdered<int, std::string>("SELECT id, name FROM item WHERE id < ? ORDER BY id", 50)) {
+            REQUIRE(name == "item " + std::to_string(id));
+            ids.push_back(id);
+        }
+        REQUIRE(ids.size() == 50);
+        REQUIRE(std::is_sorted(ids.begin(), ids.end()));
+
+        auto descending = sharded.mergeOrderedBy<int>(std::greater<std::tuple<int>>(), "SELECT id FROM item ORDER BY id DESC");
+        int expected = itemCount;
+        for (auto&& [id] : descending)
+            REQUIRE(id == --expected);
+        REQUIRE(expected == 0);
+
+        auto nothing = sharded.mergeOrdered<int>("SELECT id FROM item WHERE id < 0 ORDER BY id");
+        REQUIRE(nothing.begin() == nothing.end());
+    }
+}
@@ -0,0 +1,93 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <optional>
+#include <thread>
+#include <vector>
+
+using namespace Dbpp;
+
+TEST_CASE("Sqlite3::SharedMemoryDatabase", "[sqlite3]") {
+    SECTION("Connections share the database") {
+        Sqlite3::SharedMemoryDatabase shared("test db #1");
+        REQUIRE(shared.name() == "test db #1");
+        REQUIRE(shared.uri() == "file:/test%20db%20%231?vfs=memdb");
+
+        Persons persons(shared.connect());
+        persons.populate();
+        auto reader = shared.connect(Sqlite3::OpenMode::ReadOnly);
+        REQUIRE(reader.get<int>("SELECT COUNT(*) FROM person") == Persons::Count);
+        persons.db.exec("DELETE FROM person WHERE id = ?", persons.andersSvensson().id);
+        REQUIRE(reader.get<int>("SELECT COUNT(*) FROM person") == Persons::Count - 1);
+        REQUIRE_THROWS_AS(reader.exec("DELETE FROM person"), Error);
+
+        REQUIRE_THROWS_AS(Sqlite3::SharedMemoryDatabase("test db #1"), Error);
+        REQUIRE(Sqlite3::SharedMemoryDatabase().name() != Sqlite3::SharedMemoryDatabase().name());
+    }
+
+    SECTION("The database is freed with the object and its connections") {
+        {
+            Sqlite3::SharedMemoryDatabase shared("freed");
+            shared.connect().exec("CREATE TABLE t (x)");
+            REQUIRE(shared.connect().get<int>("SELECT COUNT(*) FROM sqlite_schema") == 1);
+
+            Sqlite3::SharedMemoryDatabase moved(std::move(shared));
+            REQUIRE(moved.connect().get<int>("SELECT COUNT(*) FROM sqlite_schema") == 1);
+        }
+        Sqlite3::SharedMemoryDatabase shared("freed");
+        REQUIRE(shared.connect().get<int>("SELECT COUNT(*) FROM sqlite_schema") == 0);
+    }
+
+    SECTION("The name is taken until the last connection is closed") {
+        std::optional<Connection> db;
+        {
+            Sqlite3::SharedMemoryDatabase shared("still connected");
+            db = shared.connect();
+            db->exec("CREATE TABLE t (x)");
+        }
+        REQUIRE_THROWS_AS(Sqlite3::SharedMemoryDatabase("still connected"), Error);
+        REQUIRE(db->get<int>("SELECT COUNT(*) FROM sqlite_schema") == 1);
+        db.reset();
+        Sqlite3::SharedMemoryDatabase shared("still connected");
+        REQUIRE(shared.connect().get<int>("SELECT COUNT(*) FROM sqlite_schema") == 0);
+    }
+
+    SECTION("Copying a database and reading it from several threads") {
+        Persons persons;
+        persons.populate();
+        Sqlite3::SharedMemoryDatabase shared(persons.db);
+        persons.db.exec("DELETE FROM person");
+
+        std::atomic<int> total{0};
+        std::vector<std::thread> readers;
+        for (int i = 0; i < 4; ++i) {
+            readers.emplace_back([&shared, &total] {
+                auto db = shared.connect(Sqlite3::OpenMode::ReadOnly);
+                for (int j = 0; j < 100; ++j)
+                    total += db.get<int>("SELECT SUM(age) FROM person");
+            });
+        }
+        for (auto& reader : readers)
+            reader.join();
+        REQUIRE(total == 4 * 100 * (48 + 45 + 38));
+    }
+}
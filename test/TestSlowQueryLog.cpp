@@ -0,0 +1,199 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+using namespace Dbpp;
+
+TEST_CASE("Sqlite3 slow query log", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+
+    std::vector<Sqlite3::SlowQuery> logged;
+    Sqlite3::SlowQueryLog log;
+    log.threshold = std::chrono::nanoseconds(0);
+    log.callback = [&logged](const Sqlite3::SlowQuery& entry) { logged.push_back(entry); };
+
+    SECTION("Entries") {
+        Sqlite3::enableSlowQueryLog(db, log);
+
+        auto st = db.statement("SELECT name FROM person WHERE age > ? ORDER BY name", 40);
+        for (auto&& row : st)
+            (void) row;
+        REQUIRE(logged.size() == 1);
+        REQUIRE(logged[0].sql == "SELECT name FROM person WHERE age > 40 ORDER BY name");
+        REQUIRE(logged[0].rows == 2);
+        REQUIRE(logged[0].resultCode == SQLITE_DONE);
+        REQUIRE(logged[0].vmSteps > 0);
+        REQUIRE(logged[0].duration.count() > 0);
+        REQUIRE_FALSE(logged[0].waitedOnLock);
+
+        // Statements that are destroyed before they are done are logged too
+        REQUIRE(db.get<std::string>("SELECT name FROM person WHERE id = ?", persons.johnDoe().id) == persons.johnDoe().name);
+        REQUIRE(logged.size() == 2);
+        REQUIRE(logged[1].sql == "SELECT name FROM person WHERE id = " + std::to_string(persons.johnDoe().id));
+        REQUIRE(logged[1].rows == 1);
+        REQUIRE(logged[1].resultCode == SQLITE_ROW);
+
+        // Reused prepared statements are logged once per execution
+        auto prepared = db.preparedStatement("SELECT COUNT(*) FROM person WHERE age > ?");
+        for (int age : {30, 40, 50}) {
+            prepared.rebind(age);
+            (void) prepared.step();
+        }
+        REQUIRE(logged.size() == 4);
+        REQUIRE(logged[3].sql == "SELECT COUNT(*) FROM person WHERE age > 40");
+        prepared.reset();
+        REQUIRE(logged.size() == 5);
+        REQUIRE(logged[4].sql == "SELECT COUNT(*) FROM person WHERE age > 50");
+
+        Sqlite3::disableSlowQueryLog(db);
+        db.exec("DELETE FROM person");
+        REQUIRE(logged.size() == 5);
+    }
+
+    SECTION("Threshold") {
+        log.threshold = std::chrono::hours(1);
+        Sqlite3::enableSlowQueryLog(db, log);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+        REQUIRE(logged.empty());
+    }
+
+    SECTION("Sampling") {
+        log.sampleEvery = 3;
+        Sqlite3::enableSlowQueryLog(db, log);
+        for (int i = 0; i < 9; ++i)
+            REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+        REQUIRE(logged.size() == 3);
+    }
+
+    SECTION("Exceptions thrown by the callback are ignored") {
+        log.callback = [](const Sqlite3::SlowQuery&) { throw std::runtime_error("callback"); };
+        Sqlite3::enableSlowQueryLog(db, log);
+
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+        REQUIRE_THROWS_AS(db.exec("INSERT INTO person (name) VALUES ('Nobody')"), ErrorWithCode);
+
+        std::vector<Sqlite3::RowChange> changes;
+        auto subscription = Sqlite3::subscribeToChanges(db, [&changes](const std::vector<Sqlite3::RowChange>& c) {
+            changes.insert(changes.end(), c.begin(), c.end());
+        });
+        db.begin();
+        db.exec("UPDATE person SET age = age + 1 WHERE id = ?", persons.johnDoe().id);
+        db.commit();
+        REQUIRE(changes.size() == 1);
+
+        auto prepared = db.preparedStatement("SELECT name FROM person ORDER BY id");
+        (void) prepared.step();
+        prepared.reset();
+        REQUIRE(prepared.step().get<std::string>(0) == persons.johnDoe().name);
+    }
+
+    SECTION("The callback may disable or replace the log") {
+        int calls = 0;
+        // The captures are used after the log is disabled
+        log.callback = [&](const Sqlite3::SlowQuery& entry) {
+            Sqlite3::disableSlowQueryLog(db);
+            ++calls;
+            logged.push_back(entry);
+        };
+        Sqlite3::enableSlowQueryLog(db, log);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+        REQUIRE(calls == 1);
+
+        log.callback = [&](const Sqlite3::SlowQuery& entry) {
+            Sqlite3::SlowQueryLog replacement;
+            replacement.threshold = std::chrono::nanoseconds(0);
+            replacement.callback = [&logged](const Sqlite3::SlowQuery& e) { logged.push_back(e); };
+            Sqlite3::enableSlowQueryLog(db, std::move(replacement));
+            ++calls;
+            logged.push_back(entry);
+        };
+        Sqlite3::enableSlowQueryLog(db, log);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+        REQUIRE(calls == 2);
+        REQUIRE(logged.size() == 3);
+    }
+
+    SECTION("Invalid settings") {
+        log.sampleEvery = 0;
+        REQUIRE_THROWS_AS(Sqlite3::enableSlowQueryLog(db, log), Error);
+        REQUIRE_THROWS_AS(Sqlite3::enableSlowQueryLog(db, Sqlite3::SlowQueryLog{}), Error);
+    }
+
+    SECTION("Lock waits") {
+        const auto file = std::filesystem::temp_directory_path() / "dbpp-test-slow-query-log.db";
+        std::filesystem::remove(file);
+        {
+            auto writer = Sqlite3::open(file);
+            auto waiter = Sqlite3::open(file);
+            writer.exec("CREATE TABLE t (x INTEGER)");
+
+            Sqlite3::setBusyTimeout(waiter, std::chrono::seconds(10));
+            Sqlite3::enableSlowQueryLog(waiter, log);
+
+            writer.exec("BEGIN IMMEDIATE");
+            writer.exec("INSERT INTO t VALUES (1)");
+            std::thread committer([&writer]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                writer.exec("COMMIT");
+            });
+            waiter.exec("INSERT INTO t VALUES (2)");
+            committer.join();
+
+            REQUIRE(logged.size() == 1);
+            REQUIRE(logged[0].waitedOnLock);
+            REQUIRE(logged[0].duration >= std::chrono::milliseconds(10));
+            REQUIRE(waiter.get<int>("SELECT COUNT(*) FROM t") == 2);
+
+            Sqlite3::setBusyTimeout(waiter, std::chrono::milliseconds(0));
+            logged.clear();
+            writer.exec("BEGIN IMMEDIATE");
+            REQUIRE_THROWS_AS(waiter.exec("INSERT INTO t VALUES (3)"), ErrorWithCode);
+            writer.exec("ROLLBACK");
+
+            // Failed executions are logged with their error
+            REQUIRE(logged.size() == 1);
+            REQUIRE(logged[0].sql == "INSERT INTO t VALUES (3)");
+            REQUIRE((logged[0].resultCode & 0xff) == SQLITE_BUSY);
+
+            // PRAGMA busy_timeout replaces the busy handler, and setBusyTimeout() installs it again
+            waiter.exec("PRAGMA busy_timeout = 10000");
+            Sqlite3::setBusyTimeout(waiter, std::chrono::seconds(10));
+            writer.exec("BEGIN IMMEDIATE");
+            writer.exec("INSERT INTO t VALUES (4)");
+            std::thread committer2([&writer]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                writer.exec("COMMIT");
+            });
+            waiter.exec("INSERT INTO t VALUES (5)");
+            committer2.join();
+            REQUIRE(logged.size() == 3); // Including the PRAGMA
+            REQUIRE(logged[2].waitedOnLock);
+        }
+        std::filesystem::remove(file);
+    }
+}
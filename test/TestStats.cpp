@@ -0,0 +1,69 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+using namespace Dbpp;
+
+TEST_CASE("Sqlite3 connection statistics", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+
+    SECTION("stats()") {
+        for (int i = 0; i < 10; ++i)
+            REQUIRE(db.get<int>("SELECT COUNT(*) FROM person") == persons.Count);
+
+        auto stats = Sqlite3::stats(db);
+        REQUIRE(stats.cacheHits > 0);
+        REQUIRE(stats.cacheHitRatio() > 0.0);
+        REQUIRE(stats.cacheHitRatio() <= 1.0);
+        REQUIRE(stats.cacheUsed > 0);
+        REQUIRE(stats.schemaUsed > 0);
+        REQUIRE_FALSE(stats.deferredForeignKeys);
+        REQUIRE(stats.memory.memoryUsed > 0);
+        REQUIRE(stats.memory.memoryUsedHighwater >= stats.memory.memoryUsed);
+        REQUIRE(stats.memory.mallocCount > 0);
+
+        // Resetting clears the counters, but not the gauges, nor the process wide highwater marks
+        const auto highwater = Sqlite3::memoryStats().memoryUsedHighwater;
+        (void) Sqlite3::stats(db, true);
+        stats = Sqlite3::stats(db);
+        REQUIRE(stats.cacheHits == 0);
+        REQUIRE(stats.cacheMisses == 0);
+        REQUIRE(stats.cacheUsed > 0);
+        REQUIRE(stats.memory.memoryUsedHighwater >= highwater);
+    }
+
+    SECTION("statementUsed") {
+        const auto before = Sqlite3::stats(db).statementUsed;
+        auto st = db.statement("SELECT name FROM person WHERE age > ? ORDER BY name", 40);
+        REQUIRE(Sqlite3::stats(db).statementUsed > before);
+    }
+
+    SECTION("deferredForeignKeys") {
+        db.exec("PRAGMA foreign_keys = ON");
+        db.exec("CREATE TABLE pet (id INTEGER PRIMARY KEY, owner_id INTEGER REFERENCES person(id) DEFERRABLE INITIALLY DEFERRED)");
+        db.exec("BEGIN");
+        db.exec("INSERT INTO pet (owner_id) VALUES (?)", 4711);
+        REQUIRE(Sqlite3::stats(db).deferredForeignKeys);
+        db.exec("ROLLBACK");
+        REQUIRE_FALSE(Sqlite3::stats(db).deferredForeignKeys);
+    }
+}
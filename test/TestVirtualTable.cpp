@@ -0,0 +1,149 @@
+// Copyright (C) 2020 Anders Rosén (panrosen@gmail.com)
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+// USA
+
+#include "Persons.h"
+
+#include <catch2/catch.hpp>
+
+#include <deque>
+
+using namespace Dbpp;
+
+namespace {
+
+struct Title {
+    std::int64_t id;
+    std::string name;
+    int minimumAge;
+    std::optional<std::string> note;
+
+    [[nodiscard]]
+    std::string upperName() const {
+        std::string upper = name;
+        for (auto& c : upper)
+            c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        return upper;
+    }
+};
+
+template <typename Statement>
+std::vector<std::string> strings(Statement&& st) {
+    std::vector<std::string> result;
+    for (auto [s] : std::forward<Statement>(st).template as<std::string>())
+        result.push_back(s);
+    return result;
+}
+
+} // namespace
+
+TEST_CASE("Sqlite3 virtual tables", "[sqlite3]") {
+    Persons persons;
+    Connection& db = persons.db;
+    persons.populate();
+
+    std::vector<Title> titles{
+        {10, "Intern", 0, std::nullopt},
+        {20, "Engineer", 40, "Builds things"},
+        {30, "Director", 46, std::nullopt},
+    };
+    Sqlite3::VirtualTable<Title> table(titles);
+    table.column("id", &Title::id, Sqlite3::ColumnFlag::Sorted)
+        .column("name", &Title::name)
+        .column("minimum_age", &Title::minimumAge)
+        .column("note", &Title::note)
+        .column("upper_name", &Title::upperName);
+    Sqlite3::registerVirtualTable(db, "title", std::move(table));
+
+    SECTION("Reading all rows") {
+        REQUIRE(strings(db.statement("SELECT name FROM title")) == std::vector<std::string>{"Intern", "Engineer", "Director"});
+        REQUIRE(strings(db.statement("SELECT upper_name FROM title WHERE rowid = 2")) == std::vector<std::string>{"DIRECTOR"});
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE note IS NULL") == 2);
+        REQUIRE(db.get<std::string>("SELECT note FROM title WHERE id = 20") == "Builds things");
+        REQUIRE(db.get<std::int64_t>("SELECT SUM(rowid) FROM title") == 0 + 1 + 2);
+    }
+
+    SECTION("Equality constraints") {
+        REQUIRE(strings(db.statement("SELECT name FROM title WHERE id = ?", 30)) == std::vector<std::string>{"Director"});
+        REQUIRE(strings(db.statement("SELECT name FROM title WHERE id IN (10, 30) ORDER BY id")) == std::vector<std::string>{"Intern", "Director"});
+        REQUIRE(strings(db.statement("SELECT name FROM title WHERE name = 'Engineer'")) == std::vector<std::string>{"Engineer"});
+        REQUIRE(strings(db.statement("SELECT name FROM title WHERE minimum_age = 46 AND rowid = 2")) == std::vector<std::string>{"Director"});
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE id = 25") == 0);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE id = NULL") == 0);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE rowid = 17") == 0);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE name = 'engineer' COLLATE NOCASE") == 1);
+    }
+
+    SECTION("Equality constraints apply the affinity of the column") {
+        titles.push_back({40, "30", 30, std::nullopt});
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE name = 30") == 1);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE name = ?", 30) == 1);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE name = 30 COLLATE NOCASE") == 1);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE minimum_age = '30'") == 1);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE id = '40'") == 1);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE id = 40.0") == 1);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title WHERE name = 30.5") == 0);
+    }
+
+    SECTION("Joining with an ordinary table") {
+        auto st = db.statement(
+            "SELECT p.name FROM person p JOIN title t ON t.minimum_age = p.age WHERE t.id = 20");
+        REQUIRE(strings(std::move(st)).empty());
+
+        st = db.statement(
+            "SELECT p.name || ': ' || t.name FROM person p JOIN title t ON p.age >= t.minimum_age"
+            " WHERE t.id = (SELECT MAX(id) FROM title WHERE minimum_age <= p.age) ORDER BY p.age");
+        REQUIRE(strings(std::move(st)) == std::vector<std::string>{
+            "Anders Svensson: Intern", "Jane Doe: Engineer", "John Doe: Director"});
+    }
+
+    SECTION("Changes to the container are seen by later statements") {
+        titles.push_back({40, "Chief", 60, std::nullopt});
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM title") == 4);
+        REQUIRE(db.get<std::string>("SELECT name FROM title WHERE id = 40") == "Chief");
+    }
+
+    SECTION("Sorted columns are searched") {
+        std::deque<std::int64_t> numbers;
+        for (std::int64_t i = 0; i < 10000; ++i)
+            numbers.push_back(i * 2);
+        auto comparisons = std::make_shared<int>(0);
+
+        Sqlite3::VirtualTable<std::int64_t> evens(numbers);
+        evens.column("n", [comparisons](std::int64_t n) {
+            ++*comparisons;
+            return n;
+        }, Sqlite3::ColumnFlag::Sorted);
+        Sqlite3::registerVirtualTable(db, "evens", std::move(evens));
+
+        REQUIRE(db.get<std::int64_t>("SELECT rowid FROM evens WHERE n = 5000") == 2500);
+        REQUIRE(*comparisons < 100);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM evens WHERE n = 5001") == 0);
+        REQUIRE(db.get<int>("SELECT COUNT(*) FROM evens") == 10000);
+    }
+
+    SECTION("Temporary containers are owned by the table") {
+        Sqlite3::VirtualTable<std::string> colors(std::vector<std::string>{"red", "green", "blue"});
+        colors.column("name", [](const std::string& s) { return s; });
+        Sqlite3::registerVirtualTable(db, "colors", std::move(colors));
+        REQUIRE(strings(db.statement("SELECT name FROM colors ORDER BY name")) == std::vector<std::string>{"blue", "green", "red"});
+    }
+
+    SECTION("A table needs columns") {
+        Sqlite3::VirtualTable<Title> empty(titles);
+        REQUIRE_THROWS_AS(Sqlite3::registerVirtualTable(db, "nothing_here", std::move(empty)), Error);
+    }
+}